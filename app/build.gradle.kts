@@ -4,6 +4,8 @@ plugins {
     alias(libs.plugins.kotlin.compose)
 }
 
+val contentAssetsDir = layout.buildDirectory.dir("generated/assets/content")
+
 android {
     namespace = "com.amwatson.vrtemplate"
     compileSdk = 35
@@ -48,6 +50,15 @@ android {
     buildFeatures {
         compose = true
     }
+    androidResources {
+        // Asset packages are memory-mapped in place, which needs them stored
+        noCompress += "vpak"
+    }
+    sourceSets {
+        getByName("main") {
+            assets.srcDir(contentAssetsDir)
+        }
+    }
     externalNativeBuild {
         cmake {
             path = file("src/main/cpp/CMakeLists.txt")
@@ -56,6 +67,44 @@ android {
     }
 }
 
+// content.vpak is baked on the build machine: a host build of the native
+// tree (no NDK) builds asset_packer and runs it through the content_package
+// target. CMake tracks the packer's sources, so unchanged builds are a no-op.
+// The host build needs a host compiler and EGL/GLES headers, so it is opt-in
+// (-Pvrtemplate.packContent=true or gradle.properties); without the package
+// the app generates its scene geometry at startup.
+val packContentEnabled = providers.gradleProperty("vrtemplate.packContent")
+    .map { it.toBoolean() }.getOrElse(false)
+val sdkCmakeBin = android.sdkDirectory.resolve("cmake/3.22.1/bin")
+val hostCmake = sdkCmakeBin.resolve("cmake").takeIf { it.exists() }?.path ?: "cmake"
+val hostToolsDir = layout.buildDirectory.dir("host-tools").get().asFile
+
+val configureHostTools by tasks.registering(Exec::class) {
+    val arguments = mutableListOf(
+        hostCmake, "-S", file("src/main/cpp").path, "-B", hostToolsDir.path,
+        "-DCMAKE_BUILD_TYPE=Release",
+        "-DCONTENT_PACKAGE=${contentAssetsDir.get().asFile.resolve("content.vpak").path}"
+    )
+    val ninja = sdkCmakeBin.resolve("ninja")
+    if (ninja.exists()) {
+        arguments += listOf("-G", "Ninja", "-DCMAKE_MAKE_PROGRAM=${ninja.path}")
+    }
+    commandLine(arguments)
+    inputs.file("src/main/cpp/CMakeLists.txt")
+    outputs.file(hostToolsDir.resolve("CMakeCache.txt"))
+}
+
+val packContent by tasks.registering(Exec::class) {
+    dependsOn(configureHostTools)
+    commandLine(hostCmake, "--build", hostToolsDir.path, "--target", "content_package")
+}
+
+if (packContentEnabled) {
+    tasks.named("preBuild") {
+        dependsOn(packContent)
+    }
+}
+
 dependencies {
 
     implementation(libs.androidx.core.ktx)
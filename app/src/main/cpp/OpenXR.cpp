@@ -14,6 +14,7 @@ License     :   Licensed under GPLv3 or any later version.
 #include <algorithm>
 #include <cinttypes>
 #include <cstring>
+#include <ctime>
 #include <vector>
 
 // Global XrInstance for error handling access
@@ -58,6 +59,28 @@ const XrInstance& OpenXr::GetInstance() {
     return gXrInstance;
 }
 
+bool OpenXr::IsExtensionEnabled(const char* name) const {
+    for (uint32_t i = 0; i < mEnabledExtensionCount; i++) {
+        if (strcmp(mEnabledExtensions[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+XrTime OpenXr::GetCurrentXrTime() const {
+    if (mConvertTimespecTime == nullptr) {
+        return 0;
+    }
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    XrTime time = 0;
+    if (XR_FAILED(mConvertTimespecTime(mInstance, &now, &time))) {
+        return 0;
+    }
+    return time;
+}
+
 int32_t OpenXr::Init(JavaVM* jvm, jobject activityObject) {
     // Step-by-step initialization sequence
     int32_t result;
@@ -262,7 +285,14 @@ int32_t OpenXr::InitInstance() {
 
     BAIL_ON_XR_ERROR(xrCreateInstance(&createInfo, &mInstance), -4);
 
-    // 5. Log runtime information
+    // 5. Look up the clock conversion that latency measurement stamps with
+    if (IsExtensionEnabled(XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME) &&
+        XR_FAILED(xrGetInstanceProcAddr(mInstance, "xrConvertTimespecTimeToTimeKHR",
+                                        (PFN_xrVoidFunction*)&mConvertTimespecTime))) {
+        mConvertTimespecTime = nullptr;
+    }
+
+    // 6. Log runtime information
     XrInstanceProperties instanceProps{};
     instanceProps.type = XR_TYPE_INSTANCE_PROPERTIES;
     instanceProps.next = nullptr;
@@ -596,6 +626,7 @@ void OpenXr::DestroyInstance() {
         ALOGD("Destroying XrInstance");
         xrDestroyInstance(mInstance);
         mInstance = XR_NULL_HANDLE;
+        mConvertTimespecTime = nullptr;
         gXrInstance = XR_NULL_HANDLE;
     }
 }
\ No newline at end of file
@@ -18,6 +18,7 @@ License     :   Licensed under GPLv3 or any later version.
 // Define XR-specific preprocessor directives before including OpenXR headers
 #define XR_USE_GRAPHICS_API_OPENGL_ES 1
 #define XR_USE_PLATFORM_ANDROID 1
+#define XR_USE_TIMESPEC 1
 
 #include <openxr/openxr.h>
 #include <openxr/openxr_platform.h>
@@ -55,6 +56,12 @@ public:
     // Get the global OpenXR instance
     static const XrInstance& GetInstance();
 
+    // Whether @p name was enabled on the instance (required, or optional and available)
+    bool IsExtensionEnabled(const char* name) const;
+
+    // Now, on the runtime's XrTime clock; 0 without XR_KHR_convert_timespec_time
+    XrTime GetCurrentXrTime() const;
+
     // Public view and space data
     XrInstance mInstance = XR_NULL_HANDLE;
     XrSystemId mSystemId = XR_NULL_SYSTEM_ID;
@@ -113,8 +120,15 @@ private:
             XR_EXT_HAND_TRACKING_EXTENSION_NAME,        // Add hand tracking
             XR_FB_TOUCH_CONTROLLER_PRO_EXTENSION_NAME,  // For Quest 3 controllers
             XR_KHR_VISIBILITY_MASK_EXTENSION_NAME,
+            XR_FB_SWAPCHAIN_UPDATE_STATE_EXTENSION_NAME,  // Foveation needs all three
+            XR_FB_FOVEATION_EXTENSION_NAME,
+            XR_FB_FOVEATION_CONFIGURATION_EXTENSION_NAME,
+            XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME,  // Latency measurement
     };
 
+    // From XR_KHR_convert_timespec_time, if enabled
+    PFN_xrConvertTimespecTimeToTimeKHR mConvertTimespecTime = nullptr;
+
     // Enabled extensions cache (populated during initialization)
     std::unique_ptr<const char*[]> mEnabledExtensions;
     uint32_t mEnabledExtensionCount = 0;
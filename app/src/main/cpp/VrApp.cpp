@@ -18,6 +18,7 @@ License     :   Licensed under GPLv3 or any later version.
 
 #define XR_USE_GRAPHICS_API_OPENGL_ES 1
 #define XR_USE_PLATFORM_ANDROID       1
+#define XR_USE_TIMESPEC               1
 
 #include <openxr/openxr.h>
 #include <openxr/openxr_platform.h>
@@ -27,11 +28,18 @@ License     :   Licensed under GPLv3 or any later version.
 #include <GLES3/gl3.h>
 #include <GLES3/gl3ext.h>
 
+#include <android/asset_manager_jni.h>
 #include <android/native_window_jni.h>
 #include <jni.h>
+#include <sys/system_properties.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -56,49 +64,93 @@ License     :   Licensed under GPLv3 or any later version.
 #endif
 
 namespace {
-    constexpr XrPerfSettingsLevelEXT kGpuPerfLevel = XR_PERF_SETTINGS_LEVEL_BOOST_EXT;
-    std::chrono::time_point<std::chrono::steady_clock> gOnCreateStartTime;
-    std::unique_ptr<OpenXr> gOpenXr;
-    MessageQueue gMessageQueue;
-
- /**
- * Logs an OpenGL shader-compile or program-link error.
- *
- * @param id      The object handle returned by glCreateShader() or glCreateProgram().
- * @param isProg  if true, treat @p id as a program, use glGetProgram* calls
- *                if false, treat @p id as a shader, use glGetShader*  calls
- * @param label   Human-readable label (“VS”, “FS”, “Program”, …) for the log message.
- * @param isFatal if true, terminal program (FATAL) on error, log non-fatal error otherwise.
- */
-    void LogShaderError(const GLuint id, const bool isProg, const char* label, const bool isFatal ) noexcept
-    {
-        GLint status = 0;
-        if (isProg)
-            glGetProgramiv(id, GL_LINK_STATUS, &status);
-        else
-            glGetShaderiv(id,  GL_COMPILE_STATUS, &status);
-
-        if (status == GL_TRUE)   // no error → nothing to log
-            return;
-
-        GLint logLen = 0;
-        if (isProg)
-            glGetProgramiv(id, GL_INFO_LOG_LENGTH, &logLen);
-        else
-            glGetShaderiv(id,  GL_INFO_LOG_LENGTH, &logLen);
+    // Values of the cpu_perf_level and gpu_perf_level parameters
+    const std::vector<ParameterRegistry::Choice> kPerfLevelChoices = {
+            {"power_savings", XR_PERF_SETTINGS_LEVEL_POWER_SAVINGS_EXT},
+            {"sustained_low", XR_PERF_SETTINGS_LEVEL_SUSTAINED_LOW_EXT},
+            {"sustained_high", XR_PERF_SETTINGS_LEVEL_SUSTAINED_HIGH_EXT},
+            {"boost", XR_PERF_SETTINGS_LEVEL_BOOST_EXT},
+    };
+    // "name = value" lines in mCaptureDir, read at startup. A "[model]"
+    // section (ro.product.model, e.g. "Quest 3") tunes one device.
+    constexpr const char* kParameterFileName = "parameters.cfg";
+    // Steps of the live eye-buffer controls on the right controller
+    constexpr std::array<int, 3> kMultisampleSteps = {4, 2, 1};
+    constexpr std::array<float, 3> kResolutionScaleSteps = {1.0f, 0.85f, 0.7f};
+    constexpr int32_t kMinEyeSize = 256;
+    // Frames between pre-allocating a new config's render targets and
+    // switching to it, so their release fence has signaled and the pool
+    // hands them straight back
+    constexpr uint64_t kPrewarmFrames = 2;
+    // Frames a replaced swapchain set lives on; the compositor may still be
+    // showing the last image submitted from it
+    constexpr uint64_t kRetireFrames = 3;
+    // Written by tools/AssetPacker.cpp; must be stored uncompressed to be mapped
+    constexpr const char* kAssetPackageName = "content.vpak";
+
+    // The mirror refreshes every few frames at reduced size; screenshots are
+    // full size. Tags tell them apart on the readback consumer thread.
+    constexpr uint32_t kMirrorTag = 0;
+    constexpr uint32_t kScreenshotTag = 1;
+    constexpr uint32_t kMirrorDownscale = 2;
+    constexpr uint64_t kMirrorFrameInterval = 4;
+
+    // Default GPU memory budget. Far above what the demo scene needs;
+    // eviction only matters once content grows, and lower-end headsets may
+    // want less (the gpu_memory_budget_mib parameter)
+    constexpr int32_t kGpuMemoryBudgetMiB = 512;
+    constexpr uint64_t kBytesPerMiB = 1024 * 1024;
+
+    // Live telemetry is off unless this property holds a rate in Hz, e.g.
+    // `adb shell setprop debug.vrtemplate.telemetry 10`. Read at startup.
+    constexpr const char* kTelemetryRateProperty = "debug.vrtemplate.telemetry";
+    // Abstract socket; see TelemetryServer.h for forwarding it over adb
+    constexpr const char* kTelemetrySocket = "vrtemplate.telemetry";
+    constexpr uint32_t kMaxTelemetryRate = 120;
+
+    std::string GetDeviceModel() {
+        char value[PROP_VALUE_MAX] = {};
+        __system_property_get("ro.product.model", value);
+        return value;
+    }
 
-        std::vector<char> log(logLen > 1 ? logLen : 1);
-        if (isProg)
-            glGetProgramInfoLog(id, logLen, nullptr, log.data());
-        else
-            glGetShaderInfoLog(id,  logLen, nullptr, log.data());
+    uint32_t GetTelemetryRate() {
+        char value[PROP_VALUE_MAX] = {};
+        if (__system_property_get(kTelemetryRateProperty, value) <= 0) {
+            return 0;
+        }
+        return std::min<uint32_t>(static_cast<uint32_t>(strtoul(value, nullptr, 10)),
+                                  kMaxTelemetryRate);
+    }
 
-        if (isFatal) {
-            FAIL("%s error:\n%s", label ? label : "GL object", log.data());
-        } else {
-            ALOGE("%s error:\n%s", label ? label : "GL object", log.data());
+    // Uncompressed 32-bit TGA, whose default row order is GL's bottom-up one
+    bool WriteTga(const std::string& path, const FrameReadback::Image& image) {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
         }
+        const uint8_t header[18] = {0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                    static_cast<uint8_t>(image.mWidth),
+                                    static_cast<uint8_t>(image.mWidth >> 8),
+                                    static_cast<uint8_t>(image.mHeight),
+                                    static_cast<uint8_t>(image.mHeight >> 8), 32, 8};
+        bool written = fwrite(header, sizeof(header), 1, file) == 1;
+        std::vector<uint8_t> row(image.mWidth * 4);
+        for (uint32_t y = 0; y < image.mHeight && written; y++) {
+            const uint8_t* rgba = image.mPixels.data() + y * row.size();
+            for (size_t i = 0; i < row.size(); i += 4) {
+                row[i] = rgba[i + 2];
+                row[i + 1] = rgba[i + 1];
+                row[i + 2] = rgba[i];
+                row[i + 3] = rgba[i + 3];
+            }
+            written = fwrite(row.data(), row.size(), 1, file) == 1;
+        }
+        return fclose(file) == 0 && written;
     }
+    std::chrono::time_point<std::chrono::steady_clock> gOnCreateStartTime;
+    std::unique_ptr<OpenXr> gOpenXr;
+    MessageQueue gMessageQueue;
 
     [[maybe_unused]] const char *XrSessionStateToString(const XrSessionState state) {
         switch (state) {
@@ -127,6 +179,34 @@ namespace {
         }
     }
 
+    const char* PerfLevelToString(const XrPerfSettingsLevelEXT level) {
+        switch (level) {
+            case XR_PERF_SETTINGS_LEVEL_POWER_SAVINGS_EXT:
+                return "power_savings";
+            case XR_PERF_SETTINGS_LEVEL_SUSTAINED_LOW_EXT:
+                return "sustained_low";
+            case XR_PERF_SETTINGS_LEVEL_SUSTAINED_HIGH_EXT:
+                return "sustained_high";
+            case XR_PERF_SETTINGS_LEVEL_BOOST_EXT:
+                return "boost";
+            default:
+                return "unknown";
+        }
+    }
+
+    const char* PerfNotificationToString(const XrPerfSettingsNotificationLevelEXT level) {
+        switch (level) {
+            case XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT:
+                return "normal";
+            case XR_PERF_SETTINGS_NOTIF_LEVEL_WARNING_EXT:
+                return "warning";
+            case XR_PERF_SETTINGS_NOTIF_LEVEL_IMPAIRED_EXT:
+                return "impaired";
+            default:
+                return "unknown";
+        }
+    }
+
     // Called whenever a session is started/resumed
     void CreateRuntimeInitiatedReferenceSpaces(const XrTime predictedDisplayTime) {
         // Create a reference space with the forward direction from the
@@ -180,6 +260,8 @@ void VrApp::MainLoop() {
     while (true) {
         // Handle events/state-changes.
         AppState appState = HandleEvents();
+        RecordStateChanges(appState);
+        ApplyParameterChanges(appState);
         if (appState.mIsStopRequested) { break; }
         HandleStateChanges(appState);
 
@@ -199,13 +281,22 @@ void VrApp::MainLoop() {
             }
 
             // Update non-tracking-dependent-state.
+            mLatency.BeginFrame(mFrameIndex);
+            mLatency.Mark(LatencyTracker::Stage::INPUT_SYNC);
             mInputStateFrame.SyncButtonsAndThumbSticks(gOpenXr->mSession, *mInputStateStatic);
+            mLatency.SetInputEventTime(mInputStateFrame.GetLatestChangeTime());
             HandleInput(mInputStateFrame, appState);
+            HandleCaptureInput(mInputStateFrame);
+            HandleQualityInput(mInputStateFrame);
 
             Frame(appState);
         } else {
             // If no XR session is active, just handle the message queue and wait for events
             mFrameIndex = 0;
+            // No frames to carry session changes to telemetry
+            if (appState.mSessionState != mLastAppState.mSessionState) {
+                PublishTelemetry(appState, 0);
+            }
         }
         mLastAppState = appState;
     }
@@ -218,108 +309,289 @@ void VrApp::MainLoop() {
 
 void VrApp::Init() {
     assert(gOpenXr != nullptr);
+    InitParameters();
     mInputStateStatic = std::make_unique<InputStateStatic>(OpenXr::GetInstance(),
                                                            gOpenXr->mSession);
 
     // Initialize framebuffers for both eyes
-    const uint32_t eyeWidth = gOpenXr->mViewConfigurationViews[0].recommendedImageRectWidth;
-    const uint32_t eyeHeight = gOpenXr->mViewConfigurationViews[0].recommendedImageRectHeight;
-
-    for (size_t eye = 0; eye < MAX_EYES; eye++) {
-        if (!mFramebuffers[eye].Create(gOpenXr->mSession, GL_SRGB8_ALPHA8, eyeWidth, eyeHeight,
-                                       4, false)) {
-            ALOGE("Failed to create framebuffer for eye %zu", eye);
+    // The scene has no multiview path, so eye swapchains are never created
+    // for GL_OVR_multiview2, and a swapchain per eye costs a scene pass per
+    // eye. Both eyes are drawn in one instanced pass into a double-wide
+    // swapchain instead, unless the runtime foveates: swapchains only take
+    // foveation profiles if created for them, and a profile is centered on
+    // the whole image, which is wrong for double-wide.
+    mFoveation.Init(*gOpenXr);
+    mInstancedStereo = !mFoveation.IsEnabled();
+    mEyeResolution = GetEyeResolution(mEyeConfig);
+    for (size_t i = 0; i < GetFramebufferCount(); i++) {
+        if (!CreateEyeFramebuffer(mFramebuffers[i], mEyeConfig)) {
+            ALOGE("Failed to create eye framebuffer %zu", i);
         }
     }
 
+    if (!mCaptureDir.empty()) {
+        InitReadback(mEyeConfig.mColorFormat, mEyeResolution.width, mEyeResolution.height);
+    }
+
+    // On the runtime's clock, latencies compare with predicted display times
+    if (gOpenXr->IsExtensionEnabled(XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME)) {
+        mLatency.SetClock([] { return gOpenXr->GetCurrentXrTime(); });
+    } else {
+        ALOGI("No XR_KHR_convert_timespec_time; input latency is not measured");
+    }
+
     InitSceneResources();
-    ALOGD("Initialized VR App with eye buffers %dx%d", eyeWidth, eyeHeight);
+    InitSlackTasks();
+    InitGpuMemory();
+    mWatchdog.Start(mCaptureDir);
+    // An acquire is only a stall once it outlasts its own timeout
+    mWatchdog.SetDeadline(Watchdog::Phase::ACQUIRE, mAcquireTimeout);
+    if (!mCaptureDir.empty() && mFlightRecorder.Open(mCaptureDir)) {
+        mFlightRecorder.InstallCrashHandlers();
+    }
+    const uint32_t telemetryRate = GetTelemetryRate();
+    if (telemetryRate > 0) {
+        // Clients change parameters with "set <name> <value>" lines
+        TelemetryServer::Options options;
+        for (size_t i = 0; i < mParameters.GetCount(); i++) {
+            options.mParameterNames.emplace_back(
+                    mParameters.GetName(static_cast<ParameterRegistry::Id>(i)));
+        }
+        options.mCommandHandler = [this](const std::string& command) {
+            char name[64] = {};
+            char value[64] = {};
+            if (sscanf(command.c_str(), "set %63s %63s", name, value) != 2) {
+                ALOGW("Telemetry: ignored command \"%s\"", command.c_str());
+                return;
+            }
+            // MakeSetMessage() says why it refuses
+            Message message;
+            if (mParameters.MakeSetMessage(name, value, message)) {
+                gMessageQueue.Post(message);
+            }
+        };
+        mTelemetry.Start(kTelemetrySocket, telemetryRate, std::move(options));
+    }
+    ALOGD("Initialized VR App with eye buffers %dx%d%s", mEyeResolution.width,
+          mEyeResolution.height, mInstancedStereo ? " (instanced stereo)" : "");
+}
+
+void VrApp::InitParameters() {
+    ParameterIds& ids = mParameterIds;
+    ids.mCpuPerfLevel = mParameters.AddChoice("cpu_perf_level", XR_PERF_SETTINGS_LEVEL_BOOST_EXT,
+                                              kPerfLevelChoices, "XR_EXT_performance_settings");
+    ids.mGpuPerfLevel = mParameters.AddChoice("gpu_perf_level", XR_PERF_SETTINGS_LEVEL_BOOST_EXT,
+                                              kPerfLevelChoices, "XR_EXT_performance_settings");
+    ids.mMultisamples = mParameters.AddChoice("msaa", mEyeConfig.mMultisamples,
+                                              {{"1", 1}, {"2", 2}, {"4", 4}},
+                                              "eye buffer samples");
+    ids.mResolutionScale = mParameters.AddFloat("resolution_scale", mEyeConfig.mResolutionScale,
+                                                0.5f, 1.0f, "of the recommended eye size");
+    ids.mMaxMessagesPerFrame = mParameters.AddInt("max_messages_per_frame", 20, 1, 64,
+                                                  "MessageQueue messages handled per frame");
+    ids.mAcquireTimeoutMs = mParameters.AddInt(
+            "acquire_timeout_ms", static_cast<int32_t>(mAcquireTimeout / 1000000), 10, 5000,
+            "xrWaitSwapchainImage timeout");
+    ids.mGpuMemoryBudgetMiB = mParameters.AddInt("gpu_memory_budget_mib", kGpuMemoryBudgetMiB,
+                                                 0, 4096, "evict idle storage above; 0 for none");
+
+    if (!mCaptureDir.empty()) {
+        mParameters.LoadFile(mCaptureDir + "/" + kParameterFileName, GetDeviceModel());
+    }
+    // Startup values need no reconfiguring, just taking as they are
+    for (size_t i = 0; i < mParameters.GetCount(); i++) {
+        mParameters.TakeChanged(static_cast<ParameterRegistry::Id>(i));
+    }
+    mEyeConfig.mMultisamples = mParameters.GetInt(ids.mMultisamples);
+    mEyeConfig.mResolutionScale = mParameters.GetFloat(ids.mResolutionScale);
+    mAcquireTimeout = XrDuration{mParameters.GetInt(ids.mAcquireTimeoutMs)} * 1000000;
+    ALOGI("Parameters:");
+    mParameters.LogValues();
+}
+
+void VrApp::ApplyParameterChanges(const AppState& appState) {
+    const ParameterIds& ids = mParameterIds;
+    bool changed[ParameterRegistry::MAX_PARAMETERS] = {};
+    bool anyChanged = false;
+    for (size_t i = 0; i < mParameters.GetCount(); i++) {
+        const auto id = static_cast<ParameterRegistry::Id>(i);
+        changed[i] = mParameters.TakeChanged(id);
+        if (changed[i]) {
+            anyChanged = true;
+            mFlightRecorder.AddEvent(FlightFormat::EventType::NOTE, mFrameIndex, 0, "%s=%s",
+                                     mParameters.GetName(id), mParameters.Format(id).c_str());
+        }
+    }
+    if (!anyChanged) {
+        return;
+    }
+
+    // Otherwise they are set when the session becomes ready
+    if ((changed[ids.mCpuPerfLevel] || changed[ids.mGpuPerfLevel]) &&
+        appState.mIsXrSessionActive) {
+        SetPerfLevels();
+    }
+    if (changed[ids.mMultisamples] || changed[ids.mResolutionScale]) {
+        EyeConfig config = mEyeConfig;
+        config.mMultisamples = mParameters.GetInt(ids.mMultisamples);
+        config.mResolutionScale = mParameters.GetFloat(ids.mResolutionScale);
+        RequestEyeConfig(config);
+    }
+    if (changed[ids.mAcquireTimeoutMs]) {
+        mAcquireTimeout = XrDuration{mParameters.GetInt(ids.mAcquireTimeoutMs)} * 1000000;
+        mWatchdog.SetDeadline(Watchdog::Phase::ACQUIRE, mAcquireTimeout);
+    }
+    if (changed[ids.mGpuMemoryBudgetMiB]) {
+        mGpuMemory.SetBudget(GetGpuMemoryBudget());
+    }
+}
+
+void VrApp::SetPerfLevels() const {
+    PFN_xrPerfSettingsSetPerformanceLevelEXT pfnPerfSettingsSetPerformanceLevelEXT = nullptr;
+    OXR(xrGetInstanceProcAddr(
+            gOpenXr->mInstance, "xrPerfSettingsSetPerformanceLevelEXT",
+            (PFN_xrVoidFunction *) (&pfnPerfSettingsSetPerformanceLevelEXT)));
+
+    OXR(pfnPerfSettingsSetPerformanceLevelEXT(
+            gOpenXr->mSession, XR_PERF_SETTINGS_DOMAIN_CPU_EXT,
+            static_cast<XrPerfSettingsLevelEXT>(mParameters.GetInt(mParameterIds.mCpuPerfLevel))));
+    OXR(pfnPerfSettingsSetPerformanceLevelEXT(
+            gOpenXr->mSession, XR_PERF_SETTINGS_DOMAIN_GPU_EXT,
+            static_cast<XrPerfSettingsLevelEXT>(mParameters.GetInt(mParameterIds.mGpuPerfLevel))));
+}
+
+void VrApp::InitReadback(const GLenum format, const GLsizei width, const GLsizei height) {
+    const std::string dir = mCaptureDir;
+    mReadback.Init(format, width, height, [dir](const FrameReadback::Image& image) {
+        if (image.mTag == kScreenshotTag) {
+            const std::string path =
+                    dir + "/screenshot_" + std::to_string(image.mFrameIndex) + ".tga";
+            if (WriteTga(path, image)) {
+                ALOGI("Saved %s", path.c_str());
+            } else {
+                ALOGE("Failed to write %s", path.c_str());
+            }
+            return;
+        }
+        // Replaced whole so a reader polling it never sees a partial frame
+        const std::string path = dir + "/mirror.tga";
+        const std::string staging = path + ".tmp";
+        if (!WriteTga(staging, image) || rename(staging.c_str(), path.c_str()) != 0) {
+            ALOGW("Failed to update %s", path.c_str());
+        }
+    });
 }
 
 void VrApp::InitSceneResources() {
-    // Vertex shader
-    const GLchar *vsSource = R"(
-        #version 300 es
-        layout(location = 0) in vec3 aPosition;
-        uniform mat4 uModelViewProjection;
-        void main() {
-            gl_Position = uModelViewProjection * vec4(aPosition, 1.0);
-        }
-    )";
-
-    // Fragment shader
-    const GLchar *fsSource = R"(
-        #version 300 es
-        precision mediump float;
-        out vec4 fragColor;
-        void main() {
-            fragColor = vec4(1.0, 0.0, 0.0, 1.0); // red
-        }
-    )";
-
-    // Compile shaders
-    GLint ok = 0;
-
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vsSource, nullptr);
-    glCompileShader(vs);
-    glGetShaderiv(vs, GL_COMPILE_STATUS,&ok);
-    if (!ok) {
-        LogShaderError(vs, false, "Vertex Shader", true);
-    }
-
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fsSource, nullptr);
-    glCompileShader(fs);
-    glGetShaderiv(fs, GL_COMPILE_STATUS,&ok);
-    if (!ok) {
-        LogShaderError(fs, false, "Fragment Shader", true);
-    }
-
-    // Link proggitram
-    mSquareProgram = glCreateProgram();
-    glAttachShader(mSquareProgram, vs);
-    glAttachShader(mSquareProgram, fs);
-    glLinkProgram(mSquareProgram);
-    glGetProgramiv(mSquareProgram, GL_COMPILE_STATUS,&ok);
-    if (!ok) {
-        LogShaderError(mSquareProgram, true, "Square Program", true);
-    }
-
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-
-    // Square vertices (centered on 0,0,-2)
-    constexpr GLfloat quadVerts[] = {
-            -0.5f, -0.5f, -2.0f,
-            0.5f, -0.5f, -2.0f,
-            0.5f, 0.5f, -2.0f,
-            -0.5f, -0.5f, -2.0f,
-            0.5f, 0.5f, -2.0f,
-            -0.5f, 0.5f, -2.0f
-    };
+    // Programs are only requested here; they finish compiling over the first
+    // few frames through ShaderManager::Update().
+    mShaderManager.Init(mEyeConfig.mColorFormat, mEyeConfig.mMultisamples);
+    mSceneRenderer.Init(mShaderManager, &mJobSystem, mInstancedStereo, mAssets);
+    mDemoScene.Populate(mSceneRenderer);
+
+    // Parked out of view until the controllers are first tracked
+    const XrPosef parked = {MathUtils::kIdentityQuat, {0.0f, -100.0f, 0.0f}};
+    for (TransformHierarchy::NodeId& root : mHandRoots) {
+        root = mTransforms.AddNode(TransformHierarchy::INVALID_NODE, parked);
+    }
+    mDemoScene.AttachHandProps(mSceneRenderer, mTransforms, mHandRoots);
+}
+
+void VrApp::InitSlackTasks() {
+    // Trimming deletes GL objects, which is not free; nothing needs it soon
+    mSlackScheduler.Add("Resource pool trim", SlackScheduler::Priority::NORMAL,
+                        [this](int64_t) {
+        mResourcePool.TrimIdle();
+        return SlackScheduler::Result::MORE;
+    });
+
+    mStatsHistory.reserve(SUMMARY_WINDOW_FRAMES);
+    mSlackScheduler.Add("Frame stats summary", SlackScheduler::Priority::LOW, [this](int64_t) {
+        if (mStatsHistory.size() < SUMMARY_WINDOW_FRAMES) {
+            return SlackScheduler::Result::MORE;
+        }
+        int64_t submitNs = 0;
+        int64_t maxSubmitNs = 0;
+        int64_t slackNs = 0;
+        int64_t slackUsedNs = 0;
+        uint64_t drawCalls = 0;
+        uint64_t triangles = 0;
+        for (const FrameStats& stats : mStatsHistory) {
+            submitNs += stats.mCpuSubmitNs;
+            maxSubmitNs = std::max(maxSubmitNs, stats.mCpuSubmitNs);
+            slackNs += stats.mSlackNs;
+            slackUsedNs += stats.mSlackUsedNs;
+            drawCalls += stats.mDrawCalls;
+            triangles += stats.mTriangles;
+        }
+        const auto frames = static_cast<double>(mStatsHistory.size());
+        const FrameStats& last = mStatsHistory.back();
+        ALOGI("Frames %llu-%llu: submit %.2f ms avg %.2f max, %.0f draws, %.0f triangles, "
+              "slack %.2f ms, %.2f used, %llu short waits, GPU memory %.1f MiB (peak %.1f)",
+              static_cast<unsigned long long>(mStatsHistory.front().mFrameIndex),
+              static_cast<unsigned long long>(mStatsHistory.back().mFrameIndex),
+              submitNs / frames * 1e-6, maxSubmitNs * 1e-6, drawCalls / frames,
+              triangles / frames, slackNs / frames * 1e-6, slackUsedNs / frames * 1e-6,
+              static_cast<unsigned long long>(mSlackScheduler.GetStats().mShortWaits),
+              static_cast<double>(last.mGpuMemory.GetTotal()) / (1024.0 * 1024.0),
+              static_cast<double>(last.mGpuMemoryPeakBytes) / (1024.0 * 1024.0));
+        mStatsHistory.clear();
+        return SlackScheduler::Result::MORE;
+    });
+
+    // Sorting the window for percentiles can wait
+    mSlackScheduler.Add("Latency summary", SlackScheduler::Priority::LOW, [this](int64_t) {
+        if (mLatency.GetFrameCount() >= SUMMARY_WINDOW_FRAMES) {
+            mLatency.LogSummary();
+        }
+        return SlackScheduler::Result::MORE;
+    });
+}
 
-    glGenBuffers(1, &mSquareVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, mSquareVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVerts), quadVerts, GL_STATIC_DRAW);
+uint64_t VrApp::GetGpuMemoryBudget() const {
+    return static_cast<uint64_t>(mParameters.GetInt(mParameterIds.mGpuMemoryBudgetMiB)) *
+           kBytesPerMiB;
+}
 
-    glGenVertexArrays(1, &mSquareVAO);
-    glBindVertexArray(mSquareVAO);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, (void *) 0);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+void VrApp::InitGpuMemory() {
+    mGpuMemory.AddSource("Resource pool", [this] { return mResourcePool.GetGpuMemory(); });
+    mGpuMemory.AddSource("Eye swapchains", [this] {
+        // Including a set being built or retired
+        GpuMemoryUsage usage;
+        for (size_t i = 0; i < MAX_EYES; i++) {
+            usage += mFramebuffers[i].GetGpuMemory();
+            usage += mPendingFramebuffers[i].GetGpuMemory();
+            usage += mRetiredFramebuffers[i].GetGpuMemory();
+        }
+        return usage;
+    });
+    mGpuMemory.AddSource("Scene renderer", [this] { return mSceneRenderer.GetGpuMemory(); });
+    mGpuMemory.AddSource("Readback", [this] { return mReadback.GetGpuMemory(); });
+
+    // Idle pooled storage is the only thing that can go without a rebuild
+    mGpuMemory.AddEvictor("Resource pool", [this](const uint64_t bytes) {
+        return mResourcePool.EvictIdle(bytes);
+    });
+    mGpuMemory.SetBudget(GetGpuMemoryBudget());
+    mGpuMemory.Update();
+    mGpuMemory.LogUsage();
 }
 
-void VrApp::Frame([[maybe_unused]] const AppState &appState) noexcept {
+void VrApp::Frame(const AppState &appState) noexcept {
     ////////////////////////////////
     // XrWaitFrame()
     ////////////////////////////////
     XrFrameState frameState = {XR_TYPE_FRAME_STATE, nullptr};
     {
         XrFrameWaitInfo wfi = {XR_TYPE_FRAME_WAIT_INFO, nullptr};
+        EnterPhase(Watchdog::Phase::WAIT_FRAME);
+        mSlackScheduler.BeginWait();
         OXR(xrWaitFrame(gOpenXr->mSession, &wfi, &frameState));
+        mSlackScheduler.EndWait(frameState.predictedDisplayPeriod);
+        mLatency.Mark(LatencyTracker::Stage::WAIT_END);
+        mLatency.SetPredictedDisplayTime(frameState.predictedDisplayTime);
     }
+    EnterPhase(Watchdog::Phase::BEGIN_FRAME);
 
     ////////////////////////////////
     // XrBeginFrame()
@@ -329,6 +601,26 @@ void VrApp::Frame([[maybe_unused]] const AppState &appState) noexcept {
         OXR(xrBeginFrame(gOpenXr->mSession, &bfd));
     }
 
+    // Advance any in-flight shader compiles without blocking
+    mShaderManager.Update();
+
+    // Build, switch to or retire eye swapchains for a requested config
+    UpdateEyeReconfiguration();
+
+    // Pick this frame's foveation from recent GPU load
+    {
+        std::array<XrSwapchain, MAX_EYES> swapchains;
+        for (size_t i = 0; i < GetFramebufferCount(); i++) {
+            swapchains[i] = mFramebuffers[i].GetColorSwapChain().mHandle;
+        }
+        mFoveation.Update(frameState.predictedDisplayPeriod, swapchains.data(),
+                          static_cast<uint32_t>(GetFramebufferCount()));
+    }
+
+    // Recycle GL objects whose last use has finished on the GPU. Trimming
+    // idle ones waits for the slack.
+    mResourcePool.BeginFrame(false);
+
     ///////////////////////////////////////////////////
     // Get tracking, space, projection info for frame.
     ///////////////////////////////////////////////////
@@ -337,9 +629,11 @@ void VrApp::Frame([[maybe_unused]] const AppState &appState) noexcept {
     // it is in-sync with user
     if (mFrameIndex == 1) {
         CreateRuntimeInitiatedReferenceSpaces(frameState.predictedDisplayTime);
+        mSessionStartTime = frameState.predictedDisplayTime;
     }
 
     // Get head location in local space
+    mLatency.Mark(LatencyTracker::Stage::POSE_SAMPLE);
     gOpenXr->headLocation = {XR_TYPE_SPACE_LOCATION};
     OXR(xrLocateSpace(gOpenXr->mViewSpace, gOpenXr->mLocalSpace, frameState.predictedDisplayTime,
                       &gOpenXr->headLocation));
@@ -347,6 +641,8 @@ void VrApp::Frame([[maybe_unused]] const AppState &appState) noexcept {
     // Update hand/controller poses
     mInputStateFrame.SyncHandPoses(*mInputStateStatic, gOpenXr->mLocalSpace,
                                    frameState.predictedDisplayTime);
+    UpdateTransforms();
+    UpdatePointing();
 
     //////////////////////////////////////////////////
     //  Set the compositor layers for this frame.
@@ -356,9 +652,27 @@ void VrApp::Frame([[maybe_unused]] const AppState &appState) noexcept {
     std::array<XrCompositionLayerBaseHeader *, 2> layerHeaders = {};
     uint32_t layerCount = 0;
 
+    // Seconds since the session's first frame, narrowed to float only once
+    // small so it keeps sub-millisecond precision for hours
+    const double sessionSeconds =
+            static_cast<double>(frameState.predictedDisplayTime - mSessionStartTime) * 1e-9;
+    mDemoScene.Update(mSceneRenderer, static_cast<float>(sessionSeconds));
+
     // Render cube scene to a layer
+    EnterPhase(Watchdog::Phase::RENDER);
     RenderScene(layers, layerCount, frameState.predictedDisplayTime);
 
+    // Fence this frame's releases (e.g. Resolve's temporary FBOs)
+    mResourcePool.EndFrame();
+    mFrameStats.mPoolLiveBytes = mResourcePool.GetStats().mLiveBytes;
+    mFrameStats.mPoolHitRate = mResourcePool.GetStats().GetHitRate();
+    mGpuMemory.Update();
+    mFrameStats.mGpuMemory = mGpuMemory.GetUsage();
+    mFrameStats.mGpuMemoryPeakBytes = mGpuMemory.GetPeakTotal();
+    mFrameStats.mFoveationLevel = mFoveation.GetLevel();
+    mParameters.GetValues(mFrameStats.mParameters);
+    mFrameStats.mParameterVersion = mParameters.GetVersion();
+
     // Check if any layers were added
     if (layerCount == 0) {
         layerCount = 1;  // Ensure at least one layer is submitted
@@ -388,13 +702,95 @@ void VrApp::Frame([[maybe_unused]] const AppState &appState) noexcept {
     }
 #endif
 
+    EnterPhase(Watchdog::Phase::END_FRAME);
+    mLatency.Mark(LatencyTracker::Stage::SUBMIT);
     OXR(xrEndFrame(gOpenXr->mSession, &endFrameInfo));
+    {
+        using Metric = LatencyTracker::Metric;
+        const LatencyTracker::FrameLatencies& latencies = mLatency.EndFrame();
+        const auto get = [&latencies](const Metric metric) {
+            return latencies[static_cast<size_t>(metric)];
+        };
+        mFrameStats.mInputToWaitEndNs = get(Metric::INPUT_TO_WAIT_END);
+        mFrameStats.mInputToSubmitNs = get(Metric::INPUT_TO_SUBMIT);
+        mFrameStats.mInputToDisplayNs = get(Metric::INPUT_TO_DISPLAY);
+        mFrameStats.mPoseToSubmitNs = get(Metric::POSE_TO_SUBMIT);
+        mFrameStats.mPoseToDisplayNs = get(Metric::POSE_TO_DISPLAY);
+        mFrameStats.mEventToDisplayNs = get(Metric::EVENT_TO_DISPLAY);
+    }
+
+    // The frame is submitted; use what's left of it before xrWaitFrame()
+    EnterPhase(Watchdog::Phase::SLACK);
+    mSlackScheduler.Run();
+    mFrameStats.mSlackNs = mSlackScheduler.GetStats().mSlackNs;
+    mFrameStats.mSlackUsedNs = mSlackScheduler.GetStats().mUsedNs;
+    mWatchdog.AddFrameStats(mFrameStats);
+    EnterPhase(Watchdog::Phase::IDLE);
+    mFlightRecorder.AddFrame(mFrameStats);
+    // Reported once the render thread is moving again
+    const uint32_t stallCount = mWatchdog.GetStallCount();
+    if (stallCount != mStallCount) {
+        mFlightRecorder.AddEvent(FlightFormat::EventType::STALL, mFrameIndex,
+                                 static_cast<int32_t>(stallCount), "watchdog stall");
+        mStallCount = stallCount;
+    }
+    if (mStatsHistory.size() < SUMMARY_WINDOW_FRAMES) {
+        mStatsHistory.push_back(mFrameStats);
+    }
+    PublishTelemetry(appState, frameState.predictedDisplayPeriod);
+}
+
+void VrApp::EnterPhase(const Watchdog::Phase phase) {
+    mWatchdog.Beat(phase, mFrameIndex);
+    mFlightRecorder.Mark(phase, mFrameIndex);
+}
+
+void VrApp::RecordStateChanges(const AppState& appState) {
+    if (appState.mSessionState != mLastAppState.mSessionState) {
+        mFlightRecorder.AddEvent(FlightFormat::EventType::SESSION_STATE, mFrameIndex, 0, "%s",
+                                 XrSessionStateToString(appState.mSessionState));
+    }
+    if (appState.mCpuPerfNotification != mLastAppState.mCpuPerfNotification) {
+        mFlightRecorder.AddEvent(FlightFormat::EventType::PERF_NOTIFICATION, mFrameIndex,
+                                 XR_PERF_SETTINGS_DOMAIN_CPU_EXT, "cpu %s",
+                                 PerfNotificationToString(appState.mCpuPerfNotification));
+    }
+    if (appState.mGpuPerfNotification != mLastAppState.mGpuPerfNotification) {
+        mFlightRecorder.AddEvent(FlightFormat::EventType::PERF_NOTIFICATION, mFrameIndex,
+                                 XR_PERF_SETTINGS_DOMAIN_GPU_EXT, "gpu %s",
+                                 PerfNotificationToString(appState.mGpuPerfNotification));
+    }
+}
+
+void VrApp::PublishTelemetry(const AppState& appState, const XrDuration displayPeriod) {
+    if (!mTelemetry.IsRunning()) {
+        return;
+    }
+    TelemetrySample sample;
+    sample.mTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    sample.mFrame = mFrameStats;
+    sample.mDisplayPeriodNs = displayPeriod;
+    sample.mSessionState = XrSessionStateToString(appState.mSessionState);
+    sample.mFocused = appState.mHasFocus;
+    sample.mCpuPerfLevel = PerfLevelToString(
+            static_cast<XrPerfSettingsLevelEXT>(mParameters.GetInt(mParameterIds.mCpuPerfLevel)));
+    sample.mGpuPerfLevel = PerfLevelToString(
+            static_cast<XrPerfSettingsLevelEXT>(mParameters.GetInt(mParameterIds.mGpuPerfLevel)));
+    sample.mCpuPerfNotification = PerfNotificationToString(appState.mCpuPerfNotification);
+    sample.mGpuPerfNotification = PerfNotificationToString(appState.mGpuPerfNotification);
+    sample.mResolutionScale = mEyeConfig.mResolutionScale;
+    sample.mMultisamples = mEyeConfig.mMultisamples;
+    sample.mGpuMemoryBudget = mGpuMemory.GetBudget();
+    sample.mWatchdogStalls = mWatchdog.GetStallCount();
+    mTelemetry.Publish(sample);
 }
 
 void VrApp::RenderScene(std::array<XrCompositionLayer, 2>& layers,
                         uint32_t& layerCount,
                         const XrTime predictedDisplayTime) noexcept {
     OpenXr& xr = *gOpenXr;
+    mFrameStats.Reset(mFrameIndex);
 
     const XrViewLocateInfo locateInfo = {
             XR_TYPE_VIEW_LOCATE_INFO,
@@ -431,6 +827,36 @@ void VrApp::RenderScene(std::array<XrCompositionLayer, 2>& layers,
     static XrCompositionLayerProjectionView projViews[MAX_EYES];
     layer.viewCount = MAX_EYES;
     layer.views = projViews;
+
+    while (glGetError() != GL_NO_ERROR) { /* eat errors */ }
+
+    // Light binning and shadow tile selection cover both eyes at once, and
+    // must run before the passes that use them are declared
+    const std::array<XrPosef, MAX_EYES> eyePoses = {views[0].pose, views[1].pose};
+    const std::array<XrFovf, MAX_EYES> eyeFovs = {views[0].fov, views[1].fov};
+    mSceneRenderer.BeginFrame(eyePoses, eyeFovs, mEyeResolution, mFrameStats);
+
+    // Instanced stereo has one double-wide target and pass for both eyes
+    std::array<SceneRenderer::EyeTarget, MAX_EYES> targets = {};
+    for (size_t target = 0; target < GetFramebufferCount(); ++target) {
+        Framebuffer& fb = mFramebuffers[target];
+        EnterPhase(Watchdog::Phase::ACQUIRE);
+        fb.Acquire(mAcquireTimeout);
+        EnterPhase(Watchdog::Phase::RENDER);
+        targets[target] = {fb.GetColorTexture(), fb.GetWidth(), fb.GetHeight()};
+    }
+
+    // Foveation only covers passes that draw straight into the swapchain
+    // texture, so with it on the driver resolves MSAA as tiles are stored
+    // instead of going through an MSAA target and a blit.
+    SceneRenderer::EyePassConfig passConfig;
+    passConfig.mColorFormat = mEyeConfig.mColorFormat;
+    passConfig.mMultisamples = mEyeConfig.mMultisamples;
+    passConfig.mInstancedStereo = mInstancedStereo;
+    passConfig.mImplicitResolve = UsesImplicitResolve(mEyeConfig);
+    mSceneRenderer.AddEyePasses(mRenderGraph, eyePoses, eyeFovs, targets, passConfig,
+                                mFrameStats);
+
     for (size_t eye = 0; eye < MAX_EYES; ++eye) {
         XrCompositionLayerProjectionView& view = projViews[eye];
         view = {};
@@ -438,63 +864,118 @@ void VrApp::RenderScene(std::array<XrCompositionLayer, 2>& layers,
         view.pose = views[eye].pose;
         view.fov  = views[eye].fov;
 
-        Framebuffer& fb = mFramebuffers[eye];
-        fb.Acquire();
-        fb.SetCurrent();
-
-        while (glGetError() != GL_NO_ERROR) { /* eat errors */ }
-
-        // Setup GL
-        glViewport(0, 0, fb.GetWidth(), fb.GetHeight());
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LESS);
-        glClearDepthf(1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        GLint linkStatus = 0;
-        glGetProgramiv(mSquareProgram, GL_LINK_STATUS, &linkStatus);
-        if (linkStatus == GL_FALSE) {
-            ALOGE("Shader program failed to link.");
-            return;
-        }
-        glUseProgram(mSquareProgram);
+        const Framebuffer& fb = mFramebuffers[mInstancedStereo ? 0 : eye];
+        const int32_t offsetX = mInstancedStereo ? static_cast<int32_t>(eye) * mEyeResolution.width
+                                                 : 0;
+        view.subImage = {
+                fb.GetColorSwapChain().mHandle,
+                { {offsetX, 0}, mEyeResolution },
+                0
+        };
+    }
 
-        // Build MVP matrix
-        XrMatrix4x4f projMatrix;
-        XrMatrix4x4f_CreateProjectionFov(&projMatrix,
-                                         GraphicsAPI::GRAPHICS_OPENGL, view.fov, 0.1f, 100.0f);
+    mRenderGraph.Execute(mFrameStats);
+    mSceneRenderer.EndFrame();
+    CaptureEye();
 
-        XrPosef invertedPose;
-        XrPosef_Invert(&invertedPose, &view.pose);
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        ALOGE("OpenGL error during draw: 0x%x", err);
+    }
 
-        XrMatrix4x4f viewMatrix;
-        XrMatrix4x4f_CreateFromRigidTransform(&viewMatrix, &invertedPose);
+    // Every acquired image is released, whatever happened above
+    for (size_t i = 0; i < GetFramebufferCount(); i++) {
+        mFramebuffers[i].Release();
+    }
+    layers[layerCount].mProjection = layer;
+    layerCount++;
+}
 
-        XrMatrix4x4f mvpMatrix;
-        XrMatrix4x4f_Multiply(&mvpMatrix, &projMatrix, &viewMatrix);
+void VrApp::CaptureEye() {
+    if (!mReadback.IsInitialized()) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    mReadback.Poll();
+
+    uint32_t tag = kMirrorTag;
+    uint32_t downscale = kMirrorDownscale;
+    if (mScreenshotRequested) {
+        tag = kScreenshotTag;
+        downscale = 1;
+    } else if (!mMirrorEnabled || mFrameIndex % kMirrorFrameInterval != 0) {
+        tag = UINT32_MAX;
+    }
+    // The left eye; with instanced stereo it is the left half of the shared image.
+    // A busy ring just means this frame isn't captured; screenshots try again next frame.
+    if (tag != UINT32_MAX &&
+        mReadback.Capture(mFramebuffers[0].GetColorTexture(), 0, mEyeResolution.width,
+                          mEyeResolution.height, downscale, mFrameIndex, tag) &&
+        tag == kScreenshotTag) {
+        mScreenshotRequested = false;
+    }
+    mFrameStats.mReadbackNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
 
-        GLint mvpLoc = glGetUniformLocation(mSquareProgram, "uModelViewProjection");
-        glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, &mvpMatrix.m[0]);
+void VrApp::UpdateTransforms() {
+    constexpr XrSpaceLocationFlags kPoseValid =
+            XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT;
 
-        glBindVertexArray(mSquareVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
+    // Untracked hands keep their last pose
+    for (uint32_t hand = 0; hand < InputStateFrame::NUM_CONTROLLERS; hand++) {
+        const XrSpaceLocation& aim = mInputStateFrame.mHandPositions[hand];
+        if (mInputStateFrame.mIsHandActive[hand] &&
+            (aim.locationFlags & kPoseValid) == kPoseValid) {
+            mTransforms.SetLocalPose(mHandRoots[hand], aim.pose);
+        }
+    }
+    mTransforms.Update();
+    for (const TransformHierarchy::NodeId node : mTransforms.GetChangedNodes()) {
+        const uint32_t object = mTransforms.GetUserData(node);
+        if (object != TransformHierarchy::NO_USER_DATA) {
+            mSceneRenderer.SetObjectPose(object, mTransforms.GetWorldPose(node));
+        }
+    }
+}
 
-        GLenum err = glGetError();
-        if (err != GL_NO_ERROR) {
-            ALOGE("OpenGL error during draw: 0x%x", err);
+void VrApp::UpdatePointing() {
+    constexpr XrSpaceLocationFlags kPoseValid =
+            XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT;
+    constexpr XrVector3f kForward = {0.0f, 0.0f, -1.0f};
+
+    // Both hands go down the tree together, one SIMD lane each
+    std::array<AabbTree::Ray, InputStateFrame::NUM_CONTROLLERS> rays = {};
+    std::array<uint32_t, InputStateFrame::NUM_CONTROLLERS> hands = {};
+    uint32_t rayCount = 0;
+    for (uint32_t hand = 0; hand < InputStateFrame::NUM_CONTROLLERS; hand++) {
+        const XrSpaceLocation& aim = mInputStateFrame.mHandPositions[hand];
+        if (!mInputStateFrame.mIsHandActive[hand] ||
+            (aim.locationFlags & kPoseValid) != kPoseValid) {
+            continue;
         }
+        rays[rayCount].mOrigin = aim.pose.position;
+        XrQuaternionf_RotateVector3f(&rays[rayCount].mDirection, &aim.pose.orientation, &kForward);
+        hands[rayCount++] = hand;
+    }
 
-        fb.Resolve();
-        fb.Release();
+    std::array<AabbTree::RayHit, InputStateFrame::NUM_CONTROLLERS> hits = {};
+    mSceneRenderer.GetSpatialIndex().RayCast(rays.data(), rayCount, hits.data());
 
-        view.subImage = {
-                fb.GetColorSwapChain().mHandle,
-                { {0, 0}, {static_cast<int32_t>(fb.GetWidth()), static_cast<int32_t>(fb.GetHeight())} },
-                0
-        };
+    std::array<int64_t, InputStateFrame::NUM_CONTROLLERS> pointed = {-1, -1};
+    for (uint32_t i = 0; i < rayCount; i++) {
+        if (hits[i].mHit) {
+            pointed[hands[i]] = hits[i].mUserData;
+        }
     }
-    layers[layerCount].mProjection = layer;
-    layerCount++;
+    for (uint32_t hand = 0; hand < InputStateFrame::NUM_CONTROLLERS; hand++) {
+        if (pointed[hand] != mPointedObjects[hand]) {
+            ALOGD("%s controller pointing at object %lld",
+                  hand == InputStateFrame::LEFT_CONTROLLER ? "Left" : "Right",
+                  static_cast<long long>(pointed[hand]));
+        }
+    }
+    mPointedObjects = pointed;
 }
 
 void
@@ -508,7 +989,183 @@ VrApp::HandleInput(const InputStateFrame &inputState, AppState &newState) const
     }
 }
 
-VrApp::AppState VrApp::HandleEvents() const {
+void VrApp::HandleCaptureInput(const InputStateFrame& inputState) {
+    if (!mReadback.IsInitialized()) {
+        return;
+    }
+    const XrActionStateBoolean& screenshot = inputState.mFaceButtonStates[2];  // X
+    const XrActionStateBoolean& mirror = inputState.mFaceButtonStates[3];      // Y
+    if (screenshot.changedSinceLastSync && screenshot.currentState == XR_TRUE) {
+        mScreenshotRequested = true;
+    }
+    if (mirror.changedSinceLastSync && mirror.currentState == XR_TRUE) {
+        mMirrorEnabled = !mMirrorEnabled;
+        ALOGI("Mirror %s (%s/mirror.tga)", mMirrorEnabled ? "on" : "off", mCaptureDir.c_str());
+    }
+}
+
+void VrApp::HandleQualityInput(const InputStateFrame& inputState) {
+    const XrActionStateBoolean& msaa = inputState.mFaceButtonStates[0];        // A
+    const XrActionStateBoolean& resolution = inputState.mFaceButtonStates[1];  // B
+    const bool stepMsaa = msaa.changedSinceLastSync && msaa.currentState == XR_TRUE;
+    const bool stepResolution =
+            resolution.changedSinceLastSync && resolution.currentState == XR_TRUE;
+    if (!stepMsaa && !stepResolution) {
+        return;
+    }
+
+    // Through the registry like any other change; the new config is
+    // requested once the message is applied, at the next frame boundary
+    const auto next = [](const auto& steps, const auto current) {
+        const auto it = std::find(steps.begin(), steps.end(), current);
+        return it == steps.end() || it + 1 == steps.end() ? steps.front() : *(it + 1);
+    };
+    const ParameterIds& ids = mParameterIds;
+    if (stepMsaa) {
+        gMessageQueue.Post(mParameters.MakeSetMessage(
+                ids.mMultisamples, next(kMultisampleSteps, mParameters.GetInt(ids.mMultisamples))));
+    }
+    if (stepResolution) {
+        gMessageQueue.Post(mParameters.MakeSetMessage(
+                ids.mResolutionScale,
+                next(kResolutionScaleSteps, mParameters.GetFloat(ids.mResolutionScale))));
+    }
+}
+
+void VrApp::RequestEyeConfig(const EyeConfig& config) {
+    CancelEyeReconfiguration();
+    if (config == mEyeConfig) {
+        return;
+    }
+    mPendingEyeConfig = config;
+    mReconfigureStep = ReconfigureStep::CREATE;
+    const XrExtent2Di eye = GetEyeResolution(config);
+    ALOGI("Rebuilding eye buffers: %dx%d, %dx MSAA, format 0x%x", eye.width, eye.height,
+          config.mMultisamples, config.mColorFormat);
+}
+
+void VrApp::CancelEyeReconfiguration() {
+    // Never rendered to, so nothing on the GPU or compositor can be using them
+    for (Framebuffer& framebuffer : mPendingFramebuffers) {
+        framebuffer.Destroy();
+    }
+    mPendingCreated = 0;
+    mReconfigureStep = ReconfigureStep::IDLE;
+}
+
+void VrApp::UpdateEyeReconfiguration() {
+    // Counted in calls rather than frame indices, which restart with the session
+    if (mHasRetired && mFramesUntilRetire-- == 0) {
+        for (Framebuffer& framebuffer : mRetiredFramebuffers) {
+            framebuffer.Destroy();
+        }
+        mHasRetired = false;
+    }
+
+    switch (mReconfigureStep) {
+        case ReconfigureStep::IDLE:
+            return;
+
+        case ReconfigureStep::CREATE:
+            // Swapchain creation can take milliseconds; one per frame
+            if (!CreateEyeFramebuffer(mPendingFramebuffers[mPendingCreated], mPendingEyeConfig)) {
+                ALOGE("Failed to create eye framebuffer %zu for the new config; keeping the "
+                      "current one", mPendingCreated);
+                CancelEyeReconfiguration();
+                return;
+            }
+            if (++mPendingCreated == GetFramebufferCount()) {
+                mReconfigureStep = ReconfigureStep::PREWARM;
+            }
+            return;
+
+        case ReconfigureStep::PREWARM: {
+            // Allocate the render targets AddEyePasses() will ask for and hand
+            // them straight back, so the switch frame finds them pooled
+            const EyeConfig& config = mPendingEyeConfig;
+            const bool implicitResolve = UsesImplicitResolve(config);
+            for (size_t i = 0; i < GetFramebufferCount(); i++) {
+                const GLsizei width = mPendingFramebuffers[i].GetWidth();
+                const GLsizei height = mPendingFramebuffers[i].GetHeight();
+                const std::array<GpuResourceDesc, 2> descs = {
+                        GpuResourceDesc::Renderbuffer(GL_DEPTH_COMPONENT24, width, height,
+                                                      config.mMultisamples, implicitResolve),
+                        GpuResourceDesc::Renderbuffer(config.mColorFormat, width, height,
+                                                      config.mMultisamples)};
+                const size_t count = config.mMultisamples > 1 && !implicitResolve ? 2 : 1;
+                for (size_t d = 0; d < count; d++) {
+                    mResourcePool.Release(mResourcePool.Acquire(descs[d]), descs[d]);
+                }
+            }
+
+            // Readback only has to grow; a smaller eye fits the old ring
+            const XrExtent2Di eye = GetEyeResolution(config);
+            if (mReadback.IsInitialized() &&
+                (mReadback.GetFormat() != config.mColorFormat ||
+                 mReadback.GetMaxWidth() < eye.width || mReadback.GetMaxHeight() < eye.height)) {
+                InitReadback(config.mColorFormat, eye.width, eye.height);
+            }
+            mFramesUntilSwitch = kPrewarmFrames;
+            mReconfigureStep = ReconfigureStep::SWITCH;
+            return;
+        }
+
+        case ReconfigureStep::SWITCH:
+            if (mFramesUntilSwitch > 0) {
+                mFramesUntilSwitch--;
+                return;
+            }
+            // The set before last must be gone first
+            if (mHasRetired) {
+                return;
+            }
+            std::swap(mRetiredFramebuffers, mFramebuffers);
+            std::swap(mFramebuffers, mPendingFramebuffers);
+            mHasRetired = true;
+            mFramesUntilRetire = kRetireFrames;
+            mPendingCreated = 0;
+
+            // Cached FBOs name the old swapchain textures
+            mRenderGraph.ReleaseFramebuffers();
+            mFoveation.InvalidateSwapchains();
+            mEyeConfig = mPendingEyeConfig;
+            mEyeResolution = GetEyeResolution(mEyeConfig);
+            mReconfigureStep = ReconfigureStep::IDLE;
+            ALOGI("Switched eye buffers at frame %llu",
+                  static_cast<unsigned long long>(mFrameIndex));
+            mFlightRecorder.AddEvent(FlightFormat::EventType::NOTE, mFrameIndex, 0,
+                                     "eyes %.2fx msaa %d", mEyeConfig.mResolutionScale,
+                                     mEyeConfig.mMultisamples);
+            return;
+    }
+}
+
+bool VrApp::CreateEyeFramebuffer(Framebuffer& framebuffer, const EyeConfig& config) {
+    const XrExtent2Di eye = GetEyeResolution(config);
+    const int width = mInstancedStereo ? eye.width * static_cast<int>(MAX_EYES) : eye.width;
+    return framebuffer.Create(gOpenXr->mSession, config.mColorFormat, width, eye.height,
+                              config.mMultisamples, false, &mResourcePool, false,
+                              mFoveation.IsEnabled());
+}
+
+XrExtent2Di VrApp::GetEyeResolution(const EyeConfig& config) const {
+    const XrViewConfigurationView& view = gOpenXr->mViewConfigurationViews[0];
+    const auto scale = [&config](const uint32_t recommended, const uint32_t max) {
+        const auto size = static_cast<int32_t>(
+                std::lround(static_cast<float>(recommended) * config.mResolutionScale));
+        return std::clamp(size, std::min(kMinEyeSize, static_cast<int32_t>(max)),
+                          static_cast<int32_t>(max));
+    };
+    return {scale(view.recommendedImageRectWidth, view.maxImageRectWidth),
+            scale(view.recommendedImageRectHeight, view.maxImageRectHeight)};
+}
+
+bool VrApp::UsesImplicitResolve(const EyeConfig& config) const {
+    return config.mMultisamples > 1 && mFoveation.IsEnabled() &&
+           RenderGraph::SupportsImplicitResolve();
+}
+
+VrApp::AppState VrApp::HandleEvents() {
     AppState newState = mLastAppState;
     OXRPollEvents(newState);
     HandleMessageQueueEvents(newState);
@@ -562,6 +1219,11 @@ void VrApp::OXRPollEvents(AppState &newAppState) const {
                         (XrEventDataPerfSettingsEXT *) (baseEventHeader);
                 ALOGD("%s(): Received XR_TYPE_EVENT_DATA_PERF_SETTINGS_EXT event: type %d subdomain %d : level %d -> level %d",
                       __func__, pfs->type, pfs->subDomain, pfs->fromLevel, pfs->toLevel);
+                if (pfs->domain == XR_PERF_SETTINGS_DOMAIN_CPU_EXT) {
+                    newAppState.mCpuPerfNotification = pfs->toLevel;
+                } else if (pfs->domain == XR_PERF_SETTINGS_DOMAIN_GPU_EXT) {
+                    newAppState.mGpuPerfNotification = pfs->toLevel;
+                }
             }
                 break;
             case XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING:
@@ -585,6 +1247,7 @@ void VrApp::OXRHandleSessionStateChangedEvent(AppState &newAppState,
               (long long) newState.time);
     }
     lastState = newState.state;
+    newAppState.mSessionState = newState.state;
 
     switch (newState.state) {
         case XR_SESSION_STATE_FOCUSED:
@@ -648,16 +1311,7 @@ VrApp::OXRHandleSessionStateChanges(const XrSessionState state, AppState &newApp
             ALOG_LIFECYCLE_VERBOSE("%s(): Entered XR_SESSION_STATE_READY", __func__);
 
             // Set performance levels for CPU and GPU
-            PFN_xrPerfSettingsSetPerformanceLevelEXT pfnPerfSettingsSetPerformanceLevelEXT = nullptr;
-            OXR(xrGetInstanceProcAddr(
-                    gOpenXr->mInstance, "xrPerfSettingsSetPerformanceLevelEXT",
-                    (PFN_xrVoidFunction *) (&pfnPerfSettingsSetPerformanceLevelEXT)));
-
-            OXR(pfnPerfSettingsSetPerformanceLevelEXT(gOpenXr->mSession,
-                                                      XR_PERF_SETTINGS_DOMAIN_CPU_EXT,
-                                                      XR_PERF_SETTINGS_LEVEL_BOOST_EXT));
-            OXR(pfnPerfSettingsSetPerformanceLevelEXT(
-                    gOpenXr->mSession, XR_PERF_SETTINGS_DOMAIN_GPU_EXT, kGpuPerfLevel));
+            SetPerfLevels();
 
             // Set application thread priority
             PFN_xrSetAndroidApplicationThreadKHR pfnSetAndroidApplicationThreadKHR = nullptr;
@@ -676,15 +1330,15 @@ VrApp::OXRHandleSessionStateChanges(const XrSessionState state, AppState &newApp
     }
 }
 
-void VrApp::HandleMessageQueueEvents(AppState &newAppState) const {
-    // Arbitrary limit to prevent the render thread from blocking too long
-    // on a single frame. This may happen if the app is paused in an edge
-    // case.
-    constexpr size_t kMaxNumMessagesPerFrame = 20;
+void VrApp::HandleMessageQueueEvents(AppState &newAppState) {
+    // Limit to prevent the render thread from blocking too long on a single
+    // frame. This may happen if the app is paused in an edge case.
+    const auto maxNumMessagesPerFrame =
+            static_cast<size_t>(mParameters.GetInt(mParameterIds.mMaxMessagesPerFrame));
 
     size_t numMessagesHandled = 0;
     Message message;
-    while (numMessagesHandled < kMaxNumMessagesPerFrame) {
+    while (numMessagesHandled < maxNumMessagesPerFrame) {
         if (!gMessageQueue.Poll(message)) { break; }
         numMessagesHandled++;
 
@@ -694,6 +1348,9 @@ void VrApp::HandleMessageQueueEvents(AppState &newAppState) const {
                 newAppState.mIsStopRequested = true;
                 break;
             }
+            case Message::Type::SET_PARAMETER:
+                mParameters.Apply(message);
+                break;
             default:
                 ALOGE("Unknown message type: %d", static_cast<int>(message.mType));
                 break;
@@ -741,6 +1398,60 @@ private:
         ALOG_LIFECYCLE_VERBOSE("VRAppThread: exited");
     }
 
+    // Map the content package in place inside the APK, if it has one
+    static void
+    OpenAssetPackage(JNIEnv *const jni, const jobject activityObject, AssetPackage& assets) {
+        const jclass activityClass = jni->GetObjectClass(activityObject);
+        const jmethodID getAssets = jni->GetMethodID(activityClass, "getAssets",
+                                                     "()Landroid/content/res/AssetManager;");
+        const jobject assetManagerObject = jni->CallObjectMethod(activityObject, getAssets);
+        AAssetManager *const assetManager = AAssetManager_fromJava(jni, assetManagerObject);
+        AAsset *const asset = AAssetManager_open(assetManager, kAssetPackageName,
+                                                 AASSET_MODE_STREAMING);
+        if (asset == nullptr) {
+            ALOGI("No %s in the APK; generating scene geometry", kAssetPackageName);
+        } else {
+            off64_t start = 0;
+            off64_t length = 0;
+            const int fd = AAsset_openFileDescriptor64(asset, &start, &length);
+            if (fd < 0) {
+                ALOGW("%s is compressed in the APK and cannot be mapped", kAssetPackageName);
+            } else {
+                assets.Open(fd, start, length);
+                close(fd);
+            }
+            AAsset_close(asset);
+        }
+        jni->DeleteLocalRef(assetManagerObject);
+        jni->DeleteLocalRef(activityClass);
+    }
+
+    // App-specific external storage, readable over adb without root
+    static std::string GetCaptureDir(JNIEnv *const jni, const jobject activityObject) {
+        const jclass activityClass = jni->GetObjectClass(activityObject);
+        const jmethodID getExternalFilesDir = jni->GetMethodID(
+                activityClass, "getExternalFilesDir", "(Ljava/lang/String;)Ljava/io/File;");
+        const jobject dir = jni->CallObjectMethod(activityObject, getExternalFilesDir, nullptr);
+        std::string path;
+        if (dir != nullptr) {
+            const jclass fileClass = jni->GetObjectClass(dir);
+            const jmethodID getAbsolutePath = jni->GetMethodID(fileClass, "getAbsolutePath",
+                                                               "()Ljava/lang/String;");
+            const auto pathString = static_cast<jstring>(jni->CallObjectMethod(dir,
+                                                                             getAbsolutePath));
+            const char *const chars = jni->GetStringUTFChars(pathString, nullptr);
+            path = chars;
+            jni->ReleaseStringUTFChars(pathString, chars);
+            jni->DeleteLocalRef(pathString);
+            jni->DeleteLocalRef(fileClass);
+            jni->DeleteLocalRef(dir);
+        } else {
+            ALOGW("No external files directory; eye capture is off");
+        }
+        jni->DeleteLocalRef(activityClass);
+        return path;
+    }
+
     static void
     ThreadFnJNI(JavaVM *const jvm, JNIEnv *const jni, const jobject activityObjectGlobalRef) {
         assert(jni != nullptr);
@@ -754,7 +1465,10 @@ private:
             }
         }
 
-        std::make_unique<VrApp>()->MainLoop();
+        AssetPackage assets;
+        OpenAssetPackage(jni, activityObjectGlobalRef, assets);
+        std::make_unique<VrApp>(assets.IsOpen() ? &assets : nullptr,
+                                GetCaptureDir(jni, activityObjectGlobalRef))->MainLoop();
 
         ALOG_LIFECYCLE_VERBOSE("::MainLoop() exited");
 
@@ -12,37 +12,133 @@ License     :   Licensed under GPLv3 or any later version.
 
 #include "input/VrController.h"
 #include "utils/Common.h"
+#include "gl/FoveationController.h"
 #include "gl/Framebuffer.h"
+#include "gl/FrameReadback.h"
+#include "gl/ResourcePool.h"
+#include "gl/ShaderManager.h"
+#include "render/DemoScene.h"
+#include "render/RenderGraph.h"
+#include "render/SceneRenderer.h"
+#include "render/TransformHierarchy.h"
+#include "utils/AssetPackage.h"
+#include "utils/FlightRecorder.h"
+#include "utils/FrameStats.h"
+#include "utils/JobSystem.h"
+#include "utils/LatencyTracker.h"
+#include "utils/ParameterRegistry.h"
+#include "utils/SlackScheduler.h"
+#include "utils/TelemetryServer.h"
+#include "utils/Watchdog.h"
 
 #include <GLES3/gl3.h>
 #include <GLES3/gl3ext.h>
 
 #include <memory>
+#include <string>
+#include <utility>
 #include <thread>
 #include <vector>
 #include <array>
 
 class VrApp {
 public:
-    explicit VrApp() = default;
+    /**
+     * @param assets     Optional content package, kept open for the app's lifetime;
+     *                   without one, scene geometry is generated at startup
+     * @param captureDir Where the mirror image and screenshots are written;
+     *                   capture is off if empty
+     */
+    explicit VrApp(const AssetPackage* assets = nullptr, std::string captureDir = {})
+            : mAssets(assets), mCaptureDir(std::move(captureDir)) {}
     ~VrApp() = default;
 
     void MainLoop();
 
 private:
     static constexpr std::size_t MAX_EYES = 2;
+    // Helpers for per-frame CPU work (light binning); the render thread joins in
+    static constexpr uint32_t NUM_WORKER_THREADS = 2;
+    // Frames per frame stats and latency summary; about ten seconds at 72 Hz
+    static constexpr size_t SUMMARY_WINDOW_FRAMES = 720;
 
     struct AppState;
 
+    // What the eye swapchains and their render targets are built with
+    struct EyeConfig {
+        // Of the runtime's recommended per-eye size
+        float mResolutionScale = 1.0f;
+        GLenum mColorFormat = GL_SRGB8_ALPHA8;
+        int mMultisamples = 4;
+
+        bool operator==(const EyeConfig& other) const {
+            return mResolutionScale == other.mResolutionScale &&
+                   mColorFormat == other.mColorFormat && mMultisamples == other.mMultisamples;
+        }
+        bool operator!=(const EyeConfig& other) const { return !(*this == other); }
+    };
+
+    // A live eye-buffer change advances one step per frame
+    enum class ReconfigureStep : uint8_t {
+        IDLE,
+        CREATE,   // one new swapchain per frame
+        PREWARM,  // allocate the new render targets, resize readback
+        SWITCH,   // swap sets at the start of a frame
+    };
+
     void Init();
     void InitSceneResources();
+    void InitReadback(GLenum format, GLsizei width, GLsizei height);
+    // Register the deferrable work that runs in mSlackScheduler
+    void InitSlackTasks();
+    // Register what mGpuMemory counts and what it may evict
+    void InitGpuMemory();
+    // The gpu_memory_budget_mib parameter, in bytes
+    uint64_t GetGpuMemoryBudget() const;
+    // Register the tunable parameters and load mCaptureDir's parameter file
+    void InitParameters();
+    // Reconfigure whatever owns a parameter that changed since last frame
+    void ApplyParameterChanges(const AppState& appState);
+    // The registry's CPU and GPU levels, to the runtime
+    void SetPerfLevels() const;
     void Frame(const AppState& appState) noexcept;
+    // Tell mWatchdog and mFlightRecorder the render thread is entering @p phase
+    void EnterPhase(Watchdog::Phase phase);
+    // Put session and perf notification changes in the flight record
+    void RecordStateChanges(const AppState& appState);
+    // Hand the latest frame and session state to mTelemetry, if it's running
+    void PublishTelemetry(const AppState& appState, XrDuration displayPeriod);
 
     void HandleInput(const InputStateFrame& inputState, AppState& newState) const;
+    // Left controller: X takes a screenshot, Y toggles the live mirror
+    void HandleCaptureInput(const InputStateFrame& inputState);
+    // Right controller: A cycles the MSAA sample count, B the resolution scale
+    void HandleQualityInput(const InputStateFrame& inputState);
+    // Start this frame's readback, if any, and collect finished ones
+    void CaptureEye();
+
+    /**
+     * Rebuild the eye swapchains with @p config over the next few frames
+     * while the current set keeps rendering, then switch between frames.
+     * A request while a rebuild is under way replaces it.
+     */
+    void RequestEyeConfig(const EyeConfig& config);
+    // Advance a requested change by one step, and destroy a retired set once
+    // the compositor is done with it. Call before anything uses mFramebuffers.
+    void UpdateEyeReconfiguration();
+    void CancelEyeReconfiguration();
+    bool CreateEyeFramebuffer(Framebuffer& framebuffer, const EyeConfig& config);
+    XrExtent2Di GetEyeResolution(const EyeConfig& config) const;
+    // Multisampled straight into the swapchain texture, no resolve blit
+    bool UsesImplicitResolve(const EyeConfig& config) const;
+    // Cast both controllers' aim rays into the scene's spatial index
+    void UpdatePointing();
+    // Move the tracked roots to the synced poses and place what hangs off them
+    void UpdateTransforms();
 
-    AppState HandleEvents() const;
+    AppState HandleEvents();
     void HandleStateChanges(AppState& newState) const;
-    void HandleMessageQueueEvents(AppState& newState) const;
+    void HandleMessageQueueEvents(AppState& newState);
 
     void OXRPollEvents(AppState& newAppState) const;
     void OXRHandleSessionStateChangedEvent(AppState& newAppState,
@@ -53,24 +149,116 @@ private:
                      uint32_t& layerCount,
                      const XrTime predictedDisplayTime) noexcept;
 
+    // Instanced stereo puts both eyes in mFramebuffers[0]
+    size_t GetFramebufferCount() const { return mInstancedStereo ? 1 : MAX_EYES; }
+
     struct AppState {
         bool mIsStopRequested = false;
         bool mIsXrSessionActive = false;
         bool mHasFocus = false;
+        XrSessionState mSessionState = XR_SESSION_STATE_UNKNOWN;
+        // Latest runtime notification per perf domain
+        XrPerfSettingsNotificationLevelEXT mCpuPerfNotification =
+                XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT;
+        XrPerfSettingsNotificationLevelEXT mGpuPerfNotification =
+                XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT;
     };
 
-    GLuint mSquareProgram = 0;
-    GLuint mSquareVBO = 0;
-    GLuint mSquareVAO = 0;
+    // Declared first so it is destroyed last, after everything that releases into it
+    GpuResourcePool mResourcePool;
+    // Estimated GPU memory per category, kept under the gpu_memory_budget_mib
+    // parameter (GetGpuMemoryBudget())
+    GpuMemoryTracker mGpuMemory;
+
+    // Rebuilt every frame; owns the eye MSAA color and depth targets
+    RenderGraph mRenderGraph{mResourcePool};
+
+    JobSystem mJobSystem{NUM_WORKER_THREADS};
+
+    const AssetPackage* mAssets = nullptr;
+
+    ShaderManager mShaderManager;
+    SceneRenderer mSceneRenderer;
+    DemoScene mDemoScene;
+    // Props on tracked devices; node user data is the ObjectId they place
+    TransformHierarchy mTransforms{&mJobSystem};
+    std::array<TransformHierarchy::NodeId, InputStateFrame::NUM_CONTROLLERS> mHandRoots = {};
 
     // App state from previous frame.
     AppState mLastAppState;
 
+    // Tuning knobs, changed live by SET_PARAMETER messages
+    ParameterRegistry mParameters;
+    struct ParameterIds {
+        ParameterRegistry::Id mCpuPerfLevel = ParameterRegistry::INVALID_ID;
+        ParameterRegistry::Id mGpuPerfLevel = ParameterRegistry::INVALID_ID;
+        ParameterRegistry::Id mMultisamples = ParameterRegistry::INVALID_ID;
+        ParameterRegistry::Id mResolutionScale = ParameterRegistry::INVALID_ID;
+        ParameterRegistry::Id mMaxMessagesPerFrame = ParameterRegistry::INVALID_ID;
+        ParameterRegistry::Id mAcquireTimeoutMs = ParameterRegistry::INVALID_ID;
+        ParameterRegistry::Id mGpuMemoryBudgetMiB = ParameterRegistry::INVALID_ID;
+    } mParameterIds;
+    XrDuration mAcquireTimeout = Framebuffer::DEFAULT_ACQUIRE_TIMEOUT;
+
     // Eye framebuffers
     std::array<Framebuffer, MAX_EYES> mFramebuffers;
+    EyeConfig mEyeConfig;
+    FoveationController mFoveation;
+
+    // A requested eye config under construction; mFramebuffers keep
+    // rendering until the switch
+    EyeConfig mPendingEyeConfig;
+    ReconfigureStep mReconfigureStep = ReconfigureStep::IDLE;
+    std::array<Framebuffer, MAX_EYES> mPendingFramebuffers;
+    size_t mPendingCreated = 0;
+    uint64_t mFramesUntilSwitch = 0;
+    // The set replaced by the last switch, destroyed when the count runs out
+    std::array<Framebuffer, MAX_EYES> mRetiredFramebuffers;
+    bool mHasRetired = false;
+    uint64_t mFramesUntilRetire = 0;
+
+    // Copies the left eye off the GPU for the mirror and screenshots; the
+    // consumer thread writes them under mCaptureDir
+    FrameReadback mReadback;
+    std::string mCaptureDir;
+    bool mMirrorEnabled = false;
+    bool mScreenshotRequested = false;
+    // Unless foveation needs a swapchain per eye, both eyes share one
+    // double-wide swapchain and are drawn in a single instanced pass.
+    // Foveation wins: every runtime with XR_FB_foveation (every Quest) gets
+    // one scene pass per eye, so the single-pass path never runs on the
+    // target hardware; it covers other runtimes and the host tools.
+    bool mInstancedStereo = false;
+    // One eye's image size, shared swapchain or not
+    XrExtent2Di mEyeResolution = {};
 
     uint64_t mFrameIndex = 0;
+    // Predicted display time of the session's first frame; scene animation
+    // runs from here
+    XrTime mSessionStartTime = 0;
+
+    // Stats for the frame currently being built
+    FrameStats mFrameStats;
+    // Frames since the last stats summary, which is built in the slack
+    std::vector<FrameStats> mStatsHistory;
+    // Age of each frame's input and poses, on the runtime's clock; its
+    // distributions are logged in the slack
+    LatencyTracker mLatency{SUMMARY_WINDOW_FRAMES};
+
+    // Deferrable work run between xrEndFrame() and the next xrWaitFrame()
+    SlackScheduler mSlackScheduler;
+    // Reports render-thread phases that overrun their deadline; reports go
+    // to mCaptureDir
+    Watchdog mWatchdog;
+    // Stalls already in the flight record
+    uint32_t mStallCount = 0;
+    // The last frames and events, in mCaptureDir, readable after a crash
+    FlightRecorder mFlightRecorder;
+    // Opt-in live stream of frame stats and session state to local clients
+    TelemetryServer mTelemetry;
 
     std::unique_ptr<InputStateStatic> mInputStateStatic;
     InputStateFrame mInputStateFrame;
+    // Object each controller's aim ray hits, or -1
+    std::array<int64_t, InputStateFrame::NUM_CONTROLLERS> mPointedObjects = {-1, -1};
 };
\ No newline at end of file
@@ -9,6 +9,21 @@ License     :   Licensed under GPLv3 or any later version.
 #include "Egl.h"
 #include "../utils/LogUtils.h"
 
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#ifndef EGL_NO_CONFIG_KHR
+#define EGL_NO_CONFIG_KHR ((EGLConfig)0)
+#endif
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#ifndef EGL_PLATFORM_DEVICE_EXT
+#define EGL_PLATFORM_DEVICE_EXT 0x313F
+#endif
+
 namespace {
 
 /**
@@ -68,19 +83,112 @@ namespace {
             return false;
         }
 
-        if (numConfigs < 1) {
-            ALOGE("No matching EGL configs found");
+        // Not necessarily an error: configless contexts don't need one
+        return numConfigs >= 1;
+    }
+
+/**
+ * Any ES3 config that can back a pbuffer, for when surfaceless binding fails
+ */
+    bool ChoosePbufferConfig(EGLDisplay display, EGLConfig& config) {
+        const EGLint configAttribs[] = {
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_NONE
+        };
+
+        EGLint numConfigs = 0;
+        return eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) == EGL_TRUE &&
+               numConfigs >= 1;
+    }
+
+/**
+ * Check whether an extension name appears in a space-separated extension string
+ */
+    bool HasExtension(const char* extensions, const char* name) {
+        if (extensions == nullptr) {
             return false;
         }
+        const size_t len = strlen(name);
+        for (const char* p = strstr(extensions, name); p != nullptr; p = strstr(p + len, name)) {
+            const bool startOk = (p == extensions || p[-1] == ' ');
+            const bool endOk = (p[len] == ' ' || p[len] == '\0');
+            if (startOk && endOk) {
+                return true;
+            }
+        }
+        return false;
+    }
 
-        return true;
+/**
+ * Resident set size of this process in KiB, or -1 if unavailable
+ */
+    int64_t GetResidentSetKb() {
+        FILE* f = fopen("/proc/self/statm", "r");
+        if (f == nullptr) {
+            return -1;
+        }
+        long totalPages = 0;
+        long residentPages = 0;
+        const int n = fscanf(f, "%ld %ld", &totalPages, &residentPages);
+        fclose(f);
+        if (n != 2) {
+            return -1;
+        }
+        return static_cast<int64_t>(residentPages) * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+/**
+ * Get a display without a window system (Linux hosts). Prefers Mesa's
+ * surfaceless platform, then the first enumerated EGL device.
+ */
+    EGLDisplay GetHeadlessDisplay() {
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (clientExtensions == nullptr) {
+            // EGL 1.4 without EGL_EXT_client_extensions
+            eglGetError();
+            return EGL_NO_DISPLAY;
+        }
+
+        const auto eglGetPlatformDisplayEXT = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (eglGetPlatformDisplayEXT == nullptr) {
+            return EGL_NO_DISPLAY;
+        }
+
+        if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+            EGLDisplay display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+                                                          EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) {
+                ALOGD("Using EGL_MESA_platform_surfaceless display");
+                return display;
+            }
+        }
+
+        if (HasExtension(clientExtensions, "EGL_EXT_platform_device")) {
+            const auto eglQueryDevicesEXT = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(
+                    eglGetProcAddress("eglQueryDevicesEXT"));
+            EGLDeviceEXT device = nullptr;
+            EGLint numDevices = 0;
+            if (eglQueryDevicesEXT != nullptr &&
+                eglQueryDevicesEXT(1, &device, &numDevices) == EGL_TRUE && numDevices > 0) {
+                EGLDisplay display = eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, device,
+                                                              nullptr);
+                if (display != EGL_NO_DISPLAY) {
+                    ALOGD("Using EGL_EXT_platform_device display");
+                    return display;
+                }
+            }
+        }
+
+        return EGL_NO_DISPLAY;
     }
 
 /**
  * Log EGL config attributes for debugging
  */
     void LogEglConfig(EGLDisplay display, EGLConfig config) {
-        if (display == EGL_NO_DISPLAY || config == 0) {
+        if (display == EGL_NO_DISPLAY || config == EGL_NO_CONFIG_KHR) {
             return;
         }
 
@@ -119,8 +227,8 @@ namespace {
 // EglContext implementation
 //------------------------------------------------------------------------------
 
-EglContext::EglContext() {
-    const int32_t result = Init();
+EglContext::EglContext(const Platform platform) {
+    const int32_t result = Init(platform);
     if (result < 0) {
         ALOGE("EGL context initialization failed: error %d", result);
         Shutdown();
@@ -158,8 +266,19 @@ bool EglContext::ReleaseCurrent() {
     return true;
 }
 
-int32_t EglContext::Init() {
-    mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+int32_t EglContext::Init(const Platform platform) {
+    const auto startTime = std::chrono::steady_clock::now();
+    const int64_t startRssKb = GetResidentSetKb();
+
+    if (platform == Platform::HEADLESS) {
+        mDisplay = GetHeadlessDisplay();
+        if (mDisplay == EGL_NO_DISPLAY) {
+            ALOGW("No headless EGL platform available, using default display");
+        }
+    }
+    if (mDisplay == EGL_NO_DISPLAY) {
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
     if (mDisplay == EGL_NO_DISPLAY) {
         ALOGE("eglGetDisplay failed: %s", EglErrorToString(eglGetError()));
         return -1;
@@ -174,12 +293,25 @@ int32_t EglContext::Init() {
 
     ALOGD("EGL initialized: version %d.%d", majorVersion, minorVersion);
 
+    const char* displayExtensions = eglQueryString(mDisplay, EGL_EXTENSIONS);
+    mCreationStats.mIsSurfaceless = HasExtension(displayExtensions, "EGL_KHR_surfaceless_context");
+    mCreationStats.mIsNoConfig = HasExtension(displayExtensions, "EGL_KHR_no_config_context") ||
+                                 HasExtension(displayExtensions, "EGL_MESA_configless_context");
+
+    // OpenXR's graphics binding still wants a config, so pick one even if
+    // the context itself won't be bound to it.
     if (!ChooseBestEglConfig(mDisplay, mConfig)) {
-        return -3;
+        if (!mCreationStats.mIsNoConfig || !mCreationStats.mIsSurfaceless) {
+            ALOGE("No matching EGL config found");
+            return -3;
+        }
+        // Expected on headless Mesa, which exposes no RGBA8 configs
+        ALOGD("No matching EGL config, continuing configless");
+        mConfig = EGL_NO_CONFIG_KHR;
+    } else {
+        LogEglConfig(mDisplay, mConfig);
     }
 
-    LogEglConfig(mDisplay, mConfig);
-
     if (eglBindAPI(EGL_OPENGL_ES_API) == EGL_FALSE) {
         ALOGE("eglBindAPI failed: %s", EglErrorToString(eglGetError()));
         return -4;
@@ -190,27 +322,63 @@ int32_t EglContext::Init() {
             EGL_NONE
     };
 
-    mContext = eglCreateContext(mDisplay, mConfig, EGL_NO_CONTEXT, contextAttribs);
+    const EGLConfig contextConfig = mCreationStats.mIsNoConfig ? EGL_NO_CONFIG_KHR : mConfig;
+    mContext = eglCreateContext(mDisplay, contextConfig, EGL_NO_CONTEXT, contextAttribs);
+    if (mContext == EGL_NO_CONTEXT && contextConfig == EGL_NO_CONFIG_KHR && mConfig != EGL_NO_CONFIG_KHR) {
+        // Some drivers advertise the extension but reject it for ES3
+        ALOGW("Configless eglCreateContext failed (%s), retrying with config",
+              EglErrorToString(eglGetError()));
+        mCreationStats.mIsNoConfig = false;
+        mContext = eglCreateContext(mDisplay, mConfig, EGL_NO_CONTEXT, contextAttribs);
+    }
     if (mContext == EGL_NO_CONTEXT) {
         ALOGE("eglCreateContext failed: %s", EglErrorToString(eglGetError()));
         return -5;
     }
 
-    const EGLint surfaceAttribs[] = {
-            EGL_WIDTH, 16,
-            EGL_HEIGHT, 16,
-            EGL_NONE
-    };
+    if (!mCreationStats.mIsSurfaceless) {
+        const EGLint surfaceAttribs[] = {
+                EGL_WIDTH, 16,
+                EGL_HEIGHT, 16,
+                EGL_NONE
+        };
 
-    mDummySurface = eglCreatePbufferSurface(mDisplay, mConfig, surfaceAttribs);
-    if (mDummySurface == EGL_NO_SURFACE) {
-        ALOGE("eglCreatePbufferSurface failed: %s", EglErrorToString(eglGetError()));
-        return -6;
+        mDummySurface = eglCreatePbufferSurface(mDisplay, mConfig, surfaceAttribs);
+        if (mDummySurface == EGL_NO_SURFACE) {
+            ALOGE("eglCreatePbufferSurface failed: %s", EglErrorToString(eglGetError()));
+            return -6;
+        }
     }
 
     if (eglMakeCurrent(mDisplay, mDummySurface, mDummySurface, mContext) == EGL_FALSE) {
-        ALOGE("Initial eglMakeCurrent failed: %s", EglErrorToString(eglGetError()));
-        return -7;
+        if (mDummySurface != EGL_NO_SURFACE) {
+            ALOGE("Initial eglMakeCurrent failed: %s", EglErrorToString(eglGetError()));
+            return -7;
+        }
+        // Some drivers advertise surfaceless contexts but won't bind one
+        ALOGW("Surfaceless eglMakeCurrent failed (%s), falling back to a pbuffer",
+              EglErrorToString(eglGetError()));
+        mCreationStats.mIsSurfaceless = false;
+
+        EGLConfig surfaceConfig = mConfig;
+        if (surfaceConfig == EGL_NO_CONFIG_KHR && !ChoosePbufferConfig(mDisplay, surfaceConfig)) {
+            ALOGE("No EGL config for a fallback pbuffer");
+            return -7;
+        }
+        const EGLint surfaceAttribs[] = {
+                EGL_WIDTH, 1,
+                EGL_HEIGHT, 1,
+                EGL_NONE
+        };
+        mDummySurface = eglCreatePbufferSurface(mDisplay, surfaceConfig, surfaceAttribs);
+        if (mDummySurface == EGL_NO_SURFACE) {
+            ALOGE("Fallback eglCreatePbufferSurface failed: %s", EglErrorToString(eglGetError()));
+            return -7;
+        }
+        if (eglMakeCurrent(mDisplay, mDummySurface, mDummySurface, mContext) == EGL_FALSE) {
+            ALOGE("Initial eglMakeCurrent failed: %s", EglErrorToString(eglGetError()));
+            return -7;
+        }
     }
 
     const GLubyte* glVersion = glGetString(GL_VERSION);
@@ -218,6 +386,14 @@ int32_t EglContext::Init() {
         ALOGV("OpenGL ES version: %s", (const char*)glVersion);
     }
 
+    const int64_t endRssKb = GetResidentSetKb();
+    mCreationStats.mDurationMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - startTime).count();
+    mCreationStats.mRssDeltaKb = (startRssKb >= 0 && endRssKb >= 0) ? endRssKb - startRssKb : 0;
+    ALOGI("EGL context created in %.2f ms, RSS +%lld KiB (surfaceless=%d, no_config=%d)",
+          mCreationStats.mDurationMs, static_cast<long long>(mCreationStats.mRssDeltaKb),
+          mCreationStats.mIsSurfaceless, mCreationStats.mIsNoConfig);
+
     return 0;
 }
 
@@ -15,18 +15,49 @@ License     :   Licensed under GPLv3 or any later version.
 #include <GLES3/gl3.h>
 #include <GLES3/gl3ext.h>
 
+#include <cstdint>
+
 /**
  * EglContext - RAII wrapper for EGL rendering context
  *
  * This class manages the lifecycle of an EGL context for OpenGL ES rendering.
  * It automatically creates and destroys the necessary EGL resources.
+ *
+ * Where the driver exposes EGL_KHR_surfaceless_context the context is made
+ * current without any surface, and EGL_KHR_no_config_context is used to avoid
+ * binding the context to a config. A pbuffer is only created as a fallback,
+ * including when the driver advertises surfaceless contexts but won't bind one.
  */
 class EglContext {
 public:
+    /**
+     * Which EGL platform the display is obtained from.
+     *
+     * DEFAULT  - eglGetDisplay(EGL_DEFAULT_DISPLAY); the Android display on device.
+     * HEADLESS - no window system. Uses EGL_MESA_platform_surfaceless or
+     *            EGL_EXT_platform_device when present (Linux hosts, e.g. Mesa
+     *            software GL on build machines), otherwise falls back to DEFAULT.
+     */
+    enum class Platform {
+        DEFAULT,
+        HEADLESS
+    };
+
+    /**
+     * Stats gathered while creating the context
+     */
+    struct CreationStats {
+        double  mDurationMs      = 0.0;   // wall time spent in Init()
+        int64_t mRssDeltaKb      = 0;     // resident set growth across Init()
+        bool    mIsSurfaceless   = false; // no dummy surface was created
+        bool    mIsNoConfig      = false; // context created with EGL_NO_CONFIG_KHR
+    };
+
     /**
      * Constructor - Creates an EGL context suitable for use with OpenXR
+     * @param platform EGL platform to create the display on
      */
-    EglContext();
+    explicit EglContext(Platform platform = Platform::DEFAULT);
 
     /**
      * Destructor - Cleans up all EGL resources
@@ -51,6 +82,11 @@ public:
      */
     bool ReleaseCurrent();
 
+    /**
+     * @return timing/memory stats recorded when the context was created
+     */
+    const CreationStats& GetCreationStats() const { return mCreationStats; }
+
     // EGL handles
     EGLDisplay mDisplay = EGL_NO_DISPLAY;
     EGLConfig  mConfig  = 0;
@@ -58,10 +94,12 @@ public:
 
 private:
     // Private implementation
-    int32_t Init();
+    int32_t Init(Platform platform);
     void    Shutdown();
 
-    // Dummy surface for context creation
-    // (needed because OpenGL ES doesn't support surfaceless contexts on all platforms)
+    // Dummy surface for context creation. Only used when the driver lacks
+    // EGL_KHR_surfaceless_context; EGL_NO_SURFACE otherwise.
     EGLSurface mDummySurface = EGL_NO_SURFACE;
-};
\ No newline at end of file
+
+    CreationStats mCreationStats;
+};
@@ -0,0 +1,166 @@
+/*******************************************************************************
+
+Filename    :   FoveationController.cpp
+Content     :   Fixed foveated rendering for the eye swapchains, with the
+                level driven by GPU load
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "FoveationController.h"
+#include "../utils/LogUtils.h"
+
+namespace {
+    // Weight of each new GPU frame time sample
+    constexpr float kLoadSmoothing = 0.1f;
+    // Frames at a level before it may go up, or down; going down is slower
+    // so a level change that fixes the load is not immediately undone
+    constexpr uint32_t kMinFramesBeforeRaise = 30;
+    constexpr uint32_t kMinFramesBeforeLower = 180;
+
+    constexpr const char* kGpuFrameTimeCounter = "/perfmetrics_meta/app/gpu_frametime";
+
+    const char* LevelName(const XrFoveationLevelFB level) {
+        switch (level) {
+            case XR_FOVEATION_LEVEL_NONE_FB:   return "none";
+            case XR_FOVEATION_LEVEL_LOW_FB:    return "low";
+            case XR_FOVEATION_LEVEL_MEDIUM_FB: return "medium";
+            case XR_FOVEATION_LEVEL_HIGH_FB:   return "high";
+            default:                           return "unknown";
+        }
+    }
+} // anonymous namespace
+
+FoveationController::~FoveationController() {
+    Shutdown();
+}
+
+bool FoveationController::Init(const OpenXr& xr) {
+    Shutdown();
+    if (!xr.IsExtensionEnabled(XR_FB_SWAPCHAIN_UPDATE_STATE_EXTENSION_NAME) ||
+        !xr.IsExtensionEnabled(XR_FB_FOVEATION_EXTENSION_NAME) ||
+        !xr.IsExtensionEnabled(XR_FB_FOVEATION_CONFIGURATION_EXTENSION_NAME)) {
+        ALOGD("FoveationController: foveation extensions unavailable, rendering at full rate");
+        return false;
+    }
+    mSession = xr.mSession;
+
+    OXR(xrGetInstanceProcAddr(xr.mInstance, "xrCreateFoveationProfileFB",
+                              (PFN_xrVoidFunction *) (&mCreateFoveationProfile)));
+    OXR(xrGetInstanceProcAddr(xr.mInstance, "xrDestroyFoveationProfileFB",
+                              (PFN_xrVoidFunction *) (&mDestroyFoveationProfile)));
+    OXR(xrGetInstanceProcAddr(xr.mInstance, "xrUpdateSwapchainFB",
+                              (PFN_xrVoidFunction *) (&mUpdateSwapchain)));
+
+    // The level is ours to pick, so the runtime is not allowed to lower it
+    for (uint32_t level = XR_FOVEATION_LEVEL_NONE_FB; level <= MAX_LEVEL; level++) {
+        XrFoveationLevelProfileCreateInfoFB levelInfo = {
+                XR_TYPE_FOVEATION_LEVEL_PROFILE_CREATE_INFO_FB};
+        levelInfo.level = static_cast<XrFoveationLevelFB>(level);
+        levelInfo.verticalOffset = 0.0f;
+        levelInfo.dynamic = XR_FOVEATION_DYNAMIC_DISABLED_FB;
+        XrFoveationProfileCreateInfoFB profileInfo = {XR_TYPE_FOVEATION_PROFILE_CREATE_INFO_FB};
+        profileInfo.next = &levelInfo;
+        OXR(mCreateFoveationProfile(mSession, &profileInfo, &mProfiles[level]));
+    }
+
+    // GPU load is optional; without it the level stays at MIN_LEVEL
+    if (xr.IsExtensionEnabled(XR_META_PERFORMANCE_METRICS_EXTENSION_NAME)) {
+        PFN_xrSetPerformanceMetricsStateMETA setPerformanceMetricsState = nullptr;
+        OXR(xrGetInstanceProcAddr(xr.mInstance, "xrSetPerformanceMetricsStateMETA",
+                                  (PFN_xrVoidFunction *) (&setPerformanceMetricsState)));
+        OXR(xrGetInstanceProcAddr(xr.mInstance, "xrQueryPerformanceMetricsCounterMETA",
+                                  (PFN_xrVoidFunction *) (&mQueryPerformanceCounter)));
+        XrPerformanceMetricsStateMETA state = {XR_TYPE_PERFORMANCE_METRICS_STATE_META};
+        state.enabled = XR_TRUE;
+        OXR(setPerformanceMetricsState(mSession, &state));
+        OXR(xrStringToPath(xr.mInstance, kGpuFrameTimeCounter, &mGpuFrameTimePath));
+    } else {
+        ALOGW("FoveationController: no performance metrics, foveation fixed at %s",
+              LevelName(MIN_LEVEL));
+    }
+
+    mEnabled = true;
+    mLevel = MIN_LEVEL;
+    mApplied = false;
+    mGpuLoad = 0.0f;
+    mFramesSinceChange = 0;
+    return true;
+}
+
+void FoveationController::Shutdown() {
+    for (XrFoveationProfileFB& profile : mProfiles) {
+        if (profile != XR_NULL_HANDLE) {
+            mDestroyFoveationProfile(profile);
+            profile = XR_NULL_HANDLE;
+        }
+    }
+    mEnabled = false;
+    mSession = XR_NULL_HANDLE;
+    mQueryPerformanceCounter = nullptr;
+    mGpuFrameTimePath = XR_NULL_PATH;
+}
+
+bool FoveationController::SampleGpuLoad(const XrDuration displayPeriod) {
+    if (mQueryPerformanceCounter == nullptr || displayPeriod <= 0) {
+        return false;
+    }
+    XrPerformanceMetricsCounterMETA counter = {XR_TYPE_PERFORMANCE_METRICS_COUNTER_META};
+    if (XR_FAILED(mQueryPerformanceCounter(mSession, mGpuFrameTimePath, &counter)) ||
+        (counter.counterFlags & XR_PERFORMANCE_METRICS_COUNTER_FLOAT_VALUE_VALID_BIT_META) == 0 ||
+        counter.counterUnit != XR_PERFORMANCE_METRICS_COUNTER_UNIT_MILLISECONDS_META) {
+        return false;
+    }
+    const float periodMs = static_cast<float>(displayPeriod) * 1e-6f;
+    const float load = counter.floatValue / periodMs;
+    mGpuLoad = mGpuLoad > 0.0f ? mGpuLoad + (load - mGpuLoad) * kLoadSmoothing : load;
+    return true;
+}
+
+void FoveationController::Update(const XrDuration displayPeriod, const XrSwapchain* swapchains,
+                                 const uint32_t count) {
+    if (!mEnabled) {
+        return;
+    }
+
+    mFramesSinceChange++;
+    if (SampleGpuLoad(displayPeriod)) {
+        XrFoveationLevelFB next = mLevel;
+        if (mGpuLoad > RAISE_LOAD && mLevel < MAX_LEVEL &&
+            mFramesSinceChange >= kMinFramesBeforeRaise) {
+            next = static_cast<XrFoveationLevelFB>(mLevel + 1);
+        } else if (mGpuLoad < LOWER_LOAD && mLevel > MIN_LEVEL &&
+                   mFramesSinceChange >= kMinFramesBeforeLower) {
+            next = static_cast<XrFoveationLevelFB>(mLevel - 1);
+        }
+        if (next != mLevel) {
+            ALOGD("FoveationController: GPU load %.2f, foveation %s -> %s", mGpuLoad,
+                  LevelName(mLevel), LevelName(next));
+            mLevel = next;
+            mFramesSinceChange = 0;
+        }
+    }
+
+    // A failed update is logged, not retried every frame
+    if (!mApplied || mAppliedLevel != mLevel) {
+        Apply(mLevel, swapchains, count);
+        mApplied = true;
+        mAppliedLevel = mLevel;
+    }
+}
+
+void FoveationController::Apply(const XrFoveationLevelFB level, const XrSwapchain* swapchains,
+                                const uint32_t count) {
+    XrSwapchainStateFoveationFB state = {XR_TYPE_SWAPCHAIN_STATE_FOVEATION_FB};
+    state.flags = 0;
+    state.profile = mProfiles[level];
+    for (uint32_t i = 0; i < count; i++) {
+        const XrResult result = mUpdateSwapchain(
+                swapchains[i], reinterpret_cast<const XrSwapchainStateBaseHeaderFB*>(&state));
+        if (XR_FAILED(result)) {
+            ALOGE("FoveationController: xrUpdateSwapchainFB failed (%d)", result);
+        }
+    }
+}
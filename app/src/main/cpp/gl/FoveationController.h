@@ -0,0 +1,99 @@
+/*******************************************************************************
+
+Filename    :   FoveationController.h
+Content     :   Fixed foveated rendering for the eye swapchains, with the
+                level driven by GPU load
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../OpenXR.h"
+
+#include <array>
+#include <cstdint>
+
+/**
+ * FoveationController - applies XR_FB_foveation profiles to the eye
+ * swapchains and raises or lowers the level with GPU load.
+ *
+ * Our lenses blur the periphery, so even an idle GPU keeps MIN_LEVEL.
+ * GPU frame time comes from XR_META_performance_metrics and is smoothed
+ * against the display period. Above RAISE_LOAD the level goes up; below
+ * LOWER_LOAD, and after a longer wait, it comes back down. The gap between
+ * the two is wider than one level's savings, so the level does not pulse.
+ * Without performance metrics the level stays at MIN_LEVEL.
+ *
+ * Eye swapchains must be created with foveation chained in (see
+ * Framebuffer::Create()), and only passes that render straight into the
+ * swapchain texture are foveated; an MSAA target resolved into it by a
+ * blit is not.
+ *
+ * Everything no-ops if the runtime lacks XR_FB_swapchain_update_state,
+ * XR_FB_foveation or XR_FB_foveation_configuration.
+ */
+class FoveationController {
+public:
+    static constexpr XrFoveationLevelFB MIN_LEVEL = XR_FOVEATION_LEVEL_LOW_FB;
+    static constexpr XrFoveationLevelFB MAX_LEVEL = XR_FOVEATION_LEVEL_HIGH_FB;
+    // GPU frame time as a fraction of the display period
+    static constexpr float RAISE_LOAD = 0.9f;
+    static constexpr float LOWER_LOAD = 0.7f;
+
+    FoveationController() = default;
+    ~FoveationController();
+
+    FoveationController(const FoveationController&) = delete;
+    FoveationController& operator=(const FoveationController&) = delete;
+
+    /**
+     * Load entry points and create a profile per level. Returns false, and
+     * leaves foveation off, if the extensions are not enabled on @p xr.
+     */
+    bool Init(const OpenXr& xr);
+    void Shutdown();
+
+    bool IsEnabled() const { return mEnabled; }
+
+    /**
+     * Sample GPU load and apply the resulting level to @p swapchains if it
+     * differs from what they have. Call once per frame, after xrWaitFrame().
+     *
+     * @param displayPeriod From XrFrameState::predictedDisplayPeriod
+     */
+    void Update(XrDuration displayPeriod, const XrSwapchain* swapchains, uint32_t count);
+
+    // The swapchains were replaced; the next Update() applies the level again
+    void InvalidateSwapchains() { mApplied = false; }
+
+    // XR_FOVEATION_LEVEL_NONE_FB while disabled
+    XrFoveationLevelFB GetLevel() const { return mEnabled ? mLevel : XR_FOVEATION_LEVEL_NONE_FB; }
+    // Smoothed GPU frame time over display period; 0 without performance metrics
+    float GetGpuLoad() const { return mGpuLoad; }
+
+private:
+    bool SampleGpuLoad(XrDuration displayPeriod);
+    void Apply(XrFoveationLevelFB level, const XrSwapchain* swapchains, uint32_t count);
+
+    bool mEnabled = false;
+    XrSession mSession = XR_NULL_HANDLE;
+
+    PFN_xrCreateFoveationProfileFB mCreateFoveationProfile = nullptr;
+    PFN_xrDestroyFoveationProfileFB mDestroyFoveationProfile = nullptr;
+    PFN_xrUpdateSwapchainFB mUpdateSwapchain = nullptr;
+    PFN_xrQueryPerformanceMetricsCounterMETA mQueryPerformanceCounter = nullptr;
+    XrPath mGpuFrameTimePath = XR_NULL_PATH;
+
+    // Indexed by XrFoveationLevelFB
+    std::array<XrFoveationProfileFB, MAX_LEVEL + 1> mProfiles = {};
+
+    XrFoveationLevelFB mLevel = MIN_LEVEL;
+    // What the swapchains were last given, once anything has been
+    bool mApplied = false;
+    XrFoveationLevelFB mAppliedLevel = XR_FOVEATION_LEVEL_NONE_FB;
+    float mGpuLoad = 0.0f;
+    uint32_t mFramesSinceChange = 0;
+};
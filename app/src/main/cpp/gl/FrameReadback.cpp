@@ -0,0 +1,244 @@
+/*******************************************************************************
+
+Filename    :   FrameReadback.cpp
+Content     :   Asynchronous eye-buffer readback through a ring of pixel-pack
+                buffers, delivered to a consumer on a background thread
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "FrameReadback.h"
+#include "ResourcePool.h"
+#include "../utils/LogUtils.h"
+
+#include <sys/prctl.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+    constexpr GLsizei kBytesPerPixel = 4;
+} // anonymous namespace
+
+FrameReadback::~FrameReadback() {
+    Shutdown();
+}
+
+bool FrameReadback::Init(const GLenum format, const GLsizei maxWidth, const GLsizei maxHeight,
+                         Consumer consumer) {
+    Shutdown();
+    mFormat = format;
+    mMaxWidth = maxWidth;
+    mMaxHeight = maxHeight;
+
+    // Blitting into the same format as the source copies the encoded values,
+    // so sRGB eye buffers read back as sRGB bytes
+    glGenRenderbuffers(1, &mStagingColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, mStagingColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, format, maxWidth, maxHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &mStagingFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, mStagingFbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              mStagingColor);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glGenFramebuffers(1, &mReadFbo);
+
+    const GLsizeiptr slotBytes = static_cast<GLsizeiptr>(maxWidth) * maxHeight * kBytesPerPixel;
+    for (Slot& slot : mSlots) {
+        glGenBuffers(1, &slot.mBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.mBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, slotBytes, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    const GLenum error = glGetError();
+    if (status != GL_FRAMEBUFFER_COMPLETE || error != GL_NO_ERROR) {
+        ALOGE("FrameReadback: staging target incomplete (0x%x) or GL error 0x%x", status, error);
+        Shutdown();
+        return false;
+    }
+
+    mConsumer = std::move(consumer);
+    mStopping = false;
+    mConsumerThread = std::thread(&FrameReadback::ConsumerLoop, this);
+    ALOGD("FrameReadback: %u x %lld byte pixel-pack ring, up to %dx%d", RING_SIZE,
+          static_cast<long long>(slotBytes), maxWidth, maxHeight);
+    return true;
+}
+
+void FrameReadback::Shutdown() {
+    if (mConsumerThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_one();
+        mConsumerThread.join();
+    }
+    mQueued.clear();
+    mFreeImages.clear();
+    mConsumer = nullptr;
+
+    for (Slot& slot : mSlots) {
+        if (slot.mFence != nullptr) {
+            glDeleteSync(slot.mFence);
+        }
+        if (slot.mBuffer != 0) {
+            glDeleteBuffers(1, &slot.mBuffer);
+        }
+        slot = {};
+    }
+    mOldest = 0;
+    mInFlight = 0;
+
+    if (mReadFbo != 0) {
+        glDeleteFramebuffers(1, &mReadFbo);
+        mReadFbo = 0;
+    }
+    if (mStagingFbo != 0) {
+        glDeleteFramebuffers(1, &mStagingFbo);
+        mStagingFbo = 0;
+    }
+    if (mStagingColor != 0) {
+        glDeleteRenderbuffers(1, &mStagingColor);
+        mStagingColor = 0;
+    }
+}
+
+bool FrameReadback::Capture(const GLuint texture, const GLint x, const GLsizei width,
+                            const GLsizei height, const uint32_t downscale,
+                            const uint64_t frameIndex, const uint32_t tag) {
+    if (!IsInitialized() || width > mMaxWidth || height > mMaxHeight || downscale == 0) {
+        return false;
+    }
+    if (mInFlight == RING_SIZE) {
+        mStats.mSkippedBusy++;
+        return false;
+    }
+    Slot& slot = mSlots[(mOldest + mInFlight) % RING_SIZE];
+    slot.mFrameIndex = frameIndex;
+    slot.mTag = tag;
+    slot.mWidth = std::max<GLsizei>(width / static_cast<GLsizei>(downscale), 1);
+    slot.mHeight = std::max<GLsizei>(height / static_cast<GLsizei>(downscale), 1);
+
+    // Scale into the staging target, then start the copy into the slot's
+    // buffer; with a pack buffer bound glReadPixels() returns immediately
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mReadFbo);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mStagingFbo);
+    glBlitFramebuffer(x, 0, x + width, height, 0, 0, slot.mWidth, slot.mHeight,
+                      GL_COLOR_BUFFER_BIT, downscale > 1 ? GL_LINEAR : GL_NEAREST);
+    // Don't keep a swapchain image attached past this frame
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mStagingFbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.mBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, slot.mWidth, slot.mHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    slot.mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mInFlight++;
+    mStats.mCaptured++;
+    return true;
+}
+
+void FrameReadback::Poll() {
+    while (mInFlight > 0) {
+        Slot& slot = mSlots[mOldest];
+        // Zero timeout: only ask, never wait
+        const GLenum result = glClientWaitSync(slot.mFence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        glDeleteSync(slot.mFence);
+        slot.mFence = nullptr;
+
+        Image image;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mFreeImages.empty()) {
+                image = std::move(mFreeImages.back());
+                mFreeImages.pop_back();
+            }
+        }
+        const size_t bytes = static_cast<size_t>(slot.mWidth) * slot.mHeight * kBytesPerPixel;
+        image.mFrameIndex = slot.mFrameIndex;
+        image.mTag = slot.mTag;
+        image.mWidth = static_cast<uint32_t>(slot.mWidth);
+        image.mHeight = static_cast<uint32_t>(slot.mHeight);
+        image.mPixels.resize(bytes);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.mBuffer);
+        const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                              static_cast<GLsizeiptr>(bytes), GL_MAP_READ_BIT);
+        const bool copied = mapped != nullptr;
+        if (copied) {
+            memcpy(image.mPixels.data(), mapped, bytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            ALOGW("FrameReadback: mapping frame %llu failed: 0x%x",
+                  static_cast<unsigned long long>(slot.mFrameIndex), glGetError());
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        mOldest = (mOldest + 1) % RING_SIZE;
+        mInFlight--;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!copied) {
+            mFreeImages.push_back(std::move(image));
+            continue;
+        }
+        if (mQueued.size() == MAX_QUEUED) {
+            mFreeImages.push_back(std::move(mQueued.front()));
+            mQueued.pop_front();
+            mStats.mDroppedBehind++;
+        }
+        mQueued.push_back(std::move(image));
+        mWake.notify_one();
+    }
+}
+
+GpuMemoryUsage FrameReadback::GetGpuMemory() const {
+    GpuMemoryUsage usage;
+    if (!IsInitialized()) {
+        return usage;
+    }
+    const GpuResourceDesc staging = GpuResourceDesc::Renderbuffer(mFormat, mMaxWidth, mMaxHeight);
+    usage.Add(staging.GetMemoryCategory(), staging.GetSizeBytes());
+    usage.Add(GpuMemoryCategory::BUFFER, uint64_t{RING_SIZE} * mMaxWidth * mMaxHeight *
+                                         kBytesPerPixel);
+    return usage;
+}
+
+FrameReadback::Stats FrameReadback::GetStats() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+void FrameReadback::ConsumerLoop() {
+    prctl(PR_SET_NAME, (long) "VR::Readback", 0, 0, 0);
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+        mWake.wait(lock, [this] { return mStopping || !mQueued.empty(); });
+        if (mStopping) {
+            return;
+        }
+        Image image = std::move(mQueued.front());
+        mQueued.pop_front();
+
+        lock.unlock();
+        mConsumer(image);
+        lock.lock();
+
+        mStats.mDelivered++;
+        mFreeImages.push_back(std::move(image));
+    }
+}
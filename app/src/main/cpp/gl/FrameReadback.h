@@ -0,0 +1,157 @@
+/*******************************************************************************
+
+Filename    :   FrameReadback.h
+Content     :   Asynchronous eye-buffer readback through a ring of pixel-pack
+                buffers, delivered to a consumer on a background thread
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../utils/GpuMemory.h"
+
+#include <GLES3/gl3.h>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * FrameReadback - gets rendered frames off the GPU without stalling it.
+ *
+ * Capture() blits one eye of a resolved color texture, optionally scaled
+ * down, into a staging renderbuffer and starts a glReadPixels() into the
+ * next free pixel-pack buffer in a ring, followed by a fence. Nothing waits:
+ * Poll() checks the fences a frame or more later, maps only the buffers the
+ * GPU has finished, copies them out and hands the images to a consumer
+ * thread, which calls the Consumer (write a file, stream to a socket, ...)
+ * off the render thread.
+ *
+ * The per-frame GPU cost is bounded by construction: at most one capture
+ * per Capture() call, never larger than the size given to Init(), and none
+ * at all while every ring slot is still in flight. If the consumer falls
+ * behind, the oldest undelivered image is dropped rather than letting the
+ * queue grow.
+ *
+ * Images are RGBA8 in the eye buffer's encoding (sRGB for sRGB swapchains),
+ * rows bottom to top as GL reads them. All methods but the Consumer run on
+ * the thread that owns the GL context.
+ */
+class FrameReadback {
+public:
+    static constexpr uint32_t RING_SIZE = 3;
+    // Images waiting for the consumer before the oldest is dropped
+    static constexpr uint32_t MAX_QUEUED = 2;
+
+    struct Image {
+        uint64_t mFrameIndex = 0;
+        // Caller-defined, passed through from Capture()
+        uint32_t mTag = 0;
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        std::vector<uint8_t> mPixels;
+    };
+    using Consumer = std::function<void(const Image& image)>;
+
+    struct Stats {
+        uint64_t mCaptured = 0;
+        uint64_t mDelivered = 0;
+        // Capture() calls refused because every slot was in flight
+        uint64_t mSkippedBusy = 0;
+        // Images dropped because the consumer was behind
+        uint64_t mDroppedBehind = 0;
+    };
+
+    FrameReadback() = default;
+    ~FrameReadback();
+
+    FrameReadback(const FrameReadback&) = delete;
+    FrameReadback& operator=(const FrameReadback&) = delete;
+
+    /**
+     * Allocate the staging target and ring and start the consumer thread.
+     * Requires a current GL context.
+     *
+     * @param format    Color format of the textures that will be captured
+     * @param maxWidth  Largest region Capture() will be asked for, before scaling
+     * @param maxHeight
+     * @param consumer  Called on the consumer thread for every delivered image
+     */
+    bool Init(GLenum format, GLsizei maxWidth, GLsizei maxHeight, Consumer consumer);
+
+    /**
+     * Drop in-flight captures, deliver nothing further, and join the consumer.
+     * Requires the context used in Init() to be current.
+     */
+    void Shutdown();
+
+    bool IsInitialized() const { return mReadFbo != 0; }
+    // As given to Init()
+    GLenum GetFormat() const { return mFormat; }
+    GLsizei GetMaxWidth() const { return mMaxWidth; }
+    GLsizei GetMaxHeight() const { return mMaxHeight; }
+
+    /**
+     * Start reading back columns [x, x + width) and rows [0, height) of
+     * @p texture, a single-sample 2D color texture, scaled down by
+     * @p downscale. Call after the passes that write it are submitted.
+     *
+     * @return false if no ring slot is free or the region is too large
+     */
+    bool Capture(GLuint texture, GLint x, GLsizei width, GLsizei height, uint32_t downscale,
+                 uint64_t frameIndex, uint32_t tag = 0);
+
+    /**
+     * Copy out every capture the GPU has finished, oldest first. Never
+     * blocks on the GPU; call once per frame.
+     */
+    void Poll();
+
+    Stats GetStats() const;
+    // Staging target and pixel-pack ring
+    GpuMemoryUsage GetGpuMemory() const;
+
+private:
+    struct Slot {
+        GLuint mBuffer = 0;
+        GLsync mFence = nullptr;
+        uint64_t mFrameIndex = 0;
+        uint32_t mTag = 0;
+        GLsizei mWidth = 0;
+        GLsizei mHeight = 0;
+    };
+
+    void ConsumerLoop();
+
+    GLenum mFormat = 0;
+    GLsizei mMaxWidth = 0;
+    GLsizei mMaxHeight = 0;
+    GLuint mReadFbo = 0;
+    GLuint mStagingFbo = 0;
+    GLuint mStagingColor = 0;
+
+    // In flight in submission order, starting at mOldest
+    std::array<Slot, RING_SIZE> mSlots = {};
+    uint32_t mOldest = 0;
+    uint32_t mInFlight = 0;
+    // mDelivered is guarded by mMutex, the rest are render-thread only
+    Stats mStats;
+
+    // Guarded by mMutex
+    mutable std::mutex mMutex;
+    std::condition_variable mWake;
+    std::deque<Image> mQueued;
+    std::vector<Image> mFreeImages;
+    bool mStopping = false;
+
+    Consumer mConsumer;
+    std::thread mConsumerThread;
+};
@@ -10,6 +10,7 @@ License     :   Licensed under GPLv3 or any later version.
 
 #include "Framebuffer.h"
 #include "FramebufferValidation.h"
+#include <utility>
 #include <vector>
 
 //  pointer types for the OpenGL extension s we need
@@ -91,7 +92,10 @@ namespace {
 } // anonymous namespace
 
 Framebuffer::Framebuffer()
-        : mWidth(0)
+        : mPool(nullptr)
+        , mColorFormat(0)
+        , mDepthSamples(0)
+        , mWidth(0)
         , mHeight(0)
         , mMultisamples(0)
         , mUseMultiview(false)
@@ -100,17 +104,49 @@ Framebuffer::Framebuffer()
 {
 }
 
+Framebuffer::Framebuffer(Framebuffer&& other) noexcept : Framebuffer() {
+    *this = std::move(other);
+}
+
+Framebuffer& Framebuffer::operator=(Framebuffer&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    // Handles must end up with exactly one owner, or both would destroy them
+    Destroy();
+    mPool = std::exchange(other.mPool, nullptr);
+    mColorFormat = std::exchange(other.mColorFormat, 0);
+    mDepthSamples = std::exchange(other.mDepthSamples, 0);
+    mWidth = std::exchange(other.mWidth, 0);
+    mHeight = std::exchange(other.mHeight, 0);
+    mMultisamples = std::exchange(other.mMultisamples, 0);
+    mUseMultiview = std::exchange(other.mUseMultiview, false);
+    mTextureSwapChainLength = std::exchange(other.mTextureSwapChainLength, 0);
+    mTextureSwapChainIndex = std::exchange(other.mTextureSwapChainIndex, 0);
+    mColorSwapChain = std::exchange(other.mColorSwapChain, {});
+    mColorSwapChainImages = std::exchange(other.mColorSwapChainImages, {});
+    mDepthBuffers = std::exchange(other.mDepthBuffers, {});
+    mFrameBuffers = std::exchange(other.mFrameBuffers, {});
+    mMsaaColorBuffers = std::exchange(other.mMsaaColorBuffers, {});
+    return *this;
+}
+
 Framebuffer::~Framebuffer() {
     Destroy();
 }
 
-bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int height, int multisamples, bool useMultiview) {
+bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int height, int multisamples,
+                         bool useMultiview, GpuResourcePool* pool, bool createRenderTargets,
+                         bool foveated) {
     ALOGD("Creating framebuffer: %dx%d, multisamples=%d, multiview=%d, format=0x%x",
           width, height, multisamples, useMultiview, colorFormat);
 
+    mPool = pool;
+    mColorFormat = colorFormat;
     mWidth = width;
     mHeight = height;
     mMultisamples = multisamples;
+    mDepthSamples = multisamples > 1 ? multisamples : 0;
     mUseMultiview = useMultiview;
 
     // Load extension s if needed
@@ -179,6 +215,11 @@ bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int h
     sci.arraySize = mUseMultiview ? 2 : 1;
     sci.mipCount = 1;
 
+    XrSwapchainCreateInfoFoveationFB foveationInfo{XR_TYPE_SWAPCHAIN_CREATE_INFO_FOVEATION_FB};
+    if (foveated) {
+        sci.next = &foveationInfo;
+    }
+
     mColorSwapChain.mWidth = width;
     mColorSwapChain.mHeight = height;
     OXR(xrCreateSwapchain(session, &sci, &mColorSwapChain.mHandle));
@@ -190,9 +231,11 @@ bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int h
             &mTextureSwapChainLength,
             reinterpret_cast<XrSwapchainImageBaseHeader*>(mColorSwapChainImages.data())));
 
-    mDepthBuffers.resize(mTextureSwapChainLength, 0);
-    mFrameBuffers.resize(mTextureSwapChainLength, 0);
-    mMsaaColorBuffers.resize(mTextureSwapChainLength, 0);
+    if (createRenderTargets) {
+        mDepthBuffers.resize(mTextureSwapChainLength, 0);
+        mFrameBuffers.resize(mTextureSwapChainLength, 0);
+        mMsaaColorBuffers.resize(mTextureSwapChainLength, 0);
+    }
 
     ALOGD("Creating %d framebuffers with swapchain textures", mTextureSwapChainLength);
 
@@ -225,18 +268,28 @@ bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int h
             GL(glBindTexture(GL_TEXTURE_2D, 0));
         }
 
-        // Create depth buffer
-        GL(glGenRenderbuffers(1, &mDepthBuffers[i]));
-        GL(glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffers[i]));
+        if (!createRenderTargets) {
+            continue;
+        }
 
-        if (mMultisamples > 1 && glRenderbufferStorageMultisampleEXT != nullptr) {
-            ALOGD("Creating multisampled depth buffer: samples=%d", mMultisamples);
-            GL(glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, mMultisamples, GL_DEPTH_COMPONENT24, width, height));
+        // Create depth buffer
+        if (mPool != nullptr) {
+            // Pooled renderbuffers use core ES 3.0 multisample storage
+            mDepthBuffers[i] = mPool->Acquire(
+                    GpuResourceDesc::Renderbuffer(GL_DEPTH_COMPONENT24, width, height, mDepthSamples));
         } else {
-            if (mMultisamples > 1 && glRenderbufferStorageMultisampleEXT == nullptr) {
-                ALOGW("glRenderbufferStorageMultisampleEXT missing, falling back to non-multisampled depth");
+            GL(glGenRenderbuffers(1, &mDepthBuffers[i]));
+            GL(glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffers[i]));
+
+            if (mMultisamples > 1 && glRenderbufferStorageMultisampleEXT != nullptr) {
+                ALOGD("Creating multisampled depth buffer: samples=%d", mMultisamples);
+                GL(glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, mMultisamples, GL_DEPTH_COMPONENT24, width, height));
+            } else {
+                if (mMultisamples > 1 && glRenderbufferStorageMultisampleEXT == nullptr) {
+                    ALOGW("glRenderbufferStorageMultisampleEXT missing, falling back to non-multisampled depth");
+                }
+                GL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height));
             }
-            GL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height));
         }
 
         ValidateRenderbufferState(mDepthBuffers[i], "Depth buffer");
@@ -244,7 +297,7 @@ bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int h
         GL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
 
         // Create framebuffer
-        GL(glGenFramebuffers(1, &mFrameBuffers[i]));
+        mFrameBuffers[i] = AcquireFramebufferObject();
         GL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mFrameBuffers[i]));
 
         if (mUseMultiview) {
@@ -256,16 +309,21 @@ bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int h
             if (mMultisamples > 1) {
                 // Key insight #1: We need a multisampled color buffer for MSAA
                 GLuint msaaTex = 0;
-                GL(glGenRenderbuffers(1, &msaaTex));
-                GL(glBindRenderbuffer(GL_RENDERBUFFER, msaaTex));
-
-                // Key insight #2: Use EXT version if available, otherwise regular version
-                if (glRenderbufferStorageMultisampleEXT != nullptr) {
-                    ALOGD("Using glRenderbufferStorageMultisampleEXT for color buffer");
-                    GL(glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, mMultisamples, colorFormat, width, height));
+                if (mPool != nullptr) {
+                    msaaTex = mPool->Acquire(
+                            GpuResourceDesc::Renderbuffer(colorFormat, width, height, mMultisamples));
                 } else {
-                    ALOGD("Using glRenderbufferStorageMultisample for color buffer");
-                    GL(glRenderbufferStorageMultisample(GL_RENDERBUFFER, mMultisamples, colorFormat, width, height));
+                    GL(glGenRenderbuffers(1, &msaaTex));
+                    GL(glBindRenderbuffer(GL_RENDERBUFFER, msaaTex));
+
+                    // Key insight #2: Use EXT version if available, otherwise regular version
+                    if (glRenderbufferStorageMultisampleEXT != nullptr) {
+                        ALOGD("Using glRenderbufferStorageMultisampleEXT for color buffer");
+                        GL(glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, mMultisamples, colorFormat, width, height));
+                    } else {
+                        ALOGD("Using glRenderbufferStorageMultisample for color buffer");
+                        GL(glRenderbufferStorageMultisample(GL_RENDERBUFFER, mMultisamples, colorFormat, width, height));
+                    }
                 }
 
                 ValidateRenderbufferState(msaaTex, "MSAA color buffer");
@@ -304,11 +362,19 @@ bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int h
                           msaaDepthSamples, msaaColorSamples);
 
                     // Fix the sample count mismatch by adjusting the depth buffer
-                    GL(glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffers[i]));
-                    if (glRenderbufferStorageMultisampleEXT != nullptr) {
+                    if (mPool != nullptr) {
+                        // Pooled storage is immutable per descriptor; swap in a matching one
+                        ReleaseRenderbuffer(mDepthBuffers[i], GpuResourceDesc::Renderbuffer(
+                                GL_DEPTH_COMPONENT24, width, height, mDepthSamples));
+                        mDepthSamples = msaaColorSamples;
+                        mDepthBuffers[i] = mPool->Acquire(GpuResourceDesc::Renderbuffer(
+                                GL_DEPTH_COMPONENT24, width, height, mDepthSamples));
+                    } else if (glRenderbufferStorageMultisampleEXT != nullptr) {
+                        GL(glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffers[i]));
                         GL(glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, msaaColorSamples,
                                                                GL_DEPTH_COMPONENT24, width, height));
                     } else {
+                        GL(glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffers[i]));
                         GL(glRenderbufferStorageMultisample(GL_RENDERBUFFER, msaaColorSamples,
                                                             GL_DEPTH_COMPONENT24, width, height));
                     }
@@ -343,6 +409,27 @@ bool Framebuffer::Create(XrSession session, GLenum colorFormat, int width, int h
 }
 
 void Framebuffer::Destroy() {
+    if (mPool != nullptr) {
+        // The GPU may still be reading these from the last frame or two;
+        // the pool holds on to them until that frame's fence signals.
+        const GpuResourceDesc depthDesc =
+                GpuResourceDesc::Renderbuffer(GL_DEPTH_COMPONENT24, mWidth, mHeight, mDepthSamples);
+        const GpuResourceDesc colorDesc =
+                GpuResourceDesc::Renderbuffer(mColorFormat, mWidth, mHeight, mMultisamples);
+        for (const GLuint fbo : mFrameBuffers) {
+            ReleaseFramebufferObject(fbo);
+        }
+        for (const GLuint rb : mDepthBuffers) {
+            ReleaseRenderbuffer(rb, depthDesc);
+        }
+        for (const GLuint rb : mMsaaColorBuffers) {
+            ReleaseRenderbuffer(rb, colorDesc);
+        }
+        mFrameBuffers.clear();
+        mDepthBuffers.clear();
+        mMsaaColorBuffers.clear();
+    }
+
     if (!mFrameBuffers.empty()) {
         GL(glDeleteFramebuffers(mFrameBuffers.size(), mFrameBuffers.data()));
         mFrameBuffers.clear();
@@ -365,6 +452,9 @@ void Framebuffer::Destroy() {
 
     mColorSwapChainImages.clear();
 
+    mPool = nullptr;
+    mColorFormat = 0;
+    mDepthSamples = 0;
     mWidth = 0;
     mHeight = 0;
     mMultisamples = 0;
@@ -375,22 +465,48 @@ void Framebuffer::Destroy() {
     mColorSwapChain.mHeight = 0;
 }
 
-void Framebuffer::Acquire() {
+GpuMemoryUsage Framebuffer::GetGpuMemory() const {
+    GpuMemoryUsage usage;
+    if (mColorSwapChain.mHandle == XR_NULL_HANDLE) {
+        return usage;
+    }
+    // The runtime may pad or compress these; the estimate is the plain size
+    const GpuResourceDesc image = GpuResourceDesc::Texture2DArray(mColorFormat, mWidth, mHeight,
+                                                                  mUseMultiview ? 2 : 1);
+    usage.Add(GpuMemoryCategory::SWAPCHAIN, image.GetSizeBytes() * mTextureSwapChainLength);
+
+    // Pooled render targets are counted by the pool
+    if (mPool == nullptr) {
+        const GpuResourceDesc depth =
+                GpuResourceDesc::Renderbuffer(GL_DEPTH_COMPONENT24, mWidth, mHeight, mDepthSamples);
+        const GpuResourceDesc color =
+                GpuResourceDesc::Renderbuffer(mColorFormat, mWidth, mHeight, mMultisamples);
+        for (const GLuint rb : mDepthBuffers) {
+            usage.Add(depth.GetMemoryCategory(), rb != 0 ? depth.GetSizeBytes() : 0);
+        }
+        for (const GLuint rb : mMsaaColorBuffers) {
+            usage.Add(color.GetMemoryCategory(), rb != 0 ? color.GetSizeBytes() : 0);
+        }
+    }
+    return usage;
+}
+
+void Framebuffer::Acquire(const XrDuration timeout) {
     XrSwapchainImageAcquireInfo acquireInfo{XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
     OXR(xrAcquireSwapchainImage(mColorSwapChain.mHandle, &acquireInfo,
                                 &mTextureSwapChainIndex));
 
     XrSwapchainImageWaitInfo waitInfo{XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO};
-    waitInfo.timeout = 1000000000; // 1 second in nanoseconds
+    waitInfo.timeout = timeout;
 
     XrResult result = xrWaitSwapchainImage(mColorSwapChain.mHandle, &waitInfo);
 
     // Retry a few times if we get a timeout
     int retries = 0;
-    while (result == XR_TIMEOUT_EXPIRED && retries < 3) {
+    while (result == XR_TIMEOUT_EXPIRED && retries + 1 < ACQUIRE_TRIES) {
         result = xrWaitSwapchainImage(mColorSwapChain.mHandle, &waitInfo);
         retries++;
-        ALOGD("Retry %d xrWaitSwapchainImage due to XR_TIMEOUT_EXPIRED", retries);
+        ALOGW("Retry %d xrWaitSwapchainImage due to XR_TIMEOUT_EXPIRED", retries);
     }
 
     if (result != XR_SUCCESS) {
@@ -416,13 +532,17 @@ void Framebuffer::Release() const {
     OXR(xrReleaseSwapchainImage(mColorSwapChain.mHandle, &releaseInfo));
 }
 
+GLuint Framebuffer::GetColorTexture() const {
+    return mTextureSwapChainIndex < mColorSwapChainImages.size()
+           ? mColorSwapChainImages[mTextureSwapChainIndex].image : 0;
+}
+
 void Framebuffer::Resolve() const {
-    if (mMultisamples > 1 && !mUseMultiview) {
+    if (mMultisamples > 1 && !mUseMultiview && !mFrameBuffers.empty()) {
         const GLuint msaaFb = mFrameBuffers[mTextureSwapChainIndex];
 
         // Create and configure a temporary framebuffer for resolving
-        GLuint tempFbo = 0;
-        GL(glGenFramebuffers(1, &tempFbo));
+        const GLuint tempFbo = AcquireFramebufferObject();
         GL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, tempFbo));
 
         // Explicitly attach the swapchain texture to the temp framebuffer
@@ -433,7 +553,7 @@ void Framebuffer::Resolve() const {
         GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
         if (status != GL_FRAMEBUFFER_COMPLETE) {
             ALOGE("Resolve target framebuffer incomplete: 0x%x", status);
-            GL(glDeleteFramebuffers(1, &tempFbo));
+            ReleaseFramebufferObject(tempFbo);
             return;
         }
 
@@ -445,7 +565,7 @@ void Framebuffer::Resolve() const {
         status = glCheckFramebufferStatus(GL_READ_FRAMEBUFFER);
         if (status != GL_FRAMEBUFFER_COMPLETE) {
             ALOGE("MSAA source framebuffer incomplete before blit: 0x%x", status);
-            GL(glDeleteFramebuffers(1, &tempFbo));
+            ReleaseFramebufferObject(tempFbo);
             return;
         }
 
@@ -463,7 +583,35 @@ void Framebuffer::Resolve() const {
         // Cleanup
         GL(glBindFramebuffer(GL_READ_FRAMEBUFFER, 0));
         GL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
-        GL(glDeleteFramebuffers(1, &tempFbo));
+        ReleaseFramebufferObject(tempFbo);
+    }
+}
+
+GLuint Framebuffer::AcquireFramebufferObject() const {
+    if (mPool != nullptr) {
+        return mPool->Acquire(GpuResourceDesc::Framebuffer());
+    }
+    GLuint fbo = 0;
+    GL(glGenFramebuffers(1, &fbo));
+    return fbo;
+}
+
+void Framebuffer::ReleaseFramebufferObject(const GLuint fbo) const {
+    if (mPool != nullptr) {
+        mPool->Release(fbo, GpuResourceDesc::Framebuffer());
+    } else {
+        GL(glDeleteFramebuffers(1, &fbo));
+    }
+}
+
+void Framebuffer::ReleaseRenderbuffer(const GLuint rb, const GpuResourceDesc& desc) const {
+    if (rb == 0) {
+        return;
+    }
+    if (mPool != nullptr) {
+        mPool->Release(rb, desc);
+    } else {
+        GL(glDeleteRenderbuffers(1, &rb));
     }
 }
 
@@ -13,6 +13,7 @@ License     :   Licensed under GPLv3 or any later version.
 #include "../utils/LogUtils.h"
 #include "../utils/Common.h"
 #include "../OpenXR.h"
+#include "ResourcePool.h"
 
 #include <GLES3/gl3.h>
 #include <EGL/egl.h>
@@ -25,6 +26,7 @@ License     :   Licensed under GPLv3 or any later version.
 // Define XR-specific preprocessor directives before including OpenXR headers
 #define XR_USE_GRAPHICS_API_OPENGL_ES 1
 #define XR_USE_PLATFORM_ANDROID 1
+#define XR_USE_TIMESPEC 1
 #include <openxr/openxr.h>
 #include <openxr/openxr_platform.h>
 
@@ -46,18 +48,30 @@ struct Swapchain {
 
 class Framebuffer {
 public:
+    // xrWaitSwapchainImage() timeout and how many times Acquire() tries it
+    static constexpr XrDuration DEFAULT_ACQUIRE_TIMEOUT = 1000000000;  // 1 s
+    static constexpr int ACQUIRE_TRIES = 4;
+
     Framebuffer();
     ~Framebuffer();
 
-    // Prevent copy but allow move
+    // Prevent copy but allow move; a moved-from framebuffer is empty
     Framebuffer(const Framebuffer&) = delete;
     Framebuffer& operator=(const Framebuffer&) = delete;
-    Framebuffer(Framebuffer&&) = default;
-    Framebuffer& operator=(Framebuffer&&) = default;
+    Framebuffer(Framebuffer&& other) noexcept;
+    Framebuffer& operator=(Framebuffer&& other) noexcept;
 
     // Create the framebuffer with specified parameters
     // Added useMultiview parameter to support multiview rendering
-    bool Create(XrSession session, GLenum colorFormat, int width, int height, int multisamples, bool useMultiview = false);
+    // If pool is given, GL objects come from it and are handed back with a
+    // fence instead of being deleted immediately. It must outlive this object.
+    // With createRenderTargets false only the swapchain is created; depth, MSAA
+    // and FBOs are left to the caller (e.g. a RenderGraph importing GetColorTexture()).
+    // With foveated true the swapchain accepts XR_FB_foveation profiles
+    // (see FoveationController); the runtime must support XR_FB_foveation.
+    bool Create(XrSession session, GLenum colorFormat, int width, int height, int multisamples,
+                bool useMultiview = false, GpuResourcePool* pool = nullptr,
+                bool createRenderTargets = true, bool foveated = false);
 
     // Clean up resources
     void Destroy();
@@ -66,20 +80,33 @@ public:
     void SetCurrent() const;
     static void SetNone();
     void Resolve() const;
-    void Acquire();
+    // Waits up to ACQUIRE_TRIES * @p timeout for the image
+    void Acquire(XrDuration timeout = DEFAULT_ACQUIRE_TIMEOUT);
     void Release() const;
 
     // Accessors
     int GetWidth() const { return mWidth; }
     int GetHeight() const { return mHeight; }
     Swapchain& GetColorSwapChain() { return mColorSwapChain; }
+    // Texture of the currently acquired swapchain image
+    GLuint GetColorTexture() const;
     const Swapchain& GetColorSwapChain() const { return mColorSwapChain; }
     bool UsesMultiview() const;
+    // Swapchain images, plus depth and MSAA color when not from the pool
+    GpuMemoryUsage GetGpuMemory() const;
 
     // Dumps detailed framebuffer state for debugging
     void DumpState() const;
 
 private:
+    // Pool-aware allocation; fall back to plain glGen*/glDelete* without a pool
+    GLuint AcquireFramebufferObject() const;
+    void ReleaseFramebufferObject(GLuint fbo) const;
+    void ReleaseRenderbuffer(GLuint rb, const GpuResourceDesc& desc) const;
+
+    GpuResourcePool* mPool;
+    GLenum mColorFormat;
+    int mDepthSamples;   // may differ from mMultisamples after a mismatch fix-up
     int mWidth;
     int mHeight;
     int mMultisamples;
@@ -0,0 +1,69 @@
+/*******************************************************************************
+
+Filename    :   PackagedTexture.cpp
+Content     :   Compressed texture upload straight from an asset package
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "PackagedTexture.h"
+#include "../utils/AssetPackage.h"
+#include "../utils/LogUtils.h"
+
+#include <algorithm>
+
+using namespace AssetFormat;
+
+GLuint PackagedTexture::Upload(const AssetPackage& package, const Entry& entry) {
+    const uint32_t levelCount = entry.mParams[3];
+    const uint64_t tableBytes = (uint64_t{levelCount} * sizeof(uint32_t) + BLOB_ALIGNMENT - 1) /
+                                BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+    if (entry.mType != EntryType::COMPRESSED_TEXTURE_2D || levelCount == 0 ||
+        tableBytes > entry.mSize) {
+        ALOGE("PackagedTexture: %s is not a compressed 2D texture", entry.mName);
+        return 0;
+    }
+    const auto* blob = static_cast<const uint8_t*>(package.GetData(entry));
+    const auto* sizes = reinterpret_cast<const uint32_t*>(blob);
+
+    // Check every level lies inside the entry before GL reads any of them
+    uint64_t offset = tableBytes;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        offset = (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+        if (sizes[level] > entry.mSize || offset > entry.mSize - sizes[level]) {
+            ALOGE("PackagedTexture: %s level %u lies outside the entry", entry.mName, level);
+            return 0;
+        }
+        offset += sizes[level];
+    }
+
+    const auto internalFormat = static_cast<GLenum>(entry.mParams[0]);
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levelCount - 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    offset = tableBytes;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        offset = (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+        const GLsizei width = static_cast<GLsizei>(std::max(entry.mParams[1] >> level, 1u));
+        const GLsizei height = static_cast<GLsizei>(std::max(entry.mParams[2] >> level, 1u));
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internalFormat, width,
+                               height, 0, static_cast<GLsizei>(sizes[level]), blob + offset);
+        offset += sizes[level];
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    const GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        ALOGE("PackagedTexture: upload of %s (format 0x%04x) failed: 0x%04x", entry.mName,
+              internalFormat, error);
+        glDeleteTextures(1, &texture);
+        return 0;
+    }
+    return texture;
+}
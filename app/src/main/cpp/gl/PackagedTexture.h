@@ -0,0 +1,28 @@
+/*******************************************************************************
+
+Filename    :   PackagedTexture.h
+Content     :   Compressed texture upload straight from an asset package
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <GLES3/gl3.h>
+
+class AssetPackage;
+namespace AssetFormat {
+    struct Entry;
+}
+
+namespace PackagedTexture {
+    /**
+     * Create a 2D texture from a COMPRESSED_TEXTURE_2D entry, passing each
+     * level to glCompressedTexImage2D() from the mapping with no copy.
+     * Returns 0, and logs why, if the entry is malformed or GL rejects its
+     * format. Requires a current GL context; leaves no texture bound.
+     */
+    GLuint Upload(const AssetPackage& package, const AssetFormat::Entry& entry);
+} // namespace PackagedTexture
@@ -0,0 +1,468 @@
+/*******************************************************************************
+
+Filename    :   ResourcePool.cpp
+Content     :   Descriptor-keyed GL object pool with fence-deferred deletion
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "ResourcePool.h"
+#include "../utils/LogUtils.h"
+
+#include <EGL/egl.h>
+
+#include <algorithm>
+
+typedef void (GL_APIENTRY* PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC)(GLenum target,
+        GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height);
+
+namespace {
+    // Pooled objects nobody has asked for in this many frames are deleted
+    constexpr uint64_t kMaxIdleFrames = 300;
+
+    uint32_t BitsPerPixel(const GLenum format) {
+        switch (format) {
+            case GL_R8:
+            case GL_R8UI:
+                return 8;
+            case GL_RG8:
+            case GL_R16F:
+            case GL_R16UI:
+            case GL_DEPTH_COMPONENT16:
+                return 16;
+            case GL_RGB8:
+                return 24;
+            case GL_RGBA16F:
+            case GL_DEPTH32F_STENCIL8:
+                return 64;
+            case GL_RGBA32F:
+                return 128;
+            case GL_COMPRESSED_RGB8_ETC2:
+            case GL_COMPRESSED_SRGB8_ETC2:
+                return 4;
+            case GL_COMPRESSED_RGBA8_ETC2_EAC:
+            case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+                return 8;
+            default:
+                // RGBA8, SRGB8_ALPHA8, RGB10_A2, R11F_G11F_B10F, RG16F, R32F,
+                // DEPTH_COMPONENT24 (padded), DEPTH24_STENCIL8, DEPTH_COMPONENT32F
+                return 32;
+        }
+    }
+
+    const char* TypeName(const GpuResourceType type) {
+        switch (type) {
+            case GpuResourceType::BUFFER:       return "buffer";
+            case GpuResourceType::TEXTURE:      return "texture";
+            case GpuResourceType::RENDERBUFFER: return "renderbuffer";
+            case GpuResourceType::FRAMEBUFFER:  return "framebuffer";
+        }
+        return "unknown";
+    }
+
+    PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC GetRenderbufferStorageMultisampleEXT() {
+        static const auto proc = reinterpret_cast<PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC>(
+                eglGetProcAddress("glRenderbufferStorageMultisampleEXT"));
+        return proc;
+    }
+} // anonymous namespace
+
+//==============================================================================
+// GpuResourceDesc
+
+GpuResourceDesc GpuResourceDesc::Buffer(const GLsizeiptr size, const GLenum usage) {
+    GpuResourceDesc desc;
+    desc.mType = GpuResourceType::BUFFER;
+    desc.mFormat = usage;
+    desc.mSize = size;
+    return desc;
+}
+
+GpuResourceDesc GpuResourceDesc::Texture2D(const GLenum format, const GLsizei width,
+                                           const GLsizei height, const GLsizei levels) {
+    GpuResourceDesc desc;
+    desc.mType = GpuResourceType::TEXTURE;
+    desc.mTarget = GL_TEXTURE_2D;
+    desc.mFormat = format;
+    desc.mWidth = width;
+    desc.mHeight = height;
+    desc.mLevels = levels;
+    return desc;
+}
+
+GpuResourceDesc GpuResourceDesc::Texture2DArray(const GLenum format, const GLsizei width,
+                                                const GLsizei height, const GLsizei layers,
+                                                const GLsizei levels) {
+    GpuResourceDesc desc = Texture2D(format, width, height, levels);
+    desc.mTarget = GL_TEXTURE_2D_ARRAY;
+    desc.mLayers = layers;
+    return desc;
+}
+
+GpuResourceDesc GpuResourceDesc::Renderbuffer(const GLenum format, const GLsizei width,
+                                              const GLsizei height, const GLsizei samples,
+                                              const bool implicitResolve) {
+    GpuResourceDesc desc;
+    desc.mType = GpuResourceType::RENDERBUFFER;
+    desc.mFormat = format;
+    desc.mWidth = width;
+    desc.mHeight = height;
+    desc.mSamples = samples > 1 ? samples : 0;
+    desc.mImplicitResolve = implicitResolve && desc.mSamples > 1;
+    return desc;
+}
+
+GpuResourceDesc GpuResourceDesc::Framebuffer() {
+    GpuResourceDesc desc;
+    desc.mType = GpuResourceType::FRAMEBUFFER;
+    return desc;
+}
+
+uint64_t GpuResourceDesc::GetSizeBytes() const {
+    switch (mType) {
+        case GpuResourceType::BUFFER:
+            return static_cast<uint64_t>(mSize);
+        case GpuResourceType::TEXTURE: {
+            uint64_t bits = 0;
+            GLsizei width = mWidth;
+            GLsizei height = mHeight;
+            for (GLsizei level = 0; level < mLevels; level++) {
+                bits += static_cast<uint64_t>(width) * height * BitsPerPixel(mFormat);
+                width = std::max(width / 2, 1);
+                height = std::max(height / 2, 1);
+            }
+            return bits / 8 * static_cast<uint64_t>(mLayers);
+        }
+        case GpuResourceType::RENDERBUFFER:
+            // Implicitly resolved samples only ever exist in tile memory
+            return static_cast<uint64_t>(mWidth) * mHeight * BitsPerPixel(mFormat) / 8 *
+                   static_cast<uint64_t>(mImplicitResolve ? 1 : std::max(mSamples, 1));
+        case GpuResourceType::FRAMEBUFFER:
+            return 0;
+    }
+    return 0;
+}
+
+GpuMemoryCategory GpuResourceDesc::GetMemoryCategory() const {
+    switch (mFormat) {
+        case GL_DEPTH_COMPONENT16:
+        case GL_DEPTH_COMPONENT24:
+        case GL_DEPTH_COMPONENT32F:
+        case GL_DEPTH24_STENCIL8:
+        case GL_DEPTH32F_STENCIL8:
+            if (mType != GpuResourceType::BUFFER) {
+                return GpuMemoryCategory::DEPTH;
+            }
+            break;
+        default:
+            break;
+    }
+    switch (mType) {
+        case GpuResourceType::BUFFER:
+            return GpuMemoryCategory::BUFFER;
+        case GpuResourceType::TEXTURE:
+        case GpuResourceType::RENDERBUFFER:
+            return mSamples > 1 && !mImplicitResolve ? GpuMemoryCategory::MSAA
+                                                     : GpuMemoryCategory::TEXTURE;
+        case GpuResourceType::FRAMEBUFFER:
+            break;
+    }
+    // Framebuffers have no storage of their own
+    return GpuMemoryCategory::TEXTURE;
+}
+
+bool GpuResourceDesc::operator==(const GpuResourceDesc& other) const {
+    return mType == other.mType && mTarget == other.mTarget && mFormat == other.mFormat &&
+           mWidth == other.mWidth && mHeight == other.mHeight && mLayers == other.mLayers &&
+           mLevels == other.mLevels && mSamples == other.mSamples && mSize == other.mSize &&
+           mImplicitResolve == other.mImplicitResolve;
+}
+
+size_t GpuResourceDescHash::operator()(const GpuResourceDesc& desc) const {
+    // FNV-1a over the fields
+    uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&hash](const uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+    mix(static_cast<uint64_t>(desc.mType));
+    mix(desc.mTarget);
+    mix(desc.mFormat);
+    mix(static_cast<uint64_t>(desc.mWidth));
+    mix(static_cast<uint64_t>(desc.mHeight));
+    mix(static_cast<uint64_t>(desc.mLayers));
+    mix(static_cast<uint64_t>(desc.mLevels));
+    mix(static_cast<uint64_t>(desc.mSamples));
+    mix(static_cast<uint64_t>(desc.mSize));
+    mix(desc.mImplicitResolve ? 1 : 0);
+    return static_cast<size_t>(hash);
+}
+
+//==============================================================================
+// GpuResourcePool
+
+GpuResourcePool::~GpuResourcePool() {
+    Shutdown();
+}
+
+void GpuResourcePool::Shutdown() {
+    if (mPending.empty() && mFences.empty() && mFree.empty()) {
+        return;
+    }
+
+    // Only place the pool ever blocks on the GPU
+    glFinish();
+    for (const FrameFence& frameFence : mFences) {
+        glDeleteSync(frameFence.mFence);
+    }
+    mFences.clear();
+    Retire(UINT64_MAX);
+
+    for (auto& entry : mFree) {
+        for (const FreeObject& object : entry.second) {
+            DeleteLiveObject(object.mName, entry.first);
+        }
+    }
+    mFree.clear();
+    mStats.mPooledBytes = 0;
+
+    LogStats();
+}
+
+void GpuResourcePool::BeginFrame(const bool trimIdle) {
+    uint64_t completedSerial = 0;
+    bool anyCompleted = false;
+
+    // Fences signal in submission order, so stop at the first pending one
+    while (!mFences.empty()) {
+        const FrameFence& frameFence = mFences.front();
+        const GLenum result = glClientWaitSync(frameFence.mFence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        completedSerial = frameFence.mSerial;
+        anyCompleted = true;
+        glDeleteSync(frameFence.mFence);
+        mFences.pop_front();
+    }
+
+    if (anyCompleted) {
+        Retire(completedSerial);
+    }
+    if (trimIdle) {
+        TrimIdle();
+    }
+}
+
+void GpuResourcePool::EndFrame() {
+    // Only fence frames that actually handed something back
+    if (!mPending.empty() && mPending.back().mSerial == mSerial) {
+        mFences.push_back({mSerial, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+    }
+    mSerial++;
+}
+
+GLuint GpuResourcePool::Acquire(const GpuResourceDesc& desc) {
+    const auto it = mFree.find(desc);
+    if (it != mFree.end() && !it->second.empty()) {
+        const GLuint name = it->second.back().mName;
+        it->second.pop_back();
+        mStats.mHits++;
+        mStats.mPooledBytes -= desc.GetSizeBytes();
+        return name;
+    }
+
+    mStats.mMisses++;
+    const GLuint name = CreateObject(desc);
+    if (name != 0) {
+        mStats.mLiveBytes += desc.GetSizeBytes();
+        mStats.mLiveObjects++;
+        mStats.mLiveMemory.Add(desc.GetMemoryCategory(), desc.GetSizeBytes());
+    }
+    return name;
+}
+
+void GpuResourcePool::Release(const GLuint name, const GpuResourceDesc& desc) {
+    if (name == 0) {
+        return;
+    }
+    mPending.push_back({name, desc, mSerial, false});
+    mStats.mPendingBytes += desc.GetSizeBytes();
+}
+
+void GpuResourcePool::Destroy(const GLuint name, const GpuResourceDesc& desc) {
+    if (name == 0) {
+        return;
+    }
+    mPending.push_back({name, desc, mSerial, true});
+    mStats.mPendingBytes += desc.GetSizeBytes();
+}
+
+void GpuResourcePool::LogStats() const {
+    ALOGD("GpuResourcePool: hit rate %.1f%% (%llu/%llu), %u live objects, "
+          "%.2f MiB live, %.2f MiB pooled, %.2f MiB pending",
+          mStats.GetHitRate() * 100.0f,
+          static_cast<unsigned long long>(mStats.mHits),
+          static_cast<unsigned long long>(mStats.mHits + mStats.mMisses),
+          mStats.mLiveObjects,
+          static_cast<double>(mStats.mLiveBytes) / (1024.0 * 1024.0),
+          static_cast<double>(mStats.mPooledBytes) / (1024.0 * 1024.0),
+          static_cast<double>(mStats.mPendingBytes) / (1024.0 * 1024.0));
+}
+
+GLuint GpuResourcePool::CreateObject(const GpuResourceDesc& desc) {
+    GLuint name = 0;
+    if (desc.mType == GpuResourceType::FRAMEBUFFER) {
+        glGenFramebuffers(1, &name);
+        return name;
+    }
+
+    // Don't blame an allocation for someone else's error
+    for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError()) {
+        ALOGW("GpuResourcePool: pending GL error 0x%x before allocation", error);
+    }
+
+    switch (desc.mType) {
+        case GpuResourceType::BUFFER:
+            glGenBuffers(1, &name);
+            // Bound to COPY_WRITE so vertex/index/uniform bindings are left alone
+            glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+            glBufferData(GL_COPY_WRITE_BUFFER, desc.mSize, nullptr, desc.mFormat);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            break;
+        case GpuResourceType::TEXTURE:
+            glGenTextures(1, &name);
+            glBindTexture(desc.mTarget, name);
+            if (desc.mTarget == GL_TEXTURE_2D_ARRAY || desc.mTarget == GL_TEXTURE_3D) {
+                glTexStorage3D(desc.mTarget, desc.mLevels, desc.mFormat,
+                               desc.mWidth, desc.mHeight, desc.mLayers);
+            } else {
+                glTexStorage2D(desc.mTarget, desc.mLevels, desc.mFormat, desc.mWidth, desc.mHeight);
+            }
+            glBindTexture(desc.mTarget, 0);
+            break;
+        case GpuResourceType::RENDERBUFFER:
+            glGenRenderbuffers(1, &name);
+            glBindRenderbuffer(GL_RENDERBUFFER, name);
+            if (!desc.mImplicitResolve) {
+                glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.mSamples, desc.mFormat,
+                                                 desc.mWidth, desc.mHeight);
+            } else if (GetRenderbufferStorageMultisampleEXT() != nullptr) {
+                GetRenderbufferStorageMultisampleEXT()(GL_RENDERBUFFER, desc.mSamples,
+                                                       desc.mFormat, desc.mWidth, desc.mHeight);
+            } else {
+                // Core storage would cost full multisample memory and not
+                // match implicitly resolved color, so fail instead
+                ALOGE("GpuResourcePool: glRenderbufferStorageMultisampleEXT missing");
+                glBindRenderbuffer(GL_RENDERBUFFER, 0);
+                DeleteObject(name, desc);
+                return 0;
+            }
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            break;
+        case GpuResourceType::FRAMEBUFFER:
+            break;
+    }
+
+    const GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        ALOGE("GpuResourcePool: failed to create %s (%dx%d, format 0x%x): 0x%x",
+              TypeName(desc.mType), desc.mWidth, desc.mHeight, desc.mFormat, error);
+        DeleteObject(name, desc);
+        return 0;
+    }
+    return name;
+}
+
+void GpuResourcePool::DeleteObject(const GLuint name, const GpuResourceDesc& desc) {
+    switch (desc.mType) {
+        case GpuResourceType::BUFFER:       glDeleteBuffers(1, &name); break;
+        case GpuResourceType::TEXTURE:      glDeleteTextures(1, &name); break;
+        case GpuResourceType::RENDERBUFFER: glDeleteRenderbuffers(1, &name); break;
+        case GpuResourceType::FRAMEBUFFER:  glDeleteFramebuffers(1, &name); break;
+    }
+}
+
+void GpuResourcePool::DeleteLiveObject(const GLuint name, const GpuResourceDesc& desc) {
+    DeleteObject(name, desc);
+    mStats.mLiveBytes -= desc.GetSizeBytes();
+    mStats.mLiveObjects--;
+    mStats.mLiveMemory.Remove(desc.GetMemoryCategory(), desc.GetSizeBytes());
+}
+
+void GpuResourcePool::Retire(const uint64_t completedSerial) {
+    while (!mPending.empty() && mPending.front().mSerial <= completedSerial) {
+        const PendingObject& object = mPending.front();
+        const uint64_t bytes = object.mDesc.GetSizeBytes();
+        mStats.mPendingBytes -= bytes;
+
+        if (object.mDelete) {
+            DeleteLiveObject(object.mName, object.mDesc);
+        } else {
+            mFree[object.mDesc].push_back({object.mName, mSerial});
+            mStats.mPooledBytes += bytes;
+        }
+        mPending.pop_front();
+    }
+}
+
+void GpuResourcePool::TrimIdle() {
+    if (mSerial < kMaxIdleFrames) {
+        return;
+    }
+    const uint64_t cutoff = mSerial - kMaxIdleFrames;
+
+    for (auto it = mFree.begin(); it != mFree.end();) {
+        std::vector<FreeObject>& objects = it->second;
+        const uint64_t bytes = it->first.GetSizeBytes();
+        const auto idle = std::remove_if(objects.begin(), objects.end(),
+                                         [&](const FreeObject& object) {
+            if (object.mIdleSince > cutoff) {
+                return false;
+            }
+            DeleteLiveObject(object.mName, it->first);
+            mStats.mPooledBytes -= bytes;
+            return true;
+        });
+        objects.erase(idle, objects.end());
+        it = objects.empty() ? mFree.erase(it) : std::next(it);
+    }
+}
+
+uint64_t GpuResourcePool::EvictIdle(const uint64_t bytes) {
+    // Eviction is rare and the free lists are short, so a linear search
+    // for the oldest object each time is fine
+    uint64_t freed = 0;
+    while (freed < bytes) {
+        auto oldest = mFree.end();
+        size_t oldestIndex = 0;
+        for (auto it = mFree.begin(); it != mFree.end(); ++it) {
+            if (it->first.GetSizeBytes() == 0) {
+                continue;
+            }
+            for (size_t i = 0; i < it->second.size(); i++) {
+                if (oldest == mFree.end() ||
+                    it->second[i].mIdleSince < oldest->second[oldestIndex].mIdleSince) {
+                    oldest = it;
+                    oldestIndex = i;
+                }
+            }
+        }
+        if (oldest == mFree.end()) {
+            break;
+        }
+
+        std::vector<FreeObject>& objects = oldest->second;
+        const uint64_t objectBytes = oldest->first.GetSizeBytes();
+        DeleteLiveObject(objects[oldestIndex].mName, oldest->first);
+        mStats.mPooledBytes -= objectBytes;
+        freed += objectBytes;
+        objects.erase(objects.begin() + static_cast<ptrdiff_t>(oldestIndex));
+        if (objects.empty()) {
+            mFree.erase(oldest);
+        }
+    }
+    return freed;
+}
@@ -0,0 +1,195 @@
+/*******************************************************************************
+
+Filename    :   ResourcePool.h
+Content     :   Descriptor-keyed GL object pool with fence-deferred deletion
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../utils/GpuMemory.h"
+
+#include <GLES3/gl3.h>
+#include <GLES3/gl3ext.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+enum class GpuResourceType : uint8_t {
+    BUFFER,
+    TEXTURE,
+    RENDERBUFFER,
+    FRAMEBUFFER
+};
+
+/**
+ * Everything needed to create a GL object's storage. Two objects with equal
+ * descriptors are interchangeable, which is what makes pooling possible.
+ */
+struct GpuResourceDesc {
+    GpuResourceType mType = GpuResourceType::FRAMEBUFFER;
+    GLenum mTarget = 0;       // texture target; unused otherwise
+    GLenum mFormat = 0;       // internal format, or usage for buffers
+    GLsizei mWidth = 0;
+    GLsizei mHeight = 0;
+    GLsizei mLayers = 1;
+    GLsizei mLevels = 1;
+    GLsizei mSamples = 0;
+    GLsizeiptr mSize = 0;     // buffers only
+    // Multisampled renderbuffers only: samples live in tile memory and are
+    // resolved as tiles are stored (EXT_multisampled_render_to_texture), so
+    // the storage is single-sampled. Attach only alongside implicitly
+    // resolved color with the same sample count.
+    bool mImplicitResolve = false;
+
+    static GpuResourceDesc Buffer(GLsizeiptr size, GLenum usage);
+    static GpuResourceDesc Texture2D(GLenum format, GLsizei width, GLsizei height, GLsizei levels = 1);
+    static GpuResourceDesc Texture2DArray(GLenum format, GLsizei width, GLsizei height,
+                                          GLsizei layers, GLsizei levels = 1);
+    static GpuResourceDesc Renderbuffer(GLenum format, GLsizei width, GLsizei height,
+                                        GLsizei samples = 0, bool implicitResolve = false);
+    static GpuResourceDesc Framebuffer();
+
+    // Approximate GPU memory backing this descriptor
+    uint64_t GetSizeBytes() const;
+    GpuMemoryCategory GetMemoryCategory() const;
+
+    bool operator==(const GpuResourceDesc& other) const;
+    bool operator!=(const GpuResourceDesc& other) const { return !(*this == other); }
+};
+
+struct GpuResourceDescHash {
+    size_t operator()(const GpuResourceDesc& desc) const;
+};
+
+/**
+ * GpuResourcePool - recycles GL objects and defers deletes past the GPU.
+ *
+ * Deleting an object the GPU is still reading makes the driver either stall
+ * or keep a ghost copy alive, and re-creating the same storage next frame is
+ * pure allocation churn. Instead, objects are handed back with Release() (to
+ * be reused by a later Acquire() with the same descriptor) or Destroy() (to
+ * be deleted for good). Either way the object is only touched again once the
+ * fence of the frame that released it has signaled.
+ *
+ * Call BeginFrame() and EndFrame() once per frame on the GL thread.
+ * Neither ever blocks on the GPU.
+ *
+ * Recycled framebuffers keep their previous attachments; callers must
+ * re-attach everything they use.
+ */
+class GpuResourcePool {
+public:
+    struct Stats {
+        uint64_t mHits = 0;          // Acquire() served from the pool
+        uint64_t mMisses = 0;        // Acquire() had to create storage
+        uint64_t mLiveBytes = 0;     // everything not yet deleted, pooled or not
+        uint64_t mPooledBytes = 0;   // idle and ready for reuse
+        uint64_t mPendingBytes = 0;  // released or destroyed, waiting on a fence
+        uint32_t mLiveObjects = 0;
+        // mLiveBytes by category
+        GpuMemoryUsage mLiveMemory;
+
+        float GetHitRate() const {
+            const uint64_t total = mHits + mMisses;
+            return total > 0 ? static_cast<float>(mHits) / static_cast<float>(total) : 0.0f;
+        }
+    };
+
+    GpuResourcePool() = default;
+    ~GpuResourcePool();
+
+    GpuResourcePool(const GpuResourcePool&) = delete;
+    GpuResourcePool& operator=(const GpuResourcePool&) = delete;
+
+    /**
+     * Wait for the GPU and delete every pooled or pending object. Objects
+     * still handed out stay with their owner. Requires the GL context to be current.
+     */
+    void Shutdown();
+
+    /**
+     * Retire releases whose fence has signaled and, unless @p trimIdle is
+     * false, trim long-idle objects.
+     */
+    void BeginFrame(bool trimIdle = true);
+
+    /**
+     * Delete pooled objects nobody has acquired for a while. Done by
+     * BeginFrame() unless the caller schedules it separately.
+     */
+    void TrimIdle();
+
+    /**
+     * Delete pooled objects, longest idle first, until about @p bytes are
+     * freed, for when memory is over budget.
+     * @return estimated bytes freed
+     */
+    uint64_t EvictIdle(uint64_t bytes);
+
+    /**
+     * Fence everything released or destroyed since the previous EndFrame().
+     * Call after the frame's last GL command that may reference those objects.
+     */
+    void EndFrame();
+
+    /**
+     * @return an object with storage matching @p desc, or 0 on failure
+     */
+    GLuint Acquire(const GpuResourceDesc& desc);
+
+    /**
+     * Return an object for reuse once the GPU is done with it.
+     */
+    void Release(GLuint name, const GpuResourceDesc& desc);
+
+    /**
+     * Delete an object once the GPU is done with it. Use for objects that
+     * are not expected to be needed again (e.g. unloaded assets).
+     * @p name must have come from Acquire().
+     */
+    void Destroy(GLuint name, const GpuResourceDesc& desc);
+
+    const Stats& GetStats() const { return mStats; }
+    GpuMemoryUsage GetGpuMemory() const { return mStats.mLiveMemory; }
+    void LogStats() const;
+
+private:
+    struct PendingObject {
+        GLuint mName;
+        GpuResourceDesc mDesc;
+        uint64_t mSerial;     // frame that released it
+        bool mDelete;         // delete instead of pooling
+    };
+
+    struct FreeObject {
+        GLuint mName;
+        uint64_t mIdleSince;  // frame it became reusable
+    };
+
+    struct FrameFence {
+        uint64_t mSerial;
+        GLsync mFence;
+    };
+
+    GLuint CreateObject(const GpuResourceDesc& desc);
+    void DeleteObject(GLuint name, const GpuResourceDesc& desc);
+    // DeleteObject() and drop it from the live totals
+    void DeleteLiveObject(GLuint name, const GpuResourceDesc& desc);
+    void Retire(uint64_t completedSerial);
+
+    // Serial of the frame being recorded; advanced by EndFrame()
+    uint64_t mSerial = 0;
+
+    std::deque<PendingObject> mPending;
+    std::deque<FrameFence> mFences;
+    std::unordered_map<GpuResourceDesc, std::vector<FreeObject>, GpuResourceDescHash> mFree;
+
+    Stats mStats;
+};
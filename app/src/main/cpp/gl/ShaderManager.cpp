@@ -0,0 +1,416 @@
+/*******************************************************************************
+
+Filename    :   ShaderManager.cpp
+Content     :   Non-blocking shader program compilation with pre-warm
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "ShaderManager.h"
+#include "../utils/LogUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace {
+    // Without GL_KHR_parallel_shader_compile every finalize may block, so
+    // spread them out to one per frame.
+    constexpr size_t kMaxBlockingFinalizesPerUpdate = 1;
+    constexpr size_t kMaxWarmupsPerUpdate = 2;
+
+    // Warm-up target size; only needs to exist, nothing is ever read back
+    constexpr GLsizei kWarmupSize = 4;
+
+ /**
+ * Logs an OpenGL shader-compile or program-link error.
+ *
+ * @param id      The object handle returned by glCreateShader() or glCreateProgram().
+ * @param isProg  if true, treat @p id as a program, use glGetProgram* calls
+ *                if false, treat @p id as a shader, use glGetShader*  calls
+ * @param label   Human-readable label (“VS”, “FS”, “Program”, …) for the log message.
+ * @return true if the object compiled/linked successfully
+ */
+    bool LogShaderError(const GLuint id, const bool isProg, const char* label) noexcept
+    {
+        GLint status = 0;
+        if (isProg)
+            glGetProgramiv(id, GL_LINK_STATUS, &status);
+        else
+            glGetShaderiv(id,  GL_COMPILE_STATUS, &status);
+
+        if (status == GL_TRUE)   // no error → nothing to log
+            return true;
+
+        GLint logLen = 0;
+        if (isProg)
+            glGetProgramiv(id, GL_INFO_LOG_LENGTH, &logLen);
+        else
+            glGetShaderiv(id,  GL_INFO_LOG_LENGTH, &logLen);
+
+        std::vector<char> log(logLen > 1 ? logLen : 1);
+        if (isProg)
+            glGetProgramInfoLog(id, logLen, nullptr, log.data());
+        else
+            glGetShaderInfoLog(id,  logLen, nullptr, log.data());
+
+        ALOGE("%s error:\n%s", label ? label : "GL object", log.data());
+        return false;
+    }
+
+    GLuint IssueCompile(const GLenum type, const char* source) {
+        const GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        return shader;
+    }
+} // anonymous namespace
+
+void ShaderManager::Init(const GLenum colorFormat, const int multisamples) {
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    mHasParallelCompile = extensions != nullptr &&
+                          strstr(extensions, "GL_KHR_parallel_shader_compile") != nullptr;
+    // The extension's default thread count is already the implementation's
+    // choice; raising it explicitly has been seen to slow down submission on
+    // some drivers, so only the completion query is used.
+    ALOGD("ShaderManager: parallel shader compile %s",
+          mHasParallelCompile ? "supported" : "unsupported, finalizing one program per frame");
+
+    // Match the eye buffer formats so format/sample-count dependent pipeline
+    // variants are the ones that get built during warm-up.
+    glGenRenderbuffers(1, &mWarmupColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, mWarmupColor);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, multisamples > 1 ? multisamples : 0,
+                                     colorFormat, kWarmupSize, kWarmupSize);
+    glGenRenderbuffers(1, &mWarmupDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, mWarmupDepth);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, multisamples > 1 ? multisamples : 0,
+                                     GL_DEPTH_COMPONENT24, kWarmupSize, kWarmupSize);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &mWarmupFbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mWarmupFbo);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              mWarmupColor);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                              mWarmupDepth);
+    if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        ALOGW("ShaderManager: warm-up framebuffer incomplete, skipping warm-up draws");
+        glDeleteFramebuffers(1, &mWarmupFbo);
+        mWarmupFbo = 0;
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    // Attribute-less VAO: the warm-up draw reads generic attribute values
+    glGenVertexArrays(1, &mWarmupVao);
+
+    // Textures of each kind the shaders sample, so the draw sees complete
+    // textures of the right type rather than unit 0's default texture.
+    // Integer textures are only complete with NEAREST filtering.
+    GLint previousTexture = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+    glGenTextures(WARMUP_TEXTURE_COUNT, mWarmupTextures);
+    const uint32_t zero[4] = {};
+    glBindTexture(GL_TEXTURE_2D, mWarmupTextures[WARMUP_TEXTURE_FLOAT]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, zero);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, mWarmupTextures[WARMUP_TEXTURE_UINT]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, 1, 1, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, zero);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, mWarmupTextures[WARMUP_TEXTURE_SHADOW]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, 1, 1, 0, GL_DEPTH_COMPONENT,
+                 GL_UNSIGNED_SHORT, zero);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previousTexture));
+
+    // Sized on first use to the largest block a program declares
+    glGenBuffers(1, &mWarmupUbo);
+    mWarmupUboSize = 0;
+}
+
+void ShaderManager::Shutdown() {
+    for (Program& program : mPrograms) {
+        if (program.mVertexShader != 0) { glDeleteShader(program.mVertexShader); }
+        if (program.mFragmentShader != 0) { glDeleteShader(program.mFragmentShader); }
+        if (program.mProgram != 0) { glDeleteProgram(program.mProgram); }
+    }
+    mPrograms.clear();
+
+    if (mWarmupVao != 0) { glDeleteVertexArrays(1, &mWarmupVao); }
+    if (mWarmupFbo != 0) { glDeleteFramebuffers(1, &mWarmupFbo); }
+    if (mWarmupColor != 0) { glDeleteRenderbuffers(1, &mWarmupColor); }
+    if (mWarmupDepth != 0) { glDeleteRenderbuffers(1, &mWarmupDepth); }
+    mWarmupVao = mWarmupFbo = mWarmupColor = mWarmupDepth = 0;
+    if (mWarmupTextures[0] != 0) { glDeleteTextures(WARMUP_TEXTURE_COUNT, mWarmupTextures); }
+    for (GLuint& texture : mWarmupTextures) { texture = 0; }
+    if (mWarmupUbo != 0) { glDeleteBuffers(1, &mWarmupUbo); }
+    mWarmupUbo = 0;
+    mWarmupUboSize = 0;
+}
+
+ShaderManager::ProgramHandle ShaderManager::Request(const char* label, const char* vsSource,
+                                                    const char* fsSource,
+                                                    std::initializer_list<UniformBlockBinding> uniformBlocks,
+                                                    std::initializer_list<SamplerBinding> samplers) {
+    Program program;
+    program.mLabel = label ? label : "Program";
+    for (const UniformBlockBinding& block : uniformBlocks) {
+        program.mUniformBlocks.emplace_back(block.mName, block.mBinding);
+    }
+    for (const SamplerBinding& sampler : samplers) {
+        program.mSamplers.emplace_back(sampler.mName, sampler.mUnit);
+    }
+    program.mVertexShader = IssueCompile(GL_VERTEX_SHADER, vsSource);
+    program.mFragmentShader = IssueCompile(GL_FRAGMENT_SHADER, fsSource);
+
+    // Linking doesn't require the compiles to have finished; failures show
+    // up as a link failure and are diagnosed in Finalize().
+    program.mProgram = glCreateProgram();
+    glAttachShader(program.mProgram, program.mVertexShader);
+    glAttachShader(program.mProgram, program.mFragmentShader);
+    glLinkProgram(program.mProgram);
+
+    mPrograms.push_back(std::move(program));
+    return static_cast<ProgramHandle>(mPrograms.size() - 1);
+}
+
+bool ShaderManager::IsCompletionSignaled(const Program& program) const {
+    if (!mHasParallelCompile) {
+        return false;
+    }
+    GLint completed = GL_FALSE;
+    glGetProgramiv(program.mProgram, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+void ShaderManager::Finalize(Program& program) {
+    const auto start = std::chrono::steady_clock::now();
+
+    const bool linked = LogShaderError(program.mProgram, true, program.mLabel.c_str());
+    if (!linked) {
+        // Link failures are usually compile failures; log those too
+        LogShaderError(program.mVertexShader, false, (program.mLabel + " VS").c_str());
+        LogShaderError(program.mFragmentShader, false, (program.mLabel + " FS").c_str());
+    }
+
+    glDetachShader(program.mProgram, program.mVertexShader);
+    glDetachShader(program.mProgram, program.mFragmentShader);
+    glDeleteShader(program.mVertexShader);
+    glDeleteShader(program.mFragmentShader);
+    program.mVertexShader = 0;
+    program.mFragmentShader = 0;
+
+    if (linked) {
+        for (const auto& block : program.mUniformBlocks) {
+            const GLuint index = glGetUniformBlockIndex(program.mProgram, block.first.c_str());
+            if (index == GL_INVALID_INDEX) {
+                ALOGW("%s: no uniform block '%s'", program.mLabel.c_str(), block.first.c_str());
+                continue;
+            }
+            glUniformBlockBinding(program.mProgram, index, block.second);
+
+            GLint dataSize = 0;
+            glGetActiveUniformBlockiv(program.mProgram, index, GL_UNIFORM_BLOCK_DATA_SIZE,
+                                      &dataSize);
+            program.mWarmupBlocks.emplace_back(block.second, dataSize);
+        }
+
+        // Sampler units are program state, set through the current program
+        if (!program.mSamplers.empty()) {
+            GLint previousProgram = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+            glUseProgram(program.mProgram);
+            for (const auto& sampler : program.mSamplers) {
+                const GLint location = glGetUniformLocation(program.mProgram, sampler.first.c_str());
+                if (location < 0) {
+                    ALOGW("%s: no sampler '%s'", program.mLabel.c_str(), sampler.first.c_str());
+                    continue;
+                }
+                glUniform1i(location, sampler.second);
+
+                const GLchar* name = sampler.first.c_str();
+                GLuint index = GL_INVALID_INDEX;
+                GLint type = 0;
+                glGetUniformIndices(program.mProgram, 1, &name, &index);
+                if (index != GL_INVALID_INDEX) {
+                    glGetActiveUniformsiv(program.mProgram, 1, &index, GL_UNIFORM_TYPE, &type);
+                }
+                program.mWarmupSamplers.emplace_back(sampler.second, static_cast<GLenum>(type));
+            }
+            glUseProgram(static_cast<GLuint>(previousProgram));
+        }
+    }
+
+    program.mState = linked ? State::WARMING : State::FAILED;
+
+    ALOGD("ShaderManager: finalized %s (%s) in %.2f ms", program.mLabel.c_str(),
+          linked ? "ok" : "FAILED",
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void ShaderManager::BindWarmupResources(const Program& program) {
+    GLint largestBlock = 0;
+    for (const auto& block : program.mWarmupBlocks) {
+        largestBlock = std::max(largestBlock, block.second);
+    }
+    if (largestBlock > mWarmupUboSize) {
+        const std::vector<uint8_t> zeros(static_cast<size_t>(largestBlock));
+        glBindBuffer(GL_UNIFORM_BUFFER, mWarmupUbo);
+        glBufferData(GL_UNIFORM_BUFFER, largestBlock, zeros.data(), GL_STATIC_DRAW);
+        mWarmupUboSize = largestBlock;
+    }
+    for (const auto& block : program.mWarmupBlocks) {
+        if (block.second > 0) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, block.first, mWarmupUbo, 0, block.second);
+        }
+    }
+
+    for (const auto& sampler : program.mWarmupSamplers) {
+        GLuint texture = 0;
+        switch (sampler.second) {
+            case GL_SAMPLER_2D: texture = mWarmupTextures[WARMUP_TEXTURE_FLOAT]; break;
+            case GL_UNSIGNED_INT_SAMPLER_2D: texture = mWarmupTextures[WARMUP_TEXTURE_UINT]; break;
+            case GL_SAMPLER_2D_SHADOW: texture = mWarmupTextures[WARMUP_TEXTURE_SHADOW]; break;
+            default: continue;  // no stand-in for this target; the unit keeps what it has
+        }
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(sampler.first));
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+}
+
+void ShaderManager::WarmUp(Program& program) {
+    if (mWarmupFbo != 0) {
+        // Everything touched below is put back, so the first real pass after
+        // a warm-up starts from the state it would otherwise have seen.
+        GLint previousFbo = 0;
+        GLint previousViewport[4] = {};
+        GLint previousProgram = 0;
+        GLint previousVao = 0;
+        GLint previousUbo = 0;
+        GLint previousActiveTexture = GL_TEXTURE0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+        glGetIntegerv(GL_UNIFORM_BUFFER_BINDING, &previousUbo);
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &previousActiveTexture);
+
+        struct IndexedBuffer { GLuint mIndex; GLint mBuffer; GLint64 mStart; GLint64 mSize; };
+        std::vector<IndexedBuffer> previousBlocks;
+        previousBlocks.reserve(program.mWarmupBlocks.size());
+        for (const auto& block : program.mWarmupBlocks) {
+            IndexedBuffer binding = {block.first, 0, 0, 0};
+            glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, block.first, &binding.mBuffer);
+            glGetInteger64i_v(GL_UNIFORM_BUFFER_START, block.first, &binding.mStart);
+            glGetInteger64i_v(GL_UNIFORM_BUFFER_SIZE, block.first, &binding.mSize);
+            previousBlocks.push_back(binding);
+        }
+        std::vector<std::pair<GLint, GLint>> previousTextures;
+        previousTextures.reserve(program.mWarmupSamplers.size());
+        for (const auto& sampler : program.mWarmupSamplers) {
+            GLint texture = 0;
+            glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(sampler.first));
+            glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+            previousTextures.emplace_back(sampler.first, texture);
+        }
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mWarmupFbo);
+        glViewport(0, 0, kWarmupSize, kWarmupSize);
+        glEnable(GL_DEPTH_TEST);
+        glUseProgram(program.mProgram);
+        BindWarmupResources(program);
+        glBindVertexArray(mWarmupVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        const GLenum attachments[] = {GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT};
+        glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, 2, attachments);
+
+        for (auto it = previousTextures.rbegin(); it != previousTextures.rend(); ++it) {
+            glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(it->first));
+            glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(it->second));
+        }
+        glActiveTexture(static_cast<GLenum>(previousActiveTexture));
+        for (const IndexedBuffer& binding : previousBlocks) {
+            if (binding.mBuffer != 0 && binding.mSize > 0) {
+                glBindBufferRange(GL_UNIFORM_BUFFER, binding.mIndex,
+                                  static_cast<GLuint>(binding.mBuffer),
+                                  static_cast<GLintptr>(binding.mStart),
+                                  static_cast<GLsizeiptr>(binding.mSize));
+            } else {
+                glBindBufferBase(GL_UNIFORM_BUFFER, binding.mIndex,
+                                 static_cast<GLuint>(binding.mBuffer));
+            }
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, static_cast<GLuint>(previousUbo));
+        glBindVertexArray(static_cast<GLuint>(previousVao));
+        glUseProgram(static_cast<GLuint>(previousProgram));
+        if (depthTest == GL_FALSE) {
+            glDisable(GL_DEPTH_TEST);
+        }
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2],
+                   previousViewport[3]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(previousFbo));
+    }
+    program.mState = State::READY;
+}
+
+void ShaderManager::Update() {
+    size_t blockingFinalizes = 0;
+    size_t warmups = 0;
+
+    for (Program& program : mPrograms) {
+        if (program.mState == State::COMPILING) {
+            if (IsCompletionSignaled(program)) {
+                Finalize(program);
+            } else if (!mHasParallelCompile && blockingFinalizes < kMaxBlockingFinalizesPerUpdate) {
+                Finalize(program);
+                blockingFinalizes++;
+            }
+        }
+
+        if (program.mState == State::WARMING && warmups < kMaxWarmupsPerUpdate) {
+            WarmUp(program);
+            warmups++;
+        }
+    }
+}
+
+void ShaderManager::WaitAll() {
+    for (Program& program : mPrograms) {
+        if (program.mState == State::COMPILING) {
+            Finalize(program);
+        }
+        if (program.mState == State::WARMING) {
+            WarmUp(program);
+        }
+    }
+}
+
+bool ShaderManager::IsReady(const ProgramHandle handle) const {
+    return handle < mPrograms.size() && mPrograms[handle].mState == State::READY;
+}
+
+GLuint ShaderManager::GetProgram(const ProgramHandle handle) const {
+    return IsReady(handle) ? mPrograms[handle].mProgram : 0;
+}
+
+size_t ShaderManager::GetPendingCount() const {
+    size_t pending = 0;
+    for (const Program& program : mPrograms) {
+        if (program.mState == State::COMPILING || program.mState == State::WARMING) {
+            pending++;
+        }
+    }
+    return pending;
+}
@@ -0,0 +1,168 @@
+/*******************************************************************************
+
+Filename    :   ShaderManager.h
+Content     :   Non-blocking shader program compilation with pre-warm
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <GLES3/gl3.h>
+#include <GLES3/gl3ext.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * ShaderManager - issues program compiles up front and finishes them across frames.
+ *
+ * Querying GL_COMPILE_STATUS / GL_LINK_STATUS right after glCompileShader /
+ * glLinkProgram forces the driver to finish the work on the calling thread.
+ * Instead, Request() only issues the compile and link. Update() (once per
+ * frame) polls GL_COMPLETION_STATUS_KHR when GL_KHR_parallel_shader_compile is
+ * available, so status is only read once the driver's worker threads are
+ * done. Without the extension, at most one program is finalized per Update().
+ *
+ * Before a program is reported ready it gets a warm-up draw into a tiny
+ * offscreen target, so any draw-time pipeline specialization also happens
+ * off the critical first frame that uses it. The draw sees the same kinds of
+ * uniform buffers and textures as a real one, and leaves the GL state it
+ * touches as it found it.
+ */
+class ShaderManager {
+public:
+    using ProgramHandle = uint32_t;
+    static constexpr ProgramHandle INVALID_PROGRAM = UINT32_MAX;
+
+    /**
+     * Binding point for a named uniform block. ES 3.0 has no layout(binding)
+     * qualifier, so bindings are assigned after link instead.
+     */
+    struct UniformBlockBinding {
+        const char* mName;
+        GLuint mBinding;
+    };
+
+    /**
+     * Texture unit for a named sampler uniform, likewise set after link.
+     */
+    struct SamplerBinding {
+        const char* mName;
+        GLint mUnit;
+    };
+
+    ShaderManager() = default;
+    ~ShaderManager() = default;
+
+    ShaderManager(const ShaderManager&) = delete;
+    ShaderManager& operator=(const ShaderManager&) = delete;
+
+    /**
+     * Detect extensions and create the warm-up target. Requires a current GL context.
+     *
+     * @param colorFormat  Color format of the targets programs will draw into
+     * @param multisamples Sample count of those targets
+     */
+    void Init(GLenum colorFormat = GL_SRGB8_ALPHA8, int multisamples = 4);
+
+    /**
+     * Delete all programs and the warm-up target.
+     */
+    void Shutdown();
+
+    /**
+     * Issue compile and link for a program without waiting on the result.
+     *
+     * @param label    Human-readable name used in logs
+     * @param vsSource Vertex shader source
+     * @param fsSource Fragment shader source
+     * @param uniformBlocks Uniform block bindings applied once the program links
+     * @param samplers Sampler texture units applied once the program links
+     * @return handle for GetProgram()/IsReady()
+     */
+    ProgramHandle Request(const char* label, const char* vsSource, const char* fsSource,
+                          std::initializer_list<UniformBlockBinding> uniformBlocks = {},
+                          std::initializer_list<SamplerBinding> samplers = {});
+
+    /**
+     * Advance pending programs. Call once per frame on the render thread.
+     * Never blocks on a compile when GL_KHR_parallel_shader_compile is present.
+     */
+    void Update();
+
+    /**
+     * Finish every pending program now. For load screens and tools only.
+     */
+    void WaitAll();
+
+    /**
+     * @return true once the program is linked and warmed up
+     */
+    bool IsReady(ProgramHandle handle) const;
+
+    /**
+     * @return the GL program name, or 0 if not ready yet (or failed)
+     */
+    GLuint GetProgram(ProgramHandle handle) const;
+
+    /**
+     * @return number of programs still compiling or awaiting warm-up
+     */
+    size_t GetPendingCount() const;
+
+private:
+    enum class State {
+        COMPILING,  // compile/link issued, status not read yet
+        WARMING,    // linked, warm-up draw pending
+        READY,
+        FAILED
+    };
+
+    struct Program {
+        std::string mLabel;
+        GLuint mVertexShader = 0;
+        GLuint mFragmentShader = 0;
+        GLuint mProgram = 0;
+        std::vector<std::pair<std::string, GLuint>> mUniformBlocks;
+        std::vector<std::pair<std::string, GLint>> mSamplers;
+        State mState = State::COMPILING;
+
+        // What the warm-up draw binds: block binding and data size, and
+        // sampler unit and type, read back after link
+        std::vector<std::pair<GLuint, GLint>> mWarmupBlocks;
+        std::vector<std::pair<GLint, GLenum>> mWarmupSamplers;
+    };
+
+    // Stand-ins for the textures a program samples, by sampler type
+    enum WarmupTexture {
+        WARMUP_TEXTURE_FLOAT,
+        WARMUP_TEXTURE_UINT,
+        WARMUP_TEXTURE_SHADOW,
+        WARMUP_TEXTURE_COUNT
+    };
+
+    bool IsCompletionSignaled(const Program& program) const;
+    void Finalize(Program& program);
+    void WarmUp(Program& program);
+    void BindWarmupResources(const Program& program);
+
+    std::vector<Program> mPrograms;
+
+    bool mHasParallelCompile = false;
+
+    // Warm-up target
+    GLuint mWarmupFbo = 0;
+    GLuint mWarmupColor = 0;
+    GLuint mWarmupDepth = 0;
+    GLuint mWarmupVao = 0;
+    // Zeroed uniform data and 1x1 textures bound in place of the real ones
+    GLuint mWarmupUbo = 0;
+    GLint mWarmupUboSize = 0;
+    GLuint mWarmupTextures[WARMUP_TEXTURE_COUNT] = {};
+};
@@ -0,0 +1,225 @@
+/*******************************************************************************
+
+Filename    :   StreamingBuffer.cpp
+Content     :   Persistently mapped ring buffer for per-frame dynamic GPU data
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "StreamingBuffer.h"
+#include "../utils/LogUtils.h"
+
+#include <EGL/egl.h>
+
+#include <cstring>
+
+#ifndef GL_MAP_PERSISTENT_BIT_EXT
+#define GL_MAP_PERSISTENT_BIT_EXT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT_EXT
+#define GL_MAP_COHERENT_BIT_EXT 0x0080
+#endif
+
+typedef void (GL_APIENTRY* PFNGLBUFFERSTORAGEEXTPROC)(GLenum target, GLsizeiptr size,
+                                                      const void* data, GLbitfield flags);
+
+namespace {
+    // Covers vec4 attributes and 32-bit indices
+    constexpr GLsizeiptr kVertexAlignment = 16;
+
+    // How long BeginFrame() will block on a region before giving up and
+    // overwriting it anyway. Only reached if the GPU is hung.
+    constexpr GLuint64 kFenceTimeoutNs = 1000000000;
+
+    PFNGLBUFFERSTORAGEEXTPROC glBufferStorageEXT = nullptr;
+
+    constexpr GLsizeiptr AlignUp(const GLsizeiptr value, const GLsizeiptr alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+} // anonymous namespace
+
+StreamingBuffer::~StreamingBuffer() {
+    Destroy();
+}
+
+bool StreamingBuffer::Create(const GLsizeiptr regionSize, const uint32_t regionCount) {
+    if (regionCount == 0 || regionCount > MAX_REGIONS) {
+        ALOGE("StreamingBuffer: region count %u out of range (1..%u)", regionCount, MAX_REGIONS);
+        return false;
+    }
+
+    GLint uniformAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    if (uniformAlignment > 0) {
+        mUniformAlignment = uniformAlignment;
+    }
+
+    // Regions start on a boundary that suits either kind of allocation
+    const GLsizeiptr regionAlignment =
+            mUniformAlignment > kVertexAlignment ? mUniformAlignment : kVertexAlignment;
+    mRegionSize = AlignUp(regionSize, regionAlignment);
+    mRegionCount = regionCount;
+    const GLsizeiptr totalSize = mRegionSize * mRegionCount;
+
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (glBufferStorageEXT == nullptr && extensions != nullptr &&
+        strstr(extensions, "GL_EXT_buffer_storage") != nullptr) {
+        glBufferStorageEXT = (PFNGLBUFFERSTORAGEEXTPROC)eglGetProcAddress("glBufferStorageEXT");
+    }
+
+    glGenBuffers(1, &mBuffer);
+    // GL_COPY_WRITE_BUFFER so creation doesn't disturb vertex/uniform bindings
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+    if (glBufferStorageEXT != nullptr) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+        glBufferStorageEXT(GL_COPY_WRITE_BUFFER, totalSize, nullptr, flags);
+        mMappedBase = static_cast<uint8_t*>(
+                glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags));
+        if (mMappedBase != nullptr) {
+            mMode = Mode::PERSISTENT;
+        } else {
+            // Immutable storage can't be re-specified; start over with a fresh name
+            ALOGW("StreamingBuffer: persistent map failed (0x%x), falling back", glGetError());
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &mBuffer);
+            glGenBuffers(1, &mBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+        }
+    }
+
+    if (mMode == Mode::NONE) {
+        glBufferData(GL_COPY_WRITE_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+        mMode = (glGetError() == GL_NO_ERROR) ? Mode::UNSYNCHRONIZED : Mode::NONE;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (mMode == Mode::NONE) {
+        ALOGE("StreamingBuffer: failed to allocate %lld bytes", static_cast<long long>(totalSize));
+        Destroy();
+        return false;
+    }
+
+    // Start on the last region so the first BeginFrame() lands on region 0
+    mCurrentRegion = mRegionCount - 1;
+    mRegionUsed = 0;
+
+    ALOGD("StreamingBuffer: %u x %lld bytes, %s, UBO alignment %lld", mRegionCount,
+          static_cast<long long>(mRegionSize),
+          mMode == Mode::PERSISTENT ? "persistent" : "unsynchronized",
+          static_cast<long long>(mUniformAlignment));
+    return true;
+}
+
+void StreamingBuffer::Destroy() {
+    for (GLsync& fence : mFences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    if (mBuffer != 0) {
+        if (mMappedBase != nullptr) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mMappedBase = nullptr;
+        }
+        glDeleteBuffers(1, &mBuffer);
+        mBuffer = 0;
+    }
+
+    mMode = Mode::NONE;
+    mRegionSize = 0;
+    mRegionCount = 0;
+    mCurrentRegion = 0;
+    mRegionUsed = 0;
+}
+
+void StreamingBuffer::BeginFrame() {
+    if (mMode == Mode::NONE) {
+        return;
+    }
+
+    mCurrentRegion = (mCurrentRegion + 1) % mRegionCount;
+    mRegionUsed = 0;
+
+    GLsync& fence = mFences[mCurrentRegion];
+    if (fence == nullptr) {
+        return;
+    }
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        // The GPU is more than mRegionCount frames behind
+        mStallCount++;
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeoutNs);
+    }
+    if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+        ALOGE("StreamingBuffer: region %u fence wait failed (0x%x)", mCurrentRegion, result);
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void StreamingBuffer::EndFrame() {
+    if (mMode == Mode::NONE || mRegionUsed == 0) {
+        return;
+    }
+    mFences[mCurrentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+StreamingBuffer::Allocation StreamingBuffer::AllocateUniform(const GLsizeiptr size) {
+    return Allocate(size, mUniformAlignment);
+}
+
+StreamingBuffer::Allocation StreamingBuffer::AllocateVertex(const GLsizeiptr size) {
+    return Allocate(size, kVertexAlignment);
+}
+
+StreamingBuffer::Allocation StreamingBuffer::Allocate(const GLsizeiptr size,
+                                                      const GLsizeiptr alignment) {
+    Allocation allocation;
+    if (mMode == Mode::NONE || size <= 0) {
+        return allocation;
+    }
+
+    const GLsizeiptr offsetInRegion = AlignUp(mRegionUsed, alignment);
+    if (offsetInRegion + size > mRegionSize) {
+        ALOGE("StreamingBuffer: region exhausted (%lld + %lld > %lld)",
+              static_cast<long long>(offsetInRegion), static_cast<long long>(size),
+              static_cast<long long>(mRegionSize));
+        return allocation;
+    }
+    mRegionUsed = offsetInRegion + size;
+
+    allocation.mBuffer = mBuffer;
+    allocation.mOffset = static_cast<GLintptr>(mCurrentRegion) * mRegionSize + offsetInRegion;
+    allocation.mSize = size;
+
+    if (mMode == Mode::PERSISTENT) {
+        allocation.mCpuPtr = mMappedBase + allocation.mOffset;
+    } else {
+        // Unsynchronized is safe: this region's fence was waited on in BeginFrame()
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+        allocation.mCpuPtr = glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation.mOffset, size,
+                                              GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                              GL_MAP_INVALIDATE_RANGE_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    return allocation;
+}
+
+void StreamingBuffer::Commit(const Allocation& allocation) {
+    if (mMode != Mode::UNSYNCHRONIZED || !allocation.IsValid()) {
+        return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.mBuffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
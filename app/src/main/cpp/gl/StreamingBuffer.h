@@ -0,0 +1,130 @@
+/*******************************************************************************
+
+Filename    :   StreamingBuffer.h
+Content     :   Persistently mapped ring buffer for per-frame dynamic GPU data
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <GLES3/gl3.h>
+#include <GLES3/gl3ext.h>
+
+#include <array>
+#include <cstdint>
+
+/**
+ * StreamingBuffer - one GL buffer split into per-frame regions.
+ *
+ * Each frame writes into its own region through a CPU pointer and never
+ * touches a region the GPU may still be reading: a fence is inserted at
+ * EndFrame() and waited on before that region is reused. With enough
+ * regions (frames in flight + 1) the wait is always already signaled.
+ *
+ * Mapping strategy, best first:
+ *   PERSISTENT     - GL_EXT_buffer_storage, mapped once, coherent
+ *   UNSYNCHRONIZED - glBufferData storage, each allocation mapped with
+ *                    GL_MAP_UNSYNCHRONIZED_BIT; the fences provide the sync
+ *
+ * Neither path orphans or lets the driver insert implicit synchronization.
+ * Usage per allocation is Allocate*() -> write mCpuPtr -> Commit() -> draw.
+ */
+class StreamingBuffer {
+public:
+    static constexpr uint32_t MAX_REGIONS = 4;
+
+    enum class Mode {
+        NONE,
+        PERSISTENT,
+        UNSYNCHRONIZED
+    };
+
+    /**
+     * A sub-allocation valid for the current frame only
+     */
+    struct Allocation {
+        void*      mCpuPtr = nullptr;  // write-only
+        GLuint     mBuffer = 0;
+        GLintptr   mOffset = 0;
+        GLsizeiptr mSize   = 0;
+
+        bool IsValid() const { return mCpuPtr != nullptr; }
+    };
+
+    StreamingBuffer() = default;
+    ~StreamingBuffer();
+
+    StreamingBuffer(const StreamingBuffer&) = delete;
+    StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+
+    /**
+     * @param regionSize  Bytes available to each frame
+     * @param regionCount Number of frames that may be in flight, up to MAX_REGIONS
+     * @return false if the buffer could not be created or mapped
+     */
+    bool Create(GLsizeiptr regionSize, uint32_t regionCount = 3);
+    void Destroy();
+
+    /**
+     * Move to the next region, waiting for its fence if the GPU is still on it.
+     * Call once per frame before any Allocate*().
+     */
+    void BeginFrame();
+
+    /**
+     * Make this frame's writes visible to the GPU and fence the region.
+     * Call once per frame after the last draw that reads from it.
+     */
+    void EndFrame();
+
+    /**
+     * Allocate from the current region, aligned for glBindBufferRange(GL_UNIFORM_BUFFER)
+     * @return an invalid Allocation if the region is exhausted
+     */
+    Allocation AllocateUniform(GLsizeiptr size);
+
+    /**
+     * Allocate from the current region, aligned for vertex/index attribute use
+     */
+    Allocation AllocateVertex(GLsizeiptr size);
+
+    /**
+     * Finish writing an allocation. Must be called before the GPU reads it;
+     * a no-op for persistent mappings.
+     */
+    void Commit(const Allocation& allocation);
+
+    GLuint GetBuffer() const { return mBuffer; }
+    Mode GetMode() const { return mMode; }
+
+    // Times BeginFrame() had to block on a fence. Non-zero means too few regions.
+    uint64_t GetStallCount() const { return mStallCount; }
+    // Bytes of buffer storage across all regions
+    GLsizeiptr GetSize() const { return mRegionSize * mRegionCount; }
+    // Bytes available to each frame
+    GLsizeiptr GetRegionSize() const { return mRegionSize; }
+    // What each AllocateUniform() is padded to
+    GLsizeiptr GetUniformAlignment() const { return mUniformAlignment; }
+
+private:
+    Allocation Allocate(GLsizeiptr size, GLsizeiptr alignment);
+
+    GLuint mBuffer = 0;
+    Mode mMode = Mode::NONE;
+
+    GLsizeiptr mRegionSize = 0;
+    uint32_t mRegionCount = 0;
+    uint32_t mCurrentRegion = 0;
+    GLsizeiptr mRegionUsed = 0;
+
+    // Base of the whole buffer in PERSISTENT mode, unused otherwise
+    uint8_t* mMappedBase = nullptr;
+
+    std::array<GLsync, MAX_REGIONS> mFences{};
+
+    GLsizeiptr mUniformAlignment = 256;
+    uint64_t mStallCount = 0;
+};
@@ -10,6 +10,7 @@ License     :   Licensed under GPLv3 or any later version.
 #include "../utils/LogUtils.h"
 #include "../OpenXR.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cassert>
 
@@ -480,4 +481,26 @@ bool InputStateFrame::HasButtonChanges() const {
     }
 
     return false;
+}
+
+XrTime InputStateFrame::GetLatestChangeTime() const {
+    XrTime latest = 0;
+    const auto consider = [&latest](const auto& state) {
+        if (state.isActive && state.changedSinceLastSync) {
+            latest = std::max(latest, state.lastChangeTime);
+        }
+    };
+
+    for (const XrActionStateBoolean& state : mFaceButtonStates) {
+        consider(state);
+    }
+    consider(mMenuButtonState);
+    for (unsigned int hand = 0; hand < NUM_CONTROLLERS; hand++) {
+        consider(mThumbStickState[hand]);
+        consider(mThumbStickClickState[hand]);
+        consider(mThumbrestTouchState[hand]);
+        consider(mIndexTriggerState[hand]);
+        consider(mSqueezeTriggerState[hand]);
+    }
+    return latest;
 }
\ No newline at end of file
@@ -145,6 +145,10 @@ struct InputStateFrame {
 
     // Helper method to efficiently determine if any button changed
     bool HasButtonChanges() const;
+
+    // When the newest input that changed in the last sync happened, as the
+    // runtime reports it; 0 if nothing changed
+    XrTime GetLatestChangeTime() const;
 };
 
 /**
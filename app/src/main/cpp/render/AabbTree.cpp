@@ -0,0 +1,683 @@
+/*******************************************************************************
+
+Filename    :   AabbTree.cpp
+Content     :   Dynamic bounding-volume tree for ray, overlap and frustum
+                queries against scene objects
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "AabbTree.h"
+#include "../utils/LogUtils.h"
+#include "../utils/Simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+using MathUtils::Bounds3f;
+
+namespace {
+    Bounds3f Union(const Bounds3f& a, const Bounds3f& b) {
+        Bounds3f result;
+        result.mMin = {std::min(a.mMin.x, b.mMin.x), std::min(a.mMin.y, b.mMin.y),
+                       std::min(a.mMin.z, b.mMin.z)};
+        result.mMax = {std::max(a.mMax.x, b.mMax.x), std::max(a.mMax.y, b.mMax.y),
+                       std::max(a.mMax.z, b.mMax.z)};
+        return result;
+    }
+
+    // Half the surface area; only ever compared
+    float Area(const Bounds3f& b) {
+        const XrVector3f size = b.mMax - b.mMin;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    bool Contains(const Bounds3f& outer, const Bounds3f& inner) {
+        return outer.mMin.x <= inner.mMin.x && outer.mMin.y <= inner.mMin.y &&
+               outer.mMin.z <= inner.mMin.z && outer.mMax.x >= inner.mMax.x &&
+               outer.mMax.y >= inner.mMax.y && outer.mMax.z >= inner.mMax.z;
+    }
+
+    bool Overlaps(const Bounds3f& a, const Bounds3f& b) {
+        return a.mMin.x <= b.mMax.x && a.mMax.x >= b.mMin.x && a.mMin.y <= b.mMax.y &&
+               a.mMax.y >= b.mMin.y && a.mMin.z <= b.mMax.z && a.mMax.z >= b.mMin.z;
+    }
+
+    bool Equal(const Bounds3f& a, const Bounds3f& b) {
+        return a.mMin.x == b.mMin.x && a.mMin.y == b.mMin.y && a.mMin.z == b.mMin.z &&
+               a.mMax.x == b.mMax.x && a.mMax.y == b.mMax.y && a.mMax.z == b.mMax.z;
+    }
+
+    Bounds3f Grow(const Bounds3f& b, const float margin) {
+        Bounds3f result;
+        result.mMin = {b.mMin.x - margin, b.mMin.y - margin, b.mMin.z - margin};
+        result.mMax = {b.mMax.x + margin, b.mMax.y + margin, b.mMax.z + margin};
+        return result;
+    }
+
+    // Avoids inf * 0 = NaN in the slab test for axis-parallel rays
+    float SafeInverse(const float d) {
+        return std::abs(d) > 1e-20f ? 1.0f / d : std::copysign(1e20f, d);
+    }
+
+    constexpr uint32_t kOutside = 0;
+    constexpr uint32_t kIntersecting = 1;
+    constexpr uint32_t kInside = 2;
+
+    // Six planes in two groups of four lanes, padded with planes nothing is outside of
+    struct PlanesSoA {
+        alignas(16) float mX[8];
+        alignas(16) float mY[8];
+        alignas(16) float mZ[8];
+        alignas(16) float mW[8];
+
+        explicit PlanesSoA(const AabbTree::FrustumPlanes& planes) {
+            for (size_t i = 0; i < 8; i++) {
+                const XrVector4f p =
+                        i < planes.size() ? planes[i] : XrVector4f{0.0f, 0.0f, 0.0f, 1.0f};
+                mX[i] = p.x;
+                mY[i] = p.y;
+                mZ[i] = p.z;
+                mW[i] = p.w;
+            }
+        }
+
+        uint32_t Classify(const Bounds3f& b) const {
+            const Float4 zero = Float4::Splat(0.0f);
+            const Float4 minX = Float4::Splat(b.mMin.x);
+            const Float4 minY = Float4::Splat(b.mMin.y);
+            const Float4 minZ = Float4::Splat(b.mMin.z);
+            const Float4 maxX = Float4::Splat(b.mMax.x);
+            const Float4 maxY = Float4::Splat(b.mMax.y);
+            const Float4 maxZ = Float4::Splat(b.mMax.z);
+            bool inside = true;
+            for (int group = 0; group < 2; group++) {
+                const Float4 nx = Float4::Load(mX + group * 4);
+                const Float4 ny = Float4::Load(mY + group * 4);
+                const Float4 nz = Float4::Load(mZ + group * 4);
+                const Float4 w = Float4::Load(mW + group * 4);
+                const Float4 posX = CmpGe(nx, zero);
+                const Float4 posY = CmpGe(ny, zero);
+                const Float4 posZ = CmpGe(nz, zero);
+                // Corner farthest along each plane's normal, then nearest
+                const Float4 farthest = MulAdd(nx, Select(posX, maxX, minX),
+                                               MulAdd(ny, Select(posY, maxY, minY),
+                                                      MulAdd(nz, Select(posZ, maxZ, minZ), w)));
+                if (MoveMask(CmpGe(farthest, zero)) != 0xF) {
+                    return kOutside;
+                }
+                const Float4 nearest = MulAdd(nx, Select(posX, minX, maxX),
+                                              MulAdd(ny, Select(posY, minY, maxY),
+                                                     MulAdd(nz, Select(posZ, minZ, maxZ), w)));
+                inside = inside && MoveMask(CmpGe(nearest, zero)) == 0xF;
+            }
+            return inside ? kInside : kIntersecting;
+        }
+    };
+} // anonymous namespace
+
+int32_t AabbTree::AllocateNode() {
+    int32_t node;
+    if (mFreeList != NULL_NODE) {
+        node = mFreeList;
+        mFreeList = mNodes[node].mParent;
+        mNodes[node] = Node();
+    } else {
+        node = static_cast<int32_t>(mNodes.size());
+        mNodes.emplace_back();
+        mObjectBounds.emplace_back();
+    }
+    return node;
+}
+
+void AabbTree::FreeNode(const int32_t node) {
+    mNodes[node].mParent = mFreeList;
+    mNodes[node].mHeight = -1;
+    mFreeList = node;
+}
+
+AabbTree::ProxyId AabbTree::Insert(const Bounds3f& bounds, const uint32_t userData) {
+    const int32_t leaf = AllocateNode();
+    mNodes[leaf].mBounds = Grow(bounds, MARGIN);
+    mNodes[leaf].mUserData = userData;
+    mObjectBounds[leaf] = bounds;
+    InsertLeaf(leaf);
+    mProxyCount++;
+    return leaf;
+}
+
+void AabbTree::Remove(const ProxyId proxy) {
+    RemoveLeaf(proxy);
+    FreeNode(proxy);
+    mProxyCount--;
+}
+
+bool AabbTree::Move(const ProxyId proxy, const Bounds3f& bounds, const XrVector3f& displacement) {
+    mObjectBounds[proxy] = bounds;
+    if (Contains(mNodes[proxy].mBounds, bounds)) {
+        return false;
+    }
+
+    Bounds3f grown = Grow(bounds, MARGIN);
+    const XrVector3f ahead = displacement * DISPLACEMENT_FRAMES;
+    (ahead.x < 0.0f ? grown.mMin.x : grown.mMax.x) += ahead.x;
+    (ahead.y < 0.0f ? grown.mMin.y : grown.mMax.y) += ahead.y;
+    (ahead.z < 0.0f ? grown.mMin.z : grown.mMax.z) += ahead.z;
+
+    // Still near where it was: refit in place. Otherwise the old spot in the
+    // tree says nothing about the new one.
+    if (Overlaps(mNodes[proxy].mBounds, grown)) {
+        mNodes[proxy].mBounds = grown;
+        Fixup(mNodes[proxy].mParent, true);
+        mStats.mRefits++;
+    } else {
+        RemoveLeaf(proxy);
+        mNodes[proxy].mBounds = grown;
+        InsertLeaf(proxy);
+        mStats.mReinserts++;
+    }
+    return true;
+}
+
+void AabbTree::Clear() {
+    mNodes.clear();
+    mObjectBounds.clear();
+    mRoot = NULL_NODE;
+    mFreeList = NULL_NODE;
+    mProxyCount = 0;
+}
+
+void AabbTree::InsertLeaf(const int32_t leaf) {
+    if (mRoot == NULL_NODE) {
+        mRoot = leaf;
+        mNodes[leaf].mParent = NULL_NODE;
+        return;
+    }
+
+    // Descend toward the sibling that grows the tree's surface area least
+    const Bounds3f leafBounds = mNodes[leaf].mBounds;
+    int32_t index = mRoot;
+    while (!mNodes[index].IsLeaf()) {
+        const Node& node = mNodes[index];
+        const float area = Area(node.mBounds);
+        const float combinedArea = Area(Union(node.mBounds, leafBounds));
+        // Pairing with this node makes a new parent; descending grows this node
+        const float pairCost = 2.0f * combinedArea;
+        const float inheritedCost = 2.0f * (combinedArea - area);
+
+        float childCosts[2];
+        for (int i = 0; i < 2; i++) {
+            const Node& child = mNodes[node.mChildren[i]];
+            const float grownArea = Area(Union(child.mBounds, leafBounds));
+            childCosts[i] = (child.IsLeaf() ? grownArea : grownArea - Area(child.mBounds)) +
+                            inheritedCost;
+        }
+        if (pairCost < childCosts[0] && pairCost < childCosts[1]) {
+            break;
+        }
+        index = childCosts[0] < childCosts[1] ? node.mChildren[0] : node.mChildren[1];
+    }
+
+    const int32_t sibling = index;
+    const int32_t oldParent = mNodes[sibling].mParent;
+    const int32_t newParent = AllocateNode();
+    Node& parent = mNodes[newParent];
+    parent.mParent = oldParent;
+    parent.mBounds = Union(leafBounds, mNodes[sibling].mBounds);
+    parent.mHeight = mNodes[sibling].mHeight + 1;
+    parent.mChildren[0] = sibling;
+    parent.mChildren[1] = leaf;
+    if (oldParent != NULL_NODE) {
+        ReplaceChild(oldParent, sibling, newParent);
+    } else {
+        mRoot = newParent;
+    }
+    mNodes[sibling].mParent = newParent;
+    mNodes[leaf].mParent = newParent;
+
+    Fixup(oldParent, false);
+}
+
+void AabbTree::RemoveLeaf(const int32_t leaf) {
+    if (leaf == mRoot) {
+        mRoot = NULL_NODE;
+        return;
+    }
+
+    const int32_t parent = mNodes[leaf].mParent;
+    const int32_t grandParent = mNodes[parent].mParent;
+    const int32_t sibling = mNodes[parent].mChildren[0] == leaf ? mNodes[parent].mChildren[1]
+                                                               : mNodes[parent].mChildren[0];
+    FreeNode(parent);
+    mNodes[sibling].mParent = grandParent;
+    if (grandParent == NULL_NODE) {
+        mRoot = sibling;
+        return;
+    }
+    ReplaceChild(grandParent, parent, sibling);
+    Fixup(grandParent, false);
+}
+
+void AabbTree::ReplaceChild(const int32_t parent, const int32_t oldChild, const int32_t newChild) {
+    Node& node = mNodes[parent];
+    node.mChildren[node.mChildren[0] == oldChild ? 0 : 1] = newChild;
+}
+
+void AabbTree::Fixup(int32_t index, const bool early) {
+    while (index != NULL_NODE) {
+        index = Balance(index);
+
+        Node& node = mNodes[index];
+        const Node& child0 = mNodes[node.mChildren[0]];
+        const Node& child1 = mNodes[node.mChildren[1]];
+        const Bounds3f oldBounds = node.mBounds;
+        const int32_t oldHeight = node.mHeight;
+        node.mBounds = Union(child0.mBounds, child1.mBounds);
+        node.mHeight = 1 + std::max(child0.mHeight, child1.mHeight);
+        Rotate(index);
+
+        if (early && node.mHeight == oldHeight && Equal(node.mBounds, oldBounds)) {
+            break;
+        }
+        index = node.mParent;
+    }
+}
+
+// Height rotation: lift the taller child if the two differ by more than one
+int32_t AabbTree::Balance(const int32_t iA) {
+    Node& a = mNodes[iA];
+    if (a.IsLeaf() || a.mHeight < 2) {
+        return iA;
+    }
+
+    const int32_t iB = a.mChildren[0];
+    const int32_t iC = a.mChildren[1];
+    const int32_t balance = mNodes[iC].mHeight - mNodes[iB].mHeight;
+    if (balance >= -1 && balance <= 1) {
+        return iA;
+    }
+
+    // Lift the taller child (up) above a; its shorter child moves under a
+    const bool liftC = balance > 1;
+    const int32_t iUp = liftC ? iC : iB;
+    const int32_t iStay = liftC ? iB : iC;
+    Node& up = mNodes[iUp];
+    const int32_t iF = up.mChildren[0];
+    const int32_t iG = up.mChildren[1];
+
+    up.mChildren[0] = iA;
+    up.mParent = a.mParent;
+    a.mParent = iUp;
+    if (up.mParent != NULL_NODE) {
+        ReplaceChild(up.mParent, iA, iUp);
+    } else {
+        mRoot = iUp;
+    }
+
+    const bool keepF = mNodes[iF].mHeight > mNodes[iG].mHeight;
+    const int32_t iKeep = keepF ? iF : iG;
+    const int32_t iMove = keepF ? iG : iF;
+    up.mChildren[1] = iKeep;
+    a.mChildren[liftC ? 1 : 0] = iMove;
+    mNodes[iMove].mParent = iA;
+
+    a.mBounds = Union(mNodes[iStay].mBounds, mNodes[iMove].mBounds);
+    a.mHeight = 1 + std::max(mNodes[iStay].mHeight, mNodes[iMove].mHeight);
+    up.mBounds = Union(a.mBounds, mNodes[iKeep].mBounds);
+    up.mHeight = 1 + std::max(a.mHeight, mNodes[iKeep].mHeight);
+    mStats.mRotations++;
+    return iUp;
+}
+
+// Surface-area rotation: swap a child with a grandchild under the other
+// child if that shrinks the other child without unbalancing either. The
+// node's own box and its ancestors' are unchanged.
+bool AabbTree::Rotate(const int32_t iA) {
+    Node& a = mNodes[iA];
+    if (a.IsLeaf()) {
+        return false;
+    }
+
+    float bestDelta = 0.0f;
+    int bestSide = -1;
+    int bestGrandChild = -1;
+    for (int side = 0; side < 2; side++) {
+        // Swap a.mChildren[side] with a child of the other side
+        const Node& stay = mNodes[a.mChildren[side]];
+        const Node& other = mNodes[a.mChildren[1 - side]];
+        if (other.IsLeaf()) {
+            continue;
+        }
+        for (int g = 0; g < 2; g++) {
+            const Node& swapped = mNodes[other.mChildren[g]];
+            const Node& kept = mNodes[other.mChildren[1 - g]];
+            const int32_t otherHeight = 1 + std::max(stay.mHeight, kept.mHeight);
+            if (std::abs(stay.mHeight - kept.mHeight) > 1 ||
+                std::abs(swapped.mHeight - otherHeight) > 1) {
+                continue;
+            }
+            const float delta = Area(Union(stay.mBounds, kept.mBounds)) - Area(other.mBounds);
+            if (delta < bestDelta) {
+                bestDelta = delta;
+                bestSide = side;
+                bestGrandChild = g;
+            }
+        }
+    }
+    if (bestSide < 0) {
+        return false;
+    }
+
+    const int32_t iStay = a.mChildren[bestSide];
+    const int32_t iOther = a.mChildren[1 - bestSide];
+    Node& other = mNodes[iOther];
+    const int32_t iSwapped = other.mChildren[bestGrandChild];
+    const int32_t iKept = other.mChildren[1 - bestGrandChild];
+
+    a.mChildren[bestSide] = iSwapped;
+    mNodes[iSwapped].mParent = iA;
+    other.mChildren[bestGrandChild] = iStay;
+    mNodes[iStay].mParent = iOther;
+    other.mBounds = Union(mNodes[iStay].mBounds, mNodes[iKept].mBounds);
+    other.mHeight = 1 + std::max(mNodes[iStay].mHeight, mNodes[iKept].mHeight);
+    a.mHeight = 1 + std::max(mNodes[iSwapped].mHeight, other.mHeight);
+    mStats.mRotations++;
+    return true;
+}
+
+void AabbTree::RayCast(const Ray* rays, const uint32_t count, RayHit* hits) const {
+    for (uint32_t first = 0; first < count; first += MAX_BATCH_RAYS) {
+        RayCastGroup(rays + first, std::min(count - first, MAX_BATCH_RAYS), hits + first);
+    }
+}
+
+void AabbTree::RayCastGroup(const Ray* rays, const uint32_t count, RayHit* hits) const {
+    // One ray per lane; unused lanes can never hit
+    alignas(16) float originX[4];
+    alignas(16) float originY[4];
+    alignas(16) float originZ[4];
+    alignas(16) float inverseX[4];
+    alignas(16) float inverseY[4];
+    alignas(16) float inverseZ[4];
+    alignas(16) float nearest[4];
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        const bool used = lane < count;
+        const Ray ray = used ? rays[lane] : Ray();
+        originX[lane] = ray.mOrigin.x;
+        originY[lane] = ray.mOrigin.y;
+        originZ[lane] = ray.mOrigin.z;
+        inverseX[lane] = SafeInverse(ray.mDirection.x);
+        inverseY[lane] = SafeInverse(ray.mDirection.y);
+        inverseZ[lane] = SafeInverse(ray.mDirection.z);
+        nearest[lane] = used ? ray.mMaxDistance : -1.0f;
+        if (used) {
+            hits[lane] = RayHit();
+        }
+    }
+    if (mRoot == NULL_NODE) {
+        return;
+    }
+
+    const Float4 ox = Float4::Load(originX);
+    const Float4 oy = Float4::Load(originY);
+    const Float4 oz = Float4::Load(originZ);
+    const Float4 ix = Float4::Load(inverseX);
+    const Float4 iy = Float4::Load(inverseY);
+    const Float4 iz = Float4::Load(inverseZ);
+    const Float4 zero = Float4::Splat(0.0f);
+    Float4 limit = Float4::Load(nearest);
+
+    const Float4 never = Float4::Splat(INFINITY);
+
+    // Per lane, where the ray enters @p b, or infinity if it misses or
+    // enters beyond that lane's nearest hit so far
+    const auto enter = [&](const Bounds3f& b) {
+        const Float4 x0 = (Float4::Splat(b.mMin.x) - ox) * ix;
+        const Float4 x1 = (Float4::Splat(b.mMax.x) - ox) * ix;
+        const Float4 y0 = (Float4::Splat(b.mMin.y) - oy) * iy;
+        const Float4 y1 = (Float4::Splat(b.mMax.y) - oy) * iy;
+        const Float4 z0 = (Float4::Splat(b.mMin.z) - oz) * iz;
+        const Float4 z1 = (Float4::Splat(b.mMax.z) - oz) * iz;
+        const Float4 entry = Max(Max(Min(x0, x1), Min(y0, y1)), Max(Min(z0, z1), zero));
+        const Float4 exit = Min(Min(Max(x0, x1), Max(y0, y1)), Max(z0, z1));
+        return Select(CmpLe(entry, exit) & CmpLe(entry, limit), entry, never);
+    };
+    const auto nearestLane = [](const Float4 entry) {
+        alignas(16) float lanes[4];
+        entry.Store(lanes);
+        return std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    };
+    // Leaves are tested against the object's own box, not the grown one
+    const auto childEntry = [&](const int32_t child) {
+        return enter(mNodes[child].IsLeaf() ? mObjectBounds[child] : mNodes[child].mBounds);
+    };
+
+    // Children are tested when their parent is visited and pushed far one
+    // first; by the time one is popped a nearer hit may have ruled it out
+    struct Entry {
+        Float4 mEntry;
+        int32_t mNode;
+    };
+    Entry stack[MAX_STACK];
+    uint32_t size = 0;
+    const Float4 rootEntry = childEntry(mRoot);
+    if (MoveMask(CmpLe(rootEntry, limit)) != 0) {
+        stack[size++] = {rootEntry, mRoot};
+    }
+    while (size > 0) {
+        const Entry top = stack[--size];
+        if (MoveMask(CmpLe(top.mEntry, limit)) == 0) {
+            continue;
+        }
+        const Node& node = mNodes[top.mNode];
+        if (node.IsLeaf()) {
+            alignas(16) float distances[4];
+            top.mEntry.Store(distances);
+            for (uint32_t lane = 0; lane < count; lane++) {
+                if (distances[lane] < nearest[lane]) {
+                    nearest[lane] = distances[lane];
+                    hits[lane] = {node.mUserData, distances[lane], true};
+                }
+            }
+            limit = Float4::Load(nearest);
+            continue;
+        }
+        const Float4 entry0 = childEntry(node.mChildren[0]);
+        const Float4 entry1 = childEntry(node.mChildren[1]);
+        const bool hit0 = MoveMask(CmpLe(entry0, limit)) != 0;
+        const bool hit1 = MoveMask(CmpLe(entry1, limit)) != 0;
+        if (size + 2 > MAX_STACK) {
+            ALOGE("AabbTree: ray cast stack overflow");
+            return;
+        }
+        if (hit0 && hit1) {
+            const bool firstIsNear = nearestLane(entry0) <= nearestLane(entry1);
+            stack[size++] = firstIsNear ? Entry{entry1, node.mChildren[1]}
+                                        : Entry{entry0, node.mChildren[0]};
+            stack[size++] = firstIsNear ? Entry{entry0, node.mChildren[0]}
+                                        : Entry{entry1, node.mChildren[1]};
+        } else if (hit0) {
+            stack[size++] = {entry0, node.mChildren[0]};
+        } else if (hit1) {
+            stack[size++] = {entry1, node.mChildren[1]};
+        }
+    }
+}
+
+uint32_t AabbTree::QuerySphere(const XrVector3f& center, const float radius,
+                               std::vector<uint32_t>& results) const {
+    const float radiusSq = radius * radius;
+    const auto overlaps = [&center, radiusSq](const Bounds3f& b) {
+        const float dx = std::max({b.mMin.x - center.x, 0.0f, center.x - b.mMax.x});
+        const float dy = std::max({b.mMin.y - center.y, 0.0f, center.y - b.mMax.y});
+        const float dz = std::max({b.mMin.z - center.z, 0.0f, center.z - b.mMax.z});
+        return dx * dx + dy * dy + dz * dz <= radiusSq;
+    };
+
+    const size_t start = results.size();
+    int32_t stack[MAX_STACK];
+    uint32_t size = 0;
+    if (mRoot != NULL_NODE) {
+        stack[size++] = mRoot;
+    }
+    while (size > 0) {
+        const int32_t index = stack[--size];
+        const Node& node = mNodes[index];
+        if (!overlaps(node.mBounds)) {
+            continue;
+        }
+        if (node.IsLeaf()) {
+            if (overlaps(mObjectBounds[index])) {
+                results.push_back(node.mUserData);
+            }
+        } else if (size + 2 <= MAX_STACK) {
+            stack[size++] = node.mChildren[0];
+            stack[size++] = node.mChildren[1];
+        }
+    }
+    return static_cast<uint32_t>(results.size() - start);
+}
+
+uint32_t AabbTree::QueryBox(const Bounds3f& box, std::vector<uint32_t>& results) const {
+    const size_t start = results.size();
+    int32_t stack[MAX_STACK];
+    uint32_t size = 0;
+    if (mRoot != NULL_NODE) {
+        stack[size++] = mRoot;
+    }
+    while (size > 0) {
+        const int32_t index = stack[--size];
+        const Node& node = mNodes[index];
+        if (!Overlaps(node.mBounds, box)) {
+            continue;
+        }
+        if (node.IsLeaf()) {
+            if (Overlaps(mObjectBounds[index], box)) {
+                results.push_back(node.mUserData);
+            }
+        } else if (size + 2 <= MAX_STACK) {
+            stack[size++] = node.mChildren[0];
+            stack[size++] = node.mChildren[1];
+        }
+    }
+    return static_cast<uint32_t>(results.size() - start);
+}
+
+uint32_t AabbTree::QueryFrustum(const FrustumPlanes& planes,
+                                std::vector<uint32_t>& results) const {
+    const PlanesSoA soa(planes);
+    const size_t start = results.size();
+
+    // Low bit set: already known to be wholly inside, so no more tests
+    int32_t stack[MAX_STACK];
+    uint32_t size = 0;
+    if (mRoot != NULL_NODE) {
+        stack[size++] = mRoot << 1;
+    }
+    while (size > 0) {
+        const int32_t entry = stack[--size];
+        const int32_t index = entry >> 1;
+        const Node& node = mNodes[index];
+        uint32_t inside = entry & 1;
+        if (!inside) {
+            const uint32_t result = soa.Classify(node.IsLeaf() ? mObjectBounds[index]
+                                                               : node.mBounds);
+            if (result == kOutside) {
+                continue;
+            }
+            inside = result == kInside ? 1 : 0;
+        }
+        if (node.IsLeaf()) {
+            results.push_back(node.mUserData);
+        } else if (size + 2 <= MAX_STACK) {
+            stack[size++] = (node.mChildren[0] << 1) | static_cast<int32_t>(inside);
+            stack[size++] = (node.mChildren[1] << 1) | static_cast<int32_t>(inside);
+        }
+    }
+    return static_cast<uint32_t>(results.size() - start);
+}
+
+AabbTree::FrustumPlanes AabbTree::MakeFrustumPlanes(const XrMatrix4x4f& viewProjection) {
+    // Column-major: row r is m[r], m[4 + r], m[8 + r], m[12 + r]
+    const float* m = viewProjection.m;
+    const auto row = [m](const int r) {
+        return XrVector4f{m[r], m[4 + r], m[8 + r], m[12 + r]};
+    };
+    const auto combine = [](const XrVector4f& a, const XrVector4f& b, const float sign) {
+        const XrVector4f p = {a.x + sign * b.x, a.y + sign * b.y, a.z + sign * b.z,
+                              a.w + sign * b.w};
+        const float length = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        const float scale = length > 0.0f ? 1.0f / length : 1.0f;
+        return XrVector4f{p.x * scale, p.y * scale, p.z * scale, p.w * scale};
+    };
+    const XrVector4f w = row(3);
+    // -w <= x, y, z <= w
+    return {combine(w, row(0), 1.0f), combine(w, row(0), -1.0f),
+            combine(w, row(1), 1.0f), combine(w, row(1), -1.0f),
+            combine(w, row(2), 1.0f), combine(w, row(2), -1.0f)};
+}
+
+AabbTree::Stats AabbTree::GetStats() const {
+    Stats stats = mStats;
+    stats.mProxies = mProxyCount;
+    stats.mNodes = mProxyCount > 0 ? 2 * mProxyCount - 1 : 0;
+    stats.mHeight = mRoot != NULL_NODE ? static_cast<uint32_t>(mNodes[mRoot].mHeight) : 0;
+    return stats;
+}
+
+void AabbTree::ResetStats() {
+    mStats.mRefits = 0;
+    mStats.mReinserts = 0;
+    mStats.mRotations = 0;
+}
+
+bool AabbTree::Validate() const {
+    if (mRoot == NULL_NODE) {
+        return mProxyCount == 0;
+    }
+    if (mNodes[mRoot].mParent != NULL_NODE) {
+        ALOGE("AabbTree: root %d has a parent", mRoot);
+        return false;
+    }
+
+    uint32_t leaves = 0;
+    std::vector<int32_t> stack = {mRoot};
+    while (!stack.empty()) {
+        const int32_t index = stack.back();
+        stack.pop_back();
+        const Node& node = mNodes[index];
+        if (node.IsLeaf()) {
+            if (node.mHeight != 0 || !Contains(node.mBounds, mObjectBounds[index])) {
+                ALOGE("AabbTree: leaf %d has height %d or does not contain its object", index,
+                      node.mHeight);
+                return false;
+            }
+            leaves++;
+            continue;
+        }
+        const Node& child0 = mNodes[node.mChildren[0]];
+        const Node& child1 = mNodes[node.mChildren[1]];
+        if (child0.mParent != index || child1.mParent != index) {
+            ALOGE("AabbTree: node %d's children do not point back to it", index);
+            return false;
+        }
+        if (node.mHeight != 1 + std::max(child0.mHeight, child1.mHeight)) {
+            ALOGE("AabbTree: node %d has height %d over children of %d and %d", index,
+                  node.mHeight, child0.mHeight, child1.mHeight);
+            return false;
+        }
+        if (!Equal(node.mBounds, Union(child0.mBounds, child1.mBounds))) {
+            ALOGE("AabbTree: node %d's box is not its children's union", index);
+            return false;
+        }
+        stack.push_back(node.mChildren[0]);
+        stack.push_back(node.mChildren[1]);
+    }
+    if (leaves != mProxyCount) {
+        ALOGE("AabbTree: %u leaves reachable, %u proxies", leaves, mProxyCount);
+        return false;
+    }
+    return true;
+}
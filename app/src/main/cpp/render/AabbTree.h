@@ -0,0 +1,177 @@
+/*******************************************************************************
+
+Filename    :   AabbTree.h
+Content     :   Dynamic bounding-volume tree for ray, overlap and frustum
+                queries against scene objects
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../utils/MathUtils.h"
+
+#include <openxr/openxr.h>
+#include <xr_linear.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * AabbTree - binary tree of axis-aligned boxes over objects that move.
+ *
+ * Each leaf holds an object's box grown by a margin (and, when it moves,
+ * by its predicted displacement), so small moves that stay inside it cost
+ * nothing. A move that leaves it refits the leaf and its ancestors in place;
+ * one that leaves it entirely (a teleport) removes and reinserts the leaf.
+ * Inserts descend by surface-area cost. On the way back up, a node whose
+ * children's heights differ by more than one is rotated to even them out;
+ * otherwise a child and grandchild swap places if that shrinks the tree's
+ * surface area without unbalancing it. Quality holds up under refits
+ * without periodic rebuilds, and depth stays logarithmic.
+ *
+ * Queries test against the objects' own boxes, not the grown ones. Ray casts
+ * trace up to four rays at once, one per SIMD lane, so both controllers'
+ * rays share a single traversal, nearer children first, on a fixed-size
+ * stack. Frustum queries test four planes per
+ * instruction and stop testing below nodes wholly inside.
+ *
+ * Not thread-safe; queries may run concurrently with each other only.
+ */
+class AabbTree {
+public:
+    using ProxyId = int32_t;
+    static constexpr ProxyId INVALID_PROXY = -1;
+
+    // Rays traced together in one traversal
+    static constexpr uint32_t MAX_BATCH_RAYS = 4;
+    // Growth on every side of a leaf's box, in scene units
+    static constexpr float MARGIN = 0.05f;
+    // Leaf boxes also extend this many frames of displacement ahead
+    static constexpr float DISPLACEMENT_FRAMES = 2.0f;
+
+    struct Ray {
+        XrVector3f mOrigin = {0.0f, 0.0f, 0.0f};
+        XrVector3f mDirection = {0.0f, 0.0f, -1.0f};  // need not be normalized
+        float mMaxDistance = 100.0f;  // in units of mDirection's length
+    };
+
+    struct RayHit {
+        uint32_t mUserData = 0;
+        float mDistance = 0.0f;
+        bool mHit = false;
+    };
+
+    // Planes with normals pointing inward: a point is inside if
+    // dot(normal, p) + w >= 0 for all six
+    using FrustumPlanes = std::array<XrVector4f, 6>;
+
+    struct Stats {
+        uint32_t mProxies = 0;
+        uint32_t mNodes = 0;
+        uint32_t mHeight = 0;
+        // Since the last ResetStats()
+        uint32_t mRefits = 0;
+        uint32_t mReinserts = 0;
+        uint32_t mRotations = 0;
+    };
+
+    AabbTree() = default;
+    ~AabbTree() = default;
+
+    AabbTree(const AabbTree&) = delete;
+    AabbTree& operator=(const AabbTree&) = delete;
+
+    /**
+     * Add an object. @p userData comes back from queries.
+     */
+    ProxyId Insert(const MathUtils::Bounds3f& bounds, uint32_t userData);
+    void Remove(ProxyId proxy);
+
+    /**
+     * Update an object's box.
+     *
+     * @param displacement How far it moved since the last call; leaf boxes
+     *                     are stretched along it so steady motion seldom
+     *                     touches the tree
+     * @return true if the tree changed
+     */
+    bool Move(ProxyId proxy, const MathUtils::Bounds3f& bounds, const XrVector3f& displacement);
+
+    void Clear();
+
+    uint32_t GetUserData(const ProxyId proxy) const { return mNodes[proxy].mUserData; }
+    const MathUtils::Bounds3f& GetBounds(const ProxyId proxy) const { return mObjectBounds[proxy]; }
+
+    /**
+     * Nearest hit along each ray. @p count may exceed MAX_BATCH_RAYS; rays
+     * are traced in groups of that many.
+     */
+    void RayCast(const Ray* rays, uint32_t count, RayHit* hits) const;
+
+    /**
+     * Append the user data of every object overlapping the shape to @p results.
+     *
+     * @return number appended
+     */
+    uint32_t QuerySphere(const XrVector3f& center, float radius,
+                         std::vector<uint32_t>& results) const;
+    uint32_t QueryBox(const MathUtils::Bounds3f& box, std::vector<uint32_t>& results) const;
+    uint32_t QueryFrustum(const FrustumPlanes& planes, std::vector<uint32_t>& results) const;
+
+    /**
+     * Inward planes of the frustum a view-projection matrix maps to GL clip
+     * space, for QueryFrustum().
+     */
+    static FrustumPlanes MakeFrustumPlanes(const XrMatrix4x4f& viewProjection);
+
+    // A snapshot; reading it writes nothing, so it may overlap queries
+    Stats GetStats() const;
+    void ResetStats();
+
+    /**
+     * Check parent links, heights and containment; logs and returns false
+     * on the first violation. For tests and tools.
+     */
+    bool Validate() const;
+
+private:
+    static constexpr int32_t NULL_NODE = -1;
+    // Enough for any height-balanced tree that fits in memory
+    static constexpr uint32_t MAX_STACK = 64;
+
+    struct Node {
+        MathUtils::Bounds3f mBounds;  // grown, for leaves
+        int32_t mParent = NULL_NODE;  // next free node while on the free list
+        int32_t mChildren[2] = {NULL_NODE, NULL_NODE};
+        int32_t mHeight = 0;  // 0 for leaves, -1 while free
+        uint32_t mUserData = 0;
+
+        bool IsLeaf() const { return mChildren[0] == NULL_NODE; }
+    };
+
+    int32_t AllocateNode();
+    void FreeNode(int32_t node);
+    void InsertLeaf(int32_t leaf);
+    void RemoveLeaf(int32_t leaf);
+    // Refit bounds and heights from @p node to the root, balancing and
+    // rotating on the way; stops early once nothing changes if @p early
+    void Fixup(int32_t node, bool early);
+    int32_t Balance(int32_t node);
+    bool Rotate(int32_t node);
+    void ReplaceChild(int32_t parent, int32_t oldChild, int32_t newChild);
+    void RayCastGroup(const Ray* rays, uint32_t count, RayHit* hits) const;
+
+    std::vector<Node> mNodes;
+    // Objects' own boxes, indexed like mNodes; only leaves' are meaningful
+    std::vector<MathUtils::Bounds3f> mObjectBounds;
+    int32_t mRoot = NULL_NODE;
+    int32_t mFreeList = NULL_NODE;
+    uint32_t mProxyCount = 0;
+
+    // Update counters only; the shape fields are filled in by GetStats()
+    Stats mStats;
+};
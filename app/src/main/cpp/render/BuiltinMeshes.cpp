@@ -0,0 +1,145 @@
+/*******************************************************************************
+
+Filename    :   BuiltinMeshes.cpp
+Content     :   Procedural meshes every scene can use, and their names in an
+                asset package
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "BuiltinMeshes.h"
+#include "../utils/LogUtils.h"
+#include "../utils/MathUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+
+namespace {
+    // Sphere detail levels, finest first: icosahedron subdivisions per level
+    constexpr int kSphereSubdivisions[] = {4, 3, 2, 1, 0};
+    static_assert(std::size(kSphereSubdivisions) <= LodSelector::MAX_LEVELS);
+
+    // Two triangles spanning a unit face at +0.5 along its normal
+    void AppendFace(std::vector<MeshVertex>& vertices, std::vector<uint16_t>& indices,
+                    const XrVector3f& normal, const XrVector3f& right, const XrVector3f& up,
+                    const float offset) {
+        const float corners[6][2] = {{-0.5f, -0.5f}, {0.5f, -0.5f}, {0.5f, 0.5f},
+                                     {-0.5f, -0.5f}, {0.5f, 0.5f}, {-0.5f, 0.5f}};
+        for (const auto& c : corners) {
+            const XrVector3f p = normal * offset + right * c[0] + up * c[1];
+            indices.push_back(static_cast<uint16_t>(vertices.size()));
+            vertices.push_back({{p.x, p.y, p.z}, {normal.x, normal.y, normal.z}});
+        }
+    }
+
+    // Icosahedron subdivided @p subdivisions times and pushed out onto a
+    // unit-diameter sphere. Returns how far its flat faces sink below the
+    // sphere, in the same units.
+    float AppendIcosphere(std::vector<MeshVertex>& vertices, std::vector<uint16_t>& indices,
+                          const int subdivisions) {
+        const float t = 0.5f * (1.0f + std::sqrt(5.0f));
+        std::vector<XrVector3f> points = {
+                {-1.0f, t, 0.0f}, {1.0f, t, 0.0f}, {-1.0f, -t, 0.0f}, {1.0f, -t, 0.0f},
+                {0.0f, -1.0f, t}, {0.0f, 1.0f, t}, {0.0f, -1.0f, -t}, {0.0f, 1.0f, -t},
+                {t, 0.0f, -1.0f}, {t, 0.0f, 1.0f}, {-t, 0.0f, -1.0f}, {-t, 0.0f, 1.0f}};
+        for (XrVector3f& p : points) {
+            p = MathUtils::Normalized(p);
+        }
+        // Counter-clockwise seen from outside
+        std::vector<std::array<uint32_t, 3>> faces = {
+                {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+                {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+                {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+                {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}};
+
+        for (int level = 0; level < subdivisions; level++) {
+            std::map<std::pair<uint32_t, uint32_t>, uint32_t> midpoints;
+            const auto midpoint = [&points, &midpoints](const uint32_t a, const uint32_t b) {
+                const auto key = std::make_pair(std::min(a, b), std::max(a, b));
+                const auto found = midpoints.find(key);
+                if (found != midpoints.end()) {
+                    return found->second;
+                }
+                points.push_back(MathUtils::Normalized(points[a] + points[b]));
+                const uint32_t index = static_cast<uint32_t>(points.size() - 1);
+                midpoints.emplace(key, index);
+                return index;
+            };
+            std::vector<std::array<uint32_t, 3>> split;
+            split.reserve(faces.size() * 4);
+            for (const auto& f : faces) {
+                const uint32_t ab = midpoint(f[0], f[1]);
+                const uint32_t bc = midpoint(f[1], f[2]);
+                const uint32_t ca = midpoint(f[2], f[0]);
+                split.push_back({f[0], ab, ca});
+                split.push_back({f[1], bc, ab});
+                split.push_back({f[2], ca, bc});
+                split.push_back({ab, bc, ca});
+            }
+            faces = std::move(split);
+        }
+
+        const size_t base = vertices.size();
+        for (const XrVector3f& n : points) {
+            vertices.push_back({{0.5f * n.x, 0.5f * n.y, 0.5f * n.z}, {n.x, n.y, n.z}});
+        }
+        float minCentroid = 1.0f;
+        for (const auto& f : faces) {
+            for (const uint32_t index : f) {
+                indices.push_back(static_cast<uint16_t>(base + index));
+            }
+            const XrVector3f centroid =
+                    (points[f[0]] + points[f[1]] + points[f[2]]) * (1.0f / 3.0f);
+            minCentroid = std::min(minCentroid, std::sqrt(MathUtils::Dot(centroid, centroid)));
+        }
+        return 0.5f * (1.0f - minCentroid);
+    }
+} // anonymous namespace
+
+BuiltinMeshes BuiltinMeshes::Build() {
+    // A unit quad facing +Z, a unit cube, then each sphere level
+    BuiltinMeshes meshes;
+    std::vector<MeshVertex>& vertices = meshes.mVertices;
+    std::vector<uint16_t>& indices = meshes.mIndices;
+    const auto addLevel = [&indices](LodSelector::Mesh& mesh, const uint32_t firstIndex,
+                                     const float error) {
+        LodSelector::Level& level = mesh.mLevels[mesh.mLevelCount++];
+        level.mFirstIndex = firstIndex;
+        level.mIndexCount = static_cast<uint32_t>(indices.size()) - firstIndex;
+        level.mError = error;
+    };
+    const XrVector3f axisX = {1.0f, 0.0f, 0.0f};
+    const XrVector3f axisY = {0.0f, 1.0f, 0.0f};
+    const XrVector3f axisZ = {0.0f, 0.0f, 1.0f};
+    AppendFace(vertices, indices, axisZ, axisX, axisY, 0.0f);
+    addLevel(meshes.mMeshes[static_cast<size_t>(SceneMesh::QUAD)], 0, 0.0f);
+
+    const uint32_t cubeFirst = static_cast<uint32_t>(indices.size());
+    AppendFace(vertices, indices, axisZ, axisX, axisY, 0.5f);
+    AppendFace(vertices, indices, axisZ * -1.0f, axisX * -1.0f, axisY, 0.5f);
+    AppendFace(vertices, indices, axisX, axisZ * -1.0f, axisY, 0.5f);
+    AppendFace(vertices, indices, axisX * -1.0f, axisZ, axisY, 0.5f);
+    AppendFace(vertices, indices, axisY, axisX, axisZ * -1.0f, 0.5f);
+    AppendFace(vertices, indices, axisY * -1.0f, axisX, axisZ, 0.5f);
+    addLevel(meshes.mMeshes[static_cast<size_t>(SceneMesh::CUBE)], cubeFirst, 0.0f);
+
+    // Error is measured against the finest level, not the true sphere
+    LodSelector::Mesh& sphere = meshes.mMeshes[static_cast<size_t>(SceneMesh::SPHERE)];
+    float finestError = 0.0f;
+    for (const int subdivisions : kSphereSubdivisions) {
+        const uint32_t first = static_cast<uint32_t>(indices.size());
+        const float error = AppendIcosphere(vertices, indices, subdivisions);
+        if (sphere.mLevelCount == 0) {
+            finestError = error;
+        }
+        addLevel(sphere, first, std::max(error - finestError, 0.0f));
+    }
+    if (vertices.size() > 0xFFFF) {
+        ALOGE("BuiltinMeshes: %zu vertices overflow 16-bit indices", vertices.size());
+    }
+    return meshes;
+}
@@ -0,0 +1,57 @@
+/*******************************************************************************
+
+Filename    :   BuiltinMeshes.h
+Content     :   Procedural meshes every scene can use, and their names in an
+                asset package
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "LodSelector.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class SceneMesh : uint8_t {
+    QUAD,   // unit square in the XY plane, facing +Z
+    CUBE,   // unit cube centered on the origin
+    SPHERE  // unit-diameter sphere centered on the origin, with detail levels
+};
+
+// AssetFormat::VertexLayout::POSITION_NORMAL
+struct MeshVertex {
+    float mPosition[3];
+    float mNormal[3];
+};
+
+/**
+ * BuiltinMeshes - geometry for every SceneMesh in one shared vertex and
+ * index buffer, each detail level an index range into it.
+ *
+ * Build() generates it from scratch; tools/AssetPacker.cpp writes the same
+ * data into a package under the names below, so a device can map it
+ * instead of generating it at startup.
+ */
+struct BuiltinMeshes {
+    static constexpr size_t MESH_COUNT = 3;
+    using MeshLods = std::array<LodSelector::Mesh, MESH_COUNT>;
+
+    // Asset package names
+    static constexpr const char* GROUP = "scene";
+    static constexpr const char* VERTICES = "scene.vertices";
+    static constexpr const char* INDICES = "scene.indices";
+    static constexpr const char* MESH_NAMES[MESH_COUNT] = {"mesh.quad", "mesh.cube",
+                                                           "mesh.sphere"};
+
+    std::vector<MeshVertex> mVertices;
+    std::vector<uint16_t> mIndices;
+    MeshLods mMeshes = {};
+
+    static BuiltinMeshes Build();
+};
@@ -0,0 +1,336 @@
+/*******************************************************************************
+
+Filename    :   ClusteredLighting.cpp
+Content     :   Clustered forward lighting: CPU light binning into a froxel
+                grid shared by both eyes
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "ClusteredLighting.h"
+#include "../gl/ResourcePool.h"
+#include "../utils/JobSystem.h"
+#include "../utils/LogUtils.h"
+#include "../utils/Simd.h"
+
+#include <xr_linear.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    // Depth range covered by the slices, measured from the cluster origin.
+    // Fragments outside it use the first or last slice.
+    constexpr float kClusterNear = 0.1f;
+    constexpr float kClusterFar = 50.0f;
+
+    // Depth slices per job chunk; a slice alone is too little work to be
+    // worth waking a worker for
+    constexpr uint32_t kSlicesPerJob = 4;
+
+    // std140 layout of the ClusterLighting block
+    struct ClusterUniforms {
+        XrMatrix4x4f mClusterView;           // scene space -> cluster space
+        float mTileScaleBias[4];             // tangent -> tile: x scale, x bias, y scale, y bias
+        float mDepthParams[4];               // near, slices per log unit, unused, unused
+        float mLightPositionRadius[ClusteredLighting::MAX_LIGHTS][4];
+        float mLightColor[ClusteredLighting::MAX_LIGHTS][4];
+    };
+
+    constexpr uint32_t AlignUp4(const uint32_t value) {
+        return (value + 3u) & ~3u;
+    }
+} // anonymous namespace
+
+bool ClusteredLighting::Init(JobSystem* jobs) {
+    mJobs = jobs;
+
+    for (uint32_t z = 0; z <= GRID_Z; z++) {
+        mSliceDepths[z] = kClusterNear * std::pow(kClusterFar / kClusterNear,
+                                                  static_cast<float>(z) / GRID_Z);
+    }
+
+    glGenTextures(kTextureCount, mTextures.data());
+    for (const GLuint texture : mTextures) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, kTextureWidth, kTextureHeight);
+        // Integer textures are incomplete with linear filtering
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    const GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        ALOGE("ClusteredLighting: failed to create light list textures (0x%x)", error);
+        Shutdown();
+        return false;
+    }
+    return true;
+}
+
+void ClusteredLighting::Shutdown() {
+    if (mTextures[0] != 0) {
+        glDeleteTextures(kTextureCount, mTextures.data());
+        mTextures = {};
+    }
+    mUniformAllocation = {};
+    mJobs = nullptr;
+}
+
+GpuMemoryUsage ClusteredLighting::GetGpuMemory() const {
+    GpuMemoryUsage usage;
+    if (mTextures[0] != 0) {
+        const GpuResourceDesc lists =
+                GpuResourceDesc::Texture2D(GL_R8UI, kTextureWidth, kTextureHeight);
+        usage.Add(lists.GetMemoryCategory(), lists.GetSizeBytes() * kTextureCount);
+    }
+    return usage;
+}
+
+void ClusteredLighting::Update(const StereoFrustum& frustum, const PointLight* lights,
+                               uint32_t lightCount, StreamingBuffer& uniforms, FrameStats& stats) {
+    mUniformAllocation = {};
+    if (mTextures[0] == 0) {
+        return;
+    }
+
+    const auto binStart = std::chrono::steady_clock::now();
+
+    if (lightCount > MAX_LIGHTS) {
+        ALOGW("ClusteredLighting: %u lights, only the first %u are used", lightCount, MAX_LIGHTS);
+        lightCount = MAX_LIGHTS;
+    }
+
+    mFrustum = frustum;
+
+    XrPosef sceneToCluster;
+    XrPosef_Invert(&sceneToCluster, &mFrustum.mPose);
+
+    mLightCount = lightCount;
+    for (uint32_t i = 0; i < lightCount; i++) {
+        XrVector3f p;
+        XrPosef_TransformVector3f(&p, &sceneToCluster, &lights[i].mPosition);
+        mLightX[i] = p.x;
+        mLightY[i] = p.y;
+        mLightDepth[i] = -p.z;
+        mLightRadius[i] = lights[i].mRadius;
+    }
+    // Padding lanes sit far behind the apex with no radius
+    for (uint32_t i = lightCount; i < AlignUp4(lightCount); i++) {
+        mLightX[i] = mLightY[i] = 0.0f;
+        mLightDepth[i] = -1.0e6f;
+        mLightRadius[i] = 0.0f;
+    }
+
+    if (mJobs != nullptr) {
+        mJobs->ParallelFor(GRID_Z, kSlicesPerJob, [this](const uint32_t begin, const uint32_t end) {
+            for (uint32_t z = begin; z < end; z++) {
+                BinSlice(z);
+            }
+        });
+    } else {
+        for (uint32_t z = 0; z < GRID_Z; z++) {
+            BinSlice(z);
+        }
+    }
+
+    mStats = {};
+    mStats.mLightCount = lightCount;
+    for (const SliceStats& slice : mSliceStats) {
+        mStats.mLightIndices += slice.mIndices;
+        mStats.mMaxClusterLights = std::max(mStats.mMaxClusterLights, slice.mMaxLights);
+        mStats.mOverflowClusters += slice.mOverflows;
+    }
+    mStats.mBinNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - binStart).count();
+    stats.mLightBinNs += mStats.mBinNs;
+
+    if (mStats.mOverflowClusters > 0) {
+        ALOGV("ClusteredLighting: %u clusters over %u lights (max %u)", mStats.mOverflowClusters,
+              MAX_LIGHTS_PER_CLUSTER, mStats.mMaxClusterLights);
+    }
+
+    // Light lists: rotate through the textures so this upload never waits
+    // on a frame the GPU may still be reading
+    mCurrentTexture = (mCurrentTexture + 1) % kTextureCount;
+    COUNT_GL(stats, glBindTexture(GL_TEXTURE_2D, mTextures[mCurrentTexture]));
+    COUNT_GL(stats, glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    COUNT_GL(stats, glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kTextureWidth, kTextureHeight,
+                                    GL_RED_INTEGER, GL_UNSIGNED_BYTE, mClusterData.data()));
+    COUNT_GL(stats, glBindTexture(GL_TEXTURE_2D, 0));
+
+    // Frustum mapping and light data
+    const StreamingBuffer::Allocation alloc = uniforms.AllocateUniform(sizeof(ClusterUniforms));
+    if (!alloc.IsValid()) {
+        return;
+    }
+    auto* block = static_cast<ClusterUniforms*>(alloc.mCpuPtr);
+    XrMatrix4x4f_CreateFromRigidTransform(&block->mClusterView, &sceneToCluster);
+    const float xScale = GRID_X / (mFrustum.mTanRight - mFrustum.mTanLeft);
+    const float yScale = GRID_Y / (mFrustum.mTanUp - mFrustum.mTanDown);
+    block->mTileScaleBias[0] = xScale;
+    block->mTileScaleBias[1] = -mFrustum.mTanLeft * xScale;
+    block->mTileScaleBias[2] = yScale;
+    block->mTileScaleBias[3] = -mFrustum.mTanDown * yScale;
+    block->mDepthParams[0] = kClusterNear;
+    block->mDepthParams[1] = GRID_Z / std::log(kClusterFar / kClusterNear);
+    block->mDepthParams[2] = 0.0f;
+    block->mDepthParams[3] = 0.0f;
+    for (uint32_t i = 0; i < lightCount; i++) {
+        const PointLight& light = lights[i];
+        block->mLightPositionRadius[i][0] = light.mPosition.x;
+        block->mLightPositionRadius[i][1] = light.mPosition.y;
+        block->mLightPositionRadius[i][2] = light.mPosition.z;
+        block->mLightPositionRadius[i][3] = light.mRadius;
+        block->mLightColor[i][0] = light.mColor.x;
+        block->mLightColor[i][1] = light.mColor.y;
+        block->mLightColor[i][2] = light.mColor.z;
+        block->mLightColor[i][3] = 0.0f;
+    }
+    uniforms.Commit(alloc);
+    mUniformAllocation = alloc;
+}
+
+void ClusteredLighting::BinSlice(const uint32_t slice) {
+    const float nearDepth = mSliceDepths[slice];
+    const float farDepth = mSliceDepths[slice + 1];
+
+    // Pass 1: keep lights that overlap this slice's depth range at all
+    alignas(16) float candX[MAX_LIGHTS + 4];
+    alignas(16) float candY[MAX_LIGHTS + 4];
+    alignas(16) float candDepth[MAX_LIGHTS + 4];
+    alignas(16) float candRadiusSq[MAX_LIGHTS + 4];
+    uint8_t candIndex[MAX_LIGHTS + 4];
+    uint32_t candCount = 0;
+
+    const Float4 sliceNear = Float4::Splat(nearDepth);
+    const Float4 sliceFar = Float4::Splat(farDepth);
+    for (uint32_t i = 0; i < mLightCount; i += 4) {
+        const Float4 depth = Float4::Load(&mLightDepth[i]);
+        const Float4 radius = Float4::Load(&mLightRadius[i]);
+        uint32_t mask = MoveMask(CmpGe(depth + radius, sliceNear) &
+                                 CmpLe(depth - radius, sliceFar));
+        while (mask != 0) {
+            const uint32_t light = i + static_cast<uint32_t>(__builtin_ctz(mask));
+            mask &= mask - 1;
+            candX[candCount] = mLightX[light];
+            candY[candCount] = mLightY[light];
+            candDepth[candCount] = mLightDepth[light];
+            candRadiusSq[candCount] = mLightRadius[light] * mLightRadius[light];
+            candIndex[candCount] = static_cast<uint8_t>(light);
+            candCount++;
+        }
+    }
+    // A negative squared radius never passes the distance test
+    for (uint32_t i = candCount; i < AlignUp4(candCount); i++) {
+        candX[i] = candY[i] = candDepth[i] = 0.0f;
+        candRadiusSq[i] = -1.0f;
+    }
+
+    // Pass 2: sphere vs. each froxel's bounding box, four candidates at a time
+    SliceStats sliceStats;
+    const Float4 zero = Float4::Splat(0.0f);
+    const Float4 boxMinDepth = sliceNear;
+    const Float4 boxMaxDepth = sliceFar;
+    const float tileTanWidth = (mFrustum.mTanRight - mFrustum.mTanLeft) / GRID_X;
+    const float tileTanHeight = (mFrustum.mTanUp - mFrustum.mTanDown) / GRID_Y;
+
+    for (uint32_t y = 0; y < GRID_Y; y++) {
+        const float tanY0 = mFrustum.mTanDown + tileTanHeight * static_cast<float>(y);
+        const float tanY1 = tanY0 + tileTanHeight;
+        const Float4 boxMinY = Float4::Splat(std::min(tanY0 * nearDepth, tanY0 * farDepth));
+        const Float4 boxMaxY = Float4::Splat(std::max(tanY1 * nearDepth, tanY1 * farDepth));
+        uint8_t* row = &mClusterData[(slice * GRID_Y + y) * kTextureWidth];
+
+        for (uint32_t x = 0; x < GRID_X; x++) {
+            const float tanX0 = mFrustum.mTanLeft + tileTanWidth * static_cast<float>(x);
+            const float tanX1 = tanX0 + tileTanWidth;
+            const Float4 boxMinX = Float4::Splat(std::min(tanX0 * nearDepth, tanX0 * farDepth));
+            const Float4 boxMaxX = Float4::Splat(std::max(tanX1 * nearDepth, tanX1 * farDepth));
+
+            uint8_t* list = row + x * kRowTexels;
+            uint32_t count = 0;
+            uint32_t hits = 0;
+            for (uint32_t i = 0; i < candCount; i += 4) {
+                const Float4 px = Float4::Load(&candX[i]);
+                const Float4 py = Float4::Load(&candY[i]);
+                const Float4 pd = Float4::Load(&candDepth[i]);
+                // Distance from the sphere center to the box, per axis
+                const Float4 ex = Max(Max(boxMinX - px, px - boxMaxX), zero);
+                const Float4 ey = Max(Max(boxMinY - py, py - boxMaxY), zero);
+                const Float4 ed = Max(Max(boxMinDepth - pd, pd - boxMaxDepth), zero);
+                const Float4 distSq = MulAdd(ex, ex, MulAdd(ey, ey, ed * ed));
+                uint32_t mask = MoveMask(CmpLe(distSq, Float4::Load(&candRadiusSq[i])));
+                while (mask != 0) {
+                    const uint32_t lane = static_cast<uint32_t>(__builtin_ctz(mask));
+                    mask &= mask - 1;
+                    hits++;
+                    if (count < MAX_LIGHTS_PER_CLUSTER) {
+                        list[1 + count++] = candIndex[i + lane];
+                    }
+                }
+            }
+            list[0] = static_cast<uint8_t>(count);
+
+            sliceStats.mIndices += count;
+            sliceStats.mMaxLights = std::max(sliceStats.mMaxLights, hits);
+            sliceStats.mOverflows += hits > count ? 1 : 0;
+        }
+    }
+    mSliceStats[slice] = sliceStats;
+}
+
+bool ClusteredLighting::Bind(const GLuint uniformBinding, const GLuint textureUnit,
+                             FrameStats& stats) const {
+    if (!mUniformAllocation.IsValid()) {
+        return false;
+    }
+    COUNT_GL(stats, glBindBufferRange(GL_UNIFORM_BUFFER, uniformBinding, mUniformAllocation.mBuffer,
+                                      mUniformAllocation.mOffset, mUniformAllocation.mSize));
+    COUNT_GL(stats, glActiveTexture(GL_TEXTURE0 + textureUnit));
+    COUNT_GL(stats, glBindTexture(GL_TEXTURE_2D, mTextures[mCurrentTexture]));
+    return true;
+}
+
+std::string ClusteredLighting::GetShaderSource() {
+    const std::string gridX = std::to_string(GRID_X);
+    const std::string gridY = std::to_string(GRID_Y);
+    const std::string gridZ = std::to_string(GRID_Z);
+    const std::string rowTexels = std::to_string(kRowTexels);
+    const std::string maxLights = std::to_string(MAX_LIGHTS);
+
+    return "layout(std140) uniform ClusterLighting {\n"
+           "    mat4 uClusterView;\n"
+           "    vec4 uTileScaleBias;\n"
+           "    vec4 uDepthParams;\n"
+           "    vec4 uLightPositionRadius[" + maxLights + "];\n"
+           "    vec4 uLightColor[" + maxLights + "];\n"
+           "};\n"
+           "uniform highp usampler2D uClusterLightLists;\n"
+           "vec3 ClusteredLighting(highp vec3 worldPos, vec3 normal, vec3 albedo) {\n"
+           "    highp vec3 p = (uClusterView * vec4(worldPos, 1.0)).xyz;\n"
+           "    highp float depth = max(-p.z, 1e-4);\n"
+           "    ivec2 tile = ivec2(p.xy / depth * uTileScaleBias.xz + uTileScaleBias.yw);\n"
+           "    tile = clamp(tile, ivec2(0), ivec2(" + gridX + " - 1, " + gridY + " - 1));\n"
+           "    int slice = int(log(depth / uDepthParams.x) * uDepthParams.y);\n"
+           "    slice = clamp(slice, 0, " + gridZ + " - 1);\n"
+           "    ivec2 list = ivec2(tile.x * " + rowTexels + ", slice * " + gridY + " + tile.y);\n"
+           "    int count = int(texelFetch(uClusterLightLists, list, 0).r);\n"
+           "    vec3 lit = vec3(0.0);\n"
+           "    for (int i = 0; i < count; i++) {\n"
+           "        int light = int(texelFetch(uClusterLightLists, list + ivec2(1 + i, 0), 0).r);\n"
+           "        highp vec4 positionRadius = uLightPositionRadius[light];\n"
+           "        highp vec3 toLight = positionRadius.xyz - worldPos;\n"
+           "        highp float distSq = dot(toLight, toLight);\n"
+           "        float falloff = clamp(1.0 - distSq / (positionRadius.w * positionRadius.w), 0.0, 1.0);\n"
+           "        float nDotL = max(dot(normal, toLight * inversesqrt(max(distSq, 1e-6))), 0.0);\n"
+           "        lit += uLightColor[light].rgb * (falloff * falloff * nDotL);\n"
+           "    }\n"
+           "    return albedo * lit;\n"
+           "}\n";
+}
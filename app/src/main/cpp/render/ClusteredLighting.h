@@ -0,0 +1,149 @@
+/*******************************************************************************
+
+Filename    :   ClusteredLighting.h
+Content     :   Clustered forward lighting: CPU light binning into a froxel
+                grid shared by both eyes
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../gl/StreamingBuffer.h"
+#include "../utils/FrameStats.h"
+#include "../utils/GpuMemory.h"
+#include "StereoFrustum.h"
+
+#include <GLES3/gl3.h>
+#include <GLES3/gl3ext.h>
+
+#include <openxr/openxr.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+class JobSystem;
+
+struct PointLight {
+    XrVector3f mPosition;   // scene reference space
+    float mRadius;          // influence ends here
+    XrVector3f mColor;      // linear, premultiplied by intensity
+};
+
+/**
+ * ClusteredLighting - assigns lights to view-space froxels once per frame.
+ *
+ * The view volume is cut into GRID_X x GRID_Y tiles in tangent space and
+ * GRID_Z exponentially spaced depth slices. Each light sphere is tested
+ * against every froxel's bounds on the CPU, four lights at a time, and the
+ * resulting per-froxel light lists are uploaded as an integer texture. The
+ * fragment shader finds its froxel from its world position and only loops
+ * over the lights listed there.
+ *
+ * Both eyes share one grid, built for the StereoFrustum enclosing both eye
+ * frusta. Fragments therefore index it by world position rather than
+ * gl_FragCoord, and binning runs once per frame instead of once per eye.
+ *
+ * Binning splits depth slices across a JobSystem if one is given.
+ */
+class ClusteredLighting {
+public:
+    static constexpr uint32_t GRID_X = 8;
+    static constexpr uint32_t GRID_Y = 8;
+    static constexpr uint32_t GRID_Z = 16;
+    static constexpr uint32_t MAX_LIGHTS = 64;
+    // One texel of each froxel's row holds the count, the rest indices
+    static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 31;
+
+    static constexpr const char* UNIFORM_BLOCK_NAME = "ClusterLighting";
+
+    struct Stats {
+        int64_t mBinNs = 0;
+        uint32_t mLightCount = 0;        // lights binned (capped at MAX_LIGHTS)
+        uint32_t mLightIndices = 0;      // sum of all froxel list lengths
+        uint32_t mMaxClusterLights = 0;  // longest froxel list, before capping
+        uint32_t mOverflowClusters = 0;  // froxels that dropped lights
+    };
+
+    ClusteredLighting() = default;
+    ~ClusteredLighting() = default;
+
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+    /**
+     * Create the light list textures. Requires a current GL context.
+     *
+     * @param jobs Optional worker pool for binning; must outlive this object
+     */
+    bool Init(JobSystem* jobs = nullptr);
+    void Shutdown();
+
+    /**
+     * Bin @p lights for this frame's combined eye frustum and upload the
+     * results. Call once per frame, after @p uniforms' BeginFrame().
+     */
+    void Update(const StereoFrustum& frustum, const PointLight* lights, uint32_t lightCount,
+                StreamingBuffer& uniforms, FrameStats& stats);
+
+    /**
+     * Bind this frame's light data for drawing.
+     *
+     * @param uniformBinding Binding point of the program's ClusterLighting block
+     * @param textureUnit    Unit its uClusterLightLists sampler reads
+     * @return false if Update() produced nothing to bind
+     */
+    bool Bind(GLuint uniformBinding, GLuint textureUnit, FrameStats& stats) const;
+
+    /**
+     * GLSL declaring the ClusterLighting block, the uClusterLightLists
+     * sampler and vec3 ClusteredLighting(vec3 worldPos, vec3 normal, vec3 albedo).
+     * Paste into a fragment shader after its precision statements.
+     */
+    static std::string GetShaderSource();
+
+    const Stats& GetStats() const { return mStats; }
+    GpuMemoryUsage GetGpuMemory() const;
+
+private:
+    static constexpr uint32_t kTextureCount = 3;
+    static constexpr uint32_t kRowTexels = MAX_LIGHTS_PER_CLUSTER + 1;
+    static constexpr uint32_t kTextureWidth = GRID_X * kRowTexels;
+    static constexpr uint32_t kTextureHeight = GRID_Y * GRID_Z;
+
+    void BinSlice(uint32_t slice);
+
+    JobSystem* mJobs = nullptr;
+
+    std::array<GLuint, kTextureCount> mTextures = {};
+    uint32_t mCurrentTexture = 0;
+    StreamingBuffer::Allocation mUniformAllocation;
+
+    StereoFrustum mFrustum;
+    std::array<float, GRID_Z + 1> mSliceDepths = {};
+
+    // Lights in cluster space, structure-of-arrays and padded to a multiple
+    // of 4 with lights that can never intersect anything
+    uint32_t mLightCount = 0;
+    alignas(16) float mLightX[MAX_LIGHTS] = {};
+    alignas(16) float mLightY[MAX_LIGHTS] = {};
+    alignas(16) float mLightDepth[MAX_LIGHTS] = {};
+    alignas(16) float mLightRadius[MAX_LIGHTS] = {};
+
+    // Per-slice results, reduced into mStats after binning
+    struct SliceStats {
+        uint32_t mIndices = 0;
+        uint32_t mMaxLights = 0;
+        uint32_t mOverflows = 0;
+    };
+    std::array<SliceStats, GRID_Z> mSliceStats = {};
+
+    // kTextureHeight rows of kTextureWidth texels: row (slice * GRID_Y + y)
+    // holds tiles x = 0..GRID_X-1, each a count followed by light indices
+    std::array<uint8_t, kTextureWidth * kTextureHeight> mClusterData = {};
+
+    Stats mStats;
+};
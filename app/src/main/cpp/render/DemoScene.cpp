@@ -0,0 +1,158 @@
+/*******************************************************************************
+
+Filename    :   DemoScene.cpp
+Content     :   The template's demo content: a lit quad, a few cubes, an
+                orbiting cube, receding spheres, circling point lights and
+                hidden clutter
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "DemoScene.h"
+#include "../utils/MathUtils.h"
+
+#include <xr_linear.h>
+
+#include <array>
+#include <cmath>
+
+namespace {
+    constexpr float kQuadDepth = -2.0f;
+    constexpr float kOrbitRadius = 0.35f;
+    constexpr float kOrbitDepth = -1.5f;
+    constexpr int kHiddenCubeCount = 8;
+    // Equal spheres at growing distances, each drawn at a coarser level
+    constexpr float kSphereDistances[] = {1.3f, 2.6f, 5.0f, 10.0f};
+    constexpr float kSphereScale = 0.3f;
+    constexpr int kPanelButtonCount = 3;
+
+    XrQuaternionf AxisAngle(const XrVector3f& axis, const float radians) {
+        XrQuaternionf q;
+        XrQuaternionf_CreateFromAxisAngle(&q, &axis, radians);
+        return q;
+    }
+} // anonymous namespace
+
+void DemoScene::Populate(SceneRenderer& renderer) {
+    SceneObject quad;
+    quad.mMesh = SceneMesh::QUAD;
+    quad.mPose = {MathUtils::kIdentityQuat, {0.0f, 0.0f, kQuadDepth}};
+    quad.mAlbedo = {1.0f, 0.25f, 0.25f};
+    quad.mOccluder = true;
+    renderer.AddObject(quad);
+
+    // Clutter behind the quad: hidden from the default viewpoint, so the
+    // occlusion culler should keep it out of the eye passes
+    for (int i = 0; i < kHiddenCubeCount; i++) {
+        SceneObject cube;
+        cube.mPose = {MathUtils::kIdentityQuat,
+                      {-0.3f + 0.2f * static_cast<float>(i % 4),
+                       -0.15f + 0.3f * static_cast<float>(i / 4), kQuadDepth - 0.5f}};
+        cube.mScale = {0.15f, 0.15f, 0.15f};
+        cube.mAlbedo = {0.6f, 0.6f, 0.6f};
+        renderer.AddObject(cube);
+    }
+
+    // Static cubes resting just in front of the quad
+    const XrVector3f cubePositions[] = {{-0.3f, -0.25f, -1.75f}, {0.25f, 0.2f, -1.7f},
+                                        {0.3f, -0.3f, -1.6f}};
+    const XrVector3f cubeAlbedos[] = {{0.9f, 0.9f, 0.85f}, {0.35f, 0.55f, 0.9f},
+                                      {0.45f, 0.85f, 0.45f}};
+    for (size_t i = 0; i < std::size(cubePositions); i++) {
+        SceneObject cube;
+        cube.mPose = {AxisAngle({0.0f, 1.0f, 0.0f}, 0.4f * static_cast<float>(i)),
+                      cubePositions[i]};
+        cube.mScale = {0.12f, 0.12f, 0.12f};
+        cube.mAlbedo = cubeAlbedos[i];
+        renderer.AddObject(cube);
+    }
+
+    for (size_t i = 0; i < std::size(kSphereDistances); i++) {
+        // Spread across the lower right of the view, nearest leftmost
+        const float distance = kSphereDistances[i];
+        const float tanX = 0.2f + 0.2f * static_cast<float>(i);
+        SceneObject sphere;
+        sphere.mMesh = SceneMesh::SPHERE;
+        sphere.mPose = {MathUtils::kIdentityQuat,
+                        {tanX * distance, -0.45f * distance, -distance}};
+        sphere.mScale = {kSphereScale, kSphereScale, kSphereScale};
+        sphere.mAlbedo = {0.3f, 0.75f, 0.7f};
+        renderer.AddObject(sphere);
+    }
+    // One large sphere close by, up and to the left
+    SceneObject nearSphere;
+    nearSphere.mMesh = SceneMesh::SPHERE;
+    nearSphere.mPose = {MathUtils::kIdentityQuat, {-0.6f, 0.35f, -1.2f}};
+    nearSphere.mScale = {0.4f, 0.4f, 0.4f};
+    nearSphere.mAlbedo = {0.8f, 0.5f, 0.85f};
+    renderer.AddObject(nearSphere);
+
+    SceneObject orbiting;
+    orbiting.mScale = {0.08f, 0.08f, 0.08f};
+    orbiting.mAlbedo = {0.95f, 0.8f, 0.3f};
+    orbiting.mStatic = false;
+    mOrbitingCube = renderer.AddObject(orbiting);
+
+    // Low sun over the viewer's left shoulder, so shadows fall onto the quad
+    renderer.SetSun(MathUtils::Normalized({-0.4f, 0.6f, 1.0f}), {0.8f, 0.75f, 0.7f});
+}
+
+void DemoScene::AttachHandProps(SceneRenderer& renderer, TransformHierarchy& hierarchy,
+                                const std::array<TransformHierarchy::NodeId, 2>& handRoots) const {
+    const auto attach = [&](const TransformHierarchy::NodeId parent, const XrPosef& localPose,
+                            SceneObject object) {
+        object.mStatic = false;
+        return hierarchy.AddNode(parent, localPose, renderer.AddObject(object));
+    };
+
+    // Behind the aim point, so the hand's own pointing ray starts clear of it
+    for (const TransformHierarchy::NodeId hand : handRoots) {
+        SceneObject handle;
+        handle.mScale = {0.03f, 0.03f, 0.1f};
+        handle.mAlbedo = {0.2f, 0.2f, 0.22f};
+        attach(hand, {MathUtils::kIdentityQuat, {0.0f, -0.01f, 0.07f}}, handle);
+    }
+
+    // Above the left wrist, tilted toward the face; the buttons hang off the
+    // panel so they follow it if it is ever moved on its own
+    SceneObject panel;
+    panel.mMesh = SceneMesh::QUAD;
+    panel.mScale = {0.12f, 0.08f, 1.0f};
+    panel.mAlbedo = {0.15f, 0.2f, 0.3f};
+    const TransformHierarchy::NodeId panelNode =
+            attach(handRoots[0], {AxisAngle({1.0f, 0.0f, 0.0f}, -0.8f), {0.0f, 0.05f, 0.12f}},
+                   panel);
+    for (int i = 0; i < kPanelButtonCount; i++) {
+        SceneObject button;
+        button.mScale = {0.02f, 0.02f, 0.01f};
+        button.mAlbedo = {0.9f, 0.6f - 0.2f * static_cast<float>(i), 0.2f};
+        attach(panelNode,
+               {MathUtils::kIdentityQuat, {0.035f * static_cast<float>(i - 1), 0.0f, 0.006f}},
+               button);
+    }
+}
+
+void DemoScene::Update(SceneRenderer& renderer, const float seconds) const {
+    // Small lights circling in front of the quad at different radii and speeds
+    const XrVector3f palette[] = {{1.0f, 0.8f, 0.6f}, {0.3f, 0.6f, 1.0f},
+                                  {0.4f, 1.0f, 0.5f}, {1.0f, 0.4f, 0.9f}};
+    std::array<PointLight, NUM_LIGHTS> lights;
+    for (uint32_t i = 0; i < NUM_LIGHTS; i++) {
+        const float t = static_cast<float>(i) / NUM_LIGHTS;
+        const float orbit = 0.15f + 0.45f * t;
+        const float angle = MATH_PI * 2.0f * t + seconds * (0.5f + t);
+        const XrVector3f& color = palette[i % 4];
+        lights[i] = {{orbit * std::cos(angle), orbit * std::sin(angle), -1.85f - 0.1f * t},
+                     0.2f + 0.1f * t,
+                     {color.x * 1.5f, color.y * 1.5f, color.z * 1.5f}};
+    }
+    renderer.SetLights(lights.data(), NUM_LIGHTS);
+
+    const float angle = seconds * 0.7f;
+    const XrPosef cubePose = {AxisAngle({0.3f, 1.0f, 0.2f}, seconds * 1.3f),
+                              {kOrbitRadius * std::cos(angle), 0.1f * std::sin(2.0f * angle),
+                               kOrbitDepth + kOrbitRadius * std::sin(angle)}};
+    renderer.SetObjectPose(mOrbitingCube, cubePose);
+}
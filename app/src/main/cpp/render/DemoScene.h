@@ -0,0 +1,50 @@
+/*******************************************************************************
+
+Filename    :   DemoScene.h
+Content     :   The template's demo content: a lit quad, a few cubes, an
+                orbiting cube, receding spheres, circling point lights and
+                hidden clutter
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "SceneRenderer.h"
+#include "TransformHierarchy.h"
+
+#include <array>
+
+/**
+ * DemoScene - fills a SceneRenderer with the demo content and animates it.
+ *
+ * Shared by VrApp and the host-side tools so both render the same scene;
+ * animation is a pure function of time, so a fixed time gives a fixed frame.
+ */
+class DemoScene {
+public:
+    static constexpr uint32_t NUM_LIGHTS = 32;
+
+    /**
+     * Add the scene's objects and sun to @p renderer. Call once, after its Init().
+     */
+    void Populate(SceneRenderer& renderer);
+
+    /**
+     * Add props that ride on the controllers: a handle on each, and a wrist
+     * panel with buttons on the left. Each prop is a node under the given
+     * hand root whose user data is its ObjectId.
+     */
+    void AttachHandProps(SceneRenderer& renderer, TransformHierarchy& hierarchy,
+                         const std::array<TransformHierarchy::NodeId, 2>& handRoots) const;
+
+    /**
+     * Move the lights and dynamic objects to their poses at @p seconds.
+     */
+    void Update(SceneRenderer& renderer, float seconds) const;
+
+private:
+    SceneRenderer::ObjectId mOrbitingCube = 0;
+};
@@ -0,0 +1,102 @@
+/*******************************************************************************
+
+Filename    :   LodSelector.cpp
+Content     :   Per-object level-of-detail selection from projected
+                screen-space error, shared by both eyes
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "LodSelector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    // Matches the eye projection's near plane; nothing nearer is drawn
+    constexpr float kMinDistance = 0.1f;
+} // anonymous namespace
+
+void LodSelector::BeginFrame(const std::array<XrPosef, 2>& eyePoses,
+                             const std::array<XrFovf, 2>& eyeFovs,
+                             const XrExtent2Di& eyeResolution) {
+    mStats = {};
+    mPixelsPerTangent = 0.0f;
+    for (size_t eye = 0; eye < eyePoses.size(); eye++) {
+        mEyePositions[eye] = eyePoses[eye].position;
+        const XrFovf& fov = eyeFovs[eye];
+        const float tanWidth = std::tan(fov.angleRight) - std::tan(fov.angleLeft);
+        const float tanHeight = std::tan(fov.angleUp) - std::tan(fov.angleDown);
+        if (tanWidth > 0.0f && tanHeight > 0.0f) {
+            mPixelsPerTangent = std::max({mPixelsPerTangent,
+                                          static_cast<float>(eyeResolution.width) / tanWidth,
+                                          static_cast<float>(eyeResolution.height) / tanHeight});
+        }
+    }
+}
+
+uint32_t LodSelector::TargetLevel(const Mesh& mesh, const float pixelsPerUnit,
+                                  const float coveredPixels) {
+    // Levels get coarser and their error grows with the index
+    uint32_t level = mesh.mLevelCount - 1;
+    while (level > 0 && mesh.mLevels[level].mError * pixelsPerUnit > MAX_ERROR_PIXELS) {
+        level--;
+    }
+    while (level + 1 < mesh.mLevelCount &&
+           static_cast<float>(mesh.mLevels[level].mIndexCount / 3) * MIN_PIXELS_PER_TRIANGLE >
+                   coveredPixels) {
+        level++;
+    }
+    return level;
+}
+
+bool LodSelector::Select(const Mesh& mesh, const MathUtils::Bounds3f& bounds, const float scale,
+                         uint8_t& level) {
+    uint32_t next = 0;
+    if (mForcedLevel >= 0) {
+        next = std::min<uint32_t>(static_cast<uint32_t>(mForcedLevel), mesh.mLevelCount - 1);
+    } else if (mesh.mLevelCount > 1 && !bounds.IsEmpty()) {
+        const XrVector3f center = (bounds.mMin + bounds.mMax) * 0.5f;
+        const XrVector3f extent = bounds.mMax - bounds.mMin;
+        const float radius = 0.5f * std::sqrt(MathUtils::Dot(extent, extent));
+
+        // Nearest eye; the larger pixel density was already taken in BeginFrame()
+        float distance = std::numeric_limits<float>::max();
+        for (const XrVector3f& eye : mEyePositions) {
+            const XrVector3f toCenter = center - eye;
+            distance = std::min(distance, std::sqrt(MathUtils::Dot(toCenter, toCenter)) - radius);
+        }
+        distance = std::max(distance, kMinDistance);
+
+        // Magnification at the view center. The rectilinear eye buffer is
+        // denser toward its edges, but lens distortion undersamples those
+        // pixels on the display.
+        const float pixelsPerSceneUnit = mPixelsPerTangent / distance;
+        const float pixelsPerUnit = scale * pixelsPerSceneUnit;
+        const float projectedRadius = radius * pixelsPerSceneUnit;
+        const float coveredPixels = MATH_PI * projectedRadius * projectedRadius;
+
+        next = std::min<uint32_t>(level, mesh.mLevelCount - 1);
+        const uint32_t target = TargetLevel(mesh, pixelsPerUnit, coveredPixels);
+        if (target < next) {
+            // Too coarse: refine right away
+            next = target;
+        } else {
+            const uint32_t coarser = TargetLevel(mesh, pixelsPerUnit * HYSTERESIS,
+                                                 coveredPixels * HYSTERESIS * HYSTERESIS);
+            next = std::max(next, coarser);
+        }
+    }
+
+    const bool changed = next != level;
+    level = static_cast<uint8_t>(next);
+
+    mStats.mObjects++;
+    mStats.mTriangles += mesh.mLevels[next].mIndexCount / 3;
+    mStats.mLevelChanges += changed ? 1 : 0;
+    mStats.mObjectsPerLevel[next]++;
+    return changed;
+}
@@ -0,0 +1,100 @@
+/*******************************************************************************
+
+Filename    :   LodSelector.h
+Content     :   Per-object level-of-detail selection from projected
+                screen-space error, shared by both eyes
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../utils/MathUtils.h"
+
+#include <openxr/openxr.h>
+
+#include <array>
+#include <cstdint>
+
+/**
+ * LodSelector - picks which of a mesh's detail levels to draw.
+ *
+ * A mesh's levels are index ranges into a shared index buffer, finest
+ * first, each with its geometric error: how far in mesh units that level
+ * strays from the finest surface. Each frame the selector projects that
+ * error to eye-buffer pixels using the eye FOVs and render resolution, and
+ * picks the coarsest level whose error stays under MAX_ERROR_PIXELS. A
+ * level is also dropped if its triangles would be smaller on average than
+ * MIN_PIXELS_PER_TRIANGLE, so distant geometry costs triangles in
+ * proportion to the pixels it covers.
+ *
+ * One level is picked per object for both eyes, using whichever eye is
+ * nearer and whichever has the higher pixel density, so the eyes never
+ * see different silhouettes. An object only moves to a coarser level once
+ * it is HYSTERESIS times farther than the switch point, so objects near a
+ * boundary don't flip every frame.
+ */
+class LodSelector {
+public:
+    static constexpr uint32_t MAX_LEVELS = 5;
+    static constexpr float MAX_ERROR_PIXELS = 1.0f;
+    static constexpr float MIN_PIXELS_PER_TRIANGLE = 4.0f;
+    static constexpr float HYSTERESIS = 1.25f;
+
+    struct Level {
+        uint32_t mFirstIndex = 0;
+        uint32_t mIndexCount = 0;
+        float mError = 0.0f;  // mesh units, 0 for the finest level
+    };
+
+    struct Mesh {
+        std::array<Level, MAX_LEVELS> mLevels = {};
+        uint32_t mLevelCount = 0;
+    };
+
+    struct Stats {
+        uint32_t mObjects = 0;
+        uint32_t mTriangles = 0;      // selected levels, counted once for both eyes
+        uint32_t mLevelChanges = 0;
+        std::array<uint32_t, MAX_LEVELS> mObjectsPerLevel = {};
+    };
+
+    /**
+     * Start a frame. Both eyes render at @p eyeResolution.
+     */
+    void BeginFrame(const std::array<XrPosef, 2>& eyePoses, const std::array<XrFovf, 2>& eyeFovs,
+                    const XrExtent2Di& eyeResolution);
+
+    /**
+     * Update @p level, the level @p bounds' object drew last frame, for this
+     * frame's view. @p scale converts mesh units to scene units.
+     *
+     * @return true if the level changed
+     */
+    bool Select(const Mesh& mesh, const MathUtils::Bounds3f& bounds, float scale,
+                uint8_t& level);
+
+    const Stats& GetStats() const { return mStats; }
+
+    /**
+     * Draw every mesh at @p level (or its coarsest, if it has fewer), or pick
+     * by view again with -1. For benchmarks that must hold geometry fixed
+     * while objects change size on screen.
+     */
+    void SetForcedLevel(const int32_t level) { mForcedLevel = level; }
+
+private:
+    // Coarsest acceptable level for an object drawn at @p pixelsPerUnit
+    // pixels per mesh unit, covering @p coveredPixels
+    static uint32_t TargetLevel(const Mesh& mesh, float pixelsPerUnit, float coveredPixels);
+
+    std::array<XrVector3f, 2> mEyePositions = {};
+    // Eye-buffer pixels per unit of tangent at the view center, the larger
+    // of the two eyes and two axes
+    float mPixelsPerTangent = 0.0f;
+    int32_t mForcedLevel = -1;
+
+    Stats mStats;
+};
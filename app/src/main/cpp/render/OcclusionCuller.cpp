@@ -0,0 +1,449 @@
+/*******************************************************************************
+
+Filename    :   OcclusionCuller.cpp
+Content     :   CPU occlusion culling against a small software-rasterized
+                depth buffer shared by both eyes
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "OcclusionCuller.h"
+#include "../utils/JobSystem.h"
+#include "../utils/Simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+// Float4::Load/Store on mDepth rows rely on default new alignment
+static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ >= 16, "depth rows must be 16-byte aligned");
+static_assert(OcclusionCuller::TILE_WIDTH % 4 == 0, "tiles are rasterized 4 pixels at a time");
+
+namespace {
+    // Occluder geometry is clipped here; occludees reaching closer are always visible
+    constexpr float kNearDepth = 0.05f;
+
+    // An occludee is only culled if the occluder is this much nearer (as a
+    // ratio of inverse depths), so occluders never cull themselves through
+    // interpolation error
+    constexpr float kDepthBias = 1.001f;
+
+    // Separate occluders may leave a gap this wide in one eye
+    constexpr float kMaxParallaxGapPixels = 1.0f;
+    constexpr int kMaxMarginPasses = 3;
+
+    // Below this many triangle-tile pairs, waking workers costs more than
+    // rasterizing inline
+    constexpr uint32_t kMinTileTrianglesForJobs = 64;
+
+    // Boxes per job chunk when testing visibility
+    constexpr uint32_t kBoxesPerJob = 64;
+
+    alignas(16) constexpr float kLaneOffsets[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+
+    // Returns the point where segment a-b crosses depth kNearDepth
+    XrVector3f ClipToNear(const XrVector3f& a, const XrVector3f& b) {
+        const float t = (-kNearDepth - a.z) / (b.z - a.z);
+        return {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, -kNearDepth};
+    }
+} // anonymous namespace
+
+void OcclusionCuller::Init(JobSystem* jobs) {
+    mJobs = jobs;
+    mDepth.assign(WIDTH * HEIGHT, 0.0f);
+    mTriangles.reserve(1024);
+}
+
+void OcclusionCuller::BeginFrame(const StereoFrustum& frustum) {
+    mFrustum = frustum;
+
+    XrPosef sceneToView;
+    XrPosef_Invert(&sceneToView, &frustum.mPose);
+    XrMatrix4x4f_CreateFromRigidTransform(&mSceneToView, &sceneToView);
+
+    mScaleX = static_cast<float>(WIDTH) / (frustum.mTanRight - frustum.mTanLeft);
+    mScaleY = static_cast<float>(HEIGHT) / (frustum.mTanUp - frustum.mTanDown);
+
+    // Relative to the apex, an eye sits mHalfIpd to the side and mPullBack
+    // ahead. Seen from there, two points at depths d0 < d1 shift against each
+    // other by at most (1 / (d0 - mPullBack) - 1 / (d1 - mPullBack)) times
+    // these many pixels; the forward offset moves points near the buffer
+    // edges outward.
+    const float maxTanX = std::max(-frustum.mTanLeft, frustum.mTanRight);
+    const float maxTanY = std::max(-frustum.mTanDown, frustum.mTanUp);
+    mParallaxX = (frustum.mHalfIpd + maxTanX * frustum.mPullBack) * mScaleX;
+    mParallaxY = maxTanY * frustum.mPullBack * mScaleY;
+
+    mTriangles.clear();
+    for (auto& bin : mTileBins) {
+        bin.clear();
+    }
+    mStats = {};
+}
+
+void OcclusionCuller::AddOccluder(const XrVector3f* positions, const uint32_t vertexCount,
+                                  const XrMatrix4x4f& localToScene) {
+    XrMatrix4x4f localToView;
+    XrMatrix4x4f_Multiply(&localToView, &mSceneToView, &localToScene);
+
+    for (uint32_t i = 0; i + 2 < vertexCount; i += 3) {
+        XrVector3f view[3];
+        uint32_t behind = 0;
+        for (int v = 0; v < 3; v++) {
+            XrMatrix4x4f_TransformVector3f(&view[v], &localToView, &positions[i + v]);
+            behind += view[v].z > -kNearDepth ? 1 : 0;
+        }
+        mStats.mOccluderTriangles++;
+
+        if (behind == 3) {
+            continue;
+        }
+        if (behind == 0) {
+            AddClippedTriangle(view);
+            continue;
+        }
+
+        // Clip against the near plane: one vertex behind leaves a quad,
+        // two leave a smaller triangle. Rotate so view[0] is the odd one out.
+        const bool oddIsBehind = behind == 1;
+        int odd = 0;
+        for (int v = 0; v < 3; v++) {
+            if ((view[v].z > -kNearDepth) == oddIsBehind) {
+                odd = v;
+            }
+        }
+        const XrVector3f a = view[odd];
+        const XrVector3f b = view[(odd + 1) % 3];
+        const XrVector3f c = view[(odd + 2) % 3];
+        const XrVector3f ab = ClipToNear(a, b);
+        const XrVector3f ac = ClipToNear(a, c);
+        if (oddIsBehind) {
+            const XrVector3f first[3] = {ab, b, c};
+            const XrVector3f second[3] = {ab, c, ac};
+            AddClippedTriangle(first);
+            AddClippedTriangle(second);
+        } else {
+            const XrVector3f clipped[3] = {a, ab, ac};
+            AddClippedTriangle(clipped);
+        }
+    }
+}
+
+void OcclusionCuller::AddClippedTriangle(const XrVector3f* view) {
+    Triangle tri;
+    for (int v = 0; v < 3; v++) {
+        const float invDepth = -1.0f / view[v].z;
+        tri.mX[v] = (view[v].x * invDepth - mFrustum.mTanLeft) * mScaleX;
+        tri.mY[v] = (view[v].y * invDepth - mFrustum.mTanDown) * mScaleY;
+        tri.mInvDepth[v] = invDepth;
+    }
+
+    // Back-facing or degenerate
+    const float area = (tri.mX[1] - tri.mX[0]) * (tri.mY[2] - tri.mY[0]) -
+                       (tri.mX[2] - tri.mX[0]) * (tri.mY[1] - tri.mY[0]);
+    if (!(area > 1.0e-6f)) {
+        return;
+    }
+
+    const float minX = std::min({tri.mX[0], tri.mX[1], tri.mX[2]});
+    const float maxX = std::max({tri.mX[0], tri.mX[1], tri.mX[2]});
+    const float minY = std::min({tri.mY[0], tri.mY[1], tri.mY[2]});
+    const float maxY = std::max({tri.mY[0], tri.mY[1], tri.mY[2]});
+    if (maxX < 0.0f || maxY < 0.0f || minX >= WIDTH || minY >= HEIGHT) {
+        return;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(mTriangles.size());
+    mTriangles.push_back(tri);
+    mStats.mTrianglesBinned++;
+
+    const uint32_t tileX0 = static_cast<uint32_t>(std::max(minX, 0.0f)) / TILE_WIDTH;
+    const uint32_t tileY0 = static_cast<uint32_t>(std::max(minY, 0.0f)) / TILE_HEIGHT;
+    const uint32_t tileX1 = std::min(static_cast<uint32_t>(maxX) / TILE_WIDTH, TILES_X - 1);
+    const uint32_t tileY1 = std::min(static_cast<uint32_t>(maxY) / TILE_HEIGHT, TILES_Y - 1);
+    for (uint32_t ty = tileY0; ty <= tileY1; ty++) {
+        for (uint32_t tx = tileX0; tx <= tileX1; tx++) {
+            mTileBins[ty * TILES_X + tx].push_back(index);
+            mStats.mTileTriangles++;
+        }
+    }
+}
+
+void OcclusionCuller::Rasterize() {
+    const auto rasterStart = std::chrono::steady_clock::now();
+
+    if (mJobs != nullptr && mStats.mTileTriangles >= kMinTileTrianglesForJobs) {
+        mJobs->ParallelFor(TILE_COUNT, 1, [this](const uint32_t begin, const uint32_t end) {
+            for (uint32_t tile = begin; tile < end; tile++) {
+                RasterizeTile(tile);
+            }
+        });
+    } else {
+        for (uint32_t tile = 0; tile < TILE_COUNT; tile++) {
+            RasterizeTile(tile);
+        }
+    }
+
+    mStats.mRasterNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - rasterStart).count();
+}
+
+void OcclusionCuller::RasterizeTile(const uint32_t tile) {
+    const int32_t tileX0 = static_cast<int32_t>((tile % TILES_X) * TILE_WIDTH);
+    const int32_t tileY0 = static_cast<int32_t>((tile / TILES_X) * TILE_HEIGHT);
+    const int32_t tileX1 = tileX0 + static_cast<int32_t>(TILE_WIDTH);
+    const int32_t tileY1 = tileY0 + static_cast<int32_t>(TILE_HEIGHT);
+
+    for (int32_t y = tileY0; y < tileY1; y++) {
+        std::fill_n(&mDepth[y * WIDTH + tileX0], TILE_WIDTH, 0.0f);
+    }
+
+    const Float4 zero = Float4::Splat(0.0f);
+    const Float4 laneOffsets = Float4::Load(kLaneOffsets);
+
+    for (const uint32_t index : mTileBins[tile]) {
+        const Triangle& tri = mTriangles[index];
+
+        // Edge functions E(x, y) = A x + B y + C, non-negative inside; edge i
+        // runs from vertex i to vertex i + 1, opposite vertex i + 2
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        for (int e = 0; e < 3; e++) {
+            const int next = (e + 1) % 3;
+            edgeA[e] = tri.mY[e] - tri.mY[next];
+            edgeB[e] = tri.mX[next] - tri.mX[e];
+            edgeC[e] = -(edgeA[e] * tri.mX[e] + edgeB[e] * tri.mY[e]);
+        }
+
+        // Inverse depth is linear in screen space: weight each vertex by the
+        // edge opposite it
+        const float invArea = 1.0f / (edgeC[0] + edgeC[1] + edgeC[2]);
+        const float depthA = (edgeA[1] * tri.mInvDepth[0] + edgeA[2] * tri.mInvDepth[1] +
+                              edgeA[0] * tri.mInvDepth[2]) * invArea;
+        const float depthB = (edgeB[1] * tri.mInvDepth[0] + edgeB[2] * tri.mInvDepth[1] +
+                              edgeB[0] * tri.mInvDepth[2]) * invArea;
+        const float depthC = (edgeC[1] * tri.mInvDepth[0] + edgeC[2] * tri.mInvDepth[1] +
+                              edgeC[0] * tri.mInvDepth[2]) * invArea;
+
+        // Pixel bounds within the tile, x aligned down to a group of four
+        const float minX = std::min({tri.mX[0], tri.mX[1], tri.mX[2]});
+        const float maxX = std::max({tri.mX[0], tri.mX[1], tri.mX[2]});
+        const float minY = std::min({tri.mY[0], tri.mY[1], tri.mY[2]});
+        const float maxY = std::max({tri.mY[0], tri.mY[1], tri.mY[2]});
+        const int32_t x0 = std::max(static_cast<int32_t>(std::floor(minX)), tileX0) & ~3;
+        const int32_t x1 = std::min(static_cast<int32_t>(std::ceil(maxX)), tileX1);
+        const int32_t y0 = std::max(static_cast<int32_t>(std::floor(minY)), tileY0);
+        const int32_t y1 = std::min(static_cast<int32_t>(std::ceil(maxY)), tileY1);
+
+        const Float4 a0 = Float4::Splat(edgeA[0]);
+        const Float4 a1 = Float4::Splat(edgeA[1]);
+        const Float4 a2 = Float4::Splat(edgeA[2]);
+        const Float4 depthStep = Float4::Splat(depthA);
+
+        for (int32_t y = y0; y < y1; y++) {
+            // Sample at pixel centers
+            const float py = static_cast<float>(y) + 0.5f;
+            const float rowC[3] = {edgeB[0] * py + edgeC[0], edgeB[1] * py + edgeC[1],
+                                   edgeB[2] * py + edgeC[2]};
+
+            // Solve each edge for the row's covered span; the mask below
+            // still decides per pixel, so rounding only needs to be generous
+            float spanMin = static_cast<float>(x0);
+            float spanMax = static_cast<float>(x1);
+            for (int e = 0; e < 3; e++) {
+                if (edgeA[e] > 0.0f) {
+                    spanMin = std::max(spanMin, -rowC[e] / edgeA[e] - 0.5f);
+                } else if (edgeA[e] < 0.0f) {
+                    spanMax = std::min(spanMax, -rowC[e] / edgeA[e] + 0.5f);
+                } else if (rowC[e] < 0.0f) {
+                    spanMax = spanMin;
+                }
+            }
+            if (spanMin >= spanMax) {
+                continue;
+            }
+            const int32_t spanX0 = std::max(static_cast<int32_t>(spanMin) & ~3, x0);
+            const int32_t spanX1 = std::min(static_cast<int32_t>(std::ceil(spanMax)), x1);
+
+            const Float4 row0 = Float4::Splat(rowC[0]);
+            const Float4 row1 = Float4::Splat(rowC[1]);
+            const Float4 row2 = Float4::Splat(rowC[2]);
+            const Float4 rowDepth = Float4::Splat(depthB * py + depthC);
+            float* depthRow = &mDepth[y * WIDTH];
+
+            for (int32_t x = spanX0; x < spanX1; x += 4) {
+                const Float4 px = Float4::Splat(static_cast<float>(x) + 0.5f) + laneOffsets;
+                const Float4 inside = CmpGe(MulAdd(a0, px, row0), zero) &
+                                      CmpGe(MulAdd(a1, px, row1), zero) &
+                                      CmpGe(MulAdd(a2, px, row2), zero);
+                if (MoveMask(inside) == 0) {
+                    continue;
+                }
+                const Float4 invDepth = MulAdd(depthStep, px, rowDepth);
+                const Float4 current = Float4::Load(&depthRow[x]);
+                Select(inside, Max(current, invDepth), current).Store(&depthRow[x]);
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::IsVisible(const MathUtils::Bounds3f& bounds) const {
+    if (bounds.IsEmpty()) {
+        return false;
+    }
+
+    // Box corners into view space, four at a time
+    alignas(16) float cornerX[8];
+    alignas(16) float cornerY[8];
+    alignas(16) float cornerZ[8];
+    for (int i = 0; i < 8; i++) {
+        const XrVector3f corner = bounds.GetCorner(i);
+        cornerX[i] = corner.x;
+        cornerY[i] = corner.y;
+        cornerZ[i] = corner.z;
+    }
+    const float* m = mSceneToView.m;
+    float minDepth = std::numeric_limits<float>::max();
+    float minX = std::numeric_limits<float>::max();
+    float maxX = -std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxY = -std::numeric_limits<float>::max();
+    for (int half = 0; half < 8; half += 4) {
+        const Float4 x = Float4::Load(&cornerX[half]);
+        const Float4 y = Float4::Load(&cornerY[half]);
+        const Float4 z = Float4::Load(&cornerZ[half]);
+        const Float4 vx = MulAdd(Float4::Splat(m[0]), x, MulAdd(Float4::Splat(m[4]), y,
+                          MulAdd(Float4::Splat(m[8]), z, Float4::Splat(m[12]))));
+        const Float4 vy = MulAdd(Float4::Splat(m[1]), x, MulAdd(Float4::Splat(m[5]), y,
+                          MulAdd(Float4::Splat(m[9]), z, Float4::Splat(m[13]))));
+        const Float4 vz = MulAdd(Float4::Splat(m[2]), x, MulAdd(Float4::Splat(m[6]), y,
+                          MulAdd(Float4::Splat(m[10]), z, Float4::Splat(m[14]))));
+        alignas(16) float viewX[4];
+        alignas(16) float viewY[4];
+        alignas(16) float viewZ[4];
+        vx.Store(viewX);
+        vy.Store(viewY);
+        vz.Store(viewZ);
+        for (int i = 0; i < 4; i++) {
+            const float depth = -viewZ[i];
+            if (depth < kNearDepth) {
+                return true;
+            }
+            const float invDepth = 1.0f / depth;
+            const float sx = (viewX[i] * invDepth - mFrustum.mTanLeft) * mScaleX;
+            const float sy = (viewY[i] * invDepth - mFrustum.mTanDown) * mScaleY;
+            minDepth = std::min(minDepth, depth);
+            minX = std::min(minX, sx);
+            maxX = std::max(maxX, sx);
+            minY = std::min(minY, sy);
+            maxY = std::max(maxY, sy);
+        }
+    }
+
+    if (maxX < 0.0f || maxY < 0.0f || minX >= WIDTH || minY >= HEIGHT) {
+        return false;
+    }
+
+    // The box's rectangle is widened by how far the nearest occluder over it
+    // may shift in either eye. That depends on what the wider rectangle
+    // covers, so repeat until the margin stops growing.
+    const float boxInvDepth = kDepthBias / minDepth;
+    float marginX = 0.0f;
+    float marginY = 0.0f;
+    for (int pass = 0; pass < kMaxMarginPasses; pass++) {
+        float nearestInvDepth = 0.0f;
+        float farthestInvDepth = 0.0f;
+        if (!IsRectOccluded(minX - marginX, maxX + marginX, minY - marginY, maxY + marginY,
+                            boxInvDepth, nearestInvDepth, farthestInvDepth)) {
+            return true;
+        }
+
+        const float nearest = 1.0f / nearestInvDepth - mFrustum.mPullBack;
+        const float farthest = 1.0f / farthestInvDepth - mFrustum.mPullBack;
+        if (nearest <= kNearDepth) {
+            return true;
+        }
+        // Separate occluders at different depths can open a gap between
+        // them in one eye that the combined view can't see
+        if ((1.0f / nearest - 1.0f / farthest) * mParallaxX > kMaxParallaxGapPixels) {
+            return true;
+        }
+
+        const float neededX = mParallaxX / nearest;
+        const float neededY = mParallaxY / nearest;
+        if (neededX <= marginX && neededY <= marginY) {
+            return false;
+        }
+        marginX = neededX;
+        marginY = neededY;
+    }
+    return true;
+}
+
+bool OcclusionCuller::IsRectOccluded(const float minX, const float maxX, const float minY,
+                                     const float maxY, const float boxInvDepth,
+                                     float& nearestInvDepth, float& farthestInvDepth) const {
+    // x is widened to whole groups of four, which only makes the test stricter
+    const int32_t x0 = std::max(static_cast<int32_t>(std::floor(minX)), 0) & ~3;
+    const int32_t x1 = std::min(static_cast<int32_t>(std::ceil(maxX)), static_cast<int32_t>(WIDTH));
+    const int32_t y0 = std::max(static_cast<int32_t>(std::floor(minY)), 0);
+    const int32_t y1 = std::min(static_cast<int32_t>(std::ceil(maxY)), static_cast<int32_t>(HEIGHT));
+    if (x0 >= x1 || y0 >= y1) {
+        return false;
+    }
+
+    const Float4 box = Float4::Splat(boxInvDepth);
+    Float4 nearest = Float4::Splat(0.0f);
+    Float4 farthest = Float4::Splat(std::numeric_limits<float>::max());
+    for (int32_t y = y0; y < y1; y++) {
+        const float* depthRow = &mDepth[y * WIDTH];
+        for (int32_t x = x0; x < x1; x += 4) {
+            const Float4 depth = Float4::Load(&depthRow[x]);
+            // Any pixel whose occluder is not clearly nearer than the box
+            if (MoveMask(CmpLe(depth, box)) != 0) {
+                return false;
+            }
+            nearest = Max(nearest, depth);
+            farthest = Min(farthest, depth);
+        }
+    }
+
+    alignas(16) float lanes[4];
+    nearest.Store(lanes);
+    nearestInvDepth = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    farthest.Store(lanes);
+    farthestInvDepth = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    return true;
+}
+
+uint32_t OcclusionCuller::TestVisibility(const MathUtils::Bounds3f* bounds, const uint32_t count,
+                                         const size_t stride, uint8_t* visible) {
+    const auto testStart = std::chrono::steady_clock::now();
+
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(bounds);
+    const auto testRange = [this, base, stride, visible](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            const auto& box = *reinterpret_cast<const MathUtils::Bounds3f*>(base + i * stride);
+            visible[i] = IsVisible(box) ? 1 : 0;
+        }
+    };
+    if (mJobs != nullptr && count > kBoxesPerJob) {
+        mJobs->ParallelFor(count, kBoxesPerJob, testRange);
+    } else {
+        testRange(0, count);
+    }
+
+    uint32_t culled = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        culled += visible[i] ? 0 : 1;
+    }
+    mStats.mOccludeesTested += count;
+    mStats.mOccludeesCulled += culled;
+    mStats.mTestNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - testStart).count();
+    return culled;
+}
@@ -0,0 +1,151 @@
+/*******************************************************************************
+
+Filename    :   OcclusionCuller.h
+Content     :   CPU occlusion culling against a small software-rasterized
+                depth buffer shared by both eyes
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../utils/MathUtils.h"
+#include "StereoFrustum.h"
+
+#include <openxr/openxr.h>
+#include <xr_linear.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+/**
+ * OcclusionCuller - rejects objects hidden behind large occluders before any
+ * GL work is issued for them.
+ *
+ * Each frame, selected occluder meshes are rasterized on the CPU into a
+ * WIDTH x HEIGHT buffer of inverse depth seen from the StereoFrustum apex.
+ * Triangles are binned into TILE_WIDTH x TILE_HEIGHT tiles and the tiles
+ * rasterized in parallel on a JobSystem, four pixels at a time. Occludee
+ * bounding boxes are then projected into the buffer and rejected if every
+ * pixel their rectangle covers holds something nearer than the box.
+ *
+ * The buffer is seen from between and behind the eyes rather than from
+ * either eye, so each box's rectangle is widened by the largest parallax
+ * either eye could have against the nearest occluder under it. Boxes
+ * covered by occluders at depths far enough apart that parallax could open
+ * a gap between them are kept, so a box culled here is hidden from both
+ * eyes. Occluder triangles are one-sided, with
+ * counter-clockwise front faces as in GL's default culling. Coverage is
+ * sampled at pixel centers, so gaps between occluders narrower than a
+ * buffer pixel count as closed.
+ *
+ * Boxes wholly outside the combined frustum are rejected too.
+ */
+class OcclusionCuller {
+public:
+    static constexpr uint32_t WIDTH = 256;
+    static constexpr uint32_t HEIGHT = 128;
+    static constexpr uint32_t TILE_WIDTH = 64;
+    static constexpr uint32_t TILE_HEIGHT = 32;
+    static constexpr uint32_t TILES_X = WIDTH / TILE_WIDTH;
+    static constexpr uint32_t TILES_Y = HEIGHT / TILE_HEIGHT;
+    static constexpr uint32_t TILE_COUNT = TILES_X * TILES_Y;
+
+    struct Stats {
+        int64_t mRasterNs = 0;
+        int64_t mTestNs = 0;
+        uint32_t mOccluderTriangles = 0;  // submitted through AddOccluder()
+        uint32_t mTrianglesBinned = 0;    // front-facing and on screen after clipping
+        uint32_t mTileTriangles = 0;      // sum over tiles of triangles touching them
+        uint32_t mOccludeesTested = 0;
+        uint32_t mOccludeesCulled = 0;
+    };
+
+    OcclusionCuller() = default;
+    ~OcclusionCuller() = default;
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    /**
+     * @param jobs Optional worker pool for rasterization and testing; must
+     *             outlive this object
+     */
+    void Init(JobSystem* jobs = nullptr);
+
+    /**
+     * Start a new frame seen from @p frustum. Drops last frame's occluders.
+     */
+    void BeginFrame(const StereoFrustum& frustum);
+
+    /**
+     * Add an occluder: a triangle list in local space and its local -> scene
+     * transform. Only call between BeginFrame() and Rasterize().
+     */
+    void AddOccluder(const XrVector3f* positions, uint32_t vertexCount,
+                     const XrMatrix4x4f& localToScene);
+
+    /**
+     * Rasterize everything added since BeginFrame() into the depth buffer.
+     */
+    void Rasterize();
+
+    /**
+     * Whether any part of @p bounds (scene space) might be visible to either
+     * eye. Conservative. Safe to call from several threads after Rasterize().
+     */
+    bool IsVisible(const MathUtils::Bounds3f& bounds) const;
+
+    /**
+     * IsVisible() over an array, split across the JobSystem. Writes 1 or 0
+     * per box to @p visible and returns the number culled.
+     *
+     * @param stride Bytes from one box to the next, for boxes embedded in
+     *               larger structs
+     */
+    uint32_t TestVisibility(const MathUtils::Bounds3f* bounds, uint32_t count, size_t stride,
+                            uint8_t* visible);
+
+    // Inverse view depth per pixel, bottom row first; 0 where nothing was drawn
+    const float* GetDepthBuffer() const { return mDepth.data(); }
+
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    // Screen space in buffer pixels, counter-clockwise
+    struct Triangle {
+        float mX[3];
+        float mY[3];
+        float mInvDepth[3];
+    };
+
+    void AddClippedTriangle(const XrVector3f* view);
+    void RasterizeTile(uint32_t tile);
+    // True if every pixel in the rectangle is clearly nearer than the box;
+    // also returns the nearest and farthest occluder there
+    bool IsRectOccluded(float minX, float maxX, float minY, float maxY, float boxInvDepth,
+                        float& nearestInvDepth, float& farthestInvDepth) const;
+
+    JobSystem* mJobs = nullptr;
+
+    StereoFrustum mFrustum;
+    XrMatrix4x4f mSceneToView = {};
+    float mScaleX = 1.0f;
+    float mScaleY = 1.0f;
+
+    std::vector<Triangle> mTriangles;
+    std::array<std::vector<uint32_t>, TILE_COUNT> mTileBins;
+    // Largest eye parallax in pixels, per unit of inverse depth
+    float mParallaxX = 0.0f;
+    float mParallaxY = 0.0f;
+
+    std::vector<float> mDepth;
+
+    Stats mStats;
+};
@@ -0,0 +1,714 @@
+/*******************************************************************************
+
+Filename    :   RenderGraph.cpp
+Content     :   Per-frame render pass graph with transient attachment aliasing
+                and automatic clear / invalidate placement
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "RenderGraph.h"
+#include "../utils/LogUtils.h"
+
+#include <EGL/egl.h>
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+typedef void (GL_APIENTRY* PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC)(GLenum target,
+        GLenum attachment, GLenum textarget, GLuint texture, GLint level, GLsizei samples);
+
+namespace {
+    // Transient storage nobody has asked for in this many frames goes back to the pool
+    constexpr uint32_t kMaxPhysicalIdleFrames = 3;
+    // Cached framebuffers are cheap, but imported names change with swapchains
+    constexpr uint32_t kMaxFramebufferIdleFrames = 8;
+
+    constexpr uint64_t kRenderbufferKeyBit = 1ull << 63;
+    // Implicit-resolve sample count, below the renderbuffer bit; layers stay under 2^24
+    constexpr uint32_t kSamplesKeyShift = 56;
+
+    PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC glFramebufferTexture2DMultisampleEXT = nullptr;
+
+    bool IsDepthFormat(const GLenum format) {
+        switch (format) {
+            case GL_DEPTH_COMPONENT16:
+            case GL_DEPTH_COMPONENT24:
+            case GL_DEPTH_COMPONENT32F:
+            case GL_DEPTH24_STENCIL8:
+            case GL_DEPTH32F_STENCIL8:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool HasStencil(const GLenum format) {
+        return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+    }
+
+    int64_t ElapsedNs(const std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+} // anonymous namespace
+
+//==============================================================================
+// PassContext / PassBuilder
+
+GLuint RenderGraph::PassContext::GetTexture(const ResourceHandle handle) const {
+    if (handle >= mGraph->mResources.size()) {
+        return 0;
+    }
+    const Resource& resource = mGraph->mResources[handle];
+    return resource.mTarget != 0 ? resource.mGlName : 0;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Color(const ResourceHandle handle,
+                                                          const LoadOp load,
+                                                          const std::array<float, 4>& clearColor) {
+    Pass& pass = mGraph.mPasses[mPassIndex];
+    if (pass.mColorCount >= MAX_COLOR_ATTACHMENTS) {
+        ALOGE("RenderGraph: pass '%s' has too many color attachments", pass.mLabel.c_str());
+        return *this;
+    }
+    Attachment& attachment = pass.mColors[pass.mColorCount++];
+    attachment.mResource = handle;
+    attachment.mLoad = load;
+    attachment.mClear = clearColor;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Depth(const ResourceHandle handle,
+                                                          const LoadOp load,
+                                                          const float clearDepth) {
+    Attachment& attachment = mGraph.mPasses[mPassIndex].mDepth;
+    attachment.mResource = handle;
+    attachment.mLoad = load;
+    attachment.mClear[0] = clearDepth;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(const ResourceHandle handle) {
+    if (handle != INVALID_RESOURCE) {
+        mGraph.mPasses[mPassIndex].mReads.push_back(handle);
+    }
+    return *this;
+}
+
+//==============================================================================
+// RenderGraph
+
+RenderGraph::~RenderGraph() {
+    Shutdown();
+}
+
+void RenderGraph::Shutdown() {
+    ReleaseFramebuffers();
+    for (const PhysicalResource& physical : mPhysical) {
+        mPool.Release(physical.mGlName, physical.mDesc);
+    }
+    mPhysical.clear();
+    mResources.clear();
+    mPasses.clear();
+}
+
+void RenderGraph::ReleaseFramebuffers() {
+    for (const auto& entry : mFramebuffers) {
+        mPool.Release(entry.second.mFbo, GpuResourceDesc::Framebuffer());
+    }
+    mFramebuffers.clear();
+}
+
+RenderGraph::ResourceHandle RenderGraph::CreateTransient(const char* name,
+                                                         const GpuResourceDesc& desc) {
+    if (desc.mType != GpuResourceType::TEXTURE && desc.mType != GpuResourceType::RENDERBUFFER) {
+        ALOGE("RenderGraph: transient '%s' must be a texture or renderbuffer", name);
+        return INVALID_RESOURCE;
+    }
+    Resource resource;
+    resource.mLabel = name;
+    resource.mDesc = desc;
+    resource.mTarget = desc.mType == GpuResourceType::TEXTURE ? desc.mTarget : 0;
+    mResources.push_back(std::move(resource));
+    return static_cast<ResourceHandle>(mResources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::ImportTexture(const char* name, const GLuint texture,
+                                                       const GLenum target, const GLenum format,
+                                                       const GLsizei width, const GLsizei height,
+                                                       const GLint layer, const bool preserve,
+                                                       const GLsizei samples) {
+    Resource resource;
+    resource.mLabel = name;
+    resource.mDesc = GpuResourceDesc::Texture2D(format, width, height);
+    if (samples > 1 && target == GL_TEXTURE_2D && SupportsImplicitResolve()) {
+        resource.mDesc.mSamples = samples;
+    } else if (samples > 1) {
+        ALOGW("RenderGraph: '%s' can't be rendered to multisampled; using 1 sample", name);
+    }
+    resource.mImported = true;
+    resource.mPreserve = preserve;
+    resource.mGlName = texture;
+    resource.mTarget = target;
+    resource.mLayer = layer;
+    // Imported contents are defined on entry
+    resource.mWritten = true;
+    mResources.push_back(std::move(resource));
+    return static_cast<ResourceHandle>(mResources.size() - 1);
+}
+
+bool RenderGraph::SupportsImplicitResolve() {
+    static const bool supported = []() {
+        const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+        if (extensions == nullptr ||
+            strstr(extensions, "GL_EXT_multisampled_render_to_texture") == nullptr) {
+            return false;
+        }
+        glFramebufferTexture2DMultisampleEXT =
+                reinterpret_cast<PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC>(
+                        eglGetProcAddress("glFramebufferTexture2DMultisampleEXT"));
+        return glFramebufferTexture2DMultisampleEXT != nullptr;
+    }();
+    return supported;
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char* name, ExecuteFn execute) {
+    Pass pass;
+    pass.mLabel = name;
+    pass.mExecute = std::move(execute);
+    mPasses.push_back(std::move(pass));
+    return PassBuilder(*this, static_cast<uint32_t>(mPasses.size() - 1));
+}
+
+void RenderGraph::AddResolvePass(const char* name, const ResourceHandle source,
+                                 const ResourceHandle destination) {
+    Pass pass;
+    pass.mLabel = name;
+    pass.mIsResolve = true;
+    pass.mReads.push_back(source);
+    // The blit overwrites every pixel of the destination
+    Attachment& attachment = IsDepthFormat(mResources[destination].mDesc.mFormat)
+                             ? pass.mDepth : pass.mColors[pass.mColorCount++];
+    attachment.mResource = destination;
+    attachment.mLoad = LoadOp::DONT_CARE;
+    mPasses.push_back(std::move(pass));
+}
+
+void RenderGraph::Execute(FrameStats& stats) {
+    const auto start = std::chrono::steady_clock::now();
+    // Time accounted elsewhere: pass callbacks and resolve blits
+    int64_t excludedNs = 0;
+
+    mStats = {};
+    Sort();
+    Cull();
+    ComputeLifetimes();
+
+    for (PhysicalResource& physical : mPhysical) {
+        physical.mBusyUntilPass = -1;
+        physical.mUsedThisFrame = false;
+    }
+
+    for (int i = 0; i < static_cast<int>(mPasses.size()); i++) {
+        if (mPasses[i].mCulled) {
+            mStats.mPassesCulled++;
+            continue;
+        }
+        AssignPhysical(i);
+        if (mPasses[i].mIsResolve) {
+            ExecuteResolvePass(i, stats, excludedNs);
+        } else {
+            ExecuteRasterPass(i, stats, excludedNs);
+        }
+        mStats.mPassesExecuted++;
+    }
+
+    COUNT_GL(stats, glBindFramebuffer(GL_READ_FRAMEBUFFER, 0));
+    COUNT_GL(stats, glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
+
+    EndFrame();
+
+    stats.mCpuSubmitNs += ElapsedNs(start) - excludedNs;
+}
+
+void RenderGraph::Sort() {
+    const size_t passCount = mPasses.size();
+    std::vector<std::vector<uint32_t>> successors(passCount);
+    std::vector<uint32_t> predecessorCount(passCount, 0);
+    const auto addEdge = [&](const int from, const uint32_t to) {
+        if (from >= 0 && static_cast<uint32_t>(from) != to) {
+            successors[from].push_back(to);
+            predecessorCount[to]++;
+        }
+    };
+
+    // Per resource: its latest writer so far, the reads since that write
+    // (which the next write must wait for), and reads of a transient that
+    // came before any write (which wait for the last one).
+    std::vector<int> lastWriter(mResources.size(), -1);
+    std::vector<std::vector<uint32_t>> readsSinceWrite(mResources.size());
+    std::vector<std::vector<uint32_t>> earlyReads(mResources.size());
+
+    for (uint32_t i = 0; i < passCount; i++) {
+        const Pass& pass = mPasses[i];
+        for (const ResourceHandle read : pass.mReads) {
+            if (lastWriter[read] < 0 && !mResources[read].mImported) {
+                earlyReads[read].push_back(i);
+                continue;
+            }
+            addEdge(lastWriter[read], i);
+            readsSinceWrite[read].push_back(i);
+        }
+
+        const auto write = [&](const ResourceHandle handle) {
+            addEdge(lastWriter[handle], i);
+            for (const uint32_t reader : readsSinceWrite[handle]) {
+                addEdge(static_cast<int>(reader), i);
+            }
+            readsSinceWrite[handle].clear();
+            lastWriter[handle] = static_cast<int>(i);
+        };
+        for (uint32_t c = 0; c < pass.mColorCount; c++) {
+            write(pass.mColors[c].mResource);
+        }
+        if (pass.mDepth.mResource != INVALID_RESOURCE) {
+            write(pass.mDepth.mResource);
+        }
+    }
+    for (size_t r = 0; r < mResources.size(); r++) {
+        for (const uint32_t reader : earlyReads[r]) {
+            addEdge(lastWriter[r], reader);
+        }
+    }
+
+    // Kahn's algorithm, always taking the earliest declared ready pass so
+    // an already valid declaration order is kept as-is
+    std::vector<uint32_t> order;
+    order.reserve(passCount);
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+    for (uint32_t i = 0; i < passCount; i++) {
+        if (predecessorCount[i] == 0) {
+            ready.push(i);
+        }
+    }
+    while (!ready.empty()) {
+        const uint32_t index = ready.top();
+        ready.pop();
+        order.push_back(index);
+        for (const uint32_t successor : successors[index]) {
+            if (--predecessorCount[successor] == 0) {
+                ready.push(successor);
+            }
+        }
+    }
+
+    if (order.size() < passCount) {
+        std::string cycle;
+        for (uint32_t i = 0; i < passCount; i++) {
+            if (predecessorCount[i] != 0) {
+                cycle += (cycle.empty() ? "'" : ", '") + mPasses[i].mLabel + "'";
+                order.push_back(i);
+            }
+        }
+        ALOGE("RenderGraph: passes %s are on or behind a dependency cycle; running them in "
+              "declaration order", cycle.c_str());
+    }
+
+    bool reordered = false;
+    for (uint32_t i = 0; i < passCount; i++) {
+        reordered = reordered || order[i] != i;
+    }
+    if (!reordered) {
+        return;
+    }
+    std::vector<Pass> sorted;
+    sorted.reserve(passCount);
+    for (const uint32_t index : order) {
+        sorted.push_back(std::move(mPasses[index]));
+    }
+    mPasses = std::move(sorted);
+}
+
+void RenderGraph::Cull() {
+    // Backwards liveness: a pass runs only if something later (or the outside
+    // world, for preserved imports) needs a resource it writes.
+    std::vector<bool> needed(mResources.size(), false);
+    for (size_t i = 0; i < mResources.size(); i++) {
+        needed[i] = mResources[i].mImported && mResources[i].mPreserve;
+    }
+
+    for (int i = static_cast<int>(mPasses.size()) - 1; i >= 0; i--) {
+        Pass& pass = mPasses[i];
+        const Attachment* attachments[MAX_COLOR_ATTACHMENTS + 1];
+        uint32_t count = 0;
+        for (uint32_t c = 0; c < pass.mColorCount; c++) {
+            attachments[count++] = &pass.mColors[c];
+        }
+        if (pass.mDepth.mResource != INVALID_RESOURCE) {
+            attachments[count++] = &pass.mDepth;
+        }
+
+        bool alive = false;
+        for (uint32_t a = 0; a < count; a++) {
+            alive = alive || needed[attachments[a]->mResource];
+        }
+        pass.mCulled = !alive;
+        if (!alive) {
+            continue;
+        }
+
+        // Whatever this pass fully overwrites isn't needed from earlier passes
+        // unless it loads it.
+        for (uint32_t a = 0; a < count; a++) {
+            needed[attachments[a]->mResource] = attachments[a]->mLoad == LoadOp::LOAD;
+        }
+        for (const ResourceHandle read : pass.mReads) {
+            needed[read] = true;
+        }
+    }
+}
+
+void RenderGraph::ComputeLifetimes() {
+    const auto touch = [this](const ResourceHandle handle, const int passIndex) {
+        Resource& resource = mResources[handle];
+        if (resource.mFirstPass < 0) {
+            resource.mFirstPass = passIndex;
+        }
+        resource.mLastPass = passIndex;
+    };
+
+    for (int i = 0; i < static_cast<int>(mPasses.size()); i++) {
+        const Pass& pass = mPasses[i];
+        if (pass.mCulled) {
+            continue;
+        }
+        for (uint32_t c = 0; c < pass.mColorCount; c++) {
+            touch(pass.mColors[c].mResource, i);
+        }
+        if (pass.mDepth.mResource != INVALID_RESOURCE) {
+            touch(pass.mDepth.mResource, i);
+        }
+        for (const ResourceHandle read : pass.mReads) {
+            if (!mResources[read].mWritten && mResources[read].mFirstPass < 0) {
+                ALOGW("RenderGraph: pass '%s' reads '%s' before anything writes it",
+                      pass.mLabel.c_str(), mResources[read].mLabel.c_str());
+            }
+            touch(read, i);
+        }
+    }
+}
+
+void RenderGraph::AssignPhysical(const int passIndex) {
+    for (Resource& resource : mResources) {
+        if (resource.mImported || resource.mFirstPass != passIndex) {
+            continue;
+        }
+        mStats.mTransientBytes += resource.mDesc.GetSizeBytes();
+
+        // Reuse storage whose previous occupant is already dead
+        PhysicalResource* match = nullptr;
+        for (PhysicalResource& physical : mPhysical) {
+            if (physical.mDesc == resource.mDesc && physical.mBusyUntilPass < passIndex) {
+                match = &physical;
+                break;
+            }
+        }
+        if (match == nullptr) {
+            PhysicalResource physical;
+            physical.mDesc = resource.mDesc;
+            physical.mGlName = mPool.Acquire(resource.mDesc);
+            mPhysical.push_back(physical);
+            match = &mPhysical.back();
+        }
+
+        if (!match->mUsedThisFrame) {
+            mStats.mPhysicalBytes += match->mDesc.GetSizeBytes();
+        }
+        match->mBusyUntilPass = resource.mLastPass;
+        match->mUsedThisFrame = true;
+        match->mIdleFrames = 0;
+        resource.mGlName = match->mGlName;
+    }
+}
+
+bool RenderGraph::NeedsInvalidateBefore(const Attachment& attachment) const {
+    switch (attachment.mLoad) {
+        case LoadOp::CLEAR:
+            return false;  // the clear itself avoids the load
+        case LoadOp::DONT_CARE:
+            return true;
+        case LoadOp::LOAD:
+            // Nothing to load on a transient's first use this frame
+            return !mResources[attachment.mResource].mWritten;
+    }
+    return false;
+}
+
+bool RenderGraph::NeedsInvalidateAfter(const Attachment& attachment, const int passIndex) const {
+    const Resource& resource = mResources[attachment.mResource];
+    return resource.mLastPass == passIndex && !(resource.mImported && resource.mPreserve);
+}
+
+GLenum RenderGraph::GetAttachmentPoint(const Attachment& attachment, const uint32_t colorIndex) const {
+    const GLenum format = mResources[attachment.mResource].mDesc.mFormat;
+    if (!IsDepthFormat(format)) {
+        return GL_COLOR_ATTACHMENT0 + colorIndex;
+    }
+    return HasStencil(format) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+}
+
+void RenderGraph::ExecuteRasterPass(const int passIndex, FrameStats& stats, int64_t& excludedNs) {
+    Pass& pass = mPasses[passIndex];
+
+    const GLuint fbo = GetFramebuffer(pass.mColors.data(), pass.mColorCount, pass.mDepth, stats);
+    COUNT_GL(stats, glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo));
+
+    const ResourceHandle sizeSource = pass.mColorCount > 0 ? pass.mColors[0].mResource
+                                                           : pass.mDepth.mResource;
+    const GpuResourceDesc& sizeDesc = mResources[sizeSource].mDesc;
+    COUNT_GL(stats, glViewport(0, 0, sizeDesc.mWidth, sizeDesc.mHeight));
+
+    // Load: invalidate what doesn't need loading, clear what asks for it
+    GLenum invalidate[MAX_COLOR_ATTACHMENTS + 1];
+    GLsizei invalidateCount = 0;
+    bool clearColor = false;
+    for (uint32_t c = 0; c < pass.mColorCount; c++) {
+        if (NeedsInvalidateBefore(pass.mColors[c])) {
+            invalidate[invalidateCount++] = GL_COLOR_ATTACHMENT0 + c;
+        }
+        clearColor = clearColor || pass.mColors[c].mLoad == LoadOp::CLEAR;
+    }
+    const bool hasDepth = pass.mDepth.mResource != INVALID_RESOURCE;
+    if (hasDepth && NeedsInvalidateBefore(pass.mDepth)) {
+        invalidate[invalidateCount++] = GetAttachmentPoint(pass.mDepth, 0);
+    }
+    if (invalidateCount > 0) {
+        COUNT_GL(stats, glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, invalidateCount, invalidate));
+        mStats.mInvalidates++;
+    }
+
+    const bool clearDepth = hasDepth && pass.mDepth.mLoad == LoadOp::CLEAR;
+    if (clearColor || clearDepth) {
+        // Clears honour scissor and write masks; make sure neither gets in the way
+        COUNT_GL(stats, glDisable(GL_SCISSOR_TEST));
+    }
+    if (clearColor) {
+        COUNT_GL(stats, glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+        for (uint32_t c = 0; c < pass.mColorCount; c++) {
+            if (pass.mColors[c].mLoad == LoadOp::CLEAR) {
+                COUNT_GL(stats, glClearBufferfv(GL_COLOR, static_cast<GLint>(c),
+                                                pass.mColors[c].mClear.data()));
+                mStats.mClears++;
+            }
+        }
+    }
+    if (clearDepth) {
+        COUNT_GL(stats, glDepthMask(GL_TRUE));
+        if (HasStencil(mResources[pass.mDepth.mResource].mDesc.mFormat)) {
+            COUNT_GL(stats, glClearBufferfi(GL_DEPTH_STENCIL, 0, pass.mDepth.mClear[0], 0));
+        } else {
+            COUNT_GL(stats, glClearBufferfv(GL_DEPTH, 0, pass.mDepth.mClear.data()));
+        }
+        mStats.mClears++;
+    }
+
+    if (pass.mExecute) {
+        PassContext context;
+        context.mGraph = this;
+        context.mWidth = sizeDesc.mWidth;
+        context.mHeight = sizeDesc.mHeight;
+
+        const auto callbackStart = std::chrono::steady_clock::now();
+        pass.mExecute(context);
+        excludedNs += ElapsedNs(callbackStart);
+    }
+
+    // Store: drop anything nobody reads after this pass
+    invalidateCount = 0;
+    for (uint32_t c = 0; c < pass.mColorCount; c++) {
+        mResources[pass.mColors[c].mResource].mWritten = true;
+        if (NeedsInvalidateAfter(pass.mColors[c], passIndex)) {
+            invalidate[invalidateCount++] = GL_COLOR_ATTACHMENT0 + c;
+        }
+    }
+    if (hasDepth) {
+        mResources[pass.mDepth.mResource].mWritten = true;
+        if (NeedsInvalidateAfter(pass.mDepth, passIndex)) {
+            invalidate[invalidateCount++] = GetAttachmentPoint(pass.mDepth, 0);
+        }
+    }
+    if (invalidateCount > 0) {
+        COUNT_GL(stats, glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, invalidateCount, invalidate));
+        mStats.mInvalidates++;
+    }
+}
+
+void RenderGraph::ExecuteResolvePass(const int passIndex, FrameStats& stats, int64_t& excludedNs) {
+    Pass& pass = mPasses[passIndex];
+    const ResourceHandle sourceHandle = pass.mReads[0];
+    const bool isDepth = pass.mColorCount == 0;
+    const Attachment& destination = isDepth ? pass.mDepth : pass.mColors[0];
+
+    Attachment source;
+    source.mResource = sourceHandle;
+    const Attachment noAttachment;
+
+    const GLuint readFbo = isDepth ? GetFramebuffer(nullptr, 0, source, stats)
+                                   : GetFramebuffer(&source, 1, noAttachment, stats);
+    const GLuint drawFbo = isDepth ? GetFramebuffer(nullptr, 0, destination, stats)
+                                   : GetFramebuffer(&destination, 1, noAttachment, stats);
+
+    const GLenum sourcePoint = GetAttachmentPoint(source, 0);
+    const GLenum destinationPoint = GetAttachmentPoint(destination, 0);
+    const GpuResourceDesc& sourceDesc = mResources[sourceHandle].mDesc;
+    const GpuResourceDesc& destinationDesc = mResources[destination.mResource].mDesc;
+
+    COUNT_GL(stats, glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo));
+    COUNT_GL(stats, glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo));
+
+    // Every destination pixel is overwritten, so its old contents never need loading
+    COUNT_GL(stats, glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, 1, &destinationPoint));
+    mStats.mInvalidates++;
+
+    const auto blitStart = std::chrono::steady_clock::now();
+    COUNT_GL(stats, glBlitFramebuffer(0, 0, sourceDesc.mWidth, sourceDesc.mHeight,
+                                      0, 0, destinationDesc.mWidth, destinationDesc.mHeight,
+                                      isDepth ? GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT,
+                                      GL_NEAREST));
+    const int64_t blitNs = ElapsedNs(blitStart);
+    stats.mResolveNs += blitNs;
+    excludedNs += blitNs;
+    mResources[destination.mResource].mWritten = true;
+
+    if (NeedsInvalidateAfter(source, passIndex)) {
+        COUNT_GL(stats, glInvalidateFramebuffer(GL_READ_FRAMEBUFFER, 1, &sourcePoint));
+        mStats.mInvalidates++;
+    }
+    if (NeedsInvalidateAfter(destination, passIndex)) {
+        COUNT_GL(stats, glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, 1, &destinationPoint));
+        mStats.mInvalidates++;
+    }
+}
+
+uint64_t RenderGraph::AttachmentKey(const ResourceHandle handle) const {
+    if (handle == INVALID_RESOURCE) {
+        return 0;
+    }
+    const Resource& resource = mResources[handle];
+    uint64_t key = resource.mGlName | (static_cast<uint64_t>(resource.mLayer) << 32);
+    if (resource.mTarget == 0) {
+        key |= kRenderbufferKeyBit;
+    } else {
+        key |= static_cast<uint64_t>(resource.mDesc.mSamples & 0x7F) << kSamplesKeyShift;
+    }
+    return key;
+}
+
+GLuint RenderGraph::GetFramebuffer(const Attachment* colors, const uint32_t colorCount,
+                                   const Attachment& depth, FrameStats& stats) {
+    FramebufferKey key{};
+    for (uint32_t c = 0; c < colorCount; c++) {
+        key[c] = AttachmentKey(colors[c].mResource);
+    }
+    key[MAX_COLOR_ATTACHMENTS] = AttachmentKey(depth.mResource);
+
+    const auto it = mFramebuffers.find(key);
+    if (it != mFramebuffers.end()) {
+        it->second.mIdleFrames = 0;
+        return it->second.mFbo;
+    }
+
+    // Bound to both targets: glReadBuffer applies to the read binding
+    const GLuint fbo = mPool.Acquire(GpuResourceDesc::Framebuffer());
+    COUNT_GL(stats, glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+
+    const auto attach = [&](const GLenum point, const ResourceHandle handle) {
+        if (handle == INVALID_RESOURCE) {
+            COUNT_GL(stats, glFramebufferRenderbuffer(GL_FRAMEBUFFER, point, GL_RENDERBUFFER, 0));
+            return;
+        }
+        const Resource& resource = mResources[handle];
+        if (resource.mTarget == 0) {
+            COUNT_GL(stats, glFramebufferRenderbuffer(GL_FRAMEBUFFER, point, GL_RENDERBUFFER,
+                                                      resource.mGlName));
+        } else if (resource.mDesc.mSamples > 1) {
+            COUNT_GL(stats, glFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, point,
+                                                                 resource.mTarget, resource.mGlName,
+                                                                 0, resource.mDesc.mSamples));
+        } else if (resource.mTarget == GL_TEXTURE_2D_ARRAY) {
+            COUNT_GL(stats, glFramebufferTextureLayer(GL_FRAMEBUFFER, point, resource.mGlName,
+                                                      0, resource.mLayer));
+        } else {
+            COUNT_GL(stats, glFramebufferTexture2D(GL_FRAMEBUFFER, point, resource.mTarget,
+                                                   resource.mGlName, 0));
+        }
+    };
+
+    // Pooled framebuffers may come back with someone else's attachments
+    GLenum drawBuffers[MAX_COLOR_ATTACHMENTS];
+    for (uint32_t c = 0; c < MAX_COLOR_ATTACHMENTS; c++) {
+        attach(GL_COLOR_ATTACHMENT0 + c, c < colorCount ? colors[c].mResource : INVALID_RESOURCE);
+        drawBuffers[c] = c < colorCount ? GL_COLOR_ATTACHMENT0 + c : GL_NONE;
+    }
+    attach(GL_DEPTH_STENCIL_ATTACHMENT, INVALID_RESOURCE);
+    if (depth.mResource != INVALID_RESOURCE) {
+        attach(GetAttachmentPoint(depth, 0), depth.mResource);
+    }
+    COUNT_GL(stats, glDrawBuffers(static_cast<GLsizei>(colorCount > 0 ? colorCount : 1), drawBuffers));
+    COUNT_GL(stats, glReadBuffer(colorCount > 0 ? GL_COLOR_ATTACHMENT0 : GL_NONE));
+
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        ALOGE("RenderGraph: incomplete framebuffer (0x%x) for '%s'", status,
+              mResources[colorCount > 0 ? colors[0].mResource : depth.mResource].mLabel.c_str());
+    }
+
+    mFramebuffers[key] = {fbo, 0};
+    return fbo;
+}
+
+void RenderGraph::ReleaseFramebuffersUsing(const GLuint glName, const bool isRenderbuffer) {
+    for (auto it = mFramebuffers.begin(); it != mFramebuffers.end();) {
+        bool uses = false;
+        for (const uint64_t attachmentKey : it->first) {
+            uses = uses || (attachmentKey != 0 &&
+                            static_cast<GLuint>(attachmentKey & 0xFFFFFFFFu) == glName &&
+                            ((attachmentKey & kRenderbufferKeyBit) != 0) == isRenderbuffer);
+        }
+        if (uses) {
+            mPool.Release(it->second.mFbo, GpuResourceDesc::Framebuffer());
+            it = mFramebuffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RenderGraph::EndFrame() {
+    for (auto it = mPhysical.begin(); it != mPhysical.end();) {
+        if (!it->mUsedThisFrame && ++it->mIdleFrames > kMaxPhysicalIdleFrames) {
+            ReleaseFramebuffersUsing(it->mGlName, it->mDesc.mType == GpuResourceType::RENDERBUFFER);
+            mPool.Release(it->mGlName, it->mDesc);
+            it = mPhysical.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = mFramebuffers.begin(); it != mFramebuffers.end();) {
+        if (++it->second.mIdleFrames > kMaxFramebufferIdleFrames) {
+            mPool.Release(it->second.mFbo, GpuResourceDesc::Framebuffer());
+            it = mFramebuffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    mResources.clear();
+    mPasses.clear();
+}
@@ -0,0 +1,253 @@
+/*******************************************************************************
+
+Filename    :   RenderGraph.h
+Content     :   Per-frame render pass graph with transient attachment aliasing
+                and automatic clear / invalidate placement
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../gl/ResourcePool.h"
+#include "../utils/FrameStats.h"
+
+#include <GLES3/gl3.h>
+#include <GLES3/gl3ext.h>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * RenderGraph - declare a frame's passes, then let the graph sequence them.
+ *
+ * Each frame, resources are declared as transient (storage owned by the
+ * graph) or imported (e.g. a swapchain image), and passes declare which of
+ * them they render to, how each attachment should start (LoadOp), and what
+ * they sample. Execute() then:
+ *
+ *  - culls passes whose output nothing consumes,
+ *  - gives transient resources with equal descriptors and disjoint
+ *    lifetimes the same storage, and keeps that storage across frames,
+ *  - clears attachments that ask for it and invalidates ones whose previous
+ *    contents are not needed, so tiled GPUs skip the tile load,
+ *  - invalidates attachments after their last use unless they are imported
+ *    with preserved contents, so tiled GPUs skip the tile store.
+ *
+ * Passes are first sorted by what they read and write, so they may be declared
+ * in any order. Accesses to one resource keep their declaration order, with
+ * one exception: a pass that reads a transient before any pass declared ahead
+ * of it writes it is taken to want the producer's output, and runs after the
+ * last writer. Imported resources start out defined, so an early read of one
+ * sees its incoming contents and runs before the first writer. Independent
+ * passes keep their declaration order. A dependency cycle is logged and the
+ * passes on it run in declaration order.
+ *
+ * The graph is rebuilt every frame; declaring it is cheap, and framebuffer
+ * objects and transient storage are cached between frames.
+ */
+class RenderGraph {
+public:
+    using ResourceHandle = uint32_t;
+    static constexpr ResourceHandle INVALID_RESOURCE = UINT32_MAX;
+    static constexpr uint32_t MAX_COLOR_ATTACHMENTS = 4;
+
+    enum class LoadOp {
+        LOAD,       // keep what an earlier pass wrote
+        CLEAR,      // start from the clear value
+        DONT_CARE   // every pixel will be overwritten
+    };
+
+    /**
+     * What a pass's execute callback gets to see. The pass's framebuffer is
+     * bound and the viewport set; callbacks must leave framebuffer bindings alone.
+     */
+    class PassContext {
+    public:
+        int GetWidth() const { return mWidth; }
+        int GetHeight() const { return mHeight; }
+
+        // GL texture name of a resource declared with Read(), for sampling
+        GLuint GetTexture(ResourceHandle handle) const;
+
+    private:
+        friend class RenderGraph;
+        const RenderGraph* mGraph = nullptr;
+        int mWidth = 0;
+        int mHeight = 0;
+    };
+
+    using ExecuteFn = std::function<void(const PassContext&)>;
+
+    /**
+     * Returned by AddPass() to declare the pass's attachments and inputs
+     */
+    class PassBuilder {
+    public:
+        PassBuilder& Color(ResourceHandle handle, LoadOp load,
+                           const std::array<float, 4>& clearColor = {0.0f, 0.0f, 0.0f, 0.0f});
+        PassBuilder& Depth(ResourceHandle handle, LoadOp load, float clearDepth = 1.0f);
+        // Reading INVALID_RESOURCE is a no-op, so optional inputs can be passed as-is
+        PassBuilder& Read(ResourceHandle handle);
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, uint32_t passIndex) : mGraph(graph), mPassIndex(passIndex) {}
+        RenderGraph& mGraph;
+        uint32_t mPassIndex;
+    };
+
+    struct Stats {
+        uint32_t mPassesExecuted = 0;
+        uint32_t mPassesCulled = 0;
+        uint32_t mClears = 0;
+        uint32_t mInvalidates = 0;
+        // Transient bytes as declared vs. storage actually bound after aliasing
+        uint64_t mTransientBytes = 0;
+        uint64_t mPhysicalBytes = 0;
+    };
+
+    /**
+     * @param pool Source of transient storage and framebuffer objects; must outlive the graph
+     */
+    explicit RenderGraph(GpuResourcePool& pool) : mPool(pool) {}
+    ~RenderGraph();
+
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    /**
+     * Hand all cached storage and framebuffers back to the pool.
+     */
+    void Shutdown();
+
+    /**
+     * Drop cached framebuffers. Call when imported textures are destroyed
+     * (e.g. swapchain re-creation), before their names can be reused.
+     */
+    void ReleaseFramebuffers();
+
+    /**
+     * Declare a resource whose storage the graph provides for this frame only.
+     * Only texture and renderbuffer descriptors are valid.
+     */
+    ResourceHandle CreateTransient(const char* name, const GpuResourceDesc& desc);
+
+    /**
+     * Declare an externally owned texture.
+     *
+     * @param preserve If true its contents are needed after the graph runs,
+     *                 so its final store is never invalidated
+     * @param samples  If above 1, passes render to it multisampled and the
+     *                 driver resolves as tiles are stored, with no resolve
+     *                 pass or MSAA color target. GL_TEXTURE_2D only, and
+     *                 only if SupportsImplicitResolve().
+     */
+    ResourceHandle ImportTexture(const char* name, GLuint texture, GLenum target, GLenum format,
+                                 GLsizei width, GLsizei height, GLint layer = 0,
+                                 bool preserve = true, GLsizei samples = 0);
+
+    /**
+     * Whether ImportTexture() accepts samples (EXT_multisampled_render_to_texture).
+     * Requires a current context.
+     */
+    static bool SupportsImplicitResolve();
+
+    PassBuilder AddPass(const char* name, ExecuteFn execute);
+
+    /**
+     * Blit (MSAA resolve) @p source into @p destination; both must be the same size.
+     */
+    void AddResolvePass(const char* name, ResourceHandle source, ResourceHandle destination);
+
+    /**
+     * Compile and run everything declared since the previous Execute(), then
+     * reset for the next frame. GL calls and CPU time spent by the graph
+     * itself are added to @p stats (resolve blits to mResolveNs); pass
+     * callbacks account for their own.
+     */
+    void Execute(FrameStats& stats);
+
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    struct Resource {
+        std::string mLabel;
+        GpuResourceDesc mDesc;
+        bool mImported = false;
+        bool mPreserve = false;
+        GLuint mGlName = 0;       // imported name, or bound physical storage
+        GLenum mTarget = 0;       // texture target; 0 for renderbuffers
+        GLint mLayer = 0;
+
+        // Compile-time bookkeeping
+        int mFirstPass = -1;
+        int mLastPass = -1;
+        bool mWritten = false;
+    };
+
+    struct Attachment {
+        ResourceHandle mResource = INVALID_RESOURCE;
+        LoadOp mLoad = LoadOp::DONT_CARE;
+        std::array<float, 4> mClear = {0.0f, 0.0f, 0.0f, 0.0f};
+    };
+
+    struct Pass {
+        std::string mLabel;
+        ExecuteFn mExecute;
+        std::array<Attachment, MAX_COLOR_ATTACHMENTS> mColors;
+        uint32_t mColorCount = 0;
+        Attachment mDepth;
+        std::vector<ResourceHandle> mReads;
+        bool mIsResolve = false;
+        bool mCulled = false;
+    };
+
+    // Storage shared by transients with the same descriptor
+    struct PhysicalResource {
+        GpuResourceDesc mDesc;
+        GLuint mGlName = 0;
+        int mBusyUntilPass = -1;
+        uint32_t mIdleFrames = 0;
+        bool mUsedThisFrame = false;
+    };
+
+    // One key per attachment slot: 4 colors + depth
+    using FramebufferKey = std::array<uint64_t, MAX_COLOR_ATTACHMENTS + 1>;
+
+    struct CachedFramebuffer {
+        GLuint mFbo = 0;
+        uint32_t mIdleFrames = 0;
+    };
+
+    void Sort();
+    void Cull();
+    void ComputeLifetimes();
+    void AssignPhysical(int passIndex);
+    void ExecuteRasterPass(int passIndex, FrameStats& stats, int64_t& excludedNs);
+    void ExecuteResolvePass(int passIndex, FrameStats& stats, int64_t& excludedNs);
+    GLuint GetFramebuffer(const Attachment* colors, uint32_t colorCount,
+                          const Attachment& depth, FrameStats& stats);
+    GLenum GetAttachmentPoint(const Attachment& attachment, uint32_t colorIndex) const;
+    bool NeedsInvalidateBefore(const Attachment& attachment) const;
+    bool NeedsInvalidateAfter(const Attachment& attachment, int passIndex) const;
+    void ReleaseFramebuffersUsing(GLuint glName, bool isRenderbuffer);
+    void EndFrame();
+
+    uint64_t AttachmentKey(ResourceHandle handle) const;
+
+    GpuResourcePool& mPool;
+
+    std::vector<Resource> mResources;
+    std::vector<Pass> mPasses;
+    std::vector<PhysicalResource> mPhysical;
+    std::map<FramebufferKey, CachedFramebuffer> mFramebuffers;
+
+    Stats mStats;
+};
@@ -0,0 +1,736 @@
+/*******************************************************************************
+
+Filename    :   SceneRenderer.cpp
+Content     :   GL scene rendering, independent of the OpenXR session
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "SceneRenderer.h"
+#include "../utils/AssetPackage.h"
+#include "../utils/LogUtils.h"
+
+#include <xr_linear.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+namespace {
+    constexpr GLuint kViewUniformsBinding = 0;
+    constexpr GLuint kObjectUniformsBinding = 1;
+    constexpr GLuint kClusterLightingBinding = 2;
+    constexpr GLuint kShadowParamsBinding = 3;
+
+    constexpr GLint kClusterLightListsUnit = 0;
+    constexpr GLint kShadowPageTableUnit = 1;
+    constexpr GLint kShadowAtlasUnit = 2;
+    constexpr GLint kShadowDynamicUnit = 3;
+
+    // From GL_EXT_clip_cull_distance
+    constexpr GLenum kClipDistance0 = 0x3000;
+
+    // std140 layout of the ViewUniforms block; the stereo program's holds
+    // one matrix per eye
+    struct ViewUniforms {
+        XrMatrix4x4f mViewProjection;
+    };
+    constexpr uint32_t kMaxViews = 2;
+
+    // std140 layout of the ObjectUniforms block
+    struct ObjectUniforms {
+        XrMatrix4x4f mModel;
+        float mAlbedo[4];
+    };
+
+    // Covers both eyes and a full frame of shadow tile updates; each
+    // allocation is padded to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT. Room for
+    // object uniforms is added on top as the scene grows.
+    constexpr GLsizeiptr kUniformBytesPerFrame = 32 * 1024;
+
+    XrMatrix4x4f EyeViewProjection(const XrPosef& eyePose, const XrFovf& fov) {
+        XrMatrix4x4f projMatrix;
+        XrMatrix4x4f_CreateProjectionFov(&projMatrix,
+                                         GraphicsAPI::GRAPHICS_OPENGL, fov, 0.1f, 100.0f);
+
+        XrPosef invertedPose;
+        XrPosef_Invert(&invertedPose, &eyePose);
+
+        XrMatrix4x4f viewMatrix;
+        XrMatrix4x4f_CreateFromRigidTransform(&viewMatrix, &invertedPose);
+
+        XrMatrix4x4f viewProjection;
+        XrMatrix4x4f_Multiply(&viewProjection, &projMatrix, &viewMatrix);
+        return viewProjection;
+    }
+} // anonymous namespace
+
+void SceneRenderer::Init(ShaderManager& shaders, JobSystem* jobs, const bool instancedStereo,
+                         const AssetPackage* assets) {
+    mShaders = &shaders;
+
+    // Vertex shader
+    const GLchar *vsSource = R"(
+        #version 300 es
+        layout(location = 0) in vec3 aPosition;
+        layout(location = 1) in vec3 aNormal;
+        layout(std140) uniform ViewUniforms {
+            mat4 uViewProjection;
+        };
+        layout(std140) uniform ObjectUniforms {
+            mat4 uModel;
+            vec4 uAlbedo;
+        };
+        out highp vec3 vWorldPosition;
+        out vec3 vNormal;
+        void main() {
+            vec4 worldPosition = uModel * vec4(aPosition, 1.0);
+            vWorldPosition = worldPosition.xyz;
+            // Objects are scaled about uniformly, so the model matrix will do
+            vNormal = mat3(uModel) * aNormal;
+            gl_Position = uViewProjection * worldPosition;
+        }
+    )";
+
+    // Fragment shader: ambient, shadowed sun, and clustered point lights
+    const std::string fsBody = std::string(R"(
+        precision mediump float;
+        layout(std140) uniform ObjectUniforms {
+            mat4 uModel;
+            vec4 uAlbedo;
+        };
+        in highp vec3 vWorldPosition;
+        in vec3 vNormal;
+        #ifdef STEREO_DISCARD
+        in highp float vEyeClip;
+        #endif
+        out vec4 fragColor;
+    )") + ClusteredLighting::GetShaderSource() + ShadowAtlas::GetShaderSource() + R"(
+        void main() {
+            #ifdef STEREO_DISCARD
+            if (vEyeClip < 0.0) {
+                discard;
+            }
+            #endif
+            const vec3 ambient = vec3(0.15);
+            vec3 normal = normalize(vNormal);
+            vec3 albedo = uAlbedo.rgb;
+            vec3 color = albedo * ambient + SunLighting(vWorldPosition, normal, albedo) +
+                         ClusteredLighting(vWorldPosition, normal, albedo);
+            fragColor = vec4(color, 1.0);
+        }
+    )";
+    const std::string fsSource = "#version 300 es\n" + fsBody;
+
+    mSceneProgram = shaders.Request("Scene Program", vsSource, fsSource.c_str(),
+                                    {{"ViewUniforms", kViewUniformsBinding},
+                                     {"ObjectUniforms", kObjectUniformsBinding},
+                                     {ClusteredLighting::UNIFORM_BLOCK_NAME, kClusterLightingBinding},
+                                     {ShadowAtlas::UNIFORM_BLOCK_NAME, kShadowParamsBinding}},
+                                    {{"uClusterLightLists", kClusterLightListsUnit},
+                                     {"uShadowPageTable", kShadowPageTableUnit},
+                                     {"uShadowAtlas", kShadowAtlasUnit},
+                                     {"uShadowDynamic", kShadowDynamicUnit}});
+
+    // Instanced stereo: instance N is eye N, squeezed into its half of a
+    // double-wide target. Whatever would cross the middle is clipped there,
+    // or discarded per fragment where clip distances are unsupported.
+    if (instancedStereo) {
+        const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+        mStereoClipDistance = extensions != nullptr &&
+                              strstr(extensions, "GL_EXT_clip_cull_distance") != nullptr;
+        const std::string stereoVsSource = std::string("#version 300 es\n") +
+                (mStereoClipDistance ? "#extension GL_EXT_clip_cull_distance : require\n"
+                                     : "#define STEREO_DISCARD\n") + R"(
+        layout(location = 0) in vec3 aPosition;
+        layout(location = 1) in vec3 aNormal;
+        layout(std140) uniform ViewUniforms {
+            mat4 uViewProjection[2];
+        };
+        layout(std140) uniform ObjectUniforms {
+            mat4 uModel;
+            vec4 uAlbedo;
+        };
+        out highp vec3 vWorldPosition;
+        out vec3 vNormal;
+        #ifdef STEREO_DISCARD
+        out highp float vEyeClip;
+        #endif
+        void main() {
+            vec4 worldPosition = uModel * vec4(aPosition, 1.0);
+            vWorldPosition = worldPosition.xyz;
+            vNormal = mat3(uModel) * aNormal;
+            int eye = gl_InstanceID;
+            vec4 clip = uViewProjection[eye] * worldPosition;
+            clip.x = clip.x * 0.5 + (float(eye) - 0.5) * clip.w;
+            // Positive on this eye's side of the middle
+            float eyeClip = eye == 0 ? -clip.x : clip.x;
+            #ifdef STEREO_DISCARD
+            vEyeClip = eyeClip;
+            #else
+            gl_ClipDistance[0] = eyeClip;
+            #endif
+            gl_Position = clip;
+        }
+    )";
+        const std::string stereoFsSource = std::string("#version 300 es\n") +
+                (mStereoClipDistance ? "" : "#define STEREO_DISCARD\n") + fsBody;
+        mStereoProgram = shaders.Request(
+                "Instanced Stereo Scene Program", stereoVsSource.c_str(), stereoFsSource.c_str(),
+                {{"ViewUniforms", kViewUniformsBinding},
+                 {"ObjectUniforms", kObjectUniformsBinding},
+                 {ClusteredLighting::UNIFORM_BLOCK_NAME, kClusterLightingBinding},
+                 {ShadowAtlas::UNIFORM_BLOCK_NAME, kShadowParamsBinding}},
+                {{"uClusterLightLists", kClusterLightListsUnit},
+                 {"uShadowPageTable", kShadowPageTableUnit},
+                 {"uShadowAtlas", kShadowAtlasUnit},
+                 {"uShadowDynamic", kShadowDynamicUnit}});
+        ALOGD("SceneRenderer: instanced stereo clips with %s",
+              mStereoClipDistance ? "gl_ClipDistance" : "fragment discard");
+    }
+
+    // Depth-only program for shadow casters
+    const GLchar *shadowVsSource = R"(
+        #version 300 es
+        layout(location = 0) in vec3 aPosition;
+        layout(std140) uniform ViewUniforms {
+            mat4 uViewProjection;
+        };
+        layout(std140) uniform ObjectUniforms {
+            mat4 uModel;
+            vec4 uAlbedo;
+        };
+        void main() {
+            gl_Position = uViewProjection * (uModel * vec4(aPosition, 1.0));
+        }
+    )";
+    const GLchar *shadowFsSource = R"(
+        #version 300 es
+        void main() {
+        }
+    )";
+    mShadowProgram = shaders.Request("Shadow Caster Program", shadowVsSource, shadowFsSource,
+                                     {{"ViewUniforms", kViewUniformsBinding},
+                                      {"ObjectUniforms", kObjectUniformsBinding}});
+
+    if (assets == nullptr || !UploadPackagedMeshes(*assets)) {
+        const BuiltinMeshes meshes = BuiltinMeshes::Build();
+        UploadMeshes(meshes.mVertices.data(), meshes.mVertices.size(), meshes.mIndices.data(),
+                     meshes.mIndices.size(), meshes.mMeshes);
+    }
+
+    if (!mUniforms.Create(kUniformBytesPerFrame)) {
+        ALOGE("SceneRenderer: failed to create uniform streaming buffer");
+    }
+    if (!mLighting.Init(jobs)) {
+        ALOGE("SceneRenderer: failed to initialize clustered lighting");
+    }
+    if (!mShadows.Init()) {
+        ALOGE("SceneRenderer: failed to initialize shadow atlas");
+    }
+    mOcclusion.Init(jobs);
+}
+
+GpuMemoryUsage SceneRenderer::GetGpuMemory() const {
+    GpuMemoryUsage usage;
+    usage.Add(GpuMemoryCategory::BUFFER, mMeshBytes + static_cast<uint64_t>(mUniforms.GetSize()));
+    usage += mLighting.GetGpuMemory();
+    usage += mShadows.GetGpuMemory();
+    return usage;
+}
+
+void SceneRenderer::Shutdown() {
+    if (mMeshVAO != 0) {
+        glDeleteVertexArrays(1, &mMeshVAO);
+        mMeshVAO = 0;
+    }
+    if (mMeshVBO != 0) {
+        glDeleteBuffers(1, &mMeshVBO);
+        mMeshVBO = 0;
+    }
+    if (mMeshIBO != 0) {
+        glDeleteBuffers(1, &mMeshIBO);
+        mMeshIBO = 0;
+    }
+    mMeshBytes = 0;
+    mShadows.Shutdown();
+    mLighting.Shutdown();
+    mUniforms.Destroy();
+    // Programs belong to the ShaderManager
+    mSceneProgram = ShaderManager::INVALID_PROGRAM;
+    mShadowProgram = ShaderManager::INVALID_PROGRAM;
+    mStereoProgram = ShaderManager::INVALID_PROGRAM;
+    mShaders = nullptr;
+}
+
+bool SceneRenderer::UploadPackagedMeshes(const AssetPackage& assets) {
+    using namespace AssetFormat;
+    const Entry* vertices = assets.Find(BuiltinMeshes::VERTICES, EntryType::VERTICES);
+    const Entry* indices = assets.Find(BuiltinMeshes::INDICES, EntryType::INDICES);
+    if (vertices == nullptr || indices == nullptr ||
+        vertices->mParams[0] != static_cast<uint32_t>(VertexLayout::POSITION_NORMAL) ||
+        vertices->mParams[1] != sizeof(MeshVertex) ||
+        uint64_t{vertices->mParams[2]} * sizeof(MeshVertex) > vertices->mSize ||
+        indices->mParams[0] != GL_UNSIGNED_SHORT ||
+        uint64_t{indices->mParams[1]} * sizeof(uint16_t) > indices->mSize) {
+        ALOGW("SceneRenderer: package has no usable scene geometry");
+        return false;
+    }
+    const uint32_t vertexCount = vertices->mParams[2];
+    const uint32_t indexCount = indices->mParams[1];
+
+    BuiltinMeshes::MeshLods lods = {};
+    for (size_t i = 0; i < lods.size(); i++) {
+        const Entry* mesh = assets.Find(BuiltinMeshes::MESH_NAMES[i], EntryType::MESH);
+        const uint32_t levelCount = mesh != nullptr ? mesh->mParams[2] : 0;
+        // Every mesh indexes the shared scene buffers
+        if (levelCount == 0 || levelCount > LodSelector::MAX_LEVELS ||
+            mesh->mParams[0] >= assets.GetEntryCount() ||
+            &assets.GetEntry(mesh->mParams[0]) != vertices ||
+            mesh->mParams[1] >= assets.GetEntryCount() ||
+            &assets.GetEntry(mesh->mParams[1]) != indices ||
+            uint64_t{levelCount} * sizeof(MeshLevel) > mesh->mSize) {
+            ALOGW("SceneRenderer: package mesh %s is missing or malformed",
+                  BuiltinMeshes::MESH_NAMES[i]);
+            return false;
+        }
+        const auto* levels = static_cast<const MeshLevel*>(assets.GetData(*mesh));
+        for (uint32_t level = 0; level < levelCount; level++) {
+            if (levels[level].mFirstIndex > indexCount ||
+                levels[level].mIndexCount > indexCount - levels[level].mFirstIndex) {
+                ALOGW("SceneRenderer: package mesh %s indexes past the index buffer",
+                      BuiltinMeshes::MESH_NAMES[i]);
+                return false;
+            }
+            lods[i].mLevels[level] = {levels[level].mFirstIndex, levels[level].mIndexCount,
+                                      levels[level].mError};
+        }
+        lods[i].mLevelCount = levelCount;
+    }
+
+    // Reading the indices here faults them in just before GL copies them
+    const auto* indexData = static_cast<const uint16_t*>(assets.GetData(*indices));
+    for (uint32_t i = 0; i < indexCount; i++) {
+        if (indexData[i] >= vertexCount) {
+            ALOGW("SceneRenderer: package index %u is out of range", i);
+            return false;
+        }
+    }
+
+    const uint32_t group = vertices->mGroup;
+    assets.Prefetch(group);
+    UploadMeshes(static_cast<const MeshVertex*>(assets.GetData(*vertices)), vertexCount,
+                 indexData, indexCount, lods);
+    // GL has its own copy now
+    assets.Release(group);
+    if (indices->mGroup != group) {
+        assets.Release(indices->mGroup);
+    }
+    ALOGD("SceneRenderer: mapped %u vertices, %u indices from the asset package", vertexCount,
+          indexCount);
+    return true;
+}
+
+void SceneRenderer::UploadMeshes(const MeshVertex* vertices, const size_t vertexCount,
+                                 const uint16_t* indices, const size_t indexCount,
+                                 const BuiltinMeshes::MeshLods& lods) {
+    for (size_t i = 0; i < lods.size(); i++) {
+        mMeshes[i].mLods = lods[i];
+    }
+    mOccluderPositions.clear();
+    for (MeshInfo& mesh : mMeshes) {
+        const LodSelector::Level& coarsest = mesh.mLods.mLevels[mesh.mLods.mLevelCount - 1];
+        mesh.mOccluderFirst = static_cast<uint32_t>(mOccluderPositions.size());
+        mesh.mOccluderCount = coarsest.mIndexCount;
+        for (uint32_t i = 0; i < coarsest.mIndexCount; i++) {
+            const MeshVertex& vertex = vertices[indices[coarsest.mFirstIndex + i]];
+            mOccluderPositions.push_back(
+                    {vertex.mPosition[0], vertex.mPosition[1], vertex.mPosition[2]});
+        }
+    }
+
+    glGenBuffers(1, &mMeshVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mMeshVBO);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertexCount * sizeof(MeshVertex)),
+                 vertices, GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &mMeshVAO);
+    glBindVertexArray(mMeshVAO);
+    // The element buffer binding is VAO state
+    glGenBuffers(1, &mMeshIBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMeshIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indexCount * sizeof(uint16_t)),
+                 indices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+                          (void *) offsetof(MeshVertex, mPosition));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+                          (void *) offsetof(MeshVertex, mNormal));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    mMeshBytes = vertexCount * sizeof(MeshVertex) + indexCount * sizeof(uint16_t);
+}
+
+MathUtils::Bounds3f SceneRenderer::ComputeBounds(const SceneObject& object) const {
+    // Local bounds of every mesh fit in the unit cube (the quad is flat in Z)
+    const float halfDepth = object.mMesh == SceneMesh::QUAD ? 0.0f : 0.5f;
+    const XrVector3f localCorner = {0.5f * object.mScale.x, 0.5f * object.mScale.y,
+                                    halfDepth * object.mScale.z};
+    MathUtils::Bounds3f bounds;
+    for (int i = 0; i < 8; i++) {
+        const XrVector3f local = {(i & 1) ? localCorner.x : -localCorner.x,
+                                  (i & 2) ? localCorner.y : -localCorner.y,
+                                  (i & 4) ? localCorner.z : -localCorner.z};
+        XrVector3f world;
+        XrPosef_TransformVector3f(&world, &object.mPose, &local);
+        bounds.Expand(world);
+    }
+    return bounds;
+}
+
+SceneRenderer::ObjectId SceneRenderer::AddObject(const SceneObject& object) {
+    mObjects.push_back(object);
+    mCasters.push_back({ComputeBounds(object), object.mStatic});
+    mObjectLods.push_back(0);
+    const ObjectId id = static_cast<ObjectId>(mObjects.size() - 1);
+    mObjectProxies.push_back(mSpatialIndex.Insert(mCasters.back().mBounds, id));
+    if (object.mStatic) {
+        mShadows.InvalidateBounds(mCasters.back().mBounds);
+    }
+    return id;
+}
+
+void SceneRenderer::ReserveObjectUniforms() {
+    if (mUniforms.GetMode() == StreamingBuffer::Mode::NONE) {
+        return;
+    }
+    const GLsizeiptr alignment = mUniforms.GetUniformAlignment();
+    const GLsizeiptr objectBytes =
+            (static_cast<GLsizeiptr>(sizeof(ObjectUniforms)) + alignment - 1) / alignment *
+            alignment;
+    const GLsizeiptr needed =
+            kUniformBytesPerFrame + objectBytes * static_cast<GLsizeiptr>(mObjects.size());
+    const GLsizeiptr regionSize = mUniforms.GetRegionSize();
+    if (needed <= regionSize) {
+        return;
+    }
+    // Half again at least, so a scene growing a few objects a frame doesn't
+    // rebuild every frame. The driver keeps the old buffer alive for the
+    // frames still reading it.
+    mUniforms.Destroy();
+    if (!mUniforms.Create(std::max(needed, regionSize + regionSize / 2))) {
+        ALOGE("SceneRenderer: failed to grow uniform streaming buffer to %lld bytes",
+              static_cast<long long>(needed));
+    }
+}
+
+void SceneRenderer::SetObjectPose(const ObjectId id, const XrPosef& pose) {
+    if (id >= mObjects.size()) {
+        return;
+    }
+    SceneObject& object = mObjects[id];
+    ShadowCaster& caster = mCasters[id];
+    if (object.mStatic) {
+        mShadows.InvalidateBounds(caster.mBounds);
+    }
+    const XrVector3f displacement = pose.position - object.mPose.position;
+    object.mPose = pose;
+    caster.mBounds = ComputeBounds(object);
+    mSpatialIndex.Move(mObjectProxies[id], caster.mBounds, displacement);
+    if (object.mStatic) {
+        mShadows.InvalidateBounds(caster.mBounds);
+    }
+}
+
+void SceneRenderer::SetLights(const PointLight* lights, const uint32_t count) {
+    mLights.assign(lights, lights + count);
+}
+
+void SceneRenderer::SetSun(const XrVector3f& toSun, const XrVector3f& color) {
+    mShadows.SetSun(toSun, color);
+}
+
+void SceneRenderer::BeginFrame(const std::array<XrPosef, 2>& eyePoses,
+                               const std::array<XrFovf, 2>& eyeFovs,
+                               const XrExtent2Di& eyeResolution, FrameStats& stats) {
+    ReserveObjectUniforms();
+    mUniforms.BeginFrame();
+
+    // Shadows are drawn at the eyes' level too, so cached shadows of a
+    // static object that changes level are re-rendered to match it
+    mLod.BeginFrame(eyePoses, eyeFovs, eyeResolution);
+    for (size_t i = 0; i < mObjects.size(); i++) {
+        const SceneObject& object = mObjects[i];
+        const float scale = std::max({object.mScale.x, object.mScale.y, object.mScale.z});
+        if (mLod.Select(mMeshes[static_cast<size_t>(object.mMesh)].mLods, mCasters[i].mBounds,
+                        scale, mObjectLods[i]) && object.mStatic) {
+            mShadows.InvalidateBounds(mCasters[i].mBounds);
+        }
+    }
+
+    const StereoFrustum frustum = StereoFrustum::FromEyes(eyePoses[0], eyeFovs[0],
+                                                          eyePoses[1], eyeFovs[1]);
+    mLighting.Update(frustum, mLights.data(), static_cast<uint32_t>(mLights.size()), mUniforms,
+                     stats);
+    mShadows.Update(frustum, mCasters, mUniforms, stats);
+
+    // Object uniforms are shared by both eyes and every shadow pass
+    mObjectUniforms.resize(mObjects.size());
+    for (size_t i = 0; i < mObjects.size(); i++) {
+        const SceneObject& object = mObjects[i];
+        StreamingBuffer::Allocation& alloc = mObjectUniforms[i];
+        alloc = mUniforms.AllocateUniform(sizeof(ObjectUniforms));
+        if (!alloc.IsValid()) {
+            continue;
+        }
+        ObjectUniforms uniforms;
+        XrMatrix4x4f_CreateTranslationRotationScale(&uniforms.mModel, &object.mPose.position,
+                                                    &object.mPose.orientation, &object.mScale);
+        uniforms.mAlbedo[0] = object.mAlbedo.x;
+        uniforms.mAlbedo[1] = object.mAlbedo.y;
+        uniforms.mAlbedo[2] = object.mAlbedo.z;
+        uniforms.mAlbedo[3] = 1.0f;
+        memcpy(alloc.mCpuPtr, &uniforms, sizeof(ObjectUniforms));
+        mUniforms.Commit(alloc);
+    }
+
+    // Hidden objects are skipped by the eye passes only; they may still cast
+    // visible shadows
+    const auto occlusionStart = std::chrono::steady_clock::now();
+    mOcclusion.BeginFrame(frustum);
+    for (const SceneObject& object : mObjects) {
+        if (!object.mOccluder) {
+            continue;
+        }
+        XrMatrix4x4f model;
+        XrMatrix4x4f_CreateTranslationRotationScale(&model, &object.mPose.position,
+                                                    &object.mPose.orientation, &object.mScale);
+        const MeshInfo& mesh = mMeshes[static_cast<size_t>(object.mMesh)];
+        mOcclusion.AddOccluder(&mOccluderPositions[mesh.mOccluderFirst], mesh.mOccluderCount,
+                               model);
+    }
+    mOcclusion.Rasterize();
+    mObjectVisible.resize(mObjects.size());
+    if (!mObjects.empty()) {
+        stats.mObjectsOccluded += mOcclusion.TestVisibility(
+                &mCasters[0].mBounds, static_cast<uint32_t>(mCasters.size()),
+                sizeof(ShadowCaster), mObjectVisible.data());
+    }
+    stats.mOcclusionNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - occlusionStart).count();
+}
+
+void SceneRenderer::EndFrame() {
+    mUniforms.EndFrame();
+}
+
+SceneRenderer::ShadowResources SceneRenderer::AddShadowPasses(RenderGraph& graph,
+                                                              FrameStats& stats) {
+    ShadowResources resources;
+    if (mShadows.GetAtlasTexture() == 0) {
+        return resources;
+    }
+
+    const auto draw = [this, &stats](const XrMatrix4x4f& lightViewProjection,
+                                     const uint32_t* casters, const uint32_t count) {
+        return DrawShadowCasters(lightViewProjection, casters, count, stats);
+    };
+
+    // Cached static depth: loaded, and only the scheduled tiles touched
+    resources.mAtlas = graph.ImportTexture("Shadow Atlas", mShadows.GetAtlasTexture(),
+                                           GL_TEXTURE_2D, GL_DEPTH_COMPONENT16,
+                                           ShadowAtlas::ATLAS_SIZE, ShadowAtlas::ATLAS_SIZE);
+    if (mShadows.HasStaticWork()) {
+        graph.AddPass("Shadow Tiles", [this, draw, &stats](const RenderGraph::PassContext&) {
+                    mShadows.RenderStatic(draw, stats);
+                })
+                .Depth(resources.mAtlas, RenderGraph::LoadOp::LOAD);
+    }
+
+    // Dynamic casters: redrawn every frame, not needed once the eyes are done
+    if (mShadows.HasDynamicWork()) {
+        resources.mDynamic = graph.ImportTexture("Dynamic Shadows", mShadows.GetDynamicTexture(),
+                                                 GL_TEXTURE_2D, GL_DEPTH_COMPONENT16,
+                                                 ShadowAtlas::DYNAMIC_SIZE,
+                                                 ShadowAtlas::DYNAMIC_SIZE, 0, false);
+        graph.AddPass("Dynamic Shadows", [this, draw, &stats](const RenderGraph::PassContext&) {
+                    mShadows.RenderDynamic(draw, stats);
+                })
+                .Depth(resources.mDynamic, RenderGraph::LoadOp::CLEAR);
+    }
+    return resources;
+}
+
+void SceneRenderer::AddEyePasses(RenderGraph& graph, const std::array<XrPosef, 2>& eyePoses,
+                                 const std::array<XrFovf, 2>& eyeFovs,
+                                 const std::array<EyeTarget, 2>& targets,
+                                 const EyePassConfig& config, FrameStats& stats) {
+    const ShadowResources shadows = AddShadowPasses(graph, stats);
+    const GLsizei samples = config.mMultisamples;
+    const size_t targetCount = config.mInstancedStereo ? 1 : targets.size();
+    for (size_t eye = 0; eye < targetCount; eye++) {
+        const EyeTarget& target = targets[eye];
+        const RenderGraph::ResourceHandle eyeColor = graph.ImportTexture(
+                "Eye Color", target.mTexture, GL_TEXTURE_2D, config.mColorFormat, target.mWidth,
+                target.mHeight, 0, true, config.mImplicitResolve ? samples : 0);
+
+        // VrApp pre-allocates these same descriptors before switching eye configs
+        RenderGraph::ResourceHandle sceneColor = eyeColor;
+        if (samples > 1 && !config.mImplicitResolve) {
+            sceneColor = graph.CreateTransient("MSAA Color", GpuResourceDesc::Renderbuffer(
+                    config.mColorFormat, target.mWidth, target.mHeight, samples));
+        }
+        // Implicitly resolved depth stays in tile memory alongside the color
+        const RenderGraph::ResourceHandle depth = graph.CreateTransient(
+                "Depth", GpuResourceDesc::Renderbuffer(GL_DEPTH_COMPONENT24, target.mWidth,
+                                                       target.mHeight, samples,
+                                                       config.mImplicitResolve));
+
+        // A false return from RenderEye/RenderStereo just means programs are
+        // still compiling; the eye is left cleared.
+        const bool instancedStereo = config.mInstancedStereo;
+        graph.AddPass("Scene", [this, &stats, eyePoses, eyeFovs, eye, instancedStereo](
+                        const RenderGraph::PassContext&) {
+                    if (instancedStereo) {
+                        RenderStereo(eyePoses, eyeFovs, stats);
+                    } else {
+                        RenderEye(eyePoses[eye], eyeFovs[eye], stats);
+                    }
+                })
+                .Color(sceneColor, RenderGraph::LoadOp::CLEAR)
+                .Depth(depth, RenderGraph::LoadOp::CLEAR)
+                .Read(shadows.mAtlas)
+                .Read(shadows.mDynamic);
+
+        if (sceneColor != eyeColor) {
+            graph.AddResolvePass("Resolve", sceneColor, eyeColor);
+        }
+    }
+}
+
+bool SceneRenderer::DrawShadowCasters(const XrMatrix4x4f& lightViewProjection,
+                                      const uint32_t* casters, const uint32_t count,
+                                      FrameStats& stats) {
+    const auto submitStart = std::chrono::steady_clock::now();
+
+    const GLuint program = mShaders->GetProgram(mShadowProgram);
+    if (program == 0) {
+        return false;
+    }
+    const StreamingBuffer::Allocation alloc = mUniforms.AllocateUniform(sizeof(ViewUniforms));
+    if (!alloc.IsValid()) {
+        return false;
+    }
+    memcpy(alloc.mCpuPtr, &lightViewProjection, sizeof(ViewUniforms));
+    mUniforms.Commit(alloc);
+
+    COUNT_GL(stats, glEnable(GL_DEPTH_TEST));
+    COUNT_GL(stats, glDepthFunc(GL_LESS));
+    // Thin casters (the quad) must cast from either side
+    COUNT_GL(stats, glDisable(GL_CULL_FACE));
+    COUNT_GL(stats, glUseProgram(program));
+    COUNT_GL(stats, glBindBufferRange(GL_UNIFORM_BUFFER, kViewUniformsBinding,
+                                      alloc.mBuffer, alloc.mOffset, alloc.mSize));
+    COUNT_GL(stats, glBindVertexArray(mMeshVAO));
+    for (uint32_t i = 0; i < count; i++) {
+        DrawObject(casters[i], stats);
+    }
+    COUNT_GL(stats, glBindVertexArray(0));
+
+    stats.mCpuSubmitNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - submitStart).count();
+    return true;
+}
+
+void SceneRenderer::DrawObject(const ObjectId id, FrameStats& stats, const uint32_t instances) {
+    const StreamingBuffer::Allocation& alloc = mObjectUniforms[id];
+    if (!alloc.IsValid()) {
+        return;
+    }
+    const LodSelector::Mesh& mesh = mMeshes[static_cast<size_t>(mObjects[id].mMesh)].mLods;
+    const LodSelector::Level& level = mesh.mLevels[mObjectLods[id]];
+    COUNT_GL(stats, glBindBufferRange(GL_UNIFORM_BUFFER, kObjectUniformsBinding,
+                                      alloc.mBuffer, alloc.mOffset, alloc.mSize));
+    const void* offset = (void *) (level.mFirstIndex * sizeof(GLushort));
+    if (instances > 1) {
+        COUNT_GL(stats, glDrawElementsInstanced(GL_TRIANGLES,
+                                                static_cast<GLsizei>(level.mIndexCount),
+                                                GL_UNSIGNED_SHORT, offset,
+                                                static_cast<GLsizei>(instances)));
+    } else {
+        COUNT_GL(stats, glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(level.mIndexCount),
+                                       GL_UNSIGNED_SHORT, offset));
+    }
+    stats.mDrawCalls++;
+    stats.mTriangles += level.mIndexCount / 3 * instances;
+}
+
+bool SceneRenderer::RenderEye(const XrPosef& eyePose, const XrFovf& fov, FrameStats& stats) {
+    const XrMatrix4x4f viewProjection = EyeViewProjection(eyePose, fov);
+    return DrawVisible(mShaders->GetProgram(mSceneProgram), &viewProjection, 1, stats);
+}
+
+bool SceneRenderer::RenderStereo(const std::array<XrPosef, 2>& eyePoses,
+                                 const std::array<XrFovf, 2>& eyeFovs, FrameStats& stats) {
+    const XrMatrix4x4f viewProjections[kMaxViews] = {
+            EyeViewProjection(eyePoses[0], eyeFovs[0]),
+            EyeViewProjection(eyePoses[1], eyeFovs[1])};
+    if (mStereoClipDistance) {
+        COUNT_GL(stats, glEnable(kClipDistance0));
+    }
+    const bool drawn = DrawVisible(mShaders->GetProgram(mStereoProgram), viewProjections,
+                                   kMaxViews, stats);
+    // Programs that don't write gl_ClipDistance must not run with it enabled
+    if (mStereoClipDistance) {
+        COUNT_GL(stats, glDisable(kClipDistance0));
+    }
+    return drawn;
+}
+
+bool SceneRenderer::DrawVisible(const GLuint program, const XrMatrix4x4f* viewProjections,
+                                const uint32_t eyeCount, FrameStats& stats) {
+    const auto submitStart = std::chrono::steady_clock::now();
+
+    // Setup GL
+    COUNT_GL(stats, glEnable(GL_DEPTH_TEST));
+    COUNT_GL(stats, glDepthFunc(GL_LESS));
+    COUNT_GL(stats, glEnable(GL_CULL_FACE));
+
+    // Still compiling: leave the cleared frame rather than block on the driver
+    if (program == 0) {
+        return false;
+    }
+    COUNT_GL(stats, glUseProgram(program));
+
+    // One std140 mat4 per eye, so the array is laid out like a C array
+    const GLsizeiptr viewBytes = sizeof(ViewUniforms) * eyeCount;
+    const StreamingBuffer::Allocation alloc = mUniforms.AllocateUniform(viewBytes);
+    if (!alloc.IsValid()) {
+        return false;
+    }
+    memcpy(alloc.mCpuPtr, viewProjections, viewBytes);
+    mUniforms.Commit(alloc);
+    COUNT_GL(stats, glBindBufferRange(GL_UNIFORM_BUFFER, kViewUniformsBinding,
+                                      alloc.mBuffer, alloc.mOffset, alloc.mSize));
+    if (!mLighting.Bind(kClusterLightingBinding, kClusterLightListsUnit, stats) ||
+        !mShadows.Bind(kShadowParamsBinding, kShadowPageTableUnit, kShadowAtlasUnit,
+                       kShadowDynamicUnit, stats)) {
+        return false;
+    }
+
+    COUNT_GL(stats, glBindVertexArray(mMeshVAO));
+    for (ObjectId id = 0; id < mObjects.size(); id++) {
+        if (mObjectVisible[id]) {
+            DrawObject(id, stats, eyeCount);
+        }
+    }
+    COUNT_GL(stats, glBindVertexArray(0));
+
+    stats.mCpuSubmitNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - submitStart).count();
+    return true;
+}
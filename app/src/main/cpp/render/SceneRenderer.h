@@ -0,0 +1,258 @@
+/*******************************************************************************
+
+Filename    :   SceneRenderer.h
+Content     :   GL scene rendering, independent of the OpenXR session
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../gl/ShaderManager.h"
+#include "../gl/StreamingBuffer.h"
+#include "../utils/FrameStats.h"
+#include "../utils/MathUtils.h"
+#include "AabbTree.h"
+#include "BuiltinMeshes.h"
+#include "ClusteredLighting.h"
+#include "LodSelector.h"
+#include "OcclusionCuller.h"
+#include "RenderGraph.h"
+#include "ShadowAtlas.h"
+
+#include <GLES3/gl3.h>
+#include <GLES3/gl3ext.h>
+
+#include <openxr/openxr.h>
+#include <xr_linear.h>
+
+#include <array>
+#include <vector>
+
+class AssetPackage;
+class JobSystem;
+
+struct SceneObject {
+    SceneMesh mMesh = SceneMesh::CUBE;
+    XrPosef mPose = MathUtils::kIdentityPose;
+    XrVector3f mScale = {1.0f, 1.0f, 1.0f};
+    XrVector3f mAlbedo = {1.0f, 1.0f, 1.0f};
+    // Static objects' shadows are cached; moving one re-renders the tiles it touches
+    bool mStatic = true;
+    // Rasterized into the occlusion buffer to hide what is behind it. Worth it
+    // for large, simple objects like walls, not for small clutter.
+    bool mOccluder = false;
+};
+
+/**
+ * SceneRenderer - owns scene GL resources and draws one eye view.
+ *
+ * VrApp handles swapchains and view location; this class only needs a bound
+ * draw framebuffer, an eye pose and a FOV. Keeping OpenXR runtime calls out of
+ * here lets the same path run on a headless host context.
+ *
+ * Objects are lit by an ambient term, a shadowed sun (ShadowAtlas) and
+ * clustered point lights (ClusteredLighting). Objects hidden behind
+ * occluders are skipped in the eye passes (OcclusionCuller) but still cast
+ * shadows. Meshes with several detail levels draw the one LodSelector picks
+ * for both eyes, in the eye and shadow passes alike.
+ *
+ * Every object's bounds are kept in an AabbTree (GetSpatialIndex()) for
+ * picking and proximity queries; its user data is the ObjectId.
+ *
+ * Eyes are drawn either one pass each (RenderEye()) or both in one pass
+ * into a double-wide target (RenderStereo()) when the eyes share one
+ * swapchain.
+ */
+class SceneRenderer {
+public:
+    using ObjectId = uint32_t;
+
+    // Graph resources the eye passes sample; either may be INVALID_RESOURCE
+    struct ShadowResources {
+        RenderGraph::ResourceHandle mAtlas = RenderGraph::INVALID_RESOURCE;
+        RenderGraph::ResourceHandle mDynamic = RenderGraph::INVALID_RESOURCE;
+    };
+
+    // Single-sampled image AddEyePasses() leaves an eye in: a swapchain
+    // image on device, an offscreen texture in the host tools
+    struct EyeTarget {
+        GLuint mTexture = 0;
+        // Both eyes side by side with instanced stereo
+        GLsizei mWidth = 0;
+        GLsizei mHeight = 0;
+    };
+
+    struct EyePassConfig {
+        GLenum mColorFormat = GL_RGBA8;
+        GLsizei mMultisamples = 4;
+        // Both eyes in one pass (RenderStereo()) into the first target
+        bool mInstancedStereo = false;
+        // Multisample straight into the target and let the driver resolve
+        // (RenderGraph::SupportsImplicitResolve()); no MSAA target or blit
+        bool mImplicitResolve = false;
+    };
+
+    SceneRenderer() = default;
+    ~SceneRenderer() = default;
+
+    SceneRenderer(const SceneRenderer&) = delete;
+    SceneRenderer& operator=(const SceneRenderer&) = delete;
+
+    /**
+     * Request programs and upload geometry. Requires a current GL context.
+     * Programs finish compiling through @p shaders' Update(); until then
+     * RenderEye() draws nothing.
+     *
+     * @param shaders Shader manager that outlives this renderer
+     * @param jobs    Optional worker pool for light binning; must outlive this renderer
+     * @param instancedStereo Also request the program RenderStereo() needs
+     * @param assets  Optional package to map the builtin meshes from instead of
+     *                generating them; its scene group is released once uploaded
+     */
+    void Init(ShaderManager& shaders, JobSystem* jobs = nullptr, bool instancedStereo = false,
+              const AssetPackage* assets = nullptr);
+
+    /**
+     * Release GL resources. Requires the context used in Init() to be current.
+     */
+    void Shutdown();
+
+    ObjectId AddObject(const SceneObject& object);
+    void SetObjectPose(ObjectId id, const XrPosef& pose);
+
+    /**
+     * Replace the scene's dynamic lights. Takes effect at the next BeginFrame().
+     */
+    void SetLights(const PointLight* lights, uint32_t count);
+
+    /**
+     * @param toSun Direction toward the sun. Changing it re-renders all cached shadows.
+     * @param color Linear sun color, premultiplied by intensity
+     */
+    void SetSun(const XrVector3f& toSun, const XrVector3f& color);
+
+    /**
+     * Bracket one frame. BeginFrame() picks detail levels, bins lights,
+     * picks shadow tiles and culls occluded objects for both eye views, and
+     * may wait on the GPU if it has fallen more than the ring's depth
+     * behind; call it before declaring the frame's render graph. EndFrame()
+     * fences the per-frame uniform data.
+     *
+     * @param eyeResolution Size of each eye's render target, in pixels
+     */
+    void BeginFrame(const std::array<XrPosef, 2>& eyePoses, const std::array<XrFovf, 2>& eyeFovs,
+                    const XrExtent2Di& eyeResolution, FrameStats& stats);
+    void EndFrame();
+
+    /**
+     * Declare this frame's shadow passes. Eye passes must Read() the
+     * returned resources. @p stats must outlive the graph's Execute().
+     */
+    ShadowResources AddShadowPasses(RenderGraph& graph, FrameStats& stats);
+
+    /**
+     * Declare a whole frame: the shadow passes, then per target a scene
+     * pass into a transient MSAA color and depth target, resolved into it.
+     * Both eyes go into one graph so their transients, which are dead once
+     * each eye is resolved, share storage. Call after BeginFrame(); @p stats
+     * must outlive the graph's Execute().
+     *
+     * @param targets One per eye, or only the first with instanced stereo
+     */
+    void AddEyePasses(RenderGraph& graph, const std::array<XrPosef, 2>& eyePoses,
+                      const std::array<XrFovf, 2>& eyeFovs,
+                      const std::array<EyeTarget, 2>& targets, const EyePassConfig& config,
+                      FrameStats& stats);
+
+    /**
+     * Draw the scene into the currently bound draw framebuffer. Viewport and
+     * clears are the caller's (normally the render graph pass's) job.
+     *
+     * @param eyePose Eye pose in the scene's reference space
+     * @param fov     Eye field of view
+     * @param stats   Accumulates GL call counts and CPU submit time
+     * @return false if nothing was drawn (e.g. program still compiling)
+     */
+    bool RenderEye(const XrPosef& eyePose, const XrFovf& fov, FrameStats& stats);
+
+    /**
+     * Draw both eyes into the currently bound double-wide draw framebuffer,
+     * left eye on the left half, with the viewport covering all of it. Every
+     * draw is instanced once per eye, so submission costs the same as one
+     * RenderEye(). Each instance is clipped to its half with
+     * GL_EXT_clip_cull_distance, or by discarding fragments without it.
+     * Requires Init() with instancedStereo.
+     *
+     * @return false if nothing was drawn (e.g. program still compiling)
+     */
+    bool RenderStereo(const std::array<XrPosef, 2>& eyePoses, const std::array<XrFovf, 2>& eyeFovs,
+                      FrameStats& stats);
+
+    const ClusteredLighting::Stats& GetLightingStats() const { return mLighting.GetStats(); }
+    const ShadowAtlas::Stats& GetShadowStats() const { return mShadows.GetStats(); }
+    const OcclusionCuller::Stats& GetOcclusionStats() const { return mOcclusion.GetStats(); }
+    const LodSelector::Stats& GetLodStats() const { return mLod.GetStats(); }
+    // See LodSelector::SetForcedLevel()
+    void SetForcedLod(const int32_t level) { mLod.SetForcedLevel(level); }
+    // Meshes, uniforms, light lists and shadow maps
+    GpuMemoryUsage GetGpuMemory() const;
+    const AabbTree& GetSpatialIndex() const { return mSpatialIndex; }
+
+private:
+    struct MeshInfo {
+        LodSelector::Mesh mLods;
+        // Coarsest level as a triangle list in mOccluderPositions
+        uint32_t mOccluderFirst = 0;
+        uint32_t mOccluderCount = 0;
+    };
+
+    // Upload the builtin meshes; both read the source arrays in place
+    bool UploadPackagedMeshes(const AssetPackage& assets);
+    void UploadMeshes(const MeshVertex* vertices, size_t vertexCount, const uint16_t* indices,
+                      size_t indexCount, const BuiltinMeshes::MeshLods& lods);
+    MathUtils::Bounds3f ComputeBounds(const SceneObject& object) const;
+    // Grow mUniforms to fit every object's uniforms; between frames only
+    void ReserveObjectUniforms();
+    bool DrawShadowCasters(const XrMatrix4x4f& lightViewProjection, const uint32_t* casters,
+                           uint32_t count, FrameStats& stats);
+    bool DrawVisible(GLuint program, const XrMatrix4x4f* viewProjections, uint32_t eyeCount,
+                     FrameStats& stats);
+    void DrawObject(ObjectId id, FrameStats& stats, uint32_t instances = 1);
+
+    ShaderManager* mShaders = nullptr;
+    ShaderManager::ProgramHandle mSceneProgram = ShaderManager::INVALID_PROGRAM;
+    ShaderManager::ProgramHandle mShadowProgram = ShaderManager::INVALID_PROGRAM;
+    ShaderManager::ProgramHandle mStereoProgram = ShaderManager::INVALID_PROGRAM;
+    // Whether mStereoProgram clips with gl_ClipDistance rather than discard
+    bool mStereoClipDistance = false;
+    GLuint mMeshVBO = 0;
+    GLuint mMeshIBO = 0;
+    GLuint mMeshVAO = 0;
+    uint64_t mMeshBytes = 0;
+    std::array<MeshInfo, BuiltinMeshes::MESH_COUNT> mMeshes = {};
+    // CPU copy of each mesh's coarsest level, for occluder rasterization.
+    // A coarse sphere lies inside the fine one, so it never over-occludes.
+    std::vector<XrVector3f> mOccluderPositions;
+
+    // Per-draw uniforms, written through a persistent mapping where available
+    StreamingBuffer mUniforms;
+
+    std::vector<SceneObject> mObjects;
+    // Parallel to mObjects: scene-space bounds, current detail level, and
+    // this frame's uniforms and visibility
+    std::vector<ShadowCaster> mCasters;
+    std::vector<uint8_t> mObjectLods;
+    std::vector<StreamingBuffer::Allocation> mObjectUniforms;
+    std::vector<uint8_t> mObjectVisible;
+    std::vector<AabbTree::ProxyId> mObjectProxies;
+    AabbTree mSpatialIndex;
+
+    ClusteredLighting mLighting;
+    std::vector<PointLight> mLights;
+    ShadowAtlas mShadows;
+    OcclusionCuller mOcclusion;
+    LodSelector mLod;
+};
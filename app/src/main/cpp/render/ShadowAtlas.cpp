@@ -0,0 +1,545 @@
+/*******************************************************************************
+
+Filename    :   ShadowAtlas.cpp
+Content     :   Sun shadows with static-geometry depth cached in an atlas of
+                world-anchored tiles
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "ShadowAtlas.h"
+#include "../gl/ResourcePool.h"
+#include "../utils/LogUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    // Light-space depth covered by every shadow map, either side of the
+    // scene origin along the sun direction
+    constexpr float kLightDepthRange = 20.0f;
+
+    // Where the view frustum starts for cropping; anything closer than this
+    // to the eyes is inside the first tile row anyway
+    constexpr float kCropNear = 0.05f;
+
+    // Slope-scaled and constant offset applied while rendering casters
+    constexpr float kPolygonOffsetFactor = 2.0f;
+    constexpr float kPolygonOffsetUnits = 4.0f;
+
+    // Sun direction changes smaller than this (cosine) keep the cache
+    constexpr float kSunDirectionTolerance = 0.99999f;
+
+    // std140 layout of the ShadowParams block
+    struct ShadowUniforms {
+        XrMatrix4x4f mLightView;        // scene -> light space
+        XrMatrix4x4f mDynamicMatrix;    // scene -> dynamic map texture space
+        float mTileParams[4];           // 1 / tile size, window x, window y, 0.5 / depth range
+        float mToSun[4];                // w: dynamic map valid
+        float mSunColor[4];
+    };
+
+    struct Point2 {
+        float x, y;
+    };
+
+    float Cross2(const Point2& o, const Point2& a, const Point2& b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    }
+
+    // Counter-clockwise convex hull (monotone chain); returns the vertex count
+    size_t ConvexHull(std::array<Point2, 8> points, std::array<Point2, 16>& hull) {
+        std::sort(points.begin(), points.end(), [](const Point2& a, const Point2& b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+        size_t count = 0;
+        for (const Point2& p : points) {
+            while (count >= 2 && Cross2(hull[count - 2], hull[count - 1], p) <= 0.0f) { count--; }
+            hull[count++] = p;
+        }
+        const size_t lowerCount = count + 1;
+        for (int i = static_cast<int>(points.size()) - 2; i >= 0; i--) {
+            while (count >= lowerCount && Cross2(hull[count - 2], hull[count - 1], points[i]) <= 0.0f) {
+                count--;
+            }
+            hull[count++] = points[i];
+        }
+        return count - 1;  // last point repeats the first
+    }
+
+    // Separating axis test of an axis-aligned rectangle against a CCW hull
+    bool RectOverlapsHull(const float minX, const float minY, const float maxX, const float maxY,
+                          const std::array<Point2, 16>& hull, const size_t hullCount) {
+        const Point2 corners[4] = {{minX, minY}, {maxX, minY}, {minX, maxY}, {maxX, maxY}};
+        for (size_t i = 0; i < hullCount; i++) {
+            const Point2& a = hull[i];
+            const Point2& b = hull[(i + 1) % hullCount];
+            bool allOutside = true;
+            for (const Point2& c : corners) {
+                allOutside = allOutside && Cross2(a, b, c) < 0.0f;
+            }
+            if (allOutside) {
+                return false;
+            }
+        }
+        return true;
+    }
+} // anonymous namespace
+
+bool ShadowAtlas::Init() {
+    const auto createShadowMap = [](const GLsizei size) {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT16, size, size);
+        // Hardware 2x2 PCF
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        return texture;
+    };
+    mAtlasTexture = createShadowMap(ATLAS_SIZE);
+    mDynamicTexture = createShadowMap(DYNAMIC_SIZE);
+
+    glGenTextures(1, &mPageTableTexture);
+    glBindTexture(GL_TEXTURE_2D, mPageTableTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R16UI, PAGE_WINDOW, PAGE_WINDOW);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    const GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        ALOGE("ShadowAtlas: failed to create textures (0x%x)", error);
+        Shutdown();
+        return false;
+    }
+
+    InvalidateAll();
+    mPageTableUploaded = false;
+    ALOGD("ShadowAtlas: %dx%d atlas of %u tiles (%.1fm, %d texels each), %dx%d dynamic map",
+          ATLAS_SIZE, ATLAS_SIZE, SLOT_COUNT, TILE_WORLD_SIZE, TILE_TEXELS, DYNAMIC_SIZE,
+          DYNAMIC_SIZE);
+    return true;
+}
+
+void ShadowAtlas::Shutdown() {
+    const GLuint textures[] = {mAtlasTexture, mDynamicTexture, mPageTableTexture};
+    glDeleteTextures(3, textures);
+    mAtlasTexture = mDynamicTexture = mPageTableTexture = 0;
+    mUniformAllocation = {};
+    InvalidateAll();
+}
+
+GpuMemoryUsage ShadowAtlas::GetGpuMemory() const {
+    GpuMemoryUsage usage;
+    if (mAtlasTexture == 0) {
+        return usage;
+    }
+    const GpuResourceDesc textures[] = {
+            GpuResourceDesc::Texture2D(GL_DEPTH_COMPONENT16, ATLAS_SIZE, ATLAS_SIZE),
+            GpuResourceDesc::Texture2D(GL_DEPTH_COMPONENT16, DYNAMIC_SIZE, DYNAMIC_SIZE),
+            GpuResourceDesc::Texture2D(GL_R16UI, PAGE_WINDOW, PAGE_WINDOW),
+    };
+    for (const GpuResourceDesc& desc : textures) {
+        usage.Add(desc.GetMemoryCategory(), desc.GetSizeBytes());
+    }
+    return usage;
+}
+
+void ShadowAtlas::SetSun(const XrVector3f& toSun, const XrVector3f& color) {
+    mSunColor = color;
+
+    const XrVector3f z = MathUtils::Normalized(toSun);
+    if (MathUtils::Dot(z, mLightZ) >= kSunDirectionTolerance) {
+        return;
+    }
+    const XrVector3f helper = std::fabs(z.y) < 0.99f ? XrVector3f{0.0f, 1.0f, 0.0f}
+                                                     : XrVector3f{1.0f, 0.0f, 0.0f};
+    mLightX = MathUtils::Normalized(MathUtils::Cross(helper, z));
+    mLightY = MathUtils::Cross(z, mLightX);
+    mLightZ = z;
+
+    // Every tile was rendered along the old direction
+    InvalidateAll();
+}
+
+void ShadowAtlas::InvalidateAll() {
+    for (Slot& slot : mSlots) {
+        slot = {};
+    }
+    mTileToSlot.clear();
+}
+
+void ShadowAtlas::InvalidateBounds(const MathUtils::Bounds3f& bounds) {
+    if (bounds.IsEmpty()) {
+        return;
+    }
+    const Rect rect = LightSpaceRect(bounds);
+    for (Slot& slot : mSlots) {
+        if (!slot.mResident) {
+            continue;
+        }
+        const Rect tile = {slot.mTileX * TILE_WORLD_SIZE, slot.mTileY * TILE_WORLD_SIZE,
+                           (slot.mTileX + 1) * TILE_WORLD_SIZE, (slot.mTileY + 1) * TILE_WORLD_SIZE};
+        if (tile.Overlaps(rect)) {
+            // Keeps showing the old depth until re-rendered, rather than popping to lit
+            slot.mDirty = true;
+        }
+    }
+}
+
+uint64_t ShadowAtlas::TileKey(const int32_t tileX, const int32_t tileY) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(tileX)) << 32) |
+           static_cast<uint32_t>(tileY);
+}
+
+ShadowAtlas::Rect ShadowAtlas::LightSpaceRect(const MathUtils::Bounds3f& bounds) const {
+    Rect rect = {1e30f, 1e30f, -1e30f, -1e30f};
+    for (int i = 0; i < 8; i++) {
+        const XrVector3f corner = bounds.GetCorner(i);
+        const float x = MathUtils::Dot(corner, mLightX);
+        const float y = MathUtils::Dot(corner, mLightY);
+        rect = {std::min(rect.mMinX, x), std::min(rect.mMinY, y),
+                std::max(rect.mMaxX, x), std::max(rect.mMaxY, y)};
+    }
+    return rect;
+}
+
+XrMatrix4x4f ShadowAtlas::OrthoLightMatrix(const Rect& rect) const {
+    // Light basis rows, then an orthographic fit of rect x [-range, range]
+    const float sx = 2.0f / (rect.mMaxX - rect.mMinX);
+    const float sy = 2.0f / (rect.mMaxY - rect.mMinY);
+    const float sz = -1.0f / kLightDepthRange;
+
+    XrMatrix4x4f m = {};
+    m.m[0] = mLightX.x * sx;  m.m[4] = mLightX.y * sx;  m.m[8] = mLightX.z * sx;
+    m.m[1] = mLightY.x * sy;  m.m[5] = mLightY.y * sy;  m.m[9] = mLightY.z * sy;
+    m.m[2] = mLightZ.x * sz;  m.m[6] = mLightZ.y * sz;  m.m[10] = mLightZ.z * sz;
+    m.m[12] = -(rect.mMaxX + rect.mMinX) / (rect.mMaxX - rect.mMinX);
+    m.m[13] = -(rect.mMaxY + rect.mMinY) / (rect.mMaxY - rect.mMinY);
+    m.m[15] = 1.0f;
+    return m;
+}
+
+int32_t ShadowAtlas::AllocateSlot() {
+    int32_t best = -1;
+    for (uint32_t i = 0; i < SLOT_COUNT; i++) {
+        const Slot& slot = mSlots[i];
+        if (!slot.mResident) {
+            return static_cast<int32_t>(i);
+        }
+        // Least recently needed, and not needed this frame
+        if (slot.mLastUsedFrame < mFrame &&
+            (best < 0 || slot.mLastUsedFrame < mSlots[best].mLastUsedFrame)) {
+            best = static_cast<int32_t>(i);
+        }
+    }
+    if (best >= 0) {
+        mTileToSlot.erase(TileKey(mSlots[best].mTileX, mSlots[best].mTileY));
+    }
+    return best;
+}
+
+void ShadowAtlas::Update(const StereoFrustum& frustum, const std::vector<ShadowCaster>& casters,
+                         StreamingBuffer& uniforms, FrameStats& stats) {
+    mUniformAllocation = {};
+    mScheduledSlots.clear();
+    mStaticCasters.clear();
+    mDynamicCasters.clear();
+    mStats = {};
+    if (mAtlasTexture == 0) {
+        return;
+    }
+    mFrame++;
+
+    // Crop: the combined eye frustum out to SHADOW_DISTANCE, seen from the sun
+    std::array<Point2, 8> projected;
+    const std::array<XrVector3f, 8> corners = frustum.GetCorners(kCropNear, SHADOW_DISTANCE);
+    Rect crop = {1e30f, 1e30f, -1e30f, -1e30f};
+    for (int i = 0; i < 8; i++) {
+        projected[i] = {MathUtils::Dot(corners[i], mLightX), MathUtils::Dot(corners[i], mLightY)};
+        crop = {std::min(crop.mMinX, projected[i].x), std::min(crop.mMinY, projected[i].y),
+                std::max(crop.mMaxX, projected[i].x), std::max(crop.mMaxY, projected[i].y)};
+    }
+    std::array<Point2, 16> hull;
+    const size_t hullCount = ConvexHull(projected, hull);
+
+    // Page table window, centered on the crop and snapped to tiles
+    const float centerX = 0.5f * (crop.mMinX + crop.mMaxX);
+    const float centerY = 0.5f * (crop.mMinY + crop.mMaxY);
+    mWindowX = static_cast<int32_t>(std::floor(centerX / TILE_WORLD_SIZE)) - PAGE_WINDOW / 2;
+    mWindowY = static_cast<int32_t>(std::floor(centerY / TILE_WORLD_SIZE)) - PAGE_WINDOW / 2;
+
+    // Visible tiles, nearest to the viewer first
+    const Point2 eye = {MathUtils::Dot(frustum.mPose.position, mLightX),
+                        MathUtils::Dot(frustum.mPose.position, mLightY)};
+    struct VisibleTile {
+        int32_t mX, mY;
+        float mDistanceSq;
+    };
+    std::vector<VisibleTile> visible;
+    const int32_t tileMinX = std::max(static_cast<int32_t>(std::floor(crop.mMinX / TILE_WORLD_SIZE)), mWindowX);
+    const int32_t tileMinY = std::max(static_cast<int32_t>(std::floor(crop.mMinY / TILE_WORLD_SIZE)), mWindowY);
+    const int32_t tileMaxX = std::min(static_cast<int32_t>(std::floor(crop.mMaxX / TILE_WORLD_SIZE)),
+                                      mWindowX + static_cast<int32_t>(PAGE_WINDOW) - 1);
+    const int32_t tileMaxY = std::min(static_cast<int32_t>(std::floor(crop.mMaxY / TILE_WORLD_SIZE)),
+                                      mWindowY + static_cast<int32_t>(PAGE_WINDOW) - 1);
+    for (int32_t y = tileMinY; y <= tileMaxY; y++) {
+        for (int32_t x = tileMinX; x <= tileMaxX; x++) {
+            const float x0 = x * TILE_WORLD_SIZE;
+            const float y0 = y * TILE_WORLD_SIZE;
+            if (!RectOverlapsHull(x0, y0, x0 + TILE_WORLD_SIZE, y0 + TILE_WORLD_SIZE, hull, hullCount)) {
+                continue;
+            }
+            const float dx = x0 + 0.5f * TILE_WORLD_SIZE - eye.x;
+            const float dy = y0 + 0.5f * TILE_WORLD_SIZE - eye.y;
+            visible.push_back({x, y, dx * dx + dy * dy});
+        }
+    }
+    std::sort(visible.begin(), visible.end(), [](const VisibleTile& a, const VisibleTile& b) {
+        return a.mDistanceSq < b.mDistanceSq;
+    });
+    mStats.mVisibleTiles = static_cast<uint32_t>(visible.size());
+
+    // Map visible tiles to slots and schedule the nearest dirty ones
+    for (const VisibleTile& tile : visible) {
+        const uint64_t key = TileKey(tile.mX, tile.mY);
+        const auto it = mTileToSlot.find(key);
+        int32_t slotIndex = it != mTileToSlot.end() ? static_cast<int32_t>(it->second) : -1;
+        if (slotIndex < 0) {
+            slotIndex = AllocateSlot();
+            if (slotIndex < 0) {
+                break;  // every slot is needed by a nearer tile
+            }
+            Slot& slot = mSlots[slotIndex];
+            slot = {};
+            slot.mTileX = tile.mX;
+            slot.mTileY = tile.mY;
+            slot.mResident = true;
+            slot.mDirty = true;
+            mTileToSlot[key] = static_cast<uint32_t>(slotIndex);
+        }
+
+        Slot& slot = mSlots[slotIndex];
+        slot.mLastUsedFrame = mFrame;
+        if (slot.mDirty && mScheduledSlots.size() < MAX_TILE_UPDATES_PER_FRAME) {
+            mScheduledSlots.push_back(static_cast<uint32_t>(slotIndex));
+        }
+    }
+
+    // Casters in light space, split by how they are rendered
+    const Rect cropTiles = {static_cast<float>(tileMinX) * TILE_WORLD_SIZE,
+                            static_cast<float>(tileMinY) * TILE_WORLD_SIZE,
+                            static_cast<float>(tileMaxX + 1) * TILE_WORLD_SIZE,
+                            static_cast<float>(tileMaxY + 1) * TILE_WORLD_SIZE};
+    mCasterRects.resize(casters.size());
+    for (uint32_t i = 0; i < casters.size(); i++) {
+        mCasterRects[i] = LightSpaceRect(casters[i].mBounds);
+        if (casters[i].mStatic) {
+            mStaticCasters.push_back(i);
+        } else if (mCasterRects[i].Overlaps(cropTiles)) {
+            mDynamicCasters.push_back(i);
+        }
+    }
+    mStats.mDynamicCasters = static_cast<uint32_t>(mDynamicCasters.size());
+
+    // Dynamic map covers the visible tiles; snapping to tiles keeps it from
+    // swimming as the head moves
+    if (tileMaxX >= tileMinX && tileMaxY >= tileMinY) {
+        mDynamicViewProjection = OrthoLightMatrix(cropTiles);
+    } else {
+        mDynamicCasters.clear();
+    }
+
+    // Page table: valid tiles, plus the ones about to be rendered
+    std::array<uint16_t, PAGE_WINDOW * PAGE_WINDOW> pageTable = {};
+    for (uint32_t i = 0; i < SLOT_COUNT; i++) {
+        const Slot& slot = mSlots[i];
+        const bool scheduled = std::find(mScheduledSlots.begin(), mScheduledSlots.end(), i) !=
+                               mScheduledSlots.end();
+        if (!slot.mResident || !(slot.mValid || scheduled)) {
+            continue;
+        }
+        const int32_t wx = slot.mTileX - mWindowX;
+        const int32_t wy = slot.mTileY - mWindowY;
+        if (wx >= 0 && wy >= 0 && wx < static_cast<int32_t>(PAGE_WINDOW) &&
+            wy < static_cast<int32_t>(PAGE_WINDOW)) {
+            pageTable[wy * PAGE_WINDOW + wx] = static_cast<uint16_t>(i + 1);
+            if (slot.mLastUsedFrame == mFrame) {
+                mStats.mResidentTiles++;
+            }
+        }
+    }
+    if (!mPageTableUploaded || pageTable != mPageTable) {
+        // Small and rarely changing; the driver can rename it under in-flight frames
+        mPageTable = pageTable;
+        mPageTableUploaded = true;
+        COUNT_GL(stats, glBindTexture(GL_TEXTURE_2D, mPageTableTexture));
+        COUNT_GL(stats, glPixelStorei(GL_UNPACK_ALIGNMENT, 2));
+        COUNT_GL(stats, glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, PAGE_WINDOW, PAGE_WINDOW,
+                                        GL_RED_INTEGER, GL_UNSIGNED_SHORT, mPageTable.data()));
+        COUNT_GL(stats, glBindTexture(GL_TEXTURE_2D, 0));
+    }
+
+    const StreamingBuffer::Allocation alloc = uniforms.AllocateUniform(sizeof(ShadowUniforms));
+    if (!alloc.IsValid()) {
+        return;
+    }
+    auto* block = static_cast<ShadowUniforms*>(alloc.mCpuPtr);
+    XrMatrix4x4f lightView = {};
+    lightView.m[0] = mLightX.x;  lightView.m[4] = mLightX.y;  lightView.m[8] = mLightX.z;
+    lightView.m[1] = mLightY.x;  lightView.m[5] = mLightY.y;  lightView.m[9] = mLightY.z;
+    lightView.m[2] = mLightZ.x;  lightView.m[6] = mLightZ.y;  lightView.m[10] = mLightZ.z;
+    lightView.m[15] = 1.0f;
+    block->mLightView = lightView;
+    // Clip space [-1, 1] to texture space [0, 1]
+    XrMatrix4x4f dynamicMatrix = mDynamicViewProjection;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 3; row++) {
+            float& v = dynamicMatrix.m[column * 4 + row];
+            v = 0.5f * v + 0.5f * dynamicMatrix.m[column * 4 + 3];
+        }
+    }
+    block->mDynamicMatrix = dynamicMatrix;
+    block->mTileParams[0] = 1.0f / TILE_WORLD_SIZE;
+    block->mTileParams[1] = static_cast<float>(mWindowX);
+    block->mTileParams[2] = static_cast<float>(mWindowY);
+    block->mTileParams[3] = 0.5f / kLightDepthRange;
+    block->mToSun[0] = mLightZ.x;
+    block->mToSun[1] = mLightZ.y;
+    block->mToSun[2] = mLightZ.z;
+    block->mToSun[3] = mDynamicCasters.empty() ? 0.0f : 1.0f;
+    block->mSunColor[0] = mSunColor.x;
+    block->mSunColor[1] = mSunColor.y;
+    block->mSunColor[2] = mSunColor.z;
+    block->mSunColor[3] = 0.0f;
+    uniforms.Commit(alloc);
+    mUniformAllocation = alloc;
+}
+
+void ShadowAtlas::RenderStatic(const DrawCastersFn& draw, FrameStats& stats) {
+    if (mScheduledSlots.empty()) {
+        return;
+    }
+    COUNT_GL(stats, glEnable(GL_SCISSOR_TEST));
+    COUNT_GL(stats, glEnable(GL_POLYGON_OFFSET_FILL));
+    COUNT_GL(stats, glPolygonOffset(kPolygonOffsetFactor, kPolygonOffsetUnits));
+
+    std::vector<uint32_t> tileCasters;
+    const GLfloat clearDepth = 1.0f;
+    for (const uint32_t slotIndex : mScheduledSlots) {
+        Slot& slot = mSlots[slotIndex];
+        const GLint x = static_cast<GLint>(slotIndex % TILES_PER_ROW) * TILE_TEXELS;
+        const GLint y = static_cast<GLint>(slotIndex / TILES_PER_ROW) * TILE_TEXELS;
+        COUNT_GL(stats, glViewport(x, y, TILE_TEXELS, TILE_TEXELS));
+        COUNT_GL(stats, glScissor(x, y, TILE_TEXELS, TILE_TEXELS));
+        COUNT_GL(stats, glClearBufferfv(GL_DEPTH, 0, &clearDepth));
+
+        const Rect tile = {slot.mTileX * TILE_WORLD_SIZE, slot.mTileY * TILE_WORLD_SIZE,
+                           (slot.mTileX + 1) * TILE_WORLD_SIZE, (slot.mTileY + 1) * TILE_WORLD_SIZE};
+        tileCasters.clear();
+        for (const uint32_t caster : mStaticCasters) {
+            if (mCasterRects[caster].Overlaps(tile)) {
+                tileCasters.push_back(caster);
+            }
+        }
+
+        // An empty tile is still valid: it is simply fully lit
+        const bool drawn = tileCasters.empty() ||
+                           draw(OrthoLightMatrix(tile), tileCasters.data(),
+                                static_cast<uint32_t>(tileCasters.size()));
+        if (drawn) {
+            slot.mValid = true;
+            slot.mDirty = false;
+            mStats.mTilesRendered++;
+        }
+    }
+
+    COUNT_GL(stats, glDisable(GL_POLYGON_OFFSET_FILL));
+    COUNT_GL(stats, glDisable(GL_SCISSOR_TEST));
+    stats.mShadowTileUpdates += mStats.mTilesRendered;
+}
+
+void ShadowAtlas::RenderDynamic(const DrawCastersFn& draw, FrameStats& stats) {
+    if (mDynamicCasters.empty()) {
+        return;
+    }
+    COUNT_GL(stats, glEnable(GL_POLYGON_OFFSET_FILL));
+    COUNT_GL(stats, glPolygonOffset(kPolygonOffsetFactor, kPolygonOffsetUnits));
+    draw(mDynamicViewProjection, mDynamicCasters.data(),
+         static_cast<uint32_t>(mDynamicCasters.size()));
+    COUNT_GL(stats, glDisable(GL_POLYGON_OFFSET_FILL));
+}
+
+bool ShadowAtlas::Bind(const GLuint uniformBinding, const GLuint pageTableUnit,
+                       const GLuint atlasUnit, const GLuint dynamicUnit, FrameStats& stats) const {
+    if (!mUniformAllocation.IsValid()) {
+        return false;
+    }
+    COUNT_GL(stats, glBindBufferRange(GL_UNIFORM_BUFFER, uniformBinding, mUniformAllocation.mBuffer,
+                                      mUniformAllocation.mOffset, mUniformAllocation.mSize));
+    COUNT_GL(stats, glActiveTexture(GL_TEXTURE0 + pageTableUnit));
+    COUNT_GL(stats, glBindTexture(GL_TEXTURE_2D, mPageTableTexture));
+    COUNT_GL(stats, glActiveTexture(GL_TEXTURE0 + atlasUnit));
+    COUNT_GL(stats, glBindTexture(GL_TEXTURE_2D, mAtlasTexture));
+    COUNT_GL(stats, glActiveTexture(GL_TEXTURE0 + dynamicUnit));
+    COUNT_GL(stats, glBindTexture(GL_TEXTURE_2D, mDynamicTexture));
+    return true;
+}
+
+std::string ShadowAtlas::GetShaderSource() {
+    const std::string window = std::to_string(PAGE_WINDOW);
+    const std::string tilesPerRow = std::to_string(TILES_PER_ROW);
+    const std::string tileTexels = std::to_string(TILE_TEXELS);
+
+    return "layout(std140) uniform ShadowParams {\n"
+           "    mat4 uLightView;\n"
+           "    mat4 uDynamicShadowMatrix;\n"
+           "    vec4 uShadowTileParams;\n"
+           "    vec4 uToSun;\n"
+           "    vec4 uSunColor;\n"
+           "};\n"
+           "uniform highp usampler2D uShadowPageTable;\n"
+           "uniform highp sampler2DShadow uShadowAtlas;\n"
+           "uniform highp sampler2DShadow uShadowDynamic;\n"
+           "float SunShadow(highp vec3 worldPos) {\n"
+           "    const highp float bias = 1e-4;\n"
+           "    float visibility = 1.0;\n"
+           "    highp vec3 l = (uLightView * vec4(worldPos, 1.0)).xyz;\n"
+           "    highp vec2 tileCoord = l.xy * uShadowTileParams.x;\n"
+           "    ivec2 page = ivec2(floor(tileCoord)) - ivec2(uShadowTileParams.yz);\n"
+           "    if (all(greaterThanEqual(page, ivec2(0))) && all(lessThan(page, ivec2(" + window + ")))) {\n"
+           "        int slot = int(texelFetch(uShadowPageTable, page, 0).r) - 1;\n"
+           "        if (slot >= 0) {\n"
+           "            // Stay half a texel inside the slot so filtering never reads a neighbor\n"
+           "            const highp float halfTexel = 0.5 / float(" + tileTexels + ");\n"
+           "            highp vec2 local = clamp(fract(tileCoord), halfTexel, 1.0 - halfTexel);\n"
+           "            highp vec2 slotXY = vec2(float(slot % " + tilesPerRow + "), float(slot / " + tilesPerRow + "));\n"
+           "            highp vec2 uv = (slotXY + local) / float(" + tilesPerRow + ");\n"
+           "            highp float depth = 0.5 - l.z * uShadowTileParams.w;\n"
+           "            visibility = texture(uShadowAtlas, vec3(uv, depth - bias));\n"
+           "        }\n"
+           "    }\n"
+           "    if (uToSun.w > 0.5) {\n"
+           "        highp vec3 d = (uDynamicShadowMatrix * vec4(worldPos, 1.0)).xyz;\n"
+           "        if (all(greaterThan(d.xy, vec2(0.0))) && all(lessThan(d.xy, vec2(1.0)))) {\n"
+           "            visibility = min(visibility, texture(uShadowDynamic, vec3(d.xy, d.z - bias)));\n"
+           "        }\n"
+           "    }\n"
+           "    return visibility;\n"
+           "}\n"
+           "vec3 SunLighting(highp vec3 worldPos, vec3 normal, vec3 albedo) {\n"
+           "    float nDotL = max(dot(normal, uToSun.xyz), 0.0);\n"
+           "    if (nDotL <= 0.0) {\n"
+           "        return vec3(0.0);\n"
+           "    }\n"
+           "    return albedo * uSunColor.rgb * (nDotL * SunShadow(worldPos));\n"
+           "}\n";
+}
@@ -0,0 +1,206 @@
+/*******************************************************************************
+
+Filename    :   ShadowAtlas.h
+Content     :   Sun shadows with static-geometry depth cached in an atlas of
+                world-anchored tiles
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "../gl/StreamingBuffer.h"
+#include "../utils/FrameStats.h"
+#include "../utils/GpuMemory.h"
+#include "../utils/MathUtils.h"
+#include "StereoFrustum.h"
+
+#include <GLES3/gl3.h>
+#include <GLES3/gl3ext.h>
+
+#include <openxr/openxr.h>
+#include <xr_linear.h>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ShadowCaster {
+    MathUtils::Bounds3f mBounds;  // scene space
+    bool mStatic;                 // rendered into the cached atlas, not every frame
+};
+
+/**
+ * ShadowAtlas - directional (sun) shadows that only re-render what changed.
+ *
+ * Light space is cut into fixed, world-anchored square tiles. Each frame the
+ * tiles that the StereoFrustum (up to SHADOW_DISTANCE) covers are looked up in
+ * an atlas of TILE_TEXELS-sized slots; tiles already holding static-caster
+ * depth are reused as they are. Only tiles that newly came into view, or
+ * that InvalidateBounds() touched because a static caster moved, are
+ * re-rendered, at most MAX_TILE_UPDATES_PER_FRAME per frame, nearest first.
+ * Changing the sun direction invalidates every tile.
+ *
+ * Dynamic casters are rendered every frame into a separate small map fitted
+ * to the same crop, and the shader takes the darker of the two lookups, so
+ * moving objects never dirty the cache.
+ *
+ * A page table texture maps tiles around the viewer to atlas slots; tiles
+ * without valid depth read as lit.
+ */
+class ShadowAtlas {
+public:
+    static constexpr GLsizei ATLAS_SIZE = 2048;
+    static constexpr GLsizei TILE_TEXELS = 128;
+    static constexpr uint32_t TILES_PER_ROW = ATLAS_SIZE / TILE_TEXELS;
+    static constexpr uint32_t SLOT_COUNT = TILES_PER_ROW * TILES_PER_ROW;
+    static constexpr GLsizei DYNAMIC_SIZE = 1024;
+    // Page table covers PAGE_WINDOW x PAGE_WINDOW tiles centered on the view
+    static constexpr uint32_t PAGE_WINDOW = 32;
+    static constexpr float TILE_WORLD_SIZE = 1.0f;
+    static constexpr float SHADOW_DISTANCE = 8.0f;
+    static constexpr uint32_t MAX_TILE_UPDATES_PER_FRAME = 16;
+
+    static constexpr const char* UNIFORM_BLOCK_NAME = "ShadowParams";
+
+    struct Stats {
+        uint32_t mVisibleTiles = 0;      // tiles the view needs this frame
+        uint32_t mResidentTiles = 0;     // of those, with valid cached depth
+        uint32_t mTilesRendered = 0;     // re-rendered this frame
+        uint32_t mDynamicCasters = 0;    // drawn into the dynamic map this frame
+    };
+
+    /**
+     * Draw the listed casters with @p lightViewProjection into the bound
+     * depth target. Returns false if nothing could be drawn (e.g. the depth
+     * program is still compiling).
+     */
+    using DrawCastersFn = std::function<bool(const XrMatrix4x4f& lightViewProjection,
+                                             const uint32_t* casters, uint32_t count)>;
+
+    ShadowAtlas() = default;
+    ~ShadowAtlas() = default;
+
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    /**
+     * Create the atlas, dynamic map and page table. Requires a current GL context.
+     */
+    bool Init();
+    void Shutdown();
+
+    /**
+     * @param toSun Direction toward the sun, scene space
+     * @param color Linear sun color, premultiplied by intensity
+     */
+    void SetSun(const XrVector3f& toSun, const XrVector3f& color);
+
+    /**
+     * Mark cached tiles overlapping @p bounds for re-rendering. Call with both
+     * the old and the new bounds when a static caster moves.
+     */
+    void InvalidateBounds(const MathUtils::Bounds3f& bounds);
+
+    /**
+     * Pick this frame's visible, resident and to-be-rendered tiles, fit the
+     * dynamic map and upload shading parameters. Call once per frame after
+     * @p uniforms' BeginFrame(), before the render passes below run.
+     */
+    void Update(const StereoFrustum& frustum, const std::vector<ShadowCaster>& casters,
+                StreamingBuffer& uniforms, FrameStats& stats);
+
+    // Whether this frame needs RenderStatic() / RenderDynamic()
+    bool HasStaticWork() const { return !mScheduledSlots.empty(); }
+    bool HasDynamicWork() const { return !mDynamicCasters.empty(); }
+
+    /**
+     * Render scheduled tiles. The atlas must be the bound depth attachment;
+     * existing contents are kept outside the scheduled tiles.
+     */
+    void RenderStatic(const DrawCastersFn& draw, FrameStats& stats);
+
+    /**
+     * Render dynamic casters. The dynamic map must be the bound, cleared
+     * depth attachment with a full-size viewport.
+     */
+    void RenderDynamic(const DrawCastersFn& draw, FrameStats& stats);
+
+    /**
+     * Bind this frame's shadow data for shading.
+     * @return false if Update() produced nothing to bind
+     */
+    bool Bind(GLuint uniformBinding, GLuint pageTableUnit, GLuint atlasUnit, GLuint dynamicUnit,
+              FrameStats& stats) const;
+
+    GLuint GetAtlasTexture() const { return mAtlasTexture; }
+    GLuint GetDynamicTexture() const { return mDynamicTexture; }
+
+    /**
+     * GLSL declaring the ShadowParams block, the uShadowPageTable,
+     * uShadowAtlas and uShadowDynamic samplers, and
+     * vec3 SunLighting(vec3 worldPos, vec3 normal, vec3 albedo).
+     */
+    static std::string GetShaderSource();
+
+    const Stats& GetStats() const { return mStats; }
+    GpuMemoryUsage GetGpuMemory() const;
+
+private:
+    struct Rect {
+        float mMinX, mMinY, mMaxX, mMaxY;
+        bool Overlaps(const Rect& other) const {
+            return mMinX <= other.mMaxX && other.mMinX <= mMaxX &&
+                   mMinY <= other.mMaxY && other.mMinY <= mMaxY;
+        }
+    };
+
+    struct Slot {
+        int32_t mTileX = 0;
+        int32_t mTileY = 0;
+        bool mResident = false;   // assigned to mTileX/Y
+        bool mValid = false;      // holds that tile's static depth
+        bool mDirty = false;      // needs (re-)rendering
+        uint64_t mLastUsedFrame = 0;
+    };
+
+    static uint64_t TileKey(int32_t tileX, int32_t tileY);
+    Rect LightSpaceRect(const MathUtils::Bounds3f& bounds) const;
+    XrMatrix4x4f OrthoLightMatrix(const Rect& rect) const;
+    void InvalidateAll();
+    int32_t AllocateSlot();
+
+    GLuint mAtlasTexture = 0;
+    GLuint mDynamicTexture = 0;
+    GLuint mPageTableTexture = 0;
+
+    // Rows of the light basis; light space z points at the sun
+    XrVector3f mLightX = {1.0f, 0.0f, 0.0f};
+    XrVector3f mLightY = {0.0f, 1.0f, 0.0f};
+    XrVector3f mLightZ = {0.0f, 0.0f, 1.0f};
+    XrVector3f mSunColor = {0.0f, 0.0f, 0.0f};
+
+    std::array<Slot, SLOT_COUNT> mSlots = {};
+    std::unordered_map<uint64_t, uint32_t> mTileToSlot;
+    uint64_t mFrame = 0;
+
+    // This frame
+    std::vector<uint32_t> mScheduledSlots;
+    std::vector<Rect> mCasterRects;
+    std::vector<uint32_t> mStaticCasters;
+    std::vector<uint32_t> mDynamicCasters;
+    XrMatrix4x4f mDynamicViewProjection = {};
+    int32_t mWindowX = 0;
+    int32_t mWindowY = 0;
+    StreamingBuffer::Allocation mUniformAllocation;
+
+    std::array<uint16_t, PAGE_WINDOW * PAGE_WINDOW> mPageTable = {};
+    bool mPageTableUploaded = false;
+
+    Stats mStats;
+};
@@ -0,0 +1,58 @@
+/*******************************************************************************
+
+Filename    :   StereoFrustum.cpp
+Content     :   Single frustum enclosing both eye frusta
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "StereoFrustum.h"
+
+#include <xr_linear.h>
+
+#include <algorithm>
+#include <cmath>
+
+StereoFrustum StereoFrustum::FromEyes(const XrPosef& leftEyePose, const XrFovf& leftEyeFov,
+                                      const XrPosef& rightEyePose, const XrFovf& rightEyeFov) {
+    StereoFrustum frustum;
+    frustum.mTanLeft = std::tan(std::min(leftEyeFov.angleLeft, rightEyeFov.angleLeft));
+    frustum.mTanRight = std::tan(std::max(leftEyeFov.angleRight, rightEyeFov.angleRight));
+    frustum.mTanDown = std::tan(std::min(leftEyeFov.angleDown, rightEyeFov.angleDown));
+    frustum.mTanUp = std::tan(std::max(leftEyeFov.angleUp, rightEyeFov.angleUp));
+
+    const XrVector3f center = {0.5f * (leftEyePose.position.x + rightEyePose.position.x),
+                               0.5f * (leftEyePose.position.y + rightEyePose.position.y),
+                               0.5f * (leftEyePose.position.z + rightEyePose.position.z)};
+    const float dx = rightEyePose.position.x - leftEyePose.position.x;
+    const float dy = rightEyePose.position.y - leftEyePose.position.y;
+    const float dz = rightEyePose.position.z - leftEyePose.position.z;
+    const float halfIpd = 0.5f * std::sqrt(dx * dx + dy * dy + dz * dz);
+
+    // The left eye's left plane is offset by halfIpd from the center, so the
+    // apex must sit halfIpd / tan(left) behind the eyes (likewise right)
+    const float outerTan = std::max(std::min(-frustum.mTanLeft, frustum.mTanRight), 0.01f);
+    frustum.mPullBack = halfIpd / outerTan;
+    frustum.mHalfIpd = halfIpd;
+    const XrVector3f back = {0.0f, 0.0f, frustum.mPullBack};
+    XrVector3f offset;
+    XrQuaternionf_RotateVector3f(&offset, &leftEyePose.orientation, &back);
+
+    frustum.mPose.orientation = leftEyePose.orientation;
+    frustum.mPose.position = {center.x + offset.x, center.y + offset.y, center.z + offset.z};
+    return frustum;
+}
+
+std::array<XrVector3f, 8> StereoFrustum::GetCorners(const float nearDepth,
+                                                    const float farDepth) const {
+    std::array<XrVector3f, 8> corners;
+    for (int i = 0; i < 8; i++) {
+        const float depth = (i & 4) ? farDepth : nearDepth;
+        const XrVector3f local = {((i & 1) ? mTanRight : mTanLeft) * depth,
+                                  ((i & 2) ? mTanUp : mTanDown) * depth, -depth};
+        XrPosef_TransformVector3f(&corners[i], &mPose, &local);
+    }
+    return corners;
+}
@@ -0,0 +1,47 @@
+/*******************************************************************************
+
+Filename    :   StereoFrustum.h
+Content     :   Single frustum enclosing both eye frusta
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <openxr/openxr.h>
+
+#include <array>
+
+/**
+ * StereoFrustum - one perspective frustum that contains both eyes' frusta.
+ *
+ * Its apex sits between the eyes, pulled back just far enough that the
+ * combined frustum's outer planes contain each eye's outer planes. Anything
+ * either eye can see is inside it, so per-frame view-dependent work (light
+ * binning, shadow cropping, culling) can run once for both eyes.
+ *
+ * Eye orientations are assumed equal, as on parallel-display headsets.
+ */
+struct StereoFrustum {
+    // Apex and orientation in the scene's reference space; looks down -Z
+    XrPosef mPose = {{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+    float mTanLeft = -1.0f;
+    float mTanRight = 1.0f;
+    float mTanDown = -1.0f;
+    float mTanUp = 1.0f;
+    // How far behind the eyes the apex sits, and how far each eye is to its side
+    float mPullBack = 0.0f;
+    float mHalfIpd = 0.0f;
+
+    static StereoFrustum FromEyes(const XrPosef& leftEyePose, const XrFovf& leftEyeFov,
+                                  const XrPosef& rightEyePose, const XrFovf& rightEyeFov);
+
+    /**
+     * Scene-space corners of the frustum section between two view depths
+     * (measured from the apex). Near corners first: bottom-left, bottom-right,
+     * top-left, top-right; then the same at the far depth.
+     */
+    std::array<XrVector3f, 8> GetCorners(float nearDepth, float farDepth) const;
+};
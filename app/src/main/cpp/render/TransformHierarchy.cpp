@@ -0,0 +1,291 @@
+/*******************************************************************************
+
+Filename    :   TransformHierarchy.cpp
+Content     :   Parent/child pose hierarchy stored breadth-first, updated
+                level by level in SIMD batches
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "TransformHierarchy.h"
+#include "../utils/JobSystem.h"
+#include "../utils/LogUtils.h"
+#include "../utils/MathUtils.h"
+#include "../utils/Simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+// Float4::Load/Store on the pose arrays rely on default new alignment
+static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ >= 16, "pose arrays must be 16-byte aligned");
+
+namespace {
+    // Narrower levels are not worth waking the workers for
+    constexpr uint32_t kMinParallelBatches = 64;
+    constexpr uint32_t kBatchesPerJob = 32;
+
+    uint32_t RoundUpToBatch(const uint32_t count) { return (count + 3u) & ~3u; }
+} // anonymous namespace
+
+void TransformHierarchy::PoseArrays::Resize(const size_t size) {
+    for (std::vector<float>* lane : {&mQx, &mQy, &mQz, &mQw, &mPx, &mPy, &mPz}) {
+        lane->assign(size, 0.0f);
+    }
+    std::fill(mQw.begin(), mQw.end(), 1.0f);
+}
+
+void TransformHierarchy::PoseArrays::Set(const uint32_t slot, const XrPosef& pose) {
+    mQx[slot] = pose.orientation.x;
+    mQy[slot] = pose.orientation.y;
+    mQz[slot] = pose.orientation.z;
+    mQw[slot] = pose.orientation.w;
+    mPx[slot] = pose.position.x;
+    mPy[slot] = pose.position.y;
+    mPz[slot] = pose.position.z;
+}
+
+XrPosef TransformHierarchy::PoseArrays::Get(const uint32_t slot) const {
+    return {{mQx[slot], mQy[slot], mQz[slot], mQw[slot]}, {mPx[slot], mPy[slot], mPz[slot]}};
+}
+
+TransformHierarchy::NodeId TransformHierarchy::AddNode(const NodeId parent,
+                                                       const XrPosef& localPose,
+                                                       const uint32_t userData) {
+    if (parent != INVALID_NODE && parent >= mParents.size()) {
+        ALOGE("TransformHierarchy: parent %u does not exist", parent);
+        return INVALID_NODE;
+    }
+    const NodeId node = static_cast<NodeId>(mParents.size());
+    mParents.push_back(parent);
+    mDepths.push_back(parent == INVALID_NODE ? 0 : mDepths[parent] + 1);
+    mLocalPoses.push_back(localPose);
+    mUserData.push_back(userData);
+    mSlots.push_back(NO_SLOT);
+    mLayoutDirty = true;
+    return node;
+}
+
+void TransformHierarchy::SetLocalPose(const NodeId node, const XrPosef& localPose) {
+    mLocalPoses[node] = localPose;
+    if (!mLayoutDirty) {
+        const uint32_t slot = mSlots[node];
+        mLocal.Set(slot, localPose);
+        if (mDirty[slot] == 0) {
+            mDirty[slot] = 1;
+            mDirtySlots.push_back(slot);
+        }
+    }
+}
+
+XrPosef TransformHierarchy::GetWorldPose(const NodeId node) const {
+    if (mLayoutDirty && mSlots[node] == NO_SLOT) {
+        return MathUtils::kIdentityPose;
+    }
+    return mWorld.Get(mSlots[node]);
+}
+
+void TransformHierarchy::Rebuild() {
+    const uint32_t nodeCount = GetNodeCount();
+    uint32_t levelCount = 0;
+    for (const uint32_t depth : mDepths) {
+        levelCount = std::max(levelCount, depth + 1);
+    }
+
+    // Each level sorted by parent slot, so siblings are adjacent and the
+    // parents a batch reads are close together
+    std::vector<std::vector<NodeId>> levels(levelCount);
+    for (NodeId node = 0; node < nodeCount; node++) {
+        levels[mDepths[node]].push_back(node);
+    }
+    mLevelStarts.assign(1, 0);
+    mSlotNodes.clear();
+    for (std::vector<NodeId>& level : levels) {
+        std::stable_sort(level.begin(), level.end(), [this](const NodeId a, const NodeId b) {
+            const auto parentSlot = [this](const NodeId n) {
+                return mParents[n] == INVALID_NODE ? 0u : mSlots[mParents[n]];
+            };
+            return parentSlot(a) < parentSlot(b);
+        });
+        for (const NodeId node : level) {
+            mSlots[node] = static_cast<uint32_t>(mSlotNodes.size());
+            mSlotNodes.push_back(node);
+        }
+        mSlotNodes.resize(RoundUpToBatch(static_cast<uint32_t>(mSlotNodes.size())),
+                          INVALID_NODE);
+        mLevelStarts.push_back(static_cast<uint32_t>(mSlotNodes.size()));
+    }
+
+    const uint32_t slotCount = static_cast<uint32_t>(mSlotNodes.size());
+    mParentSlots.assign(slotCount, NO_SLOT);
+    mChildBegins.assign(slotCount, 0);
+    mChildEnds.assign(slotCount, 0);
+    mLocal.Resize(slotCount);
+    mWorld.Resize(slotCount);
+    mChanged.assign(slotCount, 0);
+    mChangedSlots.clear();
+    // Everything is recomputed once after a rebuild
+    mDirty.assign(slotCount, 0);
+    mDirtySlots.clear();
+    for (uint32_t slot = 0; slot < slotCount; slot++) {
+        const NodeId node = mSlotNodes[slot];
+        if (node == INVALID_NODE) {
+            continue;
+        }
+        mDirty[slot] = 1;
+        mDirtySlots.push_back(slot);
+        mLocal.Set(slot, mLocalPoses[node]);
+        if (mParents[node] == INVALID_NODE) {
+            continue;
+        }
+        const uint32_t parentSlot = mSlots[mParents[node]];
+        mParentSlots[slot] = parentSlot;
+        if (mChildBegins[parentSlot] == mChildEnds[parentSlot]) {
+            mChildBegins[parentSlot] = slot;
+        }
+        mChildEnds[parentSlot] = slot + 1;
+    }
+    mBatchQueued.assign(slotCount / 4, 0);
+    mLevelBatches.resize(levelCount);
+    mLayoutDirty = false;
+    mStats.mNodes = nodeCount;
+    mStats.mLevels = levelCount;
+}
+
+void TransformHierarchy::MarkBatch(const uint32_t level, const uint32_t batch) {
+    if (mBatchQueued[batch] == 0) {
+        mBatchQueued[batch] = 1;
+        mLevelBatches[level].push_back(batch);
+    }
+}
+
+bool TransformHierarchy::UpdateBatch(const uint32_t batch) {
+    const uint32_t first = batch * 4;
+    bool any = false;
+    for (uint32_t slot = first; slot < first + 4; slot++) {
+        const uint32_t parent = mParentSlots[slot];
+        mChanged[slot] = mDirty[slot] | (parent != NO_SLOT ? mChanged[parent] : 0);
+        any = any || mChanged[slot] != 0;
+    }
+    if (!any) {
+        return false;
+    }
+
+    // Gather parents into lanes; roots and padding get the identity
+    alignas(16) float parent[7][4];
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        const uint32_t slot = mParentSlots[first + lane];
+        const XrPosef pose = slot != NO_SLOT ? mWorld.Get(slot) : MathUtils::kIdentityPose;
+        parent[0][lane] = pose.orientation.x;
+        parent[1][lane] = pose.orientation.y;
+        parent[2][lane] = pose.orientation.z;
+        parent[3][lane] = pose.orientation.w;
+        parent[4][lane] = pose.position.x;
+        parent[5][lane] = pose.position.y;
+        parent[6][lane] = pose.position.z;
+    }
+    const Float4 ax = Float4::Load(parent[0]);
+    const Float4 ay = Float4::Load(parent[1]);
+    const Float4 az = Float4::Load(parent[2]);
+    const Float4 aw = Float4::Load(parent[3]);
+    const Float4 bx = Float4::Load(&mLocal.mQx[first]);
+    const Float4 by = Float4::Load(&mLocal.mQy[first]);
+    const Float4 bz = Float4::Load(&mLocal.mQz[first]);
+    const Float4 bw = Float4::Load(&mLocal.mQw[first]);
+
+    // Orientation: parent * local
+    const Float4 qx = aw * bx + ax * bw + ay * bz - az * by;
+    const Float4 qy = aw * by - ax * bz + ay * bw + az * bx;
+    const Float4 qz = aw * bz + ax * by - ay * bx + az * bw;
+    const Float4 qw = aw * bw - ax * bx - ay * by - az * bz;
+
+    // Position: parent position + local position rotated by the parent,
+    // as v + w * t + cross(q, t) with t = 2 * cross(q, v)
+    const Float4 vx = Float4::Load(&mLocal.mPx[first]);
+    const Float4 vy = Float4::Load(&mLocal.mPy[first]);
+    const Float4 vz = Float4::Load(&mLocal.mPz[first]);
+    const Float4 two = Float4::Splat(2.0f);
+    const Float4 tx = two * (ay * vz - az * vy);
+    const Float4 ty = two * (az * vx - ax * vz);
+    const Float4 tz = two * (ax * vy - ay * vx);
+    const Float4 px = Float4::Load(parent[4]) + vx + aw * tx + (ay * tz - az * ty);
+    const Float4 py = Float4::Load(parent[5]) + vy + aw * ty + (az * tx - ax * tz);
+    const Float4 pz = Float4::Load(parent[6]) + vz + aw * tz + (ax * ty - ay * tx);
+
+    qx.Store(&mWorld.mQx[first]);
+    qy.Store(&mWorld.mQy[first]);
+    qz.Store(&mWorld.mQz[first]);
+    qw.Store(&mWorld.mQw[first]);
+    px.Store(&mWorld.mPx[first]);
+    py.Store(&mWorld.mPy[first]);
+    pz.Store(&mWorld.mPz[first]);
+    return true;
+}
+
+void TransformHierarchy::Update() {
+    const auto start = std::chrono::steady_clock::now();
+    if (mLayoutDirty) {
+        Rebuild();
+    }
+
+    for (const uint32_t slot : mChangedSlots) {
+        mChanged[slot] = 0;
+    }
+    mChangedSlots.clear();
+    mChangedNodes.clear();
+    for (const uint32_t slot : mDirtySlots) {
+        const auto next = std::upper_bound(mLevelStarts.begin(), mLevelStarts.end(), slot);
+        MarkBatch(static_cast<uint32_t>(next - mLevelStarts.begin() - 1), slot / 4);
+    }
+    mDirtySlots.clear();
+
+    std::atomic<uint32_t> composed{0};
+    // Levels run one after another: a level reads the one above it
+    for (uint32_t level = 0; level < mLevelBatches.size(); level++) {
+        const std::vector<uint32_t>& batches = mLevelBatches[level];
+        const auto run = [this, &batches, &composed](const uint32_t begin, const uint32_t end) {
+            uint32_t done = 0;
+            for (uint32_t i = begin; i < end; i++) {
+                done += UpdateBatch(batches[i]) ? 1 : 0;
+            }
+            composed.fetch_add(done, std::memory_order_relaxed);
+        };
+        const uint32_t count = static_cast<uint32_t>(batches.size());
+        if (mJobs != nullptr && count >= kMinParallelBatches) {
+            mJobs->ParallelFor(count, kBatchesPerJob, run);
+        } else {
+            run(0, count);
+        }
+
+        // Queue the children of everything that changed for the next level
+        for (const uint32_t batch : batches) {
+            mBatchQueued[batch] = 0;
+            for (uint32_t slot = batch * 4; slot < batch * 4 + 4; slot++) {
+                mDirty[slot] = 0;
+                if (mChanged[slot] == 0) {
+                    continue;
+                }
+                mChangedSlots.push_back(slot);
+                if (mSlotNodes[slot] != INVALID_NODE) {
+                    mChangedNodes.push_back(mSlotNodes[slot]);
+                }
+                if (mChildBegins[slot] != mChildEnds[slot]) {
+                    for (uint32_t child = mChildBegins[slot] / 4;
+                         child <= (mChildEnds[slot] - 1) / 4; child++) {
+                        MarkBatch(level + 1, child);
+                    }
+                }
+            }
+        }
+        mLevelBatches[level].clear();
+    }
+
+    mStats.mNodesChanged = static_cast<uint32_t>(mChangedNodes.size());
+    mStats.mBatchesComposed = composed.load(std::memory_order_relaxed);
+    mStats.mBatchesSkipped =
+            static_cast<uint32_t>(mBatchQueued.size()) - mStats.mBatchesComposed;
+    mStats.mUpdateNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,146 @@
+/*******************************************************************************
+
+Filename    :   TransformHierarchy.h
+Content     :   Parent/child pose hierarchy stored breadth-first, updated
+                level by level in SIMD batches
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <openxr/openxr.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+/**
+ * TransformHierarchy - nodes with a pose relative to their parent, and the
+ * scene-space pose that results.
+ *
+ * Nodes are laid out breadth-first in flat structure-of-arrays storage, one
+ * level after another, each level padded to a multiple of four. Update()
+ * walks the levels in order, so every parent is final before its children
+ * are read, and composes four poses per SIMD operation. Within a level the
+ * batches are independent, so wide levels are split across the JobSystem.
+ *
+ * Only dirty subtrees are recomputed: a node is recomputed if its local
+ * pose was set or its parent was recomputed this Update(). Siblings are
+ * adjacent, so a recomputed node's children are one contiguous range in the
+ * next level; Update() visits only the batches of four those ranges and the
+ * dirty nodes fall in, and never touches the rest.
+ *
+ * Tracked devices (head, controllers) are roots whose local pose is set
+ * from the synced pose each frame before Update(); anything attached to
+ * them follows in the same pass.
+ *
+ * Adding nodes rebuilds the layout at the next Update(). Nodes are never
+ * removed. Not thread-safe.
+ */
+class TransformHierarchy {
+public:
+    using NodeId = uint32_t;
+    static constexpr NodeId INVALID_NODE = UINT32_MAX;
+    static constexpr uint32_t NO_USER_DATA = UINT32_MAX;
+
+    struct Stats {
+        uint32_t mNodes = 0;
+        uint32_t mLevels = 0;
+        // From the last Update()
+        uint32_t mNodesChanged = 0;
+        uint32_t mBatchesComposed = 0;
+        uint32_t mBatchesSkipped = 0;
+        int64_t mUpdateNs = 0;
+    };
+
+    /**
+     * @param jobs Optional worker pool for wide levels; must outlive this object
+     */
+    explicit TransformHierarchy(JobSystem* jobs = nullptr) : mJobs(jobs) {}
+
+    TransformHierarchy(const TransformHierarchy&) = delete;
+    TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+    /**
+     * @param parent   INVALID_NODE for a root
+     * @param userData Returned by GetUserData(), e.g. the scene object the node places
+     */
+    NodeId AddNode(NodeId parent, const XrPosef& localPose, uint32_t userData = NO_USER_DATA);
+
+    void SetLocalPose(NodeId node, const XrPosef& localPose);
+    const XrPosef& GetLocalPose(const NodeId node) const { return mLocalPoses[node]; }
+    NodeId GetParent(const NodeId node) const { return mParents[node]; }
+    uint32_t GetUserData(const NodeId node) const { return mUserData[node]; }
+
+    /**
+     * Scene-space pose as of the last Update(); identity for nodes added since.
+     */
+    XrPosef GetWorldPose(NodeId node) const;
+
+    /**
+     * Recompute the world poses of every dirty subtree.
+     */
+    void Update();
+
+    /**
+     * Nodes whose world pose the last Update() recomputed, parents first.
+     */
+    const std::vector<NodeId>& GetChangedNodes() const { return mChangedNodes; }
+
+    uint32_t GetNodeCount() const { return static_cast<uint32_t>(mParents.size()); }
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    // Parent slot of roots and padding, and slot of nodes not yet laid out
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    struct PoseArrays {
+        std::vector<float> mQx, mQy, mQz, mQw;
+        std::vector<float> mPx, mPy, mPz;
+
+        void Resize(size_t size);
+        void Set(uint32_t slot, const XrPosef& pose);
+        XrPosef Get(uint32_t slot) const;
+    };
+
+    void Rebuild();
+    // Queue @p batch for @p level's pass unless it already is
+    void MarkBatch(uint32_t level, uint32_t batch);
+    // Compose slots [batch * 4, batch * 4 + 4) onto their parents
+    bool UpdateBatch(uint32_t batch);
+
+    JobSystem* mJobs = nullptr;
+
+    // Indexed by NodeId
+    std::vector<NodeId> mParents;
+    std::vector<uint32_t> mDepths;
+    std::vector<XrPosef> mLocalPoses;
+    std::vector<uint32_t> mUserData;
+    std::vector<uint32_t> mSlots;
+    bool mLayoutDirty = false;
+
+    // Indexed by slot. Level L occupies [mLevelStarts[L], mLevelStarts[L + 1]).
+    std::vector<uint32_t> mLevelStarts;
+    std::vector<NodeId> mSlotNodes;       // INVALID_NODE for padding
+    std::vector<uint32_t> mParentSlots;   // NO_SLOT for roots and padding
+    std::vector<uint32_t> mChildBegins;   // children's slots in the next level
+    std::vector<uint32_t> mChildEnds;
+    std::vector<uint8_t> mDirty;          // local pose set since the last Update()
+    std::vector<uint8_t> mChanged;        // world pose recomputed by the last Update()
+    PoseArrays mLocal;
+    PoseArrays mWorld;
+
+    std::vector<uint32_t> mDirtySlots;
+    std::vector<uint32_t> mChangedSlots;
+    // Indexed by batch, then by level: batches queued for the current Update()
+    std::vector<uint8_t> mBatchQueued;
+    std::vector<std::vector<uint32_t>> mLevelBatches;
+
+    std::vector<NodeId> mChangedNodes;
+    Stats mStats;
+};
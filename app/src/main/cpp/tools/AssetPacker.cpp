@@ -0,0 +1,359 @@
+/*******************************************************************************
+
+Filename    :   AssetPacker.cpp
+Content     :   Host-side asset package writer. Bakes the builtin scene
+                meshes, and optionally KTX compressed textures, into the
+                memory-mappable format AssetPackage reads, so the device maps
+                them instead of generating or decoding them at startup.
+
+                Usage:
+                    asset_packer --out <package> [--texture <name>=<file.ktx>]...
+                    asset_packer --list <package>
+
+                The app loads content.vpak from its APK assets, and generates
+                the geometry instead when there is none. With
+                -Pvrtemplate.packContent=true the Gradle build writes it
+                through the host content_package target; run by hand only to
+                add textures or inspect a package.
+
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "../render/BuiltinMeshes.h"
+#include "../utils/AssetPackage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace AssetFormat;
+
+namespace {
+    constexpr const char* kTextureGroup = "textures";
+    constexpr uint32_t kGlUnsignedShort = 0x1403;
+
+    constexpr uint8_t kKtxIdentifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB,
+                                            '\r', '\n', 0x1A, '\n'};
+    constexpr uint32_t kKtxEndianness = 0x04030201;
+
+    // Fields of a KTX 1.1 header, after the identifier
+    struct KtxHeader {
+        uint32_t mEndianness;
+        uint32_t mGlType;
+        uint32_t mGlTypeSize;
+        uint32_t mGlFormat;
+        uint32_t mGlInternalFormat;
+        uint32_t mGlBaseInternalFormat;
+        uint32_t mPixelWidth;
+        uint32_t mPixelHeight;
+        uint32_t mPixelDepth;
+        uint32_t mArrayElements;
+        uint32_t mFaces;
+        uint32_t mMipLevels;
+        uint32_t mKeyValueBytes;
+    };
+
+    struct PendingEntry {
+        Entry mEntry = {};
+        std::vector<uint8_t> mBlob;
+    };
+
+    struct PendingGroup {
+        std::string mName;
+        std::vector<PendingEntry> mEntries;
+    };
+
+    uint64_t AlignUp(const uint64_t value, const uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    template <typename T>
+    std::vector<uint8_t> ToBlob(const T* data, const size_t count) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+        return std::vector<uint8_t>(bytes, bytes + count * sizeof(T));
+    }
+
+    bool SetName(char (&out)[NAME_LENGTH], const std::string& name) {
+        if (name.empty() || name.size() >= NAME_LENGTH) {
+            fprintf(stderr, "Name '%s' must be 1 to %u characters\n", name.c_str(),
+                    NAME_LENGTH - 1);
+            return false;
+        }
+        memcpy(out, name.c_str(), name.size() + 1);
+        return true;
+    }
+
+    // Entries are numbered in group order, the order Write() lays them out in
+    uint32_t CountEntries(const std::vector<PendingGroup>& groups) {
+        uint32_t count = 0;
+        for (const PendingGroup& group : groups) {
+            count += static_cast<uint32_t>(group.mEntries.size());
+        }
+        return count;
+    }
+
+    PendingGroup PackMeshes() {
+        const BuiltinMeshes meshes = BuiltinMeshes::Build();
+        PendingGroup group;
+        group.mName = BuiltinMeshes::GROUP;
+
+        PendingEntry vertices;
+        SetName(vertices.mEntry.mName, BuiltinMeshes::VERTICES);
+        vertices.mEntry.mType = EntryType::VERTICES;
+        vertices.mEntry.mParams[0] = static_cast<uint32_t>(VertexLayout::POSITION_NORMAL);
+        vertices.mEntry.mParams[1] = sizeof(MeshVertex);
+        vertices.mEntry.mParams[2] = static_cast<uint32_t>(meshes.mVertices.size());
+        vertices.mBlob = ToBlob(meshes.mVertices.data(), meshes.mVertices.size());
+
+        PendingEntry indices;
+        SetName(indices.mEntry.mName, BuiltinMeshes::INDICES);
+        indices.mEntry.mType = EntryType::INDICES;
+        indices.mEntry.mParams[0] = kGlUnsignedShort;
+        indices.mEntry.mParams[1] = static_cast<uint32_t>(meshes.mIndices.size());
+        indices.mBlob = ToBlob(meshes.mIndices.data(), meshes.mIndices.size());
+
+        // Meshes refer to the two buffers by entry number; this group is first
+        group.mEntries.push_back(std::move(vertices));
+        group.mEntries.push_back(std::move(indices));
+        for (size_t i = 0; i < BuiltinMeshes::MESH_COUNT; i++) {
+            const LodSelector::Mesh& lods = meshes.mMeshes[i];
+            std::vector<MeshLevel> levels;
+            for (uint32_t level = 0; level < lods.mLevelCount; level++) {
+                levels.push_back({lods.mLevels[level].mFirstIndex,
+                                  lods.mLevels[level].mIndexCount, lods.mLevels[level].mError,
+                                  0});
+            }
+            PendingEntry mesh;
+            SetName(mesh.mEntry.mName, BuiltinMeshes::MESH_NAMES[i]);
+            mesh.mEntry.mType = EntryType::MESH;
+            mesh.mEntry.mParams[0] = 0;
+            mesh.mEntry.mParams[1] = 1;
+            mesh.mEntry.mParams[2] = lods.mLevelCount;
+            mesh.mBlob = ToBlob(levels.data(), levels.size());
+            group.mEntries.push_back(std::move(mesh));
+        }
+        return group;
+    }
+
+    bool ReadFile(const char* path, std::vector<uint8_t>& contents) {
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr) {
+            fprintf(stderr, "Cannot open %s\n", path);
+            return false;
+        }
+        uint8_t buffer[64 * 1024];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            contents.insert(contents.end(), buffer, buffer + read);
+        }
+        fclose(file);
+        return true;
+    }
+
+    /**
+     * Convert a KTX 1.1 file holding one compressed 2D texture and its mip
+     * chain into a COMPRESSED_TEXTURE_2D entry.
+     */
+    bool PackKtx(const std::string& name, const char* path, PendingEntry& out) {
+        std::vector<uint8_t> ktx;
+        if (!ReadFile(path, ktx)) {
+            return false;
+        }
+        KtxHeader header = {};
+        if (ktx.size() < sizeof(kKtxIdentifier) + sizeof(header) ||
+            memcmp(ktx.data(), kKtxIdentifier, sizeof(kKtxIdentifier)) != 0) {
+            fprintf(stderr, "%s is not a KTX 1.1 file\n", path);
+            return false;
+        }
+        memcpy(&header, ktx.data() + sizeof(kKtxIdentifier), sizeof(header));
+        if (header.mEndianness != kKtxEndianness || header.mGlType != 0 ||
+            header.mPixelDepth > 1 || header.mArrayElements > 0 || header.mFaces != 1) {
+            fprintf(stderr, "%s must be a little-endian compressed 2D texture\n", path);
+            return false;
+        }
+
+        const uint32_t levelCount = std::max(header.mMipLevels, 1u);
+        size_t cursor = sizeof(kKtxIdentifier) + sizeof(header) + header.mKeyValueBytes;
+        std::vector<uint32_t> sizes;
+        std::vector<std::pair<size_t, uint32_t>> levels;
+        for (uint32_t level = 0; level < levelCount; level++) {
+            uint32_t size = 0;
+            if (cursor + sizeof(size) > ktx.size()) {
+                fprintf(stderr, "%s is truncated\n", path);
+                return false;
+            }
+            memcpy(&size, ktx.data() + cursor, sizeof(size));
+            cursor += sizeof(size);
+            if (size > ktx.size() - cursor) {
+                fprintf(stderr, "%s is truncated\n", path);
+                return false;
+            }
+            sizes.push_back(size);
+            levels.emplace_back(cursor, size);
+            cursor = AlignUp(cursor + size, 4);
+        }
+
+        // Level sizes, then each level aligned as GL will read it
+        out.mBlob = ToBlob(sizes.data(), sizes.size());
+        for (const auto& level : levels) {
+            out.mBlob.resize(AlignUp(out.mBlob.size(), BLOB_ALIGNMENT));
+            out.mBlob.insert(out.mBlob.end(), ktx.begin() + level.first,
+                             ktx.begin() + level.first + level.second);
+        }
+        if (!SetName(out.mEntry.mName, name)) {
+            return false;
+        }
+        out.mEntry.mType = EntryType::COMPRESSED_TEXTURE_2D;
+        out.mEntry.mParams[0] = header.mGlInternalFormat;
+        out.mEntry.mParams[1] = header.mPixelWidth;
+        out.mEntry.mParams[2] = std::max(header.mPixelHeight, 1u);
+        out.mEntry.mParams[3] = levelCount;
+        return true;
+    }
+
+    bool Write(const char* path, std::vector<PendingGroup>& groups) {
+        const uint32_t entryCount = CountEntries(groups);
+        Header header = {};
+        header.mMagic = MAGIC;
+        header.mVersion = VERSION;
+        header.mGroupCount = static_cast<uint32_t>(groups.size());
+        header.mEntryCount = entryCount;
+
+        // Lay out each group on its own pages, blobs aligned within it
+        std::vector<Group> groupTable(groups.size());
+        std::vector<Entry> entryTable;
+        uint64_t offset = sizeof(Header) + groups.size() * sizeof(Group) +
+                          entryCount * sizeof(Entry);
+        for (size_t g = 0; g < groups.size(); g++) {
+            offset = AlignUp(offset, GROUP_ALIGNMENT);
+            SetName(groupTable[g].mName, groups[g].mName);
+            groupTable[g].mOffset = offset;
+            for (PendingEntry& pending : groups[g].mEntries) {
+                offset = AlignUp(offset, BLOB_ALIGNMENT);
+                pending.mEntry.mGroup = static_cast<uint32_t>(g);
+                pending.mEntry.mOffset = offset;
+                pending.mEntry.mSize = pending.mBlob.size();
+                entryTable.push_back(pending.mEntry);
+                offset += pending.mBlob.size();
+            }
+            groupTable[g].mSize = offset - groupTable[g].mOffset;
+        }
+        header.mFileSize = offset;
+
+        FILE* file = fopen(path, "wb");
+        if (file == nullptr) {
+            fprintf(stderr, "Cannot write %s\n", path);
+            return false;
+        }
+        std::vector<uint8_t> contents(header.mFileSize, 0);
+        memcpy(contents.data(), &header, sizeof(header));
+        memcpy(contents.data() + sizeof(header), groupTable.data(),
+               groupTable.size() * sizeof(Group));
+        memcpy(contents.data() + sizeof(header) + groupTable.size() * sizeof(Group),
+               entryTable.data(), entryTable.size() * sizeof(Entry));
+        for (const PendingGroup& group : groups) {
+            for (const PendingEntry& pending : group.mEntries) {
+                std::copy(pending.mBlob.begin(), pending.mBlob.end(),
+                          contents.begin() + static_cast<ptrdiff_t>(pending.mEntry.mOffset));
+            }
+        }
+        const bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        if (fclose(file) != 0 || !written) {
+            fprintf(stderr, "Failed writing %s\n", path);
+            return false;
+        }
+        printf("Wrote %s: %zu groups, %u entries, %llu bytes\n", path, groups.size(), entryCount,
+               static_cast<unsigned long long>(header.mFileSize));
+        return true;
+    }
+
+    int List(const char* path) {
+        const auto start = std::chrono::steady_clock::now();
+        AssetPackage package;
+        if (!package.Open(path)) {
+            fprintf(stderr, "Cannot open %s as an asset package\n", path);
+            return 1;
+        }
+        const double openUs = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count();
+
+        printf("%s: %llu bytes, opened in %.1f us, %zu bytes resident\n\n", path,
+               static_cast<unsigned long long>(package.GetSize()), openUs,
+               package.GetResidentBytes());
+        printf("%-32s %12s %12s\n", "group", "offset", "size");
+        for (uint32_t i = 0; i < package.GetGroupCount(); i++) {
+            const Group& group = package.GetGroup(i);
+            printf("%-32s %12llu %12llu\n", group.mName,
+                   static_cast<unsigned long long>(group.mOffset),
+                   static_cast<unsigned long long>(group.mSize));
+        }
+        printf("\n%-32s %4s %6s %12s %12s  params\n", "entry", "type", "group", "offset", "size");
+        for (uint32_t i = 0; i < package.GetEntryCount(); i++) {
+            const Entry& entry = package.GetEntry(i);
+            printf("%-32s %4u %6u %12llu %12llu ", entry.mName,
+                   static_cast<uint32_t>(entry.mType), entry.mGroup,
+                   static_cast<unsigned long long>(entry.mOffset),
+                   static_cast<unsigned long long>(entry.mSize));
+            for (const uint32_t param : entry.mParams) {
+                printf(" %u", param);
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+
+    void PrintUsage(const char* argv0) {
+        fprintf(stderr, "Usage: %s --out <package> [--texture <name>=<file.ktx>]...\n"
+                        "       %s --list <package>\n", argv0, argv0);
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    const char* outPath = nullptr;
+    std::vector<std::string> textures;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+            textures.emplace_back(argv[++i]);
+        } else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc) {
+            return List(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (outPath == nullptr) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+
+    std::vector<PendingGroup> groups;
+    groups.push_back(PackMeshes());
+    if (!textures.empty()) {
+        PendingGroup textureGroup;
+        textureGroup.mName = kTextureGroup;
+        for (const std::string& texture : textures) {
+            const size_t split = texture.find('=');
+            if (split == std::string::npos) {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+            PendingEntry entry;
+            if (!PackKtx(texture.substr(0, split), texture.c_str() + split + 1, entry)) {
+                return 1;
+            }
+            textureGroup.mEntries.push_back(std::move(entry));
+        }
+        groups.push_back(std::move(textureGroup));
+    }
+    return Write(outPath, groups) ? 0 : 1;
+}
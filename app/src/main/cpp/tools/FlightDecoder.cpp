@@ -0,0 +1,263 @@
+/*******************************************************************************
+
+Filename    :   FlightDecoder.cpp
+Content     :   Host-side reader for FlightRecorder files. Prints how the
+                run ended, the recorded events, a per-phase timing summary
+                and the last frames, and can export every frame as CSV.
+
+                Usage:
+                    flight_decoder <file.vfr> [--frames <n>] [--csv <out.csv>]
+
+                Pull the last run's record, or the one before it, with
+                    adb pull /sdcard/Android/data/com.amwatson.vrtemplate/files/flight_prev.vfr
+
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "../utils/FlightRecorder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+using namespace FlightFormat;
+
+namespace {
+    constexpr size_t kDefaultFrames = 32;
+
+    double ToMs(const int64_t ns) {
+        return static_cast<double>(ns) * 1e-6;
+    }
+
+    double ToSeconds(const int64_t ns) {
+        return static_cast<double>(ns) * 1e-9;
+    }
+
+    const char* GetEventTypeName(const EventType type) {
+        switch (type) {
+            case EventType::NOTE: return "note";
+            case EventType::SESSION_STATE: return "session";
+            case EventType::PERF_NOTIFICATION: return "perf";
+            case EventType::STALL: return "stall";
+            case EventType::FAIL: return "FAIL";
+            case EventType::SIGNAL: return "signal";
+        }
+        return "unknown";
+    }
+
+    const char* GetPhaseName(const uint32_t phase) {
+        return phase < Watchdog::PHASE_COUNT
+               ? Watchdog::GetPhaseName(static_cast<Watchdog::Phase>(phase)) : "Unknown";
+    }
+
+    void PrintUsage(const char* program) {
+        fprintf(stderr, "Usage: %s <file.vfr> [--frames <n>] [--csv <out.csv>]\n", program);
+    }
+
+    bool ReadFile(const char* path, std::vector<uint8_t>& data) {
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        uint8_t buffer[65536];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            data.insert(data.end(), buffer, buffer + read);
+        }
+        fclose(file);
+        return true;
+    }
+
+    // Published records of a ring, oldest first
+    template <typename Record>
+    std::vector<Record> Collect(const uint8_t* data, const uint64_t offset,
+                                const uint32_t capacity) {
+        std::vector<Record> records(capacity);
+        memcpy(records.data(), data + offset, capacity * sizeof(Record));
+        records.erase(std::remove_if(records.begin(), records.end(),
+                                     [](const Record& record) { return record.mSequence == 0; }),
+                      records.end());
+        std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+            return a.mSequence < b.mSequence;
+        });
+        return records;
+    }
+
+    void PrintEnding(const Header& header, const std::vector<FrameRecord>& frames) {
+        char when[32] = {};
+        const time_t startTime = static_cast<time_t>(header.mStartWallTimeNs / 1000000000);
+        tm local = {};
+        localtime_r(&startTime, &local);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local);
+        printf("pid %u, started %s\n", header.mPid, when);
+
+        const int64_t lastFrameEnd = frames.empty() ? 0 : frames.back().mEndTimeNs;
+        if (header.mCleanExit != 0) {
+            printf("exited cleanly\n");
+        } else {
+            printf("DID NOT EXIT CLEANLY: render thread last entered %s of frame %llu at "
+                   "%.3f s, %.1f ms after the last recorded frame ended\n",
+                   GetPhaseName(header.mPhase),
+                   static_cast<unsigned long long>(header.mPhaseFrameIndex),
+                   ToSeconds(header.mPhaseTimeNs), ToMs(header.mPhaseTimeNs - lastFrameEnd));
+        }
+    }
+
+    void PrintEvents(const std::vector<EventRecord>& events) {
+        printf("\nevents (%zu kept)\n", events.size());
+        for (const EventRecord& event : events) {
+            char text[TEXT_LENGTH + 1] = {};
+            memcpy(text, event.mText, TEXT_LENGTH);
+            printf("%10.3f s  frame %-8llu %-7s %6d  %s\n", ToSeconds(event.mTimeNs),
+                   static_cast<unsigned long long>(event.mFrameIndex),
+                   GetEventTypeName(event.mType), event.mValue, text);
+        }
+    }
+
+    // Per-phase mean / p99 / max, plus where frame indices skip
+    void PrintSummary(const std::vector<FrameRecord>& frames) {
+        printf("\nphases over %zu frames\n", frames.size());
+        printf("%-14s %9s %9s %9s\n", "phase", "mean_ms", "p99_ms", "max_ms");
+        std::vector<int64_t> values(frames.size());
+        for (size_t phase = 0; phase < Watchdog::PHASE_COUNT; phase++) {
+            double sum = 0.0;
+            for (size_t i = 0; i < frames.size(); i++) {
+                values[i] = frames[i].mPhaseNs[phase];
+                sum += ToMs(values[i]);
+            }
+            std::sort(values.begin(), values.end());
+            printf("%-14s %9.3f %9.3f %9.3f\n", GetPhaseName(static_cast<uint32_t>(phase)),
+                   sum / static_cast<double>(frames.size()),
+                   ToMs(values[std::min(values.size() - 1, values.size() * 99 / 100)]),
+                   ToMs(values.back()));
+        }
+
+        for (size_t i = 1; i < frames.size(); i++) {
+            if (frames[i].mFrameIndex != frames[i - 1].mFrameIndex + 1) {
+                printf("frame index jumps %llu -> %llu at %.3f s (session restart?)\n",
+                       static_cast<unsigned long long>(frames[i - 1].mFrameIndex),
+                       static_cast<unsigned long long>(frames[i].mFrameIndex),
+                       ToSeconds(frames[i].mEndTimeNs));
+            }
+        }
+    }
+
+    void PrintFrames(const std::vector<FrameRecord>& frames, const size_t count) {
+        const size_t first = frames.size() - std::min(count, frames.size());
+        printf("\nlast %zu frames\n", frames.size() - first);
+        printf("frame      end_s     ");
+        for (size_t phase = 0; phase < Watchdog::PHASE_COUNT; phase++) {
+            printf("%11.11s ", GetPhaseName(static_cast<uint32_t>(phase)));
+        }
+        printf("submit_ms gl_calls draws triangles fov gpu_mib\n");
+        for (size_t i = first; i < frames.size(); i++) {
+            const FrameRecord& frame = frames[i];
+            printf("%-9llu %9.3f ", static_cast<unsigned long long>(frame.mFrameIndex),
+                   ToSeconds(frame.mEndTimeNs));
+            for (const int64_t phaseNs : frame.mPhaseNs) {
+                printf("%11.3f ", ToMs(phaseNs));
+            }
+            printf("%9.3f %8u %5u %9u %3u %7.1f\n", ToMs(frame.mCpuSubmitNs), frame.mGlCalls,
+                   frame.mDrawCalls, frame.mTriangles, frame.mFoveationLevel,
+                   static_cast<double>(frame.mGpuMemoryBytes) / (1024.0 * 1024.0));
+        }
+    }
+
+    bool WriteCsv(const char* path, const std::vector<FrameRecord>& frames) {
+        FILE* file = fopen(path, "w");
+        if (file == nullptr) {
+            return false;
+        }
+        fprintf(file, "frame,end_ns");
+        for (size_t phase = 0; phase < Watchdog::PHASE_COUNT; phase++) {
+            fprintf(file, ",%s_ns", GetPhaseName(static_cast<uint32_t>(phase)));
+        }
+        fprintf(file, ",cpu_submit_ns,slack_ns,gpu_memory_bytes,gl_calls,draws,triangles,"
+                      "foveation,objects_occluded,shadow_tile_updates\n");
+        for (const FrameRecord& frame : frames) {
+            fprintf(file, "%llu,%lld", static_cast<unsigned long long>(frame.mFrameIndex),
+                    static_cast<long long>(frame.mEndTimeNs));
+            for (const int64_t phaseNs : frame.mPhaseNs) {
+                fprintf(file, ",%lld", static_cast<long long>(phaseNs));
+            }
+            fprintf(file, ",%lld,%lld,%llu,%u,%u,%u,%u,%u,%u\n",
+                    static_cast<long long>(frame.mCpuSubmitNs),
+                    static_cast<long long>(frame.mSlackNs),
+                    static_cast<unsigned long long>(frame.mGpuMemoryBytes), frame.mGlCalls,
+                    frame.mDrawCalls, frame.mTriangles, frame.mFoveationLevel,
+                    frame.mObjectsOccluded, frame.mShadowTileUpdates);
+        }
+        return fclose(file) == 0;
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    const char* csvPath = nullptr;
+    size_t frameCount = kDefaultFrames;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = static_cast<size_t>(atol(argv[++i]));
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csvPath = argv[++i];
+        } else if (path == nullptr && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (path == nullptr) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> data;
+    if (!ReadFile(path, data)) {
+        fprintf(stderr, "Could not read %s\n", path);
+        return 1;
+    }
+    Header header = {};
+    if (data.size() >= sizeof(header)) {
+        memcpy(&header, data.data(), sizeof(header));
+    }
+    if (header.mMagic != MAGIC || header.mVersion != VERSION) {
+        fprintf(stderr, "%s is not a version %u flight record\n", path, VERSION);
+        return 1;
+    }
+    if (header.mFileSize > data.size() ||
+        header.mFramesOffset + uint64_t{header.mFrameCapacity} * sizeof(FrameRecord) >
+        header.mEventsOffset ||
+        header.mEventsOffset + uint64_t{header.mEventCapacity} * sizeof(EventRecord) >
+        header.mFileSize) {
+        fprintf(stderr, "%s is truncated or its header is corrupt\n", path);
+        return 1;
+    }
+
+    const std::vector<FrameRecord> frames =
+            Collect<FrameRecord>(data.data(), header.mFramesOffset, header.mFrameCapacity);
+    const std::vector<EventRecord> events =
+            Collect<EventRecord>(data.data(), header.mEventsOffset, header.mEventCapacity);
+
+    PrintEnding(header, frames);
+    PrintEvents(events);
+    if (!frames.empty()) {
+        PrintSummary(frames);
+        PrintFrames(frames, frameCount);
+    }
+    if (csvPath != nullptr) {
+        if (!WriteCsv(csvPath, frames)) {
+            fprintf(stderr, "Could not write %s\n", csvPath);
+            return 1;
+        }
+        printf("\nWrote %zu frames to %s\n", frames.size(), csvPath);
+    }
+    return 0;
+}
@@ -0,0 +1,590 @@
+/*******************************************************************************
+
+Filename    :   FrameRegression.cpp
+Content     :   Host-side rendered-frame regression runner. Renders scripted
+                views through SceneRenderer on a headless EGL context, reads
+                back both eye buffers, and checks them against stored reference
+                images and CPU submit / GL call baselines. Every scene is
+                rendered one pass per eye and again with instanced stereo;
+                both must match the same reference images.
+
+                Usage:
+                    frame_regression [--record] [--data-dir <dir>]
+                                     [--gate-cpu] [--cpu-tolerance <fraction>]
+                                     [--assets <package>]
+
+                References and baselines live in tools/regression and are
+                committed. A scene without a baseline or reference image
+                fails. --record writes all of them from the current build,
+                e.g. after an intended change to the output or for a new
+                scene; review the images before committing them. Only
+                --record writes to the data directory.
+
+                Every scene is measured once per round, over several
+                rounds, so a slow spell on the machine (frequency scaling,
+                another process) hits one round of each scene rather than
+                all of one scene. CPU submit time is the interquartile mean
+                of a round's frames, and a scene's is its fastest round.
+                The budget allows --cpu-tolerance over the baseline plus a
+                multiple of the larger interquartile range of the two runs,
+                so a noisy machine gets a wider margin.
+
+                GL and draw call counts always gate. CPU time over budget is
+                only reported unless --gate-cpu is given: on shared build
+                machines whole runs can land at twice the usual time, which
+                no tolerance separates from a regression. Gate on it where
+                the machine is dedicated and pinned.
+
+                --assets maps the scene geometry from a package written by
+                asset_packer instead of generating it; the images must not
+                change.
+
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "../gl/Egl.h"
+#include "../gl/ResourcePool.h"
+#include "../render/DemoScene.h"
+#include "../render/RenderGraph.h"
+#include "../render/SceneRenderer.h"
+#include "../utils/AssetPackage.h"
+#include "../utils/FrameStats.h"
+#include "../utils/JobSystem.h"
+#include "../utils/LogUtils.h"
+#include "../utils/MathUtils.h"
+
+#include <xr_linear.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#ifndef REGRESSION_DATA_DIR
+#define REGRESSION_DATA_DIR "regression"
+#endif
+
+namespace {
+    constexpr int kEyeWidth = 256;
+    constexpr int kEyeHeight = 256;
+    constexpr int kMultisamples = 4;
+    constexpr int kNumEyes = 2;
+    // Exercise the threaded binning path; results don't depend on it
+    constexpr uint32_t kWorkerThreads = 2;
+    // Demo scene animation time every frame is rendered at
+    constexpr float kSceneSeconds = 1.25f;
+
+    constexpr int kWarmupFrames = 5;
+    constexpr int kMeasuredFrames = 31;
+    constexpr int kRounds = 3;
+
+    // A pixel differs if any channel is off by more than this
+    constexpr int kChannelTolerance = 2;
+    // An eye image fails if more than this fraction of its pixels differ
+    constexpr double kMaxDifferingPixelFraction = 0.001;
+    // Absolute CPU slack so tiny baselines don't fail on timer noise
+    constexpr double kCpuSlackUs = 50.0;
+    // Interquartile ranges of CPU submit time the budget allows on top
+    constexpr double kCpuNoiseRanges = 3.0;
+    constexpr double kDefaultCpuTolerance = 0.15;
+
+    constexpr const char* kBaselineFileName = "baselines.txt";
+
+    struct RegressionScene {
+        const char* mName;
+        XrPosef mHeadPose;
+        XrFovf mFov;
+        float mIpd;
+    };
+
+    XrQuaternionf YawQuat(const float degrees) {
+        const float halfAngle = 0.5f * degrees * MATH_DEG_TO_RAD;
+        return {0.0f, std::sin(halfAngle), 0.0f, std::cos(halfAngle)};
+    }
+
+    constexpr XrFovf SymmetricFov(const float halfDegrees) {
+        return {-halfDegrees * MATH_DEG_TO_RAD, halfDegrees * MATH_DEG_TO_RAD,
+                halfDegrees * MATH_DEG_TO_RAD, -halfDegrees * MATH_DEG_TO_RAD};
+    }
+
+    std::vector<RegressionScene> BuildScenes() {
+        // Roughly what Quest-class runtimes report for the left eye
+        const XrFovf headsetFov = {-52.0f * MATH_DEG_TO_RAD, 42.0f * MATH_DEG_TO_RAD,
+                                   41.0f * MATH_DEG_TO_RAD, -53.0f * MATH_DEG_TO_RAD};
+        return {
+                {"centered", MathUtils::Posef::Identity(), SymmetricFov(45.0f), 0.064f},
+                {"headset_fov", MathUtils::Posef::Identity(), headsetFov, 0.064f},
+                {"head_offset", {MathUtils::kIdentityQuat, {0.2f, 0.1f, 0.3f}},
+                 SymmetricFov(45.0f), 0.064f},
+                {"head_yaw", {YawQuat(20.0f), {0.0f, 0.0f, 0.0f}}, headsetFov, 0.064f},
+                {"close_up", {MathUtils::kIdentityQuat, {0.0f, 0.0f, -1.4f}},
+                 SymmetricFov(45.0f), 0.064f},
+        };
+    }
+
+    XrPosef EyePose(const RegressionScene& scene, const int eye) {
+        const XrVector3f eyeOffset = {(eye == 0 ? -0.5f : 0.5f) * scene.mIpd, 0.0f, 0.0f};
+        XrPosef pose = scene.mHeadPose;
+        XrPosef_TransformVector3f(&pose.position, &scene.mHeadPose, &eyeOffset);
+        return pose;
+    }
+
+    // Stand-in for an eye swapchain image: a single-sampled texture the render
+    // graph resolves into, plus an FBO to read it back. Double-wide for
+    // instanced stereo.
+    struct EyeTarget {
+        GLuint mColorTexture = 0;
+        GLuint mReadFbo = 0;
+        int mWidth = 0;
+
+        bool Create(const int width) {
+            mWidth = width;
+            glGenTextures(1, &mColorTexture);
+            glBindTexture(GL_TEXTURE_2D, mColorTexture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, kEyeHeight);
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            glGenFramebuffers(1, &mReadFbo);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, mReadFbo);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                                   mColorTexture, 0);
+            const bool complete =
+                    glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            return complete;
+        }
+
+        void Destroy() {
+            glDeleteFramebuffers(1, &mReadFbo);
+            glDeleteTextures(1, &mColorTexture);
+        }
+
+        // Returns one eye's columns, from @p x, as tightly packed RGB8, top row first
+        std::vector<uint8_t> ReadRgb(const int x = 0) const {
+            std::vector<uint8_t> rgba(kEyeWidth * kEyeHeight * 4);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, mReadFbo);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(x, 0, kEyeWidth, kEyeHeight, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+            std::vector<uint8_t> rgb(kEyeWidth * kEyeHeight * 3);
+            for (int y = 0; y < kEyeHeight; y++) {
+                const uint8_t* src = &rgba[(kEyeHeight - 1 - y) * kEyeWidth * 4];
+                uint8_t* dst = &rgb[y * kEyeWidth * 3];
+                for (int x = 0; x < kEyeWidth; x++) {
+                    dst[x * 3 + 0] = src[x * 4 + 0];
+                    dst[x * 3 + 1] = src[x * 4 + 1];
+                    dst[x * 3 + 2] = src[x * 4 + 2];
+                }
+            }
+            return rgb;
+        }
+    };
+
+    uint64_t HashPixels(const std::vector<uint8_t>& pixels) {
+        // FNV-1a
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (const uint8_t b : pixels) {
+            hash ^= b;
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    bool WritePpm(const std::string& path, const std::vector<uint8_t>& rgb) {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (f == nullptr) {
+            ALOGE("Could not open %s for writing", path.c_str());
+            return false;
+        }
+        fprintf(f, "P6\n%d %d\n255\n", kEyeWidth, kEyeHeight);
+        const bool ok = fwrite(rgb.data(), 1, rgb.size(), f) == rgb.size();
+        fclose(f);
+        return ok;
+    }
+
+    bool ReadPpm(const std::string& path, std::vector<uint8_t>& rgb) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (f == nullptr) {
+            return false;
+        }
+        int width = 0;
+        int height = 0;
+        int maxValue = 0;
+        const bool headerOk = fscanf(f, "P6 %d %d %d", &width, &height, &maxValue) == 3 &&
+                              fgetc(f) != EOF;
+        if (!headerOk || width != kEyeWidth || height != kEyeHeight || maxValue != 255) {
+            ALOGE("%s: unexpected PPM header (%dx%d, max %d)", path.c_str(), width, height,
+                  maxValue);
+            fclose(f);
+            return false;
+        }
+        rgb.resize(static_cast<size_t>(width) * height * 3);
+        const bool ok = fread(rgb.data(), 1, rgb.size(), f) == rgb.size();
+        fclose(f);
+        return ok;
+    }
+
+    // Fraction of pixels where any channel differs by more than kChannelTolerance
+    double DifferingPixelFraction(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+        if (a.size() != b.size() || a.empty()) {
+            return 1.0;
+        }
+        size_t differing = 0;
+        for (size_t i = 0; i < a.size(); i += 3) {
+            for (size_t c = 0; c < 3; c++) {
+                if (std::abs(static_cast<int>(a[i + c]) - static_cast<int>(b[i + c])) >
+                    kChannelTolerance) {
+                    differing++;
+                    break;
+                }
+            }
+        }
+        return static_cast<double>(differing) / static_cast<double>(a.size() / 3);
+    }
+
+    struct Baseline {
+        double mCpuSubmitUs = 0.0;
+        // Interquartile range of the frames mCpuSubmitUs came from
+        double mCpuNoiseUs = 0.0;
+        uint32_t mGlCalls = 0;
+        uint32_t mDrawCalls = 0;
+        uint64_t mHashes[kNumEyes] = {};
+    };
+
+    std::map<std::string, Baseline> ReadBaselines(const std::string& path) {
+        std::map<std::string, Baseline> baselines;
+        FILE* f = fopen(path.c_str(), "r");
+        if (f == nullptr) {
+            return baselines;
+        }
+        char line[512];
+        while (fgets(line, sizeof(line), f) != nullptr) {
+            if (line[0] == '#') { continue; }
+            char name[128];
+            Baseline b;
+            unsigned long long hash0 = 0;
+            unsigned long long hash1 = 0;
+            if (sscanf(line, "%127s %lf %lf %u %u %llx %llx", name, &b.mCpuSubmitUs,
+                       &b.mCpuNoiseUs, &b.mGlCalls, &b.mDrawCalls, &hash0, &hash1) == 7) {
+                b.mHashes[0] = hash0;
+                b.mHashes[1] = hash1;
+                baselines[name] = b;
+            }
+        }
+        fclose(f);
+        return baselines;
+    }
+
+    bool WriteBaselines(const std::string& path, const std::map<std::string, Baseline>& baselines) {
+        FILE* f = fopen(path.c_str(), "w");
+        if (f == nullptr) {
+            ALOGE("Could not open %s for writing", path.c_str());
+            return false;
+        }
+        fprintf(f, "# scene cpu_submit_us cpu_noise_us gl_calls draw_calls hash_left "
+                   "hash_right\n");
+        for (const auto& [name, b] : baselines) {
+            fprintf(f, "%s %.1f %.1f %u %u %016llx %016llx\n", name.c_str(), b.mCpuSubmitUs,
+                    b.mCpuNoiseUs, b.mGlCalls, b.mDrawCalls,
+                    static_cast<unsigned long long>(b.mHashes[0]),
+                    static_cast<unsigned long long>(b.mHashes[1]));
+        }
+        fclose(f);
+        return true;
+    }
+
+    struct SceneResult {
+        Baseline mMeasured;
+        std::vector<uint8_t> mImages[kNumEyes];
+    };
+
+    SceneResult RunScene(SceneRenderer& renderer, RenderGraph& graph, GpuResourcePool& pool,
+                         const std::array<EyeTarget, kNumEyes>& targets,
+                         const EyeTarget& stereoTarget, const RegressionScene& scene,
+                         const bool instancedStereo) {
+        SceneResult result;
+        std::vector<double> submitUs;
+        FrameStats stats;
+        const std::array<XrPosef, kNumEyes> eyePoses = {EyePose(scene, 0), EyePose(scene, 1)};
+        const std::array<XrFovf, kNumEyes> eyeFovs = {scene.mFov, scene.mFov};
+
+        // The graph VrApp builds, into offscreen targets
+        std::array<SceneRenderer::EyeTarget, kNumEyes> eyeTargets;
+        for (int eye = 0; eye < kNumEyes; eye++) {
+            const EyeTarget& target = instancedStereo ? stereoTarget : targets[eye];
+            eyeTargets[eye] = {target.mColorTexture, target.mWidth, kEyeHeight};
+        }
+        SceneRenderer::EyePassConfig passConfig;
+        passConfig.mColorFormat = GL_RGBA8;
+        passConfig.mMultisamples = kMultisamples;
+        passConfig.mInstancedStereo = instancedStereo;
+
+        for (int frame = 0; frame < kWarmupFrames + kMeasuredFrames; frame++) {
+            stats.Reset(static_cast<uint64_t>(frame));
+            pool.BeginFrame();
+            renderer.BeginFrame(eyePoses, eyeFovs, {kEyeWidth, kEyeHeight}, stats);
+            renderer.AddEyePasses(graph, eyePoses, eyeFovs, eyeTargets, passConfig, stats);
+            graph.Execute(stats);
+            renderer.EndFrame();
+            pool.EndFrame();
+            // Keep the GPU from queueing up frames so CPU timings stay comparable
+            glFinish();
+            if (frame >= kWarmupFrames) {
+                submitUs.push_back(static_cast<double>(stats.mCpuSubmitNs) / 1000.0);
+            }
+        }
+
+        // Scheduler hiccups only ever add time; the middle half ignores them
+        // without leaning on a single best-case frame
+        std::sort(submitUs.begin(), submitUs.end());
+        const size_t lower = submitUs.size() / 4;
+        const size_t upper = submitUs.size() - lower;
+        double middleSum = 0.0;
+        for (size_t i = lower; i < upper; i++) {
+            middleSum += submitUs[i];
+        }
+        result.mMeasured.mCpuSubmitUs = middleSum / static_cast<double>(upper - lower);
+        result.mMeasured.mCpuNoiseUs = submitUs[upper - 1] - submitUs[lower];
+        result.mMeasured.mGlCalls = stats.mGlCalls;
+        result.mMeasured.mDrawCalls = stats.mDrawCalls;
+
+        for (int eye = 0; eye < kNumEyes; eye++) {
+            result.mImages[eye] = instancedStereo ? stereoTarget.ReadRgb(eye * kEyeWidth)
+                                                  : targets[eye].ReadRgb();
+            result.mMeasured.mHashes[eye] = HashPixels(result.mImages[eye]);
+        }
+        return result;
+    }
+
+    void PrintUsage(const char* argv0) {
+        fprintf(stderr, "Usage: %s [--record] [--data-dir <dir>] [--gate-cpu]"
+                        " [--cpu-tolerance <fraction>]"
+                        " [--assets <package>]\n", argv0);
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    bool record = false;
+    std::string dataDir = REGRESSION_DATA_DIR;
+    bool gateCpu = false;
+    double cpuTolerance = kDefaultCpuTolerance;
+    const char* assetPath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0) {
+            record = true;
+        } else if (strcmp(argv[i], "--data-dir") == 0 && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "--gate-cpu") == 0) {
+            gateCpu = true;
+        } else if (strcmp(argv[i], "--cpu-tolerance") == 0 && i + 1 < argc) {
+            cpuTolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            assetPath = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    EglContext egl(EglContext::Platform::HEADLESS);
+    if (!egl.IsValid()) {
+        ALOGE("Could not create a headless EGL context");
+        return 2;
+    }
+    printf("Renderer: %s\n", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+
+    AssetPackage assets;
+    if (assetPath != nullptr && !assets.Open(assetPath)) {
+        return 2;
+    }
+
+    JobSystem jobs(kWorkerThreads);
+    ShaderManager shaders;
+    shaders.Init(GL_RGBA8, kMultisamples);
+    SceneRenderer renderer;
+    renderer.Init(shaders, &jobs, true, assets.IsOpen() ? &assets : nullptr);
+    DemoScene demoScene;
+    demoScene.Populate(renderer);
+    demoScene.Update(renderer, kSceneSeconds);
+    // Scenes must render fully from the first measured frame
+    shaders.WaitAll();
+
+    GpuResourcePool pool;
+    RenderGraph graph(pool);
+
+    std::array<EyeTarget, kNumEyes> targets;
+    for (auto& target : targets) {
+        if (!target.Create(kEyeWidth)) {
+            ALOGE("Could not create offscreen eye target");
+            return 2;
+        }
+    }
+    EyeTarget stereoTarget;
+    if (!stereoTarget.Create(kEyeWidth * kNumEyes)) {
+        ALOGE("Could not create offscreen stereo target");
+        return 2;
+    }
+
+    if (record) {
+        mkdir(dataDir.c_str(), 0755);
+    }
+
+    const std::string baselinePath = dataDir + "/" + kBaselineFileName;
+    std::map<std::string, Baseline> baselines = ReadBaselines(baselinePath);
+    int failures = 0;
+
+    // Per scene, then per-eye passes before instanced stereo; the fastest round's timing
+    const std::vector<RegressionScene> scenes = BuildScenes();
+    std::vector<SceneResult> results(scenes.size() * 2);
+    for (int round = 0; round < kRounds; round++) {
+        for (size_t i = 0; i < results.size(); i++) {
+            SceneResult result = RunScene(renderer, graph, pool, targets, stereoTarget,
+                                          scenes[i / 2], i % 2 != 0);
+            if (round == 0 || result.mMeasured.mCpuSubmitUs < results[i].mMeasured.mCpuSubmitUs) {
+                results[i] = std::move(result);
+            }
+        }
+    }
+
+    printf("\n%-22s %-5s %-10s %10s %10s %6s %6s  %s\n", "scene", "eye", "image", "cpu(us)",
+           "base(us)", "gl", "base", "result");
+    for (size_t sceneIndex = 0; sceneIndex < scenes.size(); sceneIndex++) {
+        const RegressionScene& scene = scenes[sceneIndex];
+        for (const bool instancedStereo : {false, true}) {
+            // Instanced stereo has its own baseline but the same reference images
+            const std::string name =
+                    std::string(scene.mName) + (instancedStereo ? "_instanced" : "");
+            const SceneResult& result = results[sceneIndex * 2 + (instancedStereo ? 1 : 0)];
+            const Baseline& measured = result.mMeasured;
+
+            if (record) {
+                for (int eye = 0; eye < kNumEyes && !instancedStereo; eye++) {
+                    const std::string path = dataDir + "/" + scene.mName + (eye == 0 ? "_left" : "_right") + ".ppm";
+                    if (!WritePpm(path, result.mImages[eye])) {
+                        failures++;
+                    }
+                }
+                baselines[name] = measured;
+                printf("%-22s %-5s %-10s %10.1f %10s %6u %6s  recorded\n", name.c_str(), "both",
+                       "-", measured.mCpuSubmitUs, "-", measured.mGlCalls, "-");
+                continue;
+            }
+
+            // Nothing to check against is a failure, not a pass
+            const auto it = baselines.find(name);
+            const bool hasBaseline = it != baselines.end();
+            const Baseline expected = hasBaseline ? it->second : Baseline();
+
+            for (int eye = 0; eye < kNumEyes; eye++) {
+                const char* eyeName = (eye == 0) ? "left" : "right";
+                char imageResult[32];
+                bool imageOk = true;
+                std::vector<uint8_t> reference;
+                const std::string path = dataDir + "/" + scene.mName + "_" + eyeName + ".ppm";
+                // Instanced stereo is checked against the per-eye passes' images
+                if (hasBaseline && measured.mHashes[eye] == expected.mHashes[eye]) {
+                    snprintf(imageResult, sizeof(imageResult), "exact");
+                } else if (!ReadPpm(path, reference)) {
+                    imageOk = false;
+                    snprintf(imageResult, sizeof(imageResult), "missing");
+                } else {
+                    const double diff = DifferingPixelFraction(result.mImages[eye], reference);
+                    snprintf(imageResult, sizeof(imageResult), "%.3f%%", diff * 100.0);
+                    imageOk = diff <= kMaxDifferingPixelFraction;
+                }
+
+                // Submission cost is per frame, so only check it once per scene
+                bool budgetOk = hasBaseline;
+                bool cpuOk = true;
+                if (eye == 0 && hasBaseline) {
+                    const double noiseUs = std::max(expected.mCpuNoiseUs, measured.mCpuNoiseUs);
+                    const double cpuBudgetUs = expected.mCpuSubmitUs * (1.0 + cpuTolerance) +
+                                               kCpuNoiseRanges * noiseUs + kCpuSlackUs;
+                    cpuOk = measured.mCpuSubmitUs <= cpuBudgetUs;
+                    budgetOk = (cpuOk || !gateCpu) && measured.mGlCalls <= expected.mGlCalls &&
+                               measured.mDrawCalls <= expected.mDrawCalls;
+                }
+
+                const bool ok = imageOk && budgetOk;
+                failures += ok ? 0 : 1;
+                printf("%-22s %-5s %-10s %10.1f %10.1f %6u %6u  %s%s%s%s\n", name.c_str(),
+                       eyeName, imageResult, measured.mCpuSubmitUs, expected.mCpuSubmitUs,
+                       measured.mGlCalls, expected.mGlCalls, ok ? "ok" : "FAIL",
+                       imageOk ? "" : " (image)",
+                       !hasBaseline ? " (no baseline; run with --record)"
+                                    : budgetOk ? "" : " (budget)",
+                       !cpuOk && budgetOk ? " (cpu over budget, not gated)" : "");
+            }
+        }
+    }
+
+    if (record) {
+        if (WriteBaselines(baselinePath, baselines)) {
+            printf("\nWrote %s; review the reference images before committing them\n",
+                   baselinePath.c_str());
+        } else {
+            failures++;
+        }
+    }
+
+    // Last frame's graph shape; the same for every scene
+    const RenderGraph::Stats& graphStats = graph.GetStats();
+    printf("\nRender graph: %u passes (%u culled), %u clears, %u invalidates, "
+           "transients %llu KiB in %llu KiB of storage\n",
+           graphStats.mPassesExecuted, graphStats.mPassesCulled, graphStats.mClears,
+           graphStats.mInvalidates,
+           static_cast<unsigned long long>(graphStats.mTransientBytes / 1024),
+           static_cast<unsigned long long>(graphStats.mPhysicalBytes / 1024));
+
+    const ClusteredLighting::Stats& lightStats = renderer.GetLightingStats();
+    printf("Clustered lighting: %u lights, %u list entries, longest list %u, "
+           "%u overflowing clusters, binned in %.1f us\n",
+           lightStats.mLightCount, lightStats.mLightIndices, lightStats.mMaxClusterLights,
+           lightStats.mOverflowClusters, static_cast<double>(lightStats.mBinNs) / 1000.0);
+
+    const ShadowAtlas::Stats& shadowStats = renderer.GetShadowStats();
+    printf("Shadow atlas: %u visible tiles, %u resident, %u rendered last frame, "
+           "%u dynamic casters\n",
+           shadowStats.mVisibleTiles, shadowStats.mResidentTiles, shadowStats.mTilesRendered,
+           shadowStats.mDynamicCasters);
+
+    const OcclusionCuller::Stats& occlusionStats = renderer.GetOcclusionStats();
+    printf("Occlusion culling: %u of %u objects culled, %u occluder triangles, "
+           "rasterized in %.1f us, tested in %.1f us\n",
+           occlusionStats.mOccludeesCulled, occlusionStats.mOccludeesTested,
+           occlusionStats.mTrianglesBinned, static_cast<double>(occlusionStats.mRasterNs) / 1000.0,
+           static_cast<double>(occlusionStats.mTestNs) / 1000.0);
+
+    const LodSelector::Stats& lodStats = renderer.GetLodStats();
+    printf("Level of detail: %u objects drawing %u triangles, per level", lodStats.mObjects,
+           lodStats.mTriangles);
+    for (const uint32_t count : lodStats.mObjectsPerLevel) {
+        printf(" %u", count);
+    }
+    printf(", %u level changes last frame\n", lodStats.mLevelChanges);
+
+    for (auto& target : targets) {
+        target.Destroy();
+    }
+    stereoTarget.Destroy();
+    graph.Shutdown();
+    pool.Shutdown();
+    renderer.Shutdown();
+    shaders.Shutdown();
+
+    printf("\n%s: %d failure(s)\n", failures == 0 ? "PASSED" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,566 @@
+/*******************************************************************************
+
+Filename    :   SceneStressBench.cpp
+Content     :   Host-side scaling benchmark for SceneRenderer. Generates
+                parametric scenes, sweeps their parameters one at a time
+                around a base scene on a headless EGL context, and reports
+                CPU preparation and submit time, GL call and draw counts,
+                triangles and, where GL_EXT_disjoint_timer_query is
+                available, GPU time for each.
+
+                Usage:
+                    scene_stress_bench [--sweep <axis>=<v>[,<v>...]]...
+                                       [--base <axis>=<v>]... [--frames <n>]
+                                       [--eye-size <pixels>] [--instanced]
+                                       [--out <report.csv>]
+
+                Axes:
+                    objects    objects in the scene
+                    density    share of objects drawn as spheres, the only
+                               mesh with fine detail levels (0-1)
+                    overdraw   layers of objects that each cover the view,
+                               drawn back to front so every layer shades.
+                               Objects draw at their coarsest detail level
+                               here, so the eye passes' triangles stay fixed
+                               and rows differ in fill. Shadow tile updates
+                               still catch more casters as objects grow.
+
+                SceneRenderer keeps every builtin mesh in one vertex array
+                and an object's albedo in its own uniform range, so mesh
+                and material variety change no GL state and have no axis.
+
+                Without --sweep, every axis is swept over its defaults.
+                Each sweep row also reports the marginal CPU submit cost of
+                the draws it adds over the row before. Rows where that
+                climbs past KNEE_FACTOR times the sweep's cheapest are
+                flagged: per-draw cost is no longer flat there, which is
+                where batching or instancing starts to pay.
+
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "../gl/Egl.h"
+#include "../gl/ResourcePool.h"
+#include "../render/RenderGraph.h"
+#include "../render/SceneRenderer.h"
+#include "../utils/FrameStats.h"
+#include "../utils/JobSystem.h"
+#include "../utils/LogUtils.h"
+#include "../utils/MathUtils.h"
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+
+#include <xr_linear.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr int kDefaultEyeSize = 512;
+    constexpr int kMultisamples = 4;
+    constexpr int kNumEyes = 2;
+    constexpr uint32_t kWorkerThreads = 2;
+    constexpr int kWarmupFrames = 5;
+    constexpr int kDefaultMeasuredFrames = 21;
+
+    constexpr float kHalfFovDegrees = 45.0f;
+    constexpr float kHalfIpd = 0.032f;
+    // Layers recede along -Z from here, each sized to cover the view
+    constexpr float kNearestLayer = 2.0f;
+    constexpr float kLayerSpacing = 0.5f;
+    // Object size as a share of its grid cell
+    constexpr float kFill = 0.9f;
+    constexpr uint32_t kLightCount = 16;
+
+    // Flag a sweep row once its added draws cost this much more CPU each
+    // than the sweep's cheapest added draws
+    constexpr double KNEE_FACTOR = 1.5;
+
+    struct StressConfig {
+        uint32_t mObjects = 256;
+        float mDensity = 0.25f;
+        uint32_t mOverdraw = 1;
+    };
+
+    enum class Axis : uint8_t {
+        OBJECTS,
+        DENSITY,
+        OVERDRAW,
+        COUNT
+    };
+    constexpr size_t kAxisCount = static_cast<size_t>(Axis::COUNT);
+    constexpr const char* kAxisNames[kAxisCount] = {"objects", "density", "overdraw"};
+
+    struct Sweep {
+        Axis mAxis;
+        std::vector<double> mValues;
+    };
+
+    std::vector<Sweep> DefaultSweeps() {
+        return {
+                {Axis::OBJECTS, {16, 64, 256, 1024, 4096}},
+                {Axis::DENSITY, {0.0, 0.25, 0.5, 1.0}},
+                {Axis::OVERDRAW, {1, 2, 4, 8}},
+        };
+    }
+
+    bool FindAxis(const std::string& name, Axis& axis) {
+        for (size_t i = 0; i < kAxisCount; i++) {
+            if (name == kAxisNames[i]) {
+                axis = static_cast<Axis>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void SetAxis(StressConfig& config, const Axis axis, const double value) {
+        switch (axis) {
+            case Axis::OBJECTS:
+                config.mObjects = std::max(1u, static_cast<uint32_t>(value));
+                break;
+            case Axis::DENSITY:
+                config.mDensity = std::clamp(static_cast<float>(value), 0.0f, 1.0f);
+                break;
+            case Axis::OVERDRAW:
+                config.mOverdraw = std::max(1u, static_cast<uint32_t>(value));
+                break;
+            case Axis::COUNT:
+                break;
+        }
+    }
+
+    // "axis=v[,v...]"
+    bool ParseAssignment(const char* text, Axis& axis, std::vector<double>& values) {
+        const char* equals = strchr(text, '=');
+        if (equals == nullptr || !FindAxis(std::string(text, equals), axis)) {
+            return false;
+        }
+        values.clear();
+        for (const char* value = equals + 1; *value != '\0';) {
+            char* end = nullptr;
+            values.push_back(strtod(value, &end));
+            if (end == value || (*end != ',' && *end != '\0')) {
+                return false;
+            }
+            value = *end == ',' ? end + 1 : end;
+        }
+        return !values.empty();
+    }
+
+    SceneMesh PickMesh(const StressConfig& config, const uint32_t index) {
+        // Spread the spheres evenly through the scene
+        const auto spheresBefore = static_cast<uint32_t>(static_cast<float>(index) *
+                                                         config.mDensity);
+        const auto spheresAfter = static_cast<uint32_t>(static_cast<float>(index + 1) *
+                                                        config.mDensity);
+        if (spheresAfter > spheresBefore) {
+            return SceneMesh::SPHERE;
+        }
+        return SceneMesh::CUBE;
+    }
+
+    XrVector3f Albedo(const uint32_t index) {
+        // Golden-ratio hue steps keep neighbouring colors apart
+        const float hue = std::fmod(static_cast<float>(index) * 0.618034f, 1.0f) * 2.0f *
+                          MATH_PI;
+        return {0.55f + 0.4f * std::cos(hue), 0.55f + 0.4f * std::cos(hue - 2.094f),
+                0.55f + 0.4f * std::cos(hue + 2.094f)};
+    }
+
+    /**
+     * Fill @p renderer with @p config's scene: a grid per layer, each layer
+     * covering the view, farthest layer first.
+     */
+    void PopulateStressScene(SceneRenderer& renderer, const StressConfig& config) {
+        const uint32_t layers = std::min(config.mOverdraw, config.mObjects);
+        const uint32_t perLayer = (config.mObjects + layers - 1) / layers;
+        const auto columns = static_cast<uint32_t>(std::ceil(std::sqrt(perLayer)));
+        const uint32_t rows = (perLayer + columns - 1) / columns;
+        const float tanHalfFov = std::tan(kHalfFovDegrees * MATH_DEG_TO_RAD);
+
+        uint32_t index = 0;
+        for (uint32_t layer = layers; layer-- > 0 && index < config.mObjects;) {
+            const float depth = kNearestLayer + static_cast<float>(layer) * kLayerSpacing;
+            const float halfExtent = depth * tanHalfFov;
+            const float cellWidth = 2.0f * halfExtent / static_cast<float>(columns);
+            const float cellHeight = 2.0f * halfExtent / static_cast<float>(rows);
+            const float size = kFill * std::min(cellWidth, cellHeight);
+            for (uint32_t cell = 0; cell < perLayer && index < config.mObjects; cell++, index++) {
+                SceneObject object;
+                object.mMesh = PickMesh(config, index);
+                object.mPose.position = {
+                        -halfExtent + (static_cast<float>(cell % columns) + 0.5f) * cellWidth,
+                        -halfExtent + (static_cast<float>(cell / columns) + 0.5f) * cellHeight,
+                        -depth};
+                object.mScale = {size, size, size};
+                object.mAlbedo = Albedo(index);
+                renderer.AddObject(object);
+            }
+        }
+
+        std::array<PointLight, kLightCount> lights = {};
+        for (uint32_t i = 0; i < kLightCount; i++) {
+            const float angle = static_cast<float>(i) * 2.0f * MATH_PI /
+                                static_cast<float>(kLightCount);
+            lights[i] = {{1.2f * std::cos(angle), 1.2f * std::sin(angle), -kNearestLayer + 0.3f},
+                         1.5f, Albedo(i)};
+        }
+        renderer.SetLights(lights.data(), kLightCount);
+        renderer.SetSun(MathUtils::Normalized({-0.4f, 0.6f, 1.0f}), {0.8f, 0.75f, 0.7f});
+    }
+
+    // GL_EXT_disjoint_timer_query around each frame's graph execution
+    class GpuTimer {
+    public:
+        bool Init() {
+            const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+            if (extensions == nullptr ||
+                strstr(extensions, "GL_EXT_disjoint_timer_query") == nullptr) {
+                return false;
+            }
+            mGenQueries = reinterpret_cast<PFNGLGENQUERIESEXTPROC>(
+                    eglGetProcAddress("glGenQueriesEXT"));
+            mDeleteQueries = reinterpret_cast<PFNGLDELETEQUERIESEXTPROC>(
+                    eglGetProcAddress("glDeleteQueriesEXT"));
+            mBeginQuery = reinterpret_cast<PFNGLBEGINQUERYEXTPROC>(
+                    eglGetProcAddress("glBeginQueryEXT"));
+            mEndQuery = reinterpret_cast<PFNGLENDQUERYEXTPROC>(
+                    eglGetProcAddress("glEndQueryEXT"));
+            mGetQueryObjectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(
+                    eglGetProcAddress("glGetQueryObjectui64vEXT"));
+            if (mGenQueries == nullptr || mDeleteQueries == nullptr || mBeginQuery == nullptr ||
+                mEndQuery == nullptr || mGetQueryObjectui64v == nullptr) {
+                return false;
+            }
+            mGenQueries(1, &mQuery);
+            return true;
+        }
+
+        void Shutdown() {
+            if (mQuery != 0) {
+                mDeleteQueries(1, &mQuery);
+                mQuery = 0;
+            }
+        }
+
+        bool IsAvailable() const { return mQuery != 0; }
+        void Begin() const { mBeginQuery(GL_TIME_ELAPSED_EXT, mQuery); }
+        void End() const { mEndQuery(GL_TIME_ELAPSED_EXT); }
+
+        // After a glFinish(); false if the GPU was disjoint meanwhile
+        bool Read(int64_t& ns) const {
+            GLint disjoint = 0;
+            glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+            GLuint64 elapsed = 0;
+            mGetQueryObjectui64v(mQuery, GL_QUERY_RESULT_EXT, &elapsed);
+            ns = static_cast<int64_t>(elapsed);
+            return disjoint == 0;
+        }
+
+    private:
+        PFNGLGENQUERIESEXTPROC mGenQueries = nullptr;
+        PFNGLDELETEQUERIESEXTPROC mDeleteQueries = nullptr;
+        PFNGLBEGINQUERYEXTPROC mBeginQuery = nullptr;
+        PFNGLENDQUERYEXTPROC mEndQuery = nullptr;
+        PFNGLGETQUERYOBJECTUI64VEXTPROC mGetQueryObjectui64v = nullptr;
+        GLuint mQuery = 0;
+    };
+
+    // Stand-in for the eye swapchain images the render graph resolves into
+    struct EyeTargets {
+        std::array<GLuint, kNumEyes> mTextures = {};
+        GLuint mStereoTexture = 0;
+
+        void Create(const int eyeSize) {
+            glGenTextures(kNumEyes, mTextures.data());
+            for (const GLuint texture : mTextures) {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, eyeSize, eyeSize);
+            }
+            glGenTextures(1, &mStereoTexture);
+            glBindTexture(GL_TEXTURE_2D, mStereoTexture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, eyeSize * kNumEyes, eyeSize);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        void Destroy() {
+            glDeleteTextures(kNumEyes, mTextures.data());
+            glDeleteTextures(1, &mStereoTexture);
+        }
+    };
+
+    struct BenchContext {
+        ShaderManager& mShaders;
+        JobSystem& mJobs;
+        GpuResourcePool& mPool;
+        RenderGraph& mGraph;
+        const EyeTargets& mTargets;
+        GpuTimer& mGpuTimer;
+        int mEyeSize;
+        int mMeasuredFrames;
+        bool mInstancedStereo;
+    };
+
+    struct Result {
+        StressConfig mConfig;
+        double mPrepareUs = 0.0;  // SceneRenderer::BeginFrame(): LOD, lights, shadows, culling
+        double mSubmitUs = 0.0;
+        double mGpuUs = -1.0;     // -1 without a timer query
+        uint32_t mGlCalls = 0;
+        uint32_t mDrawCalls = 0;
+        uint32_t mTriangles = 0;
+
+        double GetSubmitUsPerDraw() const {
+            return mDrawCalls > 0 ? mSubmitUs / mDrawCalls : 0.0;
+        }
+        // GL calls that aren't draws, per draw: binds, uniform ranges, state
+        double GetStateCallsPerDraw() const {
+            return mDrawCalls > 0 ? static_cast<double>(mGlCalls - mDrawCalls) / mDrawCalls : 0.0;
+        }
+    };
+
+    double Median(std::vector<double>& values) {
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    }
+
+    // @p pinLod draws every object at its coarsest detail level
+    Result RunConfig(const BenchContext& context, const StressConfig& config, const bool pinLod) {
+        using Clock = std::chrono::steady_clock;
+
+        // SceneRenderer can't remove objects, so every config starts afresh
+        auto renderer = std::make_unique<SceneRenderer>();
+        renderer->Init(context.mShaders, &context.mJobs, context.mInstancedStereo);
+        PopulateStressScene(*renderer, config);
+        if (pinLod) {
+            renderer->SetForcedLod(LodSelector::MAX_LEVELS - 1);
+        }
+        context.mShaders.WaitAll();
+
+        const XrFovf fov = {-kHalfFovDegrees * MATH_DEG_TO_RAD, kHalfFovDegrees * MATH_DEG_TO_RAD,
+                            kHalfFovDegrees * MATH_DEG_TO_RAD, -kHalfFovDegrees * MATH_DEG_TO_RAD};
+        const std::array<XrPosef, kNumEyes> eyePoses = {
+                XrPosef{MathUtils::kIdentityQuat, {-kHalfIpd, 0.0f, 0.0f}},
+                XrPosef{MathUtils::kIdentityQuat, {kHalfIpd, 0.0f, 0.0f}}};
+        const std::array<XrFovf, kNumEyes> eyeFovs = {fov, fov};
+        const int eyeSize = context.mEyeSize;
+
+        // The graph VrApp builds, into offscreen stand-ins for its swapchains
+        std::array<SceneRenderer::EyeTarget, kNumEyes> eyeTargets;
+        for (int eye = 0; eye < kNumEyes; eye++) {
+            eyeTargets[eye] = context.mInstancedStereo
+                    ? SceneRenderer::EyeTarget{context.mTargets.mStereoTexture,
+                                               eyeSize * kNumEyes, eyeSize}
+                    : SceneRenderer::EyeTarget{context.mTargets.mTextures[eye], eyeSize, eyeSize};
+        }
+        SceneRenderer::EyePassConfig passConfig;
+        passConfig.mColorFormat = GL_RGBA8;
+        passConfig.mMultisamples = kMultisamples;
+        passConfig.mInstancedStereo = context.mInstancedStereo;
+
+        Result result;
+        result.mConfig = config;
+        std::vector<double> prepareUs;
+        std::vector<double> submitUs;
+        std::vector<double> gpuUs;
+        FrameStats stats;
+        for (int frame = 0; frame < kWarmupFrames + context.mMeasuredFrames; frame++) {
+            stats.Reset(static_cast<uint64_t>(frame));
+            context.mPool.BeginFrame();
+            const Clock::time_point prepareStart = Clock::now();
+            renderer->BeginFrame(eyePoses, eyeFovs, {eyeSize, eyeSize}, stats);
+            const Clock::time_point prepareEnd = Clock::now();
+
+            RenderGraph& graph = context.mGraph;
+            renderer->AddEyePasses(graph, eyePoses, eyeFovs, eyeTargets, passConfig, stats);
+
+            if (context.mGpuTimer.IsAvailable()) {
+                context.mGpuTimer.Begin();
+            }
+            graph.Execute(stats);
+            if (context.mGpuTimer.IsAvailable()) {
+                context.mGpuTimer.End();
+            }
+            renderer->EndFrame();
+            context.mPool.EndFrame();
+            // One frame at a time, so CPU and GPU timings don't overlap
+            glFinish();
+
+            if (frame < kWarmupFrames) {
+                continue;
+            }
+            prepareUs.push_back(
+                    std::chrono::duration<double, std::micro>(prepareEnd - prepareStart).count());
+            submitUs.push_back(static_cast<double>(stats.mCpuSubmitNs) / 1000.0);
+            int64_t gpuNs = 0;
+            if (context.mGpuTimer.IsAvailable() && context.mGpuTimer.Read(gpuNs)) {
+                gpuUs.push_back(static_cast<double>(gpuNs) / 1000.0);
+            }
+        }
+
+        result.mPrepareUs = Median(prepareUs);
+        result.mSubmitUs = Median(submitUs);
+        if (!gpuUs.empty()) {
+            result.mGpuUs = Median(gpuUs);
+        }
+        result.mGlCalls = stats.mGlCalls;
+        result.mDrawCalls = stats.mDrawCalls;
+        result.mTriangles = stats.mTriangles;
+        renderer->Shutdown();
+        return result;
+    }
+
+    void PrintUsage(const char* program) {
+        fprintf(stderr,
+                "Usage: %s [--sweep <axis>=<v>[,<v>...]]... [--base <axis>=<v>]...\n"
+                "       [--frames <n>] [--eye-size <pixels>] [--instanced] [--out <report.csv>]\n"
+                "Axes: objects density overdraw\n",
+                program);
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    std::vector<Sweep> sweeps;
+    StressConfig base;
+    int measuredFrames = kDefaultMeasuredFrames;
+    int eyeSize = kDefaultEyeSize;
+    bool instancedStereo = false;
+    const char* outPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        Axis axis = Axis::COUNT;
+        std::vector<double> values;
+        if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc &&
+            ParseAssignment(argv[i + 1], axis, values)) {
+            sweeps.push_back({axis, values});
+            i++;
+        } else if (strcmp(argv[i], "--base") == 0 && i + 1 < argc &&
+                   ParseAssignment(argv[i + 1], axis, values) && values.size() == 1) {
+            SetAxis(base, axis, values[0]);
+            i++;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            measuredFrames = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--eye-size") == 0 && i + 1 < argc) {
+            eyeSize = std::max(16, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--instanced") == 0) {
+            instancedStereo = true;
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (sweeps.empty()) {
+        sweeps = DefaultSweeps();
+    }
+
+    EglContext egl(EglContext::Platform::HEADLESS);
+    if (!egl.IsValid()) {
+        ALOGE("Could not create a headless EGL context");
+        return 2;
+    }
+    printf("Renderer: %s\n", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+
+    GpuTimer gpuTimer;
+    const bool hasGpuTimer = gpuTimer.Init();
+    printf("GPU timing: %s\n", hasGpuTimer ? "GL_EXT_disjoint_timer_query"
+                                           : "unavailable, gpu_us is -1");
+    printf("Eyes: %dx%d, %dx MSAA, %s\n", eyeSize, eyeSize, kMultisamples,
+           instancedStereo ? "instanced stereo" : "one pass per eye");
+
+    JobSystem jobs(kWorkerThreads);
+    ShaderManager shaders;
+    shaders.Init(GL_RGBA8, kMultisamples);
+    GpuResourcePool pool;
+    RenderGraph graph(pool);
+    EyeTargets targets;
+    targets.Create(eyeSize);
+    const BenchContext context = {shaders, jobs, pool, graph, targets, gpuTimer, eyeSize,
+                                  measuredFrames, instancedStereo};
+
+    FILE* out = nullptr;
+    if (outPath != nullptr) {
+        out = fopen(outPath, "w");
+        if (out == nullptr) {
+            fprintf(stderr, "Could not open %s\n", outPath);
+            return 2;
+        }
+        fprintf(out, "sweep,objects,density,overdraw,prepare_us,submit_us,"
+                     "gpu_us,gl_calls,draws,triangles,submit_us_per_draw,marginal_us_per_draw,"
+                     "state_calls_per_draw,knee\n");
+    }
+
+    for (const Sweep& sweep : sweeps) {
+        const char* axisName = kAxisNames[static_cast<size_t>(sweep.mAxis)];
+        printf("\nsweep %s\n", axisName);
+        printf("%8s %7s %8s %11s %10s %10s %8s %6s %9s %8s %8s %8s\n", "objects", "density",
+               "overdraw", "prepare_us", "submit_us", "gpu_us", "gl_calls", "draws", "triangles",
+               "us/draw", "us/+draw", "state/d");
+
+        std::vector<Result> results;
+        for (const double value : sweep.mValues) {
+            StressConfig config = base;
+            SetAxis(config, sweep.mAxis, value);
+            // Layers are sized to cover the view, so objects grow on screen
+            // with overdraw; pinning their detail keeps the triangles fixed
+            results.push_back(RunConfig(context, config, sweep.mAxis == Axis::OVERDRAW));
+        }
+
+        // Submit cost of the draws each row adds over the one before; 0
+        // where the draw count didn't grow, as along most axes but objects
+        std::vector<double> marginal(results.size(), 0.0);
+        double cheapest = 0.0;
+        for (size_t i = 1; i < results.size(); i++) {
+            if (results[i].mDrawCalls <= results[i - 1].mDrawCalls) {
+                continue;
+            }
+            marginal[i] = (results[i].mSubmitUs - results[i - 1].mSubmitUs) /
+                          (results[i].mDrawCalls - results[i - 1].mDrawCalls);
+            if (marginal[i] > 0.0 && (cheapest == 0.0 || marginal[i] < cheapest)) {
+                cheapest = marginal[i];
+            }
+        }
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& result = results[i];
+            const StressConfig& config = result.mConfig;
+            const bool knee = cheapest > 0.0 && marginal[i] > cheapest * KNEE_FACTOR;
+            printf("%8u %7.2f %8u %11.1f %10.1f %10.1f %8u %6u %9u %8.3f %8.3f %8.2f%s\n",
+                   config.mObjects, config.mDensity, config.mOverdraw, result.mPrepareUs,
+                   result.mSubmitUs, result.mGpuUs, result.mGlCalls, result.mDrawCalls,
+                   result.mTriangles, result.GetSubmitUsPerDraw(), marginal[i],
+                   result.GetStateCallsPerDraw(), knee ? "  <- knee" : "");
+            if (out != nullptr) {
+                fprintf(out, "%s,%u,%.3f,%u,%.1f,%.1f,%.1f,%u,%u,%u,%.4f,%.4f,%.3f,%d\n",
+                        axisName, config.mObjects, config.mDensity, config.mOverdraw,
+                        result.mPrepareUs, result.mSubmitUs, result.mGpuUs, result.mGlCalls,
+                        result.mDrawCalls, result.mTriangles, result.GetSubmitUsPerDraw(),
+                        marginal[i], result.GetStateCallsPerDraw(), knee ? 1 : 0);
+            }
+        }
+        fflush(stdout);
+    }
+
+    if (out != nullptr) {
+        fclose(out);
+        printf("\nWrote %s\n", outPath);
+    }
+    targets.Destroy();
+    graph.Shutdown();
+    pool.Shutdown();
+    shaders.Shutdown();
+    gpuTimer.Shutdown();
+    return 0;
+}
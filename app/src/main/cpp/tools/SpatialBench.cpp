@@ -0,0 +1,333 @@
+/*******************************************************************************
+
+Filename    :   SpatialBench.cpp
+Content     :   Host-side benchmark for AabbTree. Scatters boxes through a
+                room-sized volume and measures insert throughput, per-frame
+                update cost with a fraction of the boxes moving (and a few
+                teleporting), controller-style two-ray cast throughput, and
+                sphere and frustum query throughput.
+
+                Usage:
+                    spatial_bench [--frames <n>] [--objects <n>]
+
+                Also checks every query against a brute-force loop over all
+                boxes, and the tree's invariants after each phase.
+
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "../render/AabbTree.h"
+#include "../utils/MathUtils.h"
+
+#include <xr_linear.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using MathUtils::Bounds3f;
+
+namespace {
+    constexpr uint32_t kDefaultSizes[] = {1000, 10000, 50000};
+    constexpr float kHalfExtent = 20.0f;
+    constexpr float kHeight = 4.0f;
+    // Fraction of boxes moving each frame, and of those, teleporting
+    constexpr float kMovingFraction = 0.1f;
+    constexpr float kTeleportFraction = 0.01f;
+    constexpr float kMaxSpeed = 0.03f;  // per frame
+    constexpr uint32_t kRayBatches = 20000;
+    constexpr uint32_t kQueries = 2000;
+    constexpr float kSphereRadius = 1.0f;
+    // Brute-force checks per query type; they are O(n) each
+    constexpr uint32_t kChecks = 200;
+
+    using Clock = std::chrono::steady_clock;
+
+    double ElapsedUs(const Clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    }
+
+    // Fixed LCG so every run tests the same scene
+    struct Random {
+        uint32_t mState = 12345u;
+
+        float Next() {
+            mState = mState * 1664525u + 1013904223u;
+            return static_cast<float>(mState >> 8) / static_cast<float>(1u << 24);
+        }
+        float Range(const float lo, const float hi) { return lo + (hi - lo) * Next(); }
+        XrVector3f Point() {
+            return {Range(-kHalfExtent, kHalfExtent), Range(0.0f, kHeight),
+                    Range(-kHalfExtent, kHalfExtent)};
+        }
+        XrVector3f Direction() {
+            const float z = Range(-1.0f, 1.0f);
+            const float angle = Range(0.0f, 2.0f * MATH_PI);
+            const float r = std::sqrt(1.0f - z * z);
+            return {r * std::cos(angle), r * std::sin(angle), z};
+        }
+    };
+
+    Bounds3f BoxAt(const XrVector3f& center, const float halfSize) {
+        Bounds3f box;
+        box.Expand({center.x - halfSize, center.y - halfSize, center.z - halfSize});
+        box.Expand({center.x + halfSize, center.y + halfSize, center.z + halfSize});
+        return box;
+    }
+
+    struct Object {
+        XrVector3f mCenter;
+        XrVector3f mVelocity;
+        float mHalfSize;
+        AabbTree::ProxyId mProxy;
+    };
+
+    float RayBox(const AabbTree::Ray& ray, const Bounds3f& b) {
+        float entry = 0.0f;
+        float exit = ray.mMaxDistance;
+        const float origin[3] = {ray.mOrigin.x, ray.mOrigin.y, ray.mOrigin.z};
+        const float direction[3] = {ray.mDirection.x, ray.mDirection.y, ray.mDirection.z};
+        const float lo[3] = {b.mMin.x, b.mMin.y, b.mMin.z};
+        const float hi[3] = {b.mMax.x, b.mMax.y, b.mMax.z};
+        for (int axis = 0; axis < 3; axis++) {
+            if (std::abs(direction[axis]) < 1e-20f) {
+                if (origin[axis] < lo[axis] || origin[axis] > hi[axis]) {
+                    return -1.0f;
+                }
+                continue;
+            }
+            const float t0 = (lo[axis] - origin[axis]) / direction[axis];
+            const float t1 = (hi[axis] - origin[axis]) / direction[axis];
+            entry = std::max(entry, std::min(t0, t1));
+            exit = std::min(exit, std::max(t0, t1));
+        }
+        return entry <= exit ? entry : -1.0f;
+    }
+
+    bool SphereOverlaps(const XrVector3f& c, const float radius, const Bounds3f& b) {
+        const float dx = std::max({b.mMin.x - c.x, 0.0f, c.x - b.mMax.x});
+        const float dy = std::max({b.mMin.y - c.y, 0.0f, c.y - b.mMax.y});
+        const float dz = std::max({b.mMin.z - c.z, 0.0f, c.z - b.mMax.z});
+        return dx * dx + dy * dy + dz * dz <= radius * radius;
+    }
+
+    bool FrustumOverlaps(const AabbTree::FrustumPlanes& planes, const Bounds3f& b) {
+        for (const XrVector4f& p : planes) {
+            const float x = p.x >= 0.0f ? b.mMax.x : b.mMin.x;
+            const float y = p.y >= 0.0f ? b.mMax.y : b.mMin.y;
+            const float z = p.z >= 0.0f ? b.mMax.z : b.mMin.z;
+            if (p.x * x + (p.y * y + (p.z * z + p.w)) < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    AabbTree::FrustumPlanes MakeViewFrustum(Random& random) {
+        const XrFovf fov = {-52.0f * MATH_DEG_TO_RAD, 52.0f * MATH_DEG_TO_RAD,
+                            45.0f * MATH_DEG_TO_RAD, -45.0f * MATH_DEG_TO_RAD};
+        XrMatrix4x4f projection;
+        XrMatrix4x4f_CreateProjectionFov(&projection, GRAPHICS_OPENGL_ES, fov, 0.05f, 30.0f);
+        const float yaw = random.Range(0.0f, 2.0f * MATH_PI);
+        const XrPosef eye = {{0.0f, std::sin(0.5f * yaw), 0.0f, std::cos(0.5f * yaw)},
+                             {random.Range(-kHalfExtent, kHalfExtent), 1.6f,
+                              random.Range(-kHalfExtent, kHalfExtent)}};
+        XrMatrix4x4f eyeToScene;
+        XrMatrix4x4f_CreateFromRigidTransform(&eyeToScene, &eye);
+        XrMatrix4x4f view;
+        XrMatrix4x4f_InvertRigidBody(&view, &eyeToScene);
+        XrMatrix4x4f viewProjection;
+        XrMatrix4x4f_Multiply(&viewProjection, &projection, &view);
+        return AabbTree::MakeFrustumPlanes(viewProjection);
+    }
+
+    // Brute-force and tree results as sets; returns whether they match
+    bool SameSet(std::vector<uint32_t> a, std::vector<uint32_t> b) {
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        return a == b;
+    }
+
+    uint32_t RunSize(const uint32_t objectCount, const uint32_t frames) {
+        Random random;
+        AabbTree tree;
+        std::vector<Object> objects(objectCount);
+        for (Object& object : objects) {
+            object.mCenter = random.Point();
+            object.mVelocity = random.Direction() * random.Range(0.0f, kMaxSpeed);
+            object.mHalfSize = random.Range(0.05f, 0.25f);
+        }
+        uint32_t failures = 0;
+
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < objectCount; i++) {
+            objects[i].mProxy = tree.Insert(BoxAt(objects[i].mCenter, objects[i].mHalfSize), i);
+        }
+        const double insertUs = ElapsedUs(start);
+        failures += tree.Validate() ? 0 : 1;
+        const uint32_t builtHeight = tree.GetStats().mHeight;
+
+        // The same objects move every frame, like a scene's dynamic set
+        const uint32_t movingCount = static_cast<uint32_t>(objectCount * kMovingFraction);
+        const uint32_t teleportEvery = static_cast<uint32_t>(1.0f / kTeleportFraction);
+        tree.ResetStats();
+        start = Clock::now();
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            for (uint32_t i = 0; i < movingCount; i++) {
+                Object& object = objects[i];
+                XrVector3f displacement = object.mVelocity;
+                if (i % teleportEvery == 0 && frame == frames / 2) {
+                    displacement = random.Point() - object.mCenter;
+                }
+                object.mCenter = object.mCenter + displacement;
+                tree.Move(object.mProxy, BoxAt(object.mCenter, object.mHalfSize), displacement);
+            }
+        }
+        const double moveUs = ElapsedUs(start) / frames;
+        failures += tree.Validate() ? 0 : 1;
+        const AabbTree::Stats stats = tree.GetStats();
+
+        // Two controllers pointing from about hand height
+        std::vector<AabbTree::Ray> rays(2 * kRayBatches);
+        for (AabbTree::Ray& ray : rays) {
+            ray.mOrigin = {random.Range(-kHalfExtent, kHalfExtent), 1.2f,
+                           random.Range(-kHalfExtent, kHalfExtent)};
+            ray.mDirection = random.Direction();
+            ray.mMaxDistance = 10.0f;
+        }
+        std::vector<AabbTree::RayHit> hits(rays.size());
+        start = Clock::now();
+        for (uint32_t batch = 0; batch < kRayBatches; batch++) {
+            tree.RayCast(&rays[2 * batch], 2, &hits[2 * batch]);
+        }
+        const double rayUs = ElapsedUs(start);
+        uint32_t rayHits = 0;
+        for (const AabbTree::RayHit& hit : hits) {
+            rayHits += hit.mHit ? 1 : 0;
+        }
+
+        start = Clock::now();
+        for (uint32_t i = 0; i < kChecks; i++) {
+            float nearest = -1.0f;
+            for (const Object& object : objects) {
+                const float t = RayBox(rays[i], tree.GetBounds(object.mProxy));
+                if (t >= 0.0f && (nearest < 0.0f || t < nearest)) {
+                    nearest = t;
+                }
+            }
+            const AabbTree::RayHit& hit = hits[i];
+            if ((nearest >= 0.0f) != hit.mHit ||
+                (hit.mHit && std::abs(nearest - hit.mDistance) > 1e-4f * (1.0f + nearest))) {
+                failures++;
+            }
+        }
+        const double bruteRayUs = ElapsedUs(start) / kChecks;
+
+        std::vector<XrVector3f> centers(kQueries);
+        for (XrVector3f& center : centers) {
+            center = random.Point();
+        }
+        std::vector<uint32_t> results;
+        results.reserve(objectCount);
+        uint64_t sphereFound = 0;
+        start = Clock::now();
+        for (const XrVector3f& center : centers) {
+            results.clear();
+            sphereFound += tree.QuerySphere(center, kSphereRadius, results);
+        }
+        const double sphereUs = ElapsedUs(start) / kQueries;
+
+        std::vector<AabbTree::FrustumPlanes> frusta(kQueries);
+        for (AabbTree::FrustumPlanes& planes : frusta) {
+            planes = MakeViewFrustum(random);
+        }
+        uint64_t frustumFound = 0;
+        start = Clock::now();
+        for (const AabbTree::FrustumPlanes& planes : frusta) {
+            results.clear();
+            frustumFound += tree.QueryFrustum(planes, results);
+        }
+        const double frustumUs = ElapsedUs(start) / kQueries;
+
+        std::vector<uint32_t> expected;
+        for (uint32_t i = 0; i < kChecks; i++) {
+            results.clear();
+            expected.clear();
+            tree.QuerySphere(centers[i], kSphereRadius, results);
+            for (uint32_t id = 0; id < objectCount; id++) {
+                if (SphereOverlaps(centers[i], kSphereRadius, tree.GetBounds(objects[id].mProxy))) {
+                    expected.push_back(id);
+                }
+            }
+            failures += SameSet(results, expected) ? 0 : 1;
+
+            results.clear();
+            expected.clear();
+            tree.QueryFrustum(frusta[i], results);
+            for (uint32_t id = 0; id < objectCount; id++) {
+                if (FrustumOverlaps(frusta[i], tree.GetBounds(objects[id].mProxy))) {
+                    expected.push_back(id);
+                }
+            }
+            failures += SameSet(results, expected) ? 0 : 1;
+        }
+
+        printf("%-8u %9.2f %6u/%-3u %9.1f %7.1f %7.1f %6.1f %9.2f %7.1fx %9.1f %9.1f\n",
+               objectCount, objectCount / insertUs, builtHeight, stats.mHeight, moveUs,
+               static_cast<double>(stats.mRefits) / frames,
+               static_cast<double>(stats.mReinserts) / frames,
+               static_cast<double>(stats.mRotations) / frames, rays.size() / rayUs,
+               bruteRayUs * kRayBatches * 2 / rayUs, sphereUs, frustumUs);
+        printf("         %u of %zu rays hit; %.1f objects per sphere, %.1f per frustum\n",
+               rayHits, rays.size(), static_cast<double>(sphereFound) / kQueries,
+               static_cast<double>(frustumFound) / kQueries);
+        return failures;
+    }
+
+    void PrintUsage(const char* argv0) {
+        fprintf(stderr, "Usage: %s [--frames <n>] [--objects <n>]\n", argv0);
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    uint32_t frames = 200;
+    uint32_t objectCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = static_cast<uint32_t>(std::max(atoi(argv[++i]), 1));
+        } else if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc) {
+            objectCount = static_cast<uint32_t>(std::max(atoi(argv[++i]), 1));
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%.0f%% of objects moving per frame over %u frames, %.0f%% of those teleporting "
+           "once; %u two-ray casts, %u sphere (r=%.1f) and frustum queries\n\n",
+           100.0f * kMovingFraction, frames, 100.0f * kTeleportFraction, kRayBatches, kQueries,
+           kSphereRadius);
+    printf("%-8s %9s %10s %9s %7s %7s %6s %9s %8s %9s %9s\n", "objects", "Mins/s", "height",
+           "move(us)", "refits", "reins", "rots", "Mray/s", "vs brute", "sphere", "frustum");
+    printf("%-8s %9s %10s %9s %7s %7s %6s %9s %8s %9s %9s\n", "", "", "built/end", "/frame",
+           "/frame", "/frame", "/frame", "", "", "(us)", "(us)");
+
+    uint32_t failures = 0;
+    if (objectCount > 0) {
+        failures += RunSize(objectCount, frames);
+    } else {
+        for (const uint32_t size : kDefaultSizes) {
+            failures += RunSize(size, frames);
+        }
+    }
+    printf("\n%s: %u mismatch(es) against brute force or invariant violation(s)\n",
+           failures == 0 ? "PASSED" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
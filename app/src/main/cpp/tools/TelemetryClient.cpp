@@ -0,0 +1,430 @@
+/*******************************************************************************
+
+Filename    :   TelemetryClient.cpp
+Content     :   Host-side client for TelemetryServer. Records the live
+                JSON-lines stream to a file while printing rolling
+                sparklines, and plots recorded files as ASCII charts.
+
+                Usage:
+                    telemetry_client [--connect <name>|tcp:<port>] [--out <file.jsonl>]
+                                     [--plot <key>[,<key>...]] [--seconds <n>]
+                                     [--set <parameter>=<value>]...
+                    telemetry_client --replay <file.jsonl> [--plot <key>[,<key>...]]
+
+                <name> is an abstract socket name, or a path for a
+                filesystem socket. On a headset, start the stream with
+                    adb shell setprop debug.vrtemplate.telemetry 10
+                restart the app, then forward it and connect over TCP:
+                    adb forward tcp:7000 localabstract:vrtemplate.telemetry
+                    telemetry_client --connect tcp:7000 --out session.jsonl
+                --set changes one of the app's ParameterRegistry values
+                live, e.g. --set msaa=2; "param_*" keys show the result.
+
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr const char* kDefaultSocket = "vrtemplate.telemetry";
+    constexpr const char* kDefaultPlotKeys = "cpu_submit_ms,slack_ms,gpu_mem_kb,foveation";
+    // Samples in a live sparkline, and the replay chart's size
+    constexpr size_t kSparklineWidth = 60;
+    constexpr size_t kChartWidth = 72;
+    constexpr size_t kChartHeight = 10;
+    // Low to high
+    constexpr const char kRamp[] = " .:-=+*#%@";
+    // Fields whose changes are listed in a replay
+    constexpr const char* kEventKeys[] = {"session", "cpu_notification", "gpu_notification",
+                                          "msaa", "resolution_scale", "param_version"};
+
+    void PrintUsage(const char* program) {
+        fprintf(stderr,
+                "Usage:\n"
+                "  %s [--connect <name>|tcp:<port>] [--out <file.jsonl>]\n"
+                "      [--plot <key>[,<key>...]] [--seconds <n>] [--set <parameter>=<value>]...\n"
+                "  %s --replay <file.jsonl> [--plot <key>[,<key>...]]\n",
+                program, program);
+    }
+
+    std::vector<std::string> SplitKeys(const std::string& keys) {
+        std::vector<std::string> result;
+        size_t start = 0;
+        while (start <= keys.size()) {
+            const size_t end = std::min(keys.find(',', start), keys.size());
+            if (end > start) {
+                result.push_back(keys.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+        return result;
+    }
+
+    // Raw value text of a top-level key in a flat JSON object; the server
+    // never nests, so a search is all the parsing needed
+    bool FindValue(const std::string& line, const std::string& key, std::string& value) {
+        const std::string pattern = "\"" + key + "\":";
+        const size_t at = line.find(pattern);
+        if (at == std::string::npos) {
+            return false;
+        }
+        size_t start = at + pattern.size();
+        size_t end = start;
+        if (start < line.size() && line[start] == '"') {
+            start++;
+            end = line.find('"', start);
+        } else {
+            end = line.find_first_of(",}", start);
+        }
+        if (end == std::string::npos) {
+            return false;
+        }
+        value = line.substr(start, end - start);
+        return true;
+    }
+
+    bool FindNumber(const std::string& line, const std::string& key, double& value) {
+        std::string text;
+        if (!FindValue(line, key, text)) {
+            return false;
+        }
+        char* end = nullptr;
+        value = strtod(text.c_str(), &end);
+        return end != text.c_str();
+    }
+
+    bool IsSample(const std::string& line) {
+        std::string type;
+        return FindValue(line, "type", type) && type == "sample";
+    }
+
+    struct Summary {
+        double mMin = 0.0;
+        double mMax = 0.0;
+        double mMean = 0.0;
+        double mP99 = 0.0;
+    };
+
+    Summary Summarize(const std::vector<double>& values) {
+        Summary summary;
+        if (values.empty()) {
+            return summary;
+        }
+        std::vector<double> sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+        summary.mMin = sorted.front();
+        summary.mMax = sorted.back();
+        double sum = 0.0;
+        for (const double value : sorted) {
+            sum += value;
+        }
+        summary.mMean = sum / static_cast<double>(sorted.size());
+        summary.mP99 = sorted[std::min(sorted.size() - 1,
+                                       static_cast<size_t>(0.99 * static_cast<double>(
+                                               sorted.size())))];
+        return summary;
+    }
+
+    std::string Sparkline(const std::deque<double>& values, const double low, const double high) {
+        constexpr size_t levels = sizeof(kRamp) - 2;
+        std::string line;
+        for (const double value : values) {
+            const double t = high > low ? (value - low) / (high - low) : 0.0;
+            line += kRamp[static_cast<size_t>(std::lround(std::clamp(t, 0.0, 1.0) * levels))];
+        }
+        return line;
+    }
+
+    // One column per bucket of samples, drawn up to the bucket's maximum so
+    // single-frame spikes survive the downsampling
+    void PrintChart(const std::string& key, const std::vector<double>& values) {
+        const Summary summary = Summarize(values);
+        printf("\n%s: %zu samples, min %.3f mean %.3f p99 %.3f max %.3f\n", key.c_str(),
+               values.size(), summary.mMin, summary.mMean, summary.mP99, summary.mMax);
+        if (values.empty()) {
+            return;
+        }
+        const size_t width = std::min(kChartWidth, values.size());
+        std::vector<double> columns(width, summary.mMin);
+        for (size_t i = 0; i < values.size(); i++) {
+            double& column = columns[i * width / values.size()];
+            column = std::max(column, values[i]);
+        }
+        const double range = summary.mMax - summary.mMin;
+        for (size_t row = kChartHeight; row-- > 0;) {
+            const double threshold =
+                    summary.mMin + range * (static_cast<double>(row) + 0.5) / kChartHeight;
+            std::string line;
+            for (const double column : columns) {
+                line += (range > 0.0 ? column >= threshold : row == 0) ? '#' : ' ';
+            }
+            const double label = summary.mMin + range * static_cast<double>(row + 1) /
+                                                static_cast<double>(kChartHeight);
+            printf("%12.3f |%s\n", label, line.c_str());
+        }
+        printf("%12s +%s\n", "", std::string(width, '-').c_str());
+    }
+
+    int Replay(const char* path, const std::vector<std::string>& keys) {
+        FILE* file = fopen(path, "r");
+        if (file == nullptr) {
+            fprintf(stderr, "Could not open %s\n", path);
+            return 1;
+        }
+        std::vector<std::vector<double>> series(keys.size());
+        std::vector<std::string> lastEvents(std::size(kEventKeys));
+        size_t samples = 0;
+        double firstFrame = 0.0;
+        double lastFrame = 0.0;
+        double dropped = 0.0;
+
+        printf("events\n");
+        char buffer[8192];
+        while (fgets(buffer, sizeof(buffer), file) != nullptr) {
+            const std::string line = buffer;
+            if (!IsSample(line)) {
+                continue;
+            }
+            double frame = 0.0;
+            FindNumber(line, "frame", frame);
+            firstFrame = samples == 0 ? frame : firstFrame;
+            lastFrame = frame;
+            FindNumber(line, "dropped", dropped);
+            samples++;
+            for (size_t i = 0; i < keys.size(); i++) {
+                double value = 0.0;
+                if (FindNumber(line, keys[i], value)) {
+                    series[i].push_back(value);
+                }
+            }
+            for (size_t i = 0; i < std::size(kEventKeys); i++) {
+                std::string value;
+                if (FindValue(line, kEventKeys[i], value) && value != lastEvents[i]) {
+                    printf("  frame %-8.0f %s -> %s\n", frame, kEventKeys[i], value.c_str());
+                    lastEvents[i] = value;
+                }
+            }
+        }
+        fclose(file);
+
+        printf("\n%zu samples, frames %.0f..%.0f, %.0f dropped by the server\n", samples,
+               firstFrame, lastFrame, dropped);
+        for (size_t i = 0; i < keys.size(); i++) {
+            PrintChart(keys[i], series[i]);
+        }
+        return samples > 0 ? 0 : 1;
+    }
+
+    int Connect(const std::string& target) {
+        if (target.compare(0, 4, "tcp:") == 0) {
+            const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(atoi(target.c_str() + 4)));
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (fd < 0 ||
+                connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                return -1;
+            }
+            return fd;
+        }
+
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        const bool abstract = target[0] != '/';
+        const size_t pathOffset = abstract ? 1 : 0;
+        if (pathOffset + target.size() >= sizeof(address.sun_path)) {
+            return -1;
+        }
+        memcpy(address.sun_path + pathOffset, target.data(), target.size());
+        const auto addressLength = static_cast<socklen_t>(
+                offsetof(sockaddr_un, sun_path) + pathOffset + target.size() + (abstract ? 0 : 1));
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 ||
+            connect(fd, reinterpret_cast<const sockaddr*>(&address), addressLength) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        return fd;
+    }
+
+    // "name=value" as the server's "set name value" command
+    bool SendSet(const int fd, const std::string& assignment) {
+        const size_t equals = assignment.find('=');
+        if (equals == std::string::npos || equals == 0) {
+            fprintf(stderr, "Expected <parameter>=<value>, got %s\n", assignment.c_str());
+            return false;
+        }
+        const std::string command = "set " + assignment.substr(0, equals) + " " +
+                                    assignment.substr(equals + 1) + "\n";
+        if (send(fd, command.data(), command.size(), MSG_NOSIGNAL) !=
+            static_cast<ssize_t>(command.size())) {
+            fprintf(stderr, "Could not send %s: %s\n", assignment.c_str(), strerror(errno));
+            return false;
+        }
+        printf("Sent %s", command.c_str());
+        return true;
+    }
+
+    int Record(const std::string& target, const char* outPath,
+               const std::vector<std::string>& keys, const double seconds,
+               const std::vector<std::string>& assignments) {
+        const int fd = Connect(target);
+        if (fd < 0) {
+            fprintf(stderr, "Could not connect to %s: %s\n", target.c_str(), strerror(errno));
+            return 1;
+        }
+        for (const std::string& assignment : assignments) {
+            if (!SendSet(fd, assignment)) {
+                close(fd);
+                return 1;
+            }
+        }
+        FILE* out = nullptr;
+        if (outPath != nullptr && (out = fopen(outPath, "w")) == nullptr) {
+            fprintf(stderr, "Could not open %s\n", outPath);
+            close(fd);
+            return 1;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point start = Clock::now();
+        Clock::time_point nextPrint = start + std::chrono::seconds(1);
+        std::vector<std::deque<double>> windows(keys.size());
+        std::string pending;
+        std::string lastLine;
+        size_t lines = 0;
+        char buffer[4096];
+        for (;;) {
+            const Clock::time_point now = Clock::now();
+            if (seconds > 0.0 && now - start >= std::chrono::duration<double>(seconds)) {
+                break;
+            }
+            pollfd pfd = {fd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) > 0) {
+                const ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    printf("Server closed the connection\n");
+                    break;
+                }
+                pending.append(buffer, static_cast<size_t>(received));
+            }
+
+            size_t newline;
+            while ((newline = pending.find('\n')) != std::string::npos) {
+                const std::string line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                if (out != nullptr) {
+                    fprintf(out, "%s\n", line.c_str());
+                }
+                if (!IsSample(line)) {
+                    printf("%s\n", line.c_str());
+                    continue;
+                }
+                lines++;
+                lastLine = line;
+                for (size_t i = 0; i < keys.size(); i++) {
+                    double value = 0.0;
+                    if (FindNumber(line, keys[i], value)) {
+                        windows[i].push_back(value);
+                        if (windows[i].size() > kSparklineWidth) {
+                            windows[i].pop_front();
+                        }
+                    }
+                }
+            }
+
+            if (Clock::now() < nextPrint || lastLine.empty()) {
+                continue;
+            }
+            nextPrint += std::chrono::seconds(1);
+            if (out != nullptr) {
+                fflush(out);
+            }
+            std::string session;
+            double frame = 0.0;
+            FindValue(lastLine, "session", session);
+            FindNumber(lastLine, "frame", frame);
+            printf("\nframe %.0f, %s, %zu samples\n", frame, session.c_str(), lines);
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (windows[i].empty()) {
+                    continue;
+                }
+                const auto [low, high] = std::minmax_element(windows[i].begin(),
+                                                             windows[i].end());
+                printf("  %-18s %10.3f [%10.3f %10.3f] %s\n", keys[i].c_str(), windows[i].back(),
+                       *low, *high, Sparkline(windows[i], *low, *high).c_str());
+            }
+            fflush(stdout);
+        }
+
+        close(fd);
+        if (out != nullptr) {
+            fclose(out);
+            printf("Recorded %zu samples to %s\n", lines, outPath);
+        }
+        return 0;
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    std::string target = kDefaultSocket;
+    const char* outPath = nullptr;
+    const char* replayPath = nullptr;
+    std::string plotKeys = kDefaultPlotKeys;
+    double seconds = 0.0;
+    std::vector<std::string> assignments;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            target = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--plot") == 0 && i + 1 < argc) {
+            plotKeys = argv[++i];
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--set") == 0 && i + 1 < argc) {
+            assignments.emplace_back(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    const std::vector<std::string> keys = SplitKeys(plotKeys);
+    if (target.empty()) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+    if (replayPath != nullptr) {
+        return Replay(replayPath, keys);
+    }
+    return Record(target, outPath, keys, seconds, assignments);
+}
@@ -0,0 +1,178 @@
+/*******************************************************************************
+
+Filename    :   TransformBench.cpp
+Content     :   Host-side benchmark for TransformHierarchy. Builds a wide,
+                shallow hierarchy like props and UI hung off tracked devices
+                and measures full and partial update cost for a range of
+                worker thread counts.
+
+                Usage:
+                    transform_bench [--iterations <n>] [--roots <n>]
+
+                Also checks every world pose against composing the chain
+                of local poses one node at a time.
+
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "../render/TransformHierarchy.h"
+#include "../utils/JobSystem.h"
+#include "../utils/MathUtils.h"
+
+#include <xr_linear.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    constexpr uint32_t kMaxWorkers = 3;
+    // Children per node at each level below the roots
+    constexpr uint32_t kFanOut[] = {16, 8, 4};
+    // Roots whose pose changes each frame in the partial update
+    constexpr uint32_t kMovingRoots = 2;
+    constexpr float kTolerance = 1e-4f;
+
+    // Fixed LCG so every run builds the same hierarchy
+    struct Random {
+        uint32_t mState = 12345u;
+
+        float Range(const float lo, const float hi) {
+            mState = mState * 1664525u + 1013904223u;
+            return lo + (hi - lo) * static_cast<float>(mState >> 8) /
+                        static_cast<float>(1u << 24);
+        }
+        XrPosef Pose() {
+            const XrQuaternionf q = {Range(-1.0f, 1.0f), Range(-1.0f, 1.0f), Range(-1.0f, 1.0f),
+                                     Range(0.1f, 1.0f)};
+            const float scale = 1.0f / std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+            return {{q.x * scale, q.y * scale, q.z * scale, q.w * scale},
+                    {Range(-1.0f, 1.0f), Range(-1.0f, 1.0f), Range(-1.0f, 1.0f)}};
+        }
+    };
+
+    XrPosef Compose(const XrPosef& parent, const XrPosef& local) {
+        XrPosef result;
+        result.orientation = parent.orientation * local.orientation;
+        XrQuaternionf_RotateVector3f(&result.position, &parent.orientation, &local.position);
+        result.position = result.position + parent.position;
+        return result;
+    }
+
+    void Build(TransformHierarchy& hierarchy, Random& random, const uint32_t roots) {
+        std::vector<TransformHierarchy::NodeId> level;
+        for (uint32_t i = 0; i < roots; i++) {
+            level.push_back(hierarchy.AddNode(TransformHierarchy::INVALID_NODE, random.Pose()));
+        }
+        for (const uint32_t fanOut : kFanOut) {
+            std::vector<TransformHierarchy::NodeId> next;
+            for (const TransformHierarchy::NodeId parent : level) {
+                for (uint32_t i = 0; i < fanOut; i++) {
+                    next.push_back(hierarchy.AddNode(parent, random.Pose()));
+                }
+            }
+            level = std::move(next);
+        }
+    }
+
+    uint32_t CountMismatches(const TransformHierarchy& hierarchy) {
+        // Nodes are added parents first, so one pass in id order suffices
+        std::vector<XrPosef> expected(hierarchy.GetNodeCount());
+        uint32_t mismatches = 0;
+        for (TransformHierarchy::NodeId node = 0; node < expected.size(); node++) {
+            const TransformHierarchy::NodeId parent = hierarchy.GetParent(node);
+            expected[node] = parent == TransformHierarchy::INVALID_NODE
+                                     ? hierarchy.GetLocalPose(node)
+                                     : Compose(expected[parent], hierarchy.GetLocalPose(node));
+            const XrPosef actual = hierarchy.GetWorldPose(node);
+            const XrVector3f delta = actual.position - expected[node].position;
+            const float dot = std::abs(actual.orientation.x * expected[node].orientation.x +
+                                       actual.orientation.y * expected[node].orientation.y +
+                                       actual.orientation.z * expected[node].orientation.z +
+                                       actual.orientation.w * expected[node].orientation.w);
+            if (MathUtils::Dot(delta, delta) > kTolerance * kTolerance ||
+                dot < 1.0f - kTolerance) {
+                mismatches++;
+            }
+        }
+        return mismatches;
+    }
+
+    void PrintUsage(const char* argv0) {
+        fprintf(stderr, "Usage: %s [--iterations <n>] [--roots <n>]\n", argv0);
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    uint32_t iterations = 200;
+    uint32_t roots = 64;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = static_cast<uint32_t>(std::max(atoi(argv[++i]), 1));
+        } else if (strcmp(argv[i], "--roots") == 0 && i + 1 < argc) {
+            roots = static_cast<uint32_t>(
+                    std::max(atoi(argv[++i]), static_cast<int>(kMovingRoots)));
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    uint32_t mismatches = 0;
+    bool printedShape = false;
+    for (uint32_t workers = 0; workers <= kMaxWorkers; workers++) {
+        JobSystem jobs(workers);
+        TransformHierarchy hierarchy(workers > 0 ? &jobs : nullptr);
+        Random random;
+        Build(hierarchy, random, roots);
+        hierarchy.Update();
+        mismatches += CountMismatches(hierarchy);
+
+        if (!printedShape) {
+            printf("Hierarchy: %u nodes in %u levels, %u roots, %u iterations\n\n",
+                   hierarchy.GetStats().mNodes, hierarchy.GetStats().mLevels, roots, iterations);
+            printf("%-8s %10s %12s %12s %12s %10s\n", "workers", "full(us)", "Mnode/s",
+                   "partial(us)", "changed", "skipped");
+            printedShape = true;
+        }
+
+        // Every root moves: the whole hierarchy is recomputed
+        int64_t fullNs = 0;
+        for (uint32_t i = 0; i < iterations; i++) {
+            for (TransformHierarchy::NodeId root = 0; root < roots; root++) {
+                hierarchy.SetLocalPose(root, random.Pose());
+            }
+            hierarchy.Update();
+            fullNs += hierarchy.GetStats().mUpdateNs;
+        }
+        mismatches += CountMismatches(hierarchy);
+
+        // Only the tracked-device roots move, as in a typical frame
+        int64_t partialNs = 0;
+        for (uint32_t i = 0; i < iterations; i++) {
+            for (TransformHierarchy::NodeId root = 0; root < kMovingRoots; root++) {
+                hierarchy.SetLocalPose(root, random.Pose());
+            }
+            hierarchy.Update();
+            partialNs += hierarchy.GetStats().mUpdateNs;
+        }
+        mismatches += CountMismatches(hierarchy);
+
+        const TransformHierarchy::Stats& stats = hierarchy.GetStats();
+        const double fullUs = static_cast<double>(fullNs) / iterations / 1000.0;
+        const double partialUs = static_cast<double>(partialNs) / iterations / 1000.0;
+        printf("%-8u %10.1f %12.2f %12.1f %12u %9.1f%%\n", workers, fullUs,
+               stats.mNodes / fullUs, partialUs, stats.mNodesChanged,
+               100.0 * stats.mBatchesSkipped / (stats.mBatchesSkipped + stats.mBatchesComposed));
+    }
+
+    printf("\n%s: %u world pose(s) differ from the scalar reference\n",
+           mismatches == 0 ? "PASSED" : "FAILED", mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+/*******************************************************************************
+
+Filename    :   AssetPackage.cpp
+Content     :   Memory-mapped asset archive: on-disk format and reader
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "AssetPackage.h"
+#include "LogUtils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+using namespace AssetFormat;
+
+namespace {
+    size_t PageSize() {
+        static const size_t kPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return kPageSize;
+    }
+
+    bool HasTerminator(const char (&name)[NAME_LENGTH]) {
+        return memchr(name, '\0', NAME_LENGTH) != nullptr;
+    }
+} // anonymous namespace
+
+AssetPackage::~AssetPackage() {
+    Close();
+}
+
+bool AssetPackage::Open(const char* path) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("AssetPackage: cannot open %s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat info = {};
+    const bool opened = fstat(fd, &info) == 0 && Open(fd, 0, info.st_size);
+    close(fd);
+    if (opened) {
+        ALOGD("AssetPackage: mapped %s, %u groups, %u entries, %llu bytes", path,
+              mHeader->mGroupCount, mHeader->mEntryCount,
+              static_cast<unsigned long long>(mHeader->mFileSize));
+    }
+    return opened;
+}
+
+bool AssetPackage::Open(const int fd, const int64_t offset, const int64_t length) {
+    Close();
+    if (offset < 0 || length < static_cast<int64_t>(sizeof(Header))) {
+        ALOGE("AssetPackage: %lld bytes is too small for a package",
+              static_cast<long long>(length));
+        return false;
+    }
+
+    // mmap offsets must be page-aligned; APK assets usually are not
+    const int64_t pageOffset = offset % static_cast<int64_t>(PageSize());
+    mMappingSize = static_cast<size_t>(length + pageOffset);
+    void* mapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_PRIVATE, fd, offset - pageOffset);
+    if (mapping == MAP_FAILED) {
+        ALOGE("AssetPackage: mmap of %lld bytes failed: %s", static_cast<long long>(length),
+              strerror(errno));
+        mMappingSize = 0;
+        return false;
+    }
+    mMapping = mapping;
+    mBase = static_cast<const uint8_t*>(mapping) + pageOffset;
+
+    if (!Validate(static_cast<uint64_t>(length))) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void AssetPackage::Close() {
+    if (mMapping != nullptr) {
+        munmap(mMapping, mMappingSize);
+    }
+    mMapping = nullptr;
+    mMappingSize = 0;
+    mBase = nullptr;
+    mHeader = nullptr;
+    mGroups = nullptr;
+    mEntries = nullptr;
+}
+
+bool AssetPackage::Validate(const uint64_t length) {
+    // Check everything up front so lookups can trust the tables
+    const auto* header = reinterpret_cast<const Header*>(mBase);
+    if (header->mMagic != MAGIC || header->mVersion != VERSION) {
+        ALOGE("AssetPackage: not a version %u package (magic %08x, version %u)", VERSION,
+              header->mMagic, header->mVersion);
+        return false;
+    }
+    const uint64_t tablesEnd = sizeof(Header) + uint64_t{header->mGroupCount} * sizeof(Group) +
+                               uint64_t{header->mEntryCount} * sizeof(Entry);
+    if (header->mFileSize != length || tablesEnd > length) {
+        ALOGE("AssetPackage: header says %llu bytes and %llu of tables, found %llu",
+              static_cast<unsigned long long>(header->mFileSize),
+              static_cast<unsigned long long>(tablesEnd), static_cast<unsigned long long>(length));
+        return false;
+    }
+
+    // The loops below touch every table page; fault them in together
+    // rather than one at a time
+    AdviseRange(0, tablesEnd, MADV_WILLNEED);
+
+    const auto* groups = reinterpret_cast<const Group*>(header + 1);
+    for (uint32_t i = 0; i < header->mGroupCount; i++) {
+        const Group& group = groups[i];
+        if (!HasTerminator(group.mName) || group.mOffset % GROUP_ALIGNMENT != 0 ||
+            group.mOffset < tablesEnd || group.mOffset > length ||
+            group.mSize > length - group.mOffset) {
+            ALOGE("AssetPackage: group %u is malformed", i);
+            return false;
+        }
+    }
+    const auto* entries = reinterpret_cast<const Entry*>(groups + header->mGroupCount);
+    for (uint32_t i = 0; i < header->mEntryCount; i++) {
+        const Entry& entry = entries[i];
+        if (!HasTerminator(entry.mName) || entry.mGroup >= header->mGroupCount ||
+            entry.mOffset % BLOB_ALIGNMENT != 0) {
+            ALOGE("AssetPackage: entry %u is malformed", i);
+            return false;
+        }
+        const Group& group = groups[entry.mGroup];
+        if (entry.mOffset < group.mOffset || entry.mSize > group.mSize ||
+            entry.mOffset - group.mOffset > group.mSize - entry.mSize) {
+            ALOGE("AssetPackage: entry %s lies outside group %s", entry.mName, group.mName);
+            return false;
+        }
+    }
+
+    mHeader = header;
+    mGroups = groups;
+    mEntries = entries;
+    return true;
+}
+
+uint32_t AssetPackage::FindGroup(const char* name) const {
+    for (uint32_t i = 0; i < GetGroupCount(); i++) {
+        if (strcmp(mGroups[i].mName, name) == 0) {
+            return i;
+        }
+    }
+    return INVALID_GROUP;
+}
+
+const Entry* AssetPackage::Find(const char* name, const EntryType type) const {
+    for (uint32_t i = 0; i < GetEntryCount(); i++) {
+        if (mEntries[i].mType == type && strcmp(mEntries[i].mName, name) == 0) {
+            return &mEntries[i];
+        }
+    }
+    return nullptr;
+}
+
+bool AssetPackage::AdviseRange(const uint64_t offset, const uint64_t size,
+                               const int advice) const {
+    if (size == 0) {
+        return true;
+    }
+    // Widen to whole pages; groups are page-aligned within the package, but
+    // the package itself may not be within its file
+    const size_t page = PageSize();
+    const auto begin = reinterpret_cast<uintptr_t>(mBase + offset) & ~(page - 1);
+    const auto end = reinterpret_cast<uintptr_t>(mBase + offset + size);
+    return madvise(reinterpret_cast<void*>(begin), end - begin, advice) == 0;
+}
+
+void AssetPackage::Advise(const uint32_t group, const int advice) const {
+    if (group >= GetGroupCount()) {
+        return;
+    }
+    if (!AdviseRange(mGroups[group].mOffset, mGroups[group].mSize, advice)) {
+        ALOGW("AssetPackage: madvise(%d) on group %s failed: %s", advice, mGroups[group].mName,
+              strerror(errno));
+    }
+}
+
+void AssetPackage::Prefetch(const uint32_t group) const {
+    Advise(group, MADV_WILLNEED);
+}
+
+void AssetPackage::Release(const uint32_t group) const {
+    Advise(group, MADV_DONTNEED);
+}
+
+size_t AssetPackage::GetResidentBytes() const {
+    if (mMapping == nullptr) {
+        return 0;
+    }
+    const size_t page = PageSize();
+    std::vector<unsigned char> resident((mMappingSize + page - 1) / page);
+    if (mincore(mMapping, mMappingSize, resident.data()) != 0) {
+        return 0;
+    }
+    size_t pages = 0;
+    for (const unsigned char flags : resident) {
+        pages += flags & 1;
+    }
+    return pages * page;
+}
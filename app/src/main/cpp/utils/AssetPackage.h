@@ -0,0 +1,159 @@
+/*******************************************************************************
+
+Filename    :   AssetPackage.h
+Content     :   Memory-mapped asset archive: on-disk format and reader
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * On-disk layout of an asset package, written by tools/AssetPacker.cpp.
+ *
+ * A Header, then mGroupCount Groups, then mEntryCount Entries, then the
+ * groups' data. Each group starts on a GROUP_ALIGNMENT boundary so it
+ * occupies whole pages of its own, and every entry's blob inside it is
+ * BLOB_ALIGNMENT-aligned, in the layout GL takes it in. Offsets are from the
+ * start of the package. All integers are little-endian.
+ */
+namespace AssetFormat {
+    constexpr uint32_t MAGIC = 0x4B415056;  // "VPAK"
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t NAME_LENGTH = 32;    // including the terminator
+    constexpr uint64_t GROUP_ALIGNMENT = 4096;
+    constexpr uint64_t BLOB_ALIGNMENT = 16;
+
+    enum class EntryType : uint32_t {
+        // mParams: VertexLayout, stride in bytes, vertex count
+        VERTICES = 1,
+        // mParams: GL index type, index count
+        INDICES = 2,
+        // mParams: VERTICES entry, INDICES entry, level count.
+        // Blob: MeshLevel per level, finest first.
+        MESH = 3,
+        // mParams: GL compressed internal format, width, height, level count.
+        // Blob: each level's size as a uint32_t, padded to BLOB_ALIGNMENT,
+        // then each level's data, each BLOB_ALIGNMENT-aligned.
+        COMPRESSED_TEXTURE_2D = 4,
+    };
+
+    enum class VertexLayout : uint32_t {
+        POSITION_NORMAL = 0,  // 3 floats, then 3 floats
+    };
+
+    struct Header {
+        uint32_t mMagic;
+        uint32_t mVersion;
+        uint32_t mGroupCount;
+        uint32_t mEntryCount;
+        uint64_t mFileSize;
+        uint64_t mReserved;
+    };
+
+    struct Group {
+        char mName[NAME_LENGTH];
+        uint64_t mOffset;
+        uint64_t mSize;
+    };
+
+    struct Entry {
+        char mName[NAME_LENGTH];
+        EntryType mType;
+        uint32_t mGroup;
+        uint64_t mOffset;
+        uint64_t mSize;
+        uint32_t mParams[6];
+    };
+
+    struct MeshLevel {
+        uint32_t mFirstIndex;
+        uint32_t mIndexCount;
+        float mError;
+        uint32_t mReserved;
+    };
+
+    static_assert(sizeof(Header) == 32 && sizeof(Group) == 48 && sizeof(Entry) == 80 &&
+                  sizeof(MeshLevel) == 16, "asset package structs must not change size");
+} // namespace AssetFormat
+
+/**
+ * AssetPackage - read-only view of a package mapped into memory.
+ *
+ * The whole package is mapped once; nothing is read until it is touched,
+ * so opening costs a few page faults for the tables whatever the package's
+ * size. Blobs are used in place: GetData() points into the mapping, and GL
+ * uploads read straight from it with no intermediate copy.
+ *
+ * Groups are the unit of streaming. Prefetch() starts reading a group in
+ * the background before it is needed; Release() drops its pages once the
+ * GPU has its own copy. Released pages fault back in from the file if
+ * touched again, so releasing early is always safe.
+ *
+ * Read-only after Open(), so lookups may run on any thread.
+ */
+class AssetPackage {
+public:
+    static constexpr uint32_t INVALID_GROUP = UINT32_MAX;
+
+    AssetPackage() = default;
+    ~AssetPackage();
+
+    AssetPackage(const AssetPackage&) = delete;
+    AssetPackage& operator=(const AssetPackage&) = delete;
+
+    /**
+     * Map the package at @p path. Returns false, and logs why, if the file
+     * is missing or malformed.
+     */
+    bool Open(const char* path);
+
+    /**
+     * Map @p length bytes at @p offset in @p fd, e.g. an uncompressed APK
+     * asset from AAsset_openFileDescriptor64(). @p fd may be closed after.
+     */
+    bool Open(int fd, int64_t offset, int64_t length);
+
+    void Close();
+    bool IsOpen() const { return mHeader != nullptr; }
+
+    uint32_t GetGroupCount() const { return IsOpen() ? mHeader->mGroupCount : 0; }
+    const AssetFormat::Group& GetGroup(const uint32_t group) const { return mGroups[group]; }
+    uint32_t FindGroup(const char* name) const;
+
+    uint32_t GetEntryCount() const { return IsOpen() ? mHeader->mEntryCount : 0; }
+    const AssetFormat::Entry& GetEntry(const uint32_t entry) const { return mEntries[entry]; }
+    // nullptr if there is none of that name and type
+    const AssetFormat::Entry* Find(const char* name, AssetFormat::EntryType type) const;
+
+    const void* GetData(const AssetFormat::Entry& entry) const { return mBase + entry.mOffset; }
+
+    // Hint that @p group will be needed soon
+    void Prefetch(uint32_t group) const;
+    // Drop @p group's resident pages
+    void Release(uint32_t group) const;
+
+    // Bytes of the package currently in memory
+    size_t GetResidentBytes() const;
+    uint64_t GetSize() const { return IsOpen() ? mHeader->mFileSize : 0; }
+
+private:
+    bool Validate(uint64_t length);
+    void Advise(uint32_t group, int advice) const;
+    // madvise() the pages holding [offset, offset + size) of the package
+    bool AdviseRange(uint64_t offset, uint64_t size, int advice) const;
+
+    // The mapping starts on a page boundary at or before the package
+    void* mMapping = nullptr;
+    size_t mMappingSize = 0;
+    const uint8_t* mBase = nullptr;
+
+    const AssetFormat::Header* mHeader = nullptr;
+    const AssetFormat::Group* mGroups = nullptr;
+    const AssetFormat::Entry* mEntries = nullptr;
+};
@@ -0,0 +1,289 @@
+/*******************************************************************************
+
+Filename    :   FlightRecorder.cpp
+Content     :   Crash-surviving memory-mapped ring of recent frames and events:
+                on-disk format and writer
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "FlightRecorder.h"
+#include "LogUtils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+using namespace FlightFormat;
+
+namespace {
+    constexpr int kCrashSignals[] = {SIGABRT, SIGSEGV, SIGBUS, SIGFPE, SIGILL};
+    constexpr size_t kCrashSignalCount = sizeof(kCrashSignals) / sizeof(kCrashSignals[0]);
+
+    // The recorder crash handlers write to, and the handlers they replaced
+    std::atomic<FlightRecorder*> gCrashRecorder{nullptr};
+    struct sigaction gPreviousActions[kCrashSignalCount];
+
+    // clock_gettime() rather than std::chrono: it is async-signal-safe
+    int64_t ReadClockNs(const clockid_t clock) {
+        timespec now = {};
+        clock_gettime(clock, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    // Signal-safe strncpy that always terminates
+    void CopyText(char (&text)[TEXT_LENGTH], const char* source) {
+        size_t i = 0;
+        for (; i + 1 < TEXT_LENGTH && source[i] != '\0'; i++) {
+            text[i] = source[i];
+        }
+        text[i] = '\0';
+    }
+
+    // strsignal() may allocate, so not from a handler
+    const char* GetSignalName(const int signal) {
+        switch (signal) {
+            case SIGABRT: return "SIGABRT";
+            case SIGSEGV: return "SIGSEGV";
+            case SIGBUS:  return "SIGBUS";
+            case SIGFPE:  return "SIGFPE";
+            case SIGILL:  return "SIGILL";
+        }
+        return "signal";
+    }
+
+    bool PreviousRunCrashed(const std::string& path) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        Header header = {};
+        const bool read = fread(&header, sizeof(header), 1, file) == 1;
+        fclose(file);
+        return read && header.mMagic == MAGIC && header.mCleanExit == 0;
+    }
+} // anonymous namespace
+
+FlightRecorder::~FlightRecorder() {
+    Close();
+}
+
+bool FlightRecorder::Open(const std::string& dir, const uint32_t frameCapacity,
+                          const uint32_t eventCapacity) {
+    Close();
+
+    const std::string path = dir + "/" + FILE_NAME;
+    const std::string previousPath = dir + "/" + PREVIOUS_FILE_NAME;
+    if (rename(path.c_str(), previousPath.c_str()) == 0 && PreviousRunCrashed(previousPath)) {
+        ALOGW("FlightRecorder: the previous run did not exit cleanly; its record is %s",
+              previousPath.c_str());
+    }
+
+    const uint64_t framesOffset = sizeof(Header);
+    const uint64_t eventsOffset = framesOffset + uint64_t{frameCapacity} * sizeof(FrameRecord);
+    const uint64_t fileSize = eventsOffset + uint64_t{eventCapacity} * sizeof(EventRecord);
+
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ALOGE("FlightRecorder: could not create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(fileSize)) == 0) {
+        mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const int error = errno;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        ALOGE("FlightRecorder: could not map %s: %s", path.c_str(), strerror(error));
+        return false;
+    }
+
+    // The file is zero-filled, so every record starts out empty
+    mMapping = mapping;
+    mMappingSize = fileSize;
+    mHeader = static_cast<Header*>(mapping);
+    mFrames = reinterpret_cast<FrameRecord*>(static_cast<uint8_t*>(mapping) + framesOffset);
+    mEvents = reinterpret_cast<EventRecord*>(static_cast<uint8_t*>(mapping) + eventsOffset);
+    mFrameCount = 0;
+    mEventCount = 0;
+    memset(mPhaseNs, 0, sizeof(mPhaseNs));
+
+    mHeader->mVersion = VERSION;
+    mHeader->mFrameCapacity = frameCapacity;
+    mHeader->mEventCapacity = eventCapacity;
+    mHeader->mFramesOffset = framesOffset;
+    mHeader->mEventsOffset = eventsOffset;
+    mHeader->mFileSize = fileSize;
+    mHeader->mStartWallTimeNs = ReadClockNs(CLOCK_REALTIME);
+    mHeader->mStartTimeNs = ReadClockNs(CLOCK_MONOTONIC);
+    mHeader->mPid = static_cast<uint32_t>(getpid());
+    mHeader->mPhase = static_cast<uint32_t>(Watchdog::Phase::IDLE);
+    // A decoder only trusts the rest once the magic is there
+    std::atomic_thread_fence(std::memory_order_release);
+    mHeader->mMagic = MAGIC;
+
+    ALOGI("FlightRecorder: recording %u frames and %u events to %s", frameCapacity,
+          eventCapacity, path.c_str());
+    return true;
+}
+
+void FlightRecorder::Close() {
+    if (mHeader == nullptr) {
+        return;
+    }
+    FlightRecorder* self = this;
+    if (gCrashRecorder.compare_exchange_strong(self, nullptr)) {
+        gFailHook = nullptr;
+        for (size_t i = 0; i < kCrashSignalCount; i++) {
+            sigaction(kCrashSignals[i], &gPreviousActions[i], nullptr);
+        }
+    }
+
+    mHeader->mCleanExit = 1;
+    msync(mMapping, mMappingSize, MS_ASYNC);
+    munmap(mMapping, mMappingSize);
+    mMapping = nullptr;
+    mHeader = nullptr;
+    mFrames = nullptr;
+    mEvents = nullptr;
+}
+
+void FlightRecorder::InstallCrashHandlers() {
+    FlightRecorder* expected = nullptr;
+    if (mHeader == nullptr || !gCrashRecorder.compare_exchange_strong(expected, this)) {
+        return;
+    }
+    gFailHook = &FlightRecorder::OnFail;
+
+    struct sigaction action = {};
+    action.sa_sigaction = &FlightRecorder::OnSignal;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < kCrashSignalCount; i++) {
+        sigaction(kCrashSignals[i], &action, &gPreviousActions[i]);
+    }
+}
+
+void FlightRecorder::Mark(const Watchdog::Phase phase, const uint64_t frameIndex) {
+    if (mHeader == nullptr) {
+        return;
+    }
+    const int64_t now = ReadClockNs(CLOCK_MONOTONIC) - mHeader->mStartTimeNs;
+    if (mHeader->mPhaseTimeNs > 0) {
+        mPhaseNs[mHeader->mPhase] += now - mHeader->mPhaseTimeNs;
+    }
+    mHeader->mPhaseFrameIndex = frameIndex;
+    mHeader->mPhaseTimeNs = now;
+    mHeader->mPhase = static_cast<uint32_t>(phase);
+}
+
+void FlightRecorder::AddFrame(const FrameStats& stats) {
+    if (mHeader == nullptr) {
+        return;
+    }
+    FrameRecord& record = mFrames[mFrameCount % mHeader->mFrameCapacity];
+    record.mSequence = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    record.mFrameIndex = stats.mFrameIndex;
+    record.mEndTimeNs = ReadClockNs(CLOCK_MONOTONIC) - mHeader->mStartTimeNs;
+    memcpy(record.mPhaseNs, mPhaseNs, sizeof(mPhaseNs));
+    record.mCpuSubmitNs = stats.mCpuSubmitNs;
+    record.mSlackNs = stats.mSlackNs;
+    record.mGpuMemoryBytes = stats.mGpuMemory.GetTotal();
+    record.mGlCalls = stats.mGlCalls;
+    record.mDrawCalls = stats.mDrawCalls;
+    record.mTriangles = stats.mTriangles;
+    record.mFoveationLevel = stats.mFoveationLevel;
+    record.mObjectsOccluded = stats.mObjectsOccluded;
+    record.mShadowTileUpdates = stats.mShadowTileUpdates;
+
+    std::atomic_thread_fence(std::memory_order_release);
+    record.mSequence = ++mFrameCount;
+    memset(mPhaseNs, 0, sizeof(mPhaseNs));
+}
+
+void FlightRecorder::AddEvent(const EventType type, const uint64_t frameIndex,
+                              const int32_t value, const char* format, ...) {
+    uint64_t sequence = 0;
+    EventRecord* event = BeginEvent(type, frameIndex, value, sequence);
+    if (event == nullptr) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vsnprintf(event->mText, sizeof(event->mText), format, args);
+    va_end(args);
+    EndEvent(event, sequence);
+}
+
+EventRecord* FlightRecorder::BeginEvent(const EventType type, const uint64_t frameIndex,
+                                        const int32_t value, uint64_t& sequence) {
+    if (mHeader == nullptr) {
+        return nullptr;
+    }
+    sequence = mEventCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    EventRecord* event = &mEvents[(sequence - 1) % mHeader->mEventCapacity];
+    event->mSequence = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    event->mTimeNs = ReadClockNs(CLOCK_MONOTONIC) - mHeader->mStartTimeNs;
+    event->mFrameIndex = frameIndex;
+    event->mType = type;
+    event->mValue = value;
+    event->mText[0] = '\0';
+    return event;
+}
+
+void FlightRecorder::EndEvent(EventRecord* event, const uint64_t sequence) {
+    std::atomic_thread_fence(std::memory_order_release);
+    event->mSequence = sequence;
+}
+
+void FlightRecorder::OnFail(const char* message) {
+    FlightRecorder* recorder = gCrashRecorder.load();
+    if (recorder != nullptr && recorder->mHeader != nullptr) {
+        recorder->AddEvent(EventType::FAIL, recorder->mHeader->mPhaseFrameIndex, 0, "%s",
+                           message);
+    }
+}
+
+void FlightRecorder::OnSignal(const int signal, siginfo_t* info, void* context) {
+    FlightRecorder* recorder = gCrashRecorder.load();
+    if (recorder != nullptr) {
+        uint64_t sequence = 0;
+        EventRecord* event = recorder->BeginEvent(
+                EventType::SIGNAL, recorder->mHeader->mPhaseFrameIndex, signal, sequence);
+        if (event != nullptr) {
+            CopyText(event->mText, GetSignalName(signal));
+            recorder->EndEvent(event, sequence);
+        }
+    }
+
+    // Hand over to the previous handler. A faulting instruction faults
+    // again on return and reaches it that way; abort() re-raises on its
+    // own, and a signal sent by someone else has to be re-raised.
+    for (size_t i = 0; i < kCrashSignalCount; i++) {
+        if (kCrashSignals[i] != signal) {
+            continue;
+        }
+        const struct sigaction& previous = gPreviousActions[i];
+        if ((previous.sa_flags & SA_SIGINFO) != 0 && previous.sa_sigaction != nullptr) {
+            previous.sa_sigaction(signal, info, context);
+            return;
+        }
+        sigaction(signal, &previous, nullptr);
+        if (info->si_code <= 0 && signal != SIGABRT) {
+            raise(signal);
+        }
+        return;
+    }
+}
@@ -0,0 +1,179 @@
+/*******************************************************************************
+
+Filename    :   FlightRecorder.h
+Content     :   Crash-surviving memory-mapped ring of recent frames and events:
+                on-disk format and writer
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "FrameStats.h"
+#include "Watchdog.h"
+
+#include <signal.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * On-disk layout of a flight record, read by tools/FlightDecoder.cpp.
+ *
+ * A Header, then mFrameCapacity FrameRecords, then mEventCapacity
+ * EventRecords, both rings. Each record carries a sequence number, 1 for
+ * the first ever written; 0 marks a slot that is empty or was being
+ * written when the process died. Times are nanoseconds since
+ * Header::mStartTimeNs on the monotonic clock. All integers are
+ * little-endian.
+ */
+namespace FlightFormat {
+    constexpr uint32_t MAGIC = 0x544C4656;  // "VFLT"
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t TEXT_LENGTH = 32;    // including the terminator
+
+    enum class EventType : uint32_t {
+        NOTE = 1,               // mText
+        SESSION_STATE = 2,      // mText: new state
+        PERF_NOTIFICATION = 3,  // mValue: domain, mText: new level
+        STALL = 4,              // mValue: watchdog stalls so far
+        FAIL = 5,               // mText: start of the FAIL() message
+        SIGNAL = 6,             // mValue: signal number
+    };
+
+    struct Header {
+        uint32_t mMagic;
+        uint32_t mVersion;
+        uint32_t mFrameCapacity;
+        uint32_t mEventCapacity;
+        uint64_t mFramesOffset;
+        uint64_t mEventsOffset;
+        uint64_t mFileSize;
+        // CLOCK_REALTIME and monotonic time at Open()
+        int64_t mStartWallTimeNs;
+        int64_t mStartTimeNs;
+        uint32_t mPid;
+        // Set by a clean Close(); still 0 after a crash or a kill
+        uint32_t mCleanExit;
+
+        // The phase the render thread last entered, and when
+        uint64_t mPhaseFrameIndex;
+        int64_t mPhaseTimeNs;
+        uint32_t mPhase;  // Watchdog::Phase
+        uint32_t mReserved;
+    };
+
+    struct FrameRecord {
+        uint64_t mSequence;
+        uint64_t mFrameIndex;
+        int64_t mEndTimeNs;
+        // Time spent in each Watchdog::Phase since the previous frame
+        int64_t mPhaseNs[Watchdog::PHASE_COUNT];
+        int64_t mCpuSubmitNs;
+        int64_t mSlackNs;
+        uint64_t mGpuMemoryBytes;
+        uint32_t mGlCalls;
+        uint32_t mDrawCalls;
+        uint32_t mTriangles;
+        uint32_t mFoveationLevel;
+        uint32_t mObjectsOccluded;
+        uint32_t mShadowTileUpdates;
+    };
+
+    struct EventRecord {
+        uint64_t mSequence;
+        int64_t mTimeNs;
+        uint64_t mFrameIndex;
+        EventType mType;
+        int32_t mValue;
+        char mText[TEXT_LENGTH];
+    };
+
+    static_assert(sizeof(Header) == 88 && sizeof(FrameRecord) == 128 &&
+                  sizeof(EventRecord) == 64, "flight record structs must not change size");
+} // namespace FlightFormat
+
+/**
+ * FlightRecorder - keeps the last few seconds of frame timings and notable
+ * events in a file-backed shared mapping.
+ *
+ * Every write lands in the page cache, not the process, so whatever was
+ * recorded survives an abort(), a fatal signal, an OOM kill or an ANR kill
+ * with nothing flushed on the way down. The header holds the phase the
+ * render thread was in and since when, which is usually the first question
+ * about a kill. Open() keeps the previous run's file next to the new one
+ * and says so if that run didn't exit cleanly.
+ *
+ * InstallCrashHandlers() also records fatal signals and FAIL() messages
+ * before the process goes, then hands the signal on to whatever handled it
+ * before (the platform's crash reporter on Android).
+ *
+ * Mark() and AddFrame() are render-thread only; AddEvent() may be called
+ * from any thread. All are plain stores into the mapping: no locks, no
+ * syscalls.
+ */
+class FlightRecorder {
+public:
+    static constexpr uint32_t DEFAULT_FRAME_CAPACITY = 1024;
+    static constexpr uint32_t DEFAULT_EVENT_CAPACITY = 256;
+    static constexpr const char* FILE_NAME = "flight.vfr";
+    static constexpr const char* PREVIOUS_FILE_NAME = "flight_prev.vfr";
+
+    FlightRecorder() = default;
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    /**
+     * Create and map FILE_NAME in @p dir, first renaming the previous run's
+     * to PREVIOUS_FILE_NAME.
+     *
+     * @return false, and logs why, if the file could not be mapped
+     */
+    bool Open(const std::string& dir, uint32_t frameCapacity = DEFAULT_FRAME_CAPACITY,
+              uint32_t eventCapacity = DEFAULT_EVENT_CAPACITY);
+    // Marks the record as a clean exit
+    void Close();
+
+    bool IsOpen() const { return mHeader != nullptr; }
+
+    /**
+     * Record fatal signals and FAIL() messages into this recorder until it
+     * is closed. One recorder per process.
+     */
+    void InstallCrashHandlers();
+
+    // Render thread: entering @p phase of frame @p frameIndex
+    void Mark(Watchdog::Phase phase, uint64_t frameIndex);
+    // Render thread: a finished frame, with the phase times since the last
+    void AddFrame(const FrameStats& stats);
+
+    __attribute__((format(printf, 5, 6)))
+    void AddEvent(FlightFormat::EventType type, uint64_t frameIndex, int32_t value,
+                  const char* format, ...);
+
+private:
+    static void OnFail(const char* message);
+    static void OnSignal(int signal, siginfo_t* info, void* context);
+
+    // Claim the next event slot and fill all but the text; EndEvent()
+    // publishes it as @p sequence
+    FlightFormat::EventRecord* BeginEvent(FlightFormat::EventType type, uint64_t frameIndex,
+                                          int32_t value, uint64_t& sequence);
+    void EndEvent(FlightFormat::EventRecord* event, uint64_t sequence);
+
+    void* mMapping = nullptr;
+    size_t mMappingSize = 0;
+    FlightFormat::Header* mHeader = nullptr;
+    FlightFormat::FrameRecord* mFrames = nullptr;
+    FlightFormat::EventRecord* mEvents = nullptr;
+
+    uint64_t mFrameCount = 0;
+    std::atomic<uint64_t> mEventCount{0};
+    // Phase times of the frame in progress
+    int64_t mPhaseNs[Watchdog::PHASE_COUNT] = {};
+};
@@ -0,0 +1,97 @@
+/*******************************************************************************
+
+Filename    :   FrameStats.h
+Content     :   Per-frame CPU-side render statistics
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "GpuMemory.h"
+#include "ParameterRegistry.h"
+
+#include <cstdint>
+
+// Counts GL entry points issued by the render path so that submission cost
+// regressions show up in FrameStats, not just in GPU captures.
+#define COUNT_GL(stats, func) do { (stats).mGlCalls++; func; } while (0)
+
+/**
+ * FrameStats - counters gathered while building one frame.
+ *
+ * Filled in by the render path and read back by whoever cares (logging,
+ * the host-side regression tool). Plain data, so it is cheap to copy out.
+ */
+struct FrameStats {
+    uint64_t mFrameIndex = 0;
+
+    // CPU time spent issuing GL commands for the eye buffers, in nanoseconds.
+    // Does not include waiting on the GPU.
+    int64_t mCpuSubmitNs = 0;
+
+    // CPU time spent inside MSAA resolve blits, kept out of mCpuSubmitNs:
+    // software rasterizers execute blits synchronously, which would swamp
+    // the submission cost being tracked.
+    int64_t mResolveNs = 0;
+
+    // Render-thread wall time spent binning lights into clusters, with
+    // any worker threads helping
+    int64_t mLightBinNs = 0;
+
+    // Render-thread wall time rasterizing occluders and testing objects
+    // against them, and how many objects that removed from the eye passes
+    int64_t mOcclusionNs = 0;
+    uint32_t mObjectsOccluded = 0;
+
+    // Render-thread time starting eye readbacks and copying out finished ones
+    int64_t mReadbackNs = 0;
+
+    // Cached shadow atlas tiles re-rendered this frame
+    uint32_t mShadowTileUpdates = 0;
+
+    // Number of GL entry points the renderer called, how many of those
+    // were draws, and how many triangles the draws submitted.
+    uint32_t mGlCalls = 0;
+    uint32_t mDrawCalls = 0;
+    uint32_t mTriangles = 0;
+
+    // XR_FB_foveation level on the eye swapchains; 0 is full rate everywhere
+    uint32_t mFoveationLevel = 0;
+
+    // Idle time after xrEndFrame() that SlackScheduler estimated, and how
+    // much of it deferred tasks used
+    int64_t mSlackNs = 0;
+    int64_t mSlackUsedNs = 0;
+
+    // How old this frame's input and poses were when it was submitted and
+    // at its predicted display time, from LatencyTracker; -1 where not
+    // measured. Input waited out xrWaitFrame() for mInputToWaitEndNs.
+    int64_t mInputToWaitEndNs = -1;
+    int64_t mInputToSubmitNs = -1;
+    int64_t mInputToDisplayNs = -1;
+    int64_t mPoseToSubmitNs = -1;
+    int64_t mPoseToDisplayNs = -1;
+    int64_t mEventToDisplayNs = -1;
+
+    // GpuResourcePool totals at the end of the frame
+    uint64_t mPoolLiveBytes = 0;
+    float mPoolHitRate = 0.0f;
+
+    // Estimated GPU memory by category after this frame's eviction, and
+    // the highest total so far
+    GpuMemoryUsage mGpuMemory;
+    uint64_t mGpuMemoryPeakBytes = 0;
+
+    // ParameterRegistry values the frame was built with, by id, and the
+    // registry's version then
+    ParameterRegistry::Values mParameters = {};
+    uint32_t mParameterVersion = 0;
+
+    void Reset(const uint64_t frameIndex) {
+        *this = {};
+        mFrameIndex = frameIndex;
+    }
+};
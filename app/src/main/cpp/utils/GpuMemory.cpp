@@ -0,0 +1,121 @@
+/*******************************************************************************
+
+Filename    :   GpuMemory.cpp
+Content     :   Estimated GPU memory per resource category, with peaks and a
+                budget enforced by asking evictable caches to shrink
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "GpuMemory.h"
+#include "LogUtils.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+    double ToMiB(const uint64_t bytes) {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+} // anonymous namespace
+
+//==============================================================================
+// GpuMemoryUsage
+
+const char* GpuMemoryUsage::GetCategoryName(const GpuMemoryCategory category) {
+    switch (category) {
+        case GpuMemoryCategory::SWAPCHAIN: return "swapchain";
+        case GpuMemoryCategory::DEPTH:     return "depth";
+        case GpuMemoryCategory::MSAA:      return "msaa";
+        case GpuMemoryCategory::TEXTURE:   return "texture";
+        case GpuMemoryCategory::BUFFER:    return "buffer";
+    }
+    return "unknown";
+}
+
+uint64_t GpuMemoryUsage::GetTotal() const {
+    uint64_t total = 0;
+    for (const uint64_t bytes : mBytes) {
+        total += bytes;
+    }
+    return total;
+}
+
+GpuMemoryUsage& GpuMemoryUsage::operator+=(const GpuMemoryUsage& other) {
+    for (size_t i = 0; i < CATEGORY_COUNT; i++) {
+        mBytes[i] += other.mBytes[i];
+    }
+    return *this;
+}
+
+//==============================================================================
+// GpuMemoryTracker
+
+void GpuMemoryTracker::AddSource(std::string name, Source source) {
+    mSources.push_back({std::move(name), std::move(source), {}});
+}
+
+void GpuMemoryTracker::AddEvictor(std::string name, Evictor evictor) {
+    mEvictors.push_back({std::move(name), std::move(evictor)});
+}
+
+void GpuMemoryTracker::Sample() {
+    mUsage = {};
+    for (NamedSource& source : mSources) {
+        source.mLast = source.mSource();
+        mUsage += source.mLast;
+    }
+}
+
+void GpuMemoryTracker::Update() {
+    Sample();
+
+    if (mBudget > 0 && mUsage.GetTotal() > mBudget) {
+        const uint64_t over = mUsage.GetTotal() - mBudget;
+        uint64_t freed = 0;
+        for (NamedEvictor& evictor : mEvictors) {
+            if (freed >= over) {
+                break;
+            }
+            const uint64_t bytes = evictor.mEvictor(over - freed);
+            if (bytes > 0) {
+                ALOGD("GpuMemoryTracker: %s evicted %.2f MiB", evictor.mName.c_str(),
+                      ToMiB(bytes));
+            }
+            freed += bytes;
+        }
+        if (freed > 0) {
+            mEvictedBytes += freed;
+            Sample();
+        }
+    }
+
+    const bool overBudget = mBudget > 0 && mUsage.GetTotal() > mBudget;
+    if (overBudget && !mOverBudget) {
+        ALOGW("GpuMemoryTracker: %.2f MiB is over the %.2f MiB budget after eviction",
+              ToMiB(mUsage.GetTotal()), ToMiB(mBudget));
+        LogUsage();
+    }
+    mOverBudget = overBudget;
+
+    // Peaks after eviction: what was actually held across the frame
+    for (size_t i = 0; i < GpuMemoryUsage::CATEGORY_COUNT; i++) {
+        mPeak.mBytes[i] = std::max(mPeak.mBytes[i], mUsage.mBytes[i]);
+    }
+    mPeakTotal = std::max(mPeakTotal, mUsage.GetTotal());
+}
+
+void GpuMemoryTracker::LogUsage() const {
+    ALOGI("GpuMemoryTracker: %.2f MiB now, %.2f MiB peak, %.2f MiB evicted",
+          ToMiB(mUsage.GetTotal()), ToMiB(mPeakTotal), ToMiB(mEvictedBytes));
+    for (size_t i = 0; i < GpuMemoryUsage::CATEGORY_COUNT; i++) {
+        ALOGI("  %-10s %8.2f MiB (peak %.2f)",
+              GpuMemoryUsage::GetCategoryName(static_cast<GpuMemoryCategory>(i)),
+              ToMiB(mUsage.mBytes[i]), ToMiB(mPeak.mBytes[i]));
+    }
+    for (const NamedSource& source : mSources) {
+        ALOGI("  %-20s %8.2f MiB", source.mName.c_str(), ToMiB(source.mLast.GetTotal()));
+    }
+}
@@ -0,0 +1,121 @@
+/*******************************************************************************
+
+Filename    :   GpuMemory.h
+Content     :   Estimated GPU memory per resource category, with peaks and a
+                budget enforced by asking evictable caches to shrink
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class GpuMemoryCategory : uint8_t {
+    SWAPCHAIN,  // runtime-owned swapchain images
+    DEPTH,      // depth and shadow targets
+    MSAA,       // multisampled color
+    TEXTURE,    // single-sample color textures and renderbuffers
+    BUFFER,     // vertex, index, uniform and pixel buffers
+};
+
+/**
+ * Bytes per GpuMemoryCategory. Owners of GL storage report one of these
+ * from GetGpuMemory(), estimated from formats and dimensions.
+ */
+struct GpuMemoryUsage {
+    static constexpr size_t CATEGORY_COUNT = 5;
+
+    std::array<uint64_t, CATEGORY_COUNT> mBytes = {};
+
+    static const char* GetCategoryName(GpuMemoryCategory category);
+
+    void Add(const GpuMemoryCategory category, const uint64_t bytes) {
+        mBytes[static_cast<size_t>(category)] += bytes;
+    }
+    void Remove(const GpuMemoryCategory category, const uint64_t bytes) {
+        mBytes[static_cast<size_t>(category)] -= bytes;
+    }
+    uint64_t Get(const GpuMemoryCategory category) const {
+        return mBytes[static_cast<size_t>(category)];
+    }
+    uint64_t GetTotal() const;
+
+    GpuMemoryUsage& operator+=(const GpuMemoryUsage& other);
+};
+
+/**
+ * GpuMemoryTracker - one place that knows where the GPU memory went.
+ *
+ * Nothing in GL reports how much memory an allocation really takes, so
+ * this works from estimates: each owner of GL storage registers a Source
+ * returning its current GpuMemoryUsage, and Update() sums them once per
+ * frame, keeping per-category and total peaks.
+ *
+ * With a budget set, a frame whose total is over it calls the registered
+ * Evictors in order, each asked for the bytes still missing, until the
+ * total fits or none are left. Evictors free what nobody needs right now
+ * (idle pooled objects, cached data that can be rebuilt); a total that
+ * still doesn't fit is logged once per episode with a per-source
+ * breakdown, which is what points at the category that grew.
+ *
+ * GL thread only.
+ */
+class GpuMemoryTracker {
+public:
+    using Source = std::function<GpuMemoryUsage()>;
+    // Free up to roughly @p bytes; returns the estimated bytes freed
+    using Evictor = std::function<uint64_t(uint64_t bytes)>;
+
+    void AddSource(std::string name, Source source);
+    void AddEvictor(std::string name, Evictor evictor);
+
+    // 0 disables the budget
+    void SetBudget(uint64_t bytes) { mBudget = bytes; }
+    uint64_t GetBudget() const { return mBudget; }
+
+    /**
+     * Re-sum the sources, update peaks, and evict if over budget. Call once
+     * per frame, where evicting idle storage is safe.
+     */
+    void Update();
+
+    const GpuMemoryUsage& GetUsage() const { return mUsage; }
+    // Per category, each at its own maximum
+    const GpuMemoryUsage& GetPeakUsage() const { return mPeak; }
+    uint64_t GetPeakTotal() const { return mPeakTotal; }
+    uint64_t GetEvictedBytes() const { return mEvictedBytes; }
+
+    void LogUsage() const;
+
+private:
+    struct NamedSource {
+        std::string mName;
+        Source mSource;
+        GpuMemoryUsage mLast;
+    };
+    struct NamedEvictor {
+        std::string mName;
+        Evictor mEvictor;
+    };
+
+    void Sample();
+
+    std::vector<NamedSource> mSources;
+    std::vector<NamedEvictor> mEvictors;
+
+    uint64_t mBudget = 0;
+    GpuMemoryUsage mUsage;
+    GpuMemoryUsage mPeak;
+    uint64_t mPeakTotal = 0;
+    uint64_t mEvictedBytes = 0;
+    // Set while over budget after eviction, so the breakdown is logged once
+    bool mOverBudget = false;
+};
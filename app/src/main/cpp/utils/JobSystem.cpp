@@ -0,0 +1,93 @@
+/*******************************************************************************
+
+Filename    :   JobSystem.cpp
+Content     :   Small fixed worker pool for splitting per-frame CPU loops
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "JobSystem.h"
+
+#include <algorithm>
+
+JobSystem::JobSystem(const uint32_t workerCount) {
+    mWorkers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; i++) {
+        mWorkers.emplace_back(&JobSystem::WorkerMain, this);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkReady.notify_all();
+    for (std::thread& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void JobSystem::ParallelFor(const uint32_t count, const uint32_t grain, const RangeFn& fn) {
+    if (count == 0) {
+        return;
+    }
+    const uint32_t chunkSize = std::max(grain, 1u);
+    if (mWorkers.empty() || count <= chunkSize) {
+        fn(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFn = &fn;
+        mCount = count;
+        mGrain = chunkSize;
+        mNextIndex.store(0, std::memory_order_relaxed);
+        mJobSerial++;
+    }
+    mWorkReady.notify_all();
+
+    RunChunks();
+
+    // Every chunk has been claimed; wait for workers still finishing theirs
+    std::unique_lock<std::mutex> lock(mMutex);
+    mWorkDone.wait(lock, [this] { return mActiveWorkers == 0; });
+    mFn = nullptr;
+}
+
+void JobSystem::RunChunks() {
+    for (;;) {
+        const uint32_t begin = mNextIndex.fetch_add(mGrain, std::memory_order_relaxed);
+        if (begin >= mCount) {
+            return;
+        }
+        (*mFn)(begin, std::min(begin + mGrain, mCount));
+    }
+}
+
+void JobSystem::WorkerMain() {
+    uint64_t seenSerial = 0;
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+        mWorkReady.wait(lock, [this, seenSerial] { return mStopping || mJobSerial != seenSerial; });
+        if (mStopping) {
+            return;
+        }
+        seenSerial = mJobSerial;
+        // Woke after the caller already wrapped up this job
+        if (mFn == nullptr) {
+            continue;
+        }
+
+        mActiveWorkers++;
+        lock.unlock();
+        RunChunks();
+        lock.lock();
+        if (--mActiveWorkers == 0) {
+            mWorkDone.notify_one();
+        }
+    }
+}
@@ -0,0 +1,70 @@
+/*******************************************************************************
+
+Filename    :   JobSystem.h
+Content     :   Small fixed worker pool for splitting per-frame CPU loops
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * JobSystem - a fixed set of worker threads that help with ParallelFor().
+ *
+ * Built for short, frame-critical loops (light binning, culling) rather than
+ * general task graphs: one ParallelFor() runs at a time, the calling thread
+ * takes chunks too, and the call returns once every chunk is done. With zero
+ * workers everything runs inline on the caller.
+ */
+class JobSystem {
+public:
+    // Processes indices [begin, end)
+    using RangeFn = std::function<void(uint32_t begin, uint32_t end)>;
+
+    explicit JobSystem(uint32_t workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /**
+     * Split [0, count) into chunks of @p grain indices and run @p fn over all
+     * of them, on the workers and the calling thread. Blocks until done.
+     * Not reentrant: @p fn must not call ParallelFor().
+     */
+    void ParallelFor(uint32_t count, uint32_t grain, const RangeFn& fn);
+
+    uint32_t GetWorkerCount() const { return static_cast<uint32_t>(mWorkers.size()); }
+
+private:
+    void WorkerMain();
+    // Take chunks of the current job until none are left
+    void RunChunks();
+
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mMutex;
+    std::condition_variable mWorkReady;
+    std::condition_variable mWorkDone;
+    bool mStopping = false;
+    // Bumped per job so sleeping workers can tell a new job from a spurious wakeup
+    uint64_t mJobSerial = 0;
+    // Workers currently inside RunChunks() for the current job
+    uint32_t mActiveWorkers = 0;
+
+    // Current job
+    const RangeFn* mFn = nullptr;
+    uint32_t mCount = 0;
+    uint32_t mGrain = 1;
+    std::atomic<uint32_t> mNextIndex{0};
+};
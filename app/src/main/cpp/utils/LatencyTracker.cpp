@@ -0,0 +1,130 @@
+/*******************************************************************************
+
+Filename    :   LatencyTracker.cpp
+Content     :   Input-to-photon latency: stage timestamps per frame on the
+                runtime's clock, and their distributions over a window
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "LatencyTracker.h"
+#include "LogUtils.h"
+
+#include <algorithm>
+
+namespace {
+    // @p sorted ascending and not empty; nearest rank
+    int64_t Percentile(const std::vector<int64_t>& sorted, const size_t percent) {
+        const size_t rank = (sorted.size() * percent + 99) / 100;
+        return sorted[std::max<size_t>(rank, 1) - 1];
+    }
+} // anonymous namespace
+
+const char* LatencyTracker::GetMetricName(const Metric metric) {
+    switch (metric) {
+        case Metric::INPUT_TO_WAIT_END: return "input_to_wait_end";
+        case Metric::INPUT_TO_SUBMIT: return "input_to_submit";
+        case Metric::INPUT_TO_DISPLAY: return "input_to_display";
+        case Metric::POSE_TO_SUBMIT: return "pose_to_submit";
+        case Metric::POSE_TO_DISPLAY: return "pose_to_display";
+        case Metric::EVENT_TO_DISPLAY: return "event_to_display";
+    }
+    return "unknown";
+}
+
+LatencyTracker::LatencyTracker(const size_t windowFrames) : mWindowFrames(windowFrames) {
+    for (std::vector<int64_t>& samples : mSamples) {
+        samples.reserve(windowFrames);
+    }
+}
+
+void LatencyTracker::BeginFrame(const uint64_t frameIndex) {
+    mStamps = {};
+    mInputEventTime = 0;
+    mPredictedDisplayTime = 0;
+    mFrameIndex = frameIndex;
+}
+
+void LatencyTracker::Mark(const Stage stage) {
+    mStamps[static_cast<size_t>(stage)] = Now();
+}
+
+const LatencyTracker::FrameLatencies& LatencyTracker::EndFrame() {
+    const auto stamp = [this](const Stage stage) { return mStamps[static_cast<size_t>(stage)]; };
+    const auto between = [](const XrTime from, const XrTime to) -> int64_t {
+        return from != 0 && to != 0 ? to - from : -1;
+    };
+    const XrTime input = stamp(Stage::INPUT_SYNC);
+    const XrTime pose = stamp(Stage::POSE_SAMPLE);
+    const XrTime submit = stamp(Stage::SUBMIT);
+
+    mLatest[static_cast<size_t>(Metric::INPUT_TO_WAIT_END)] =
+            between(input, stamp(Stage::WAIT_END));
+    mLatest[static_cast<size_t>(Metric::INPUT_TO_SUBMIT)] = between(input, submit);
+    mLatest[static_cast<size_t>(Metric::INPUT_TO_DISPLAY)] =
+            between(input, mPredictedDisplayTime);
+    mLatest[static_cast<size_t>(Metric::POSE_TO_SUBMIT)] = between(pose, submit);
+    mLatest[static_cast<size_t>(Metric::POSE_TO_DISPLAY)] = between(pose, mPredictedDisplayTime);
+    mLatest[static_cast<size_t>(Metric::EVENT_TO_DISPLAY)] =
+            between(mInputEventTime, mPredictedDisplayTime);
+
+    if (mFrameCount >= mWindowFrames) {
+        return mLatest;
+    }
+    bool measured = false;
+    for (size_t i = 0; i < METRIC_COUNT; i++) {
+        if (mLatest[i] >= 0) {
+            mSamples[i].push_back(mLatest[i]);
+            measured = true;
+        }
+    }
+    if (measured) {
+        if (mFrameCount == 0) {
+            mFirstFrame = mFrameIndex;
+        }
+        mLastFrame = mFrameIndex;
+        mFrameCount++;
+    }
+    return mLatest;
+}
+
+LatencyTracker::Distribution LatencyTracker::GetDistribution(const Metric metric) const {
+    std::vector<int64_t> sorted = mSamples[static_cast<size_t>(metric)];
+    Distribution distribution;
+    distribution.mCount = sorted.size();
+    if (sorted.empty()) {
+        return distribution;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    distribution.mP50Ns = Percentile(sorted, 50);
+    distribution.mP90Ns = Percentile(sorted, 90);
+    distribution.mP99Ns = Percentile(sorted, 99);
+    distribution.mMaxNs = sorted.back();
+    return distribution;
+}
+
+void LatencyTracker::LogSummary() {
+    ALOGI("Latency, frames %llu-%llu (p50 / p90 / p99 / max ms):",
+          static_cast<unsigned long long>(mFirstFrame),
+          static_cast<unsigned long long>(mLastFrame));
+    for (size_t i = 0; i < METRIC_COUNT; i++) {
+        const Distribution distribution = GetDistribution(static_cast<Metric>(i));
+        if (distribution.mCount == 0) {
+            continue;
+        }
+        ALOGI("  %-18s %6.2f %6.2f %6.2f %6.2f  (%zu frames)",
+              GetMetricName(static_cast<Metric>(i)), distribution.mP50Ns * 1e-6,
+              distribution.mP90Ns * 1e-6, distribution.mP99Ns * 1e-6,
+              distribution.mMaxNs * 1e-6, distribution.mCount);
+    }
+    Clear();
+}
+
+void LatencyTracker::Clear() {
+    for (std::vector<int64_t>& samples : mSamples) {
+        samples.clear();
+    }
+    mFrameCount = 0;
+}
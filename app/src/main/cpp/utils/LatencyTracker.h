@@ -0,0 +1,116 @@
+/*******************************************************************************
+
+Filename    :   LatencyTracker.h
+Content     :   Input-to-photon latency: stage timestamps per frame on the
+                runtime's clock, and their distributions over a window
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <openxr/openxr.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+ * LatencyTracker - how old a frame's input and poses are when it is shown.
+ *
+ * The render thread stamps each stage of a frame with Mark() as it passes
+ * it. Stamps are XrTime, read from a clock the owner supplies (the runtime's
+ * clock through XR_KHR_convert_timespec_time), so they compare directly with
+ * the predicted display time xrWaitFrame() returns and with the change times
+ * the runtime puts on action states.
+ *
+ * EndFrame() turns the stamps into latencies: from sampling input and poses
+ * to submitting the frame, and on to its predicted display time, which is
+ * the closest the app gets to photons. Each one goes into a window of
+ * samples whose percentiles LogSummary() reports.
+ *
+ * Without a clock, or if it returns 0, nothing is stamped or recorded.
+ * Render thread only.
+ */
+class LatencyTracker {
+public:
+    enum class Stage : uint8_t {
+        INPUT_SYNC,   // before xrSyncActions()
+        WAIT_END,     // xrWaitFrame() returned
+        POSE_SAMPLE,  // before locating the head and hands
+        SUBMIT,       // before xrEndFrame()
+    };
+    static constexpr size_t STAGE_COUNT = 4;
+
+    enum class Metric : uint8_t {
+        INPUT_TO_WAIT_END,  // input that sat out xrWaitFrame()
+        INPUT_TO_SUBMIT,
+        INPUT_TO_DISPLAY,
+        POSE_TO_SUBMIT,
+        POSE_TO_DISPLAY,    // how far ahead poses are predicted
+        EVENT_TO_DISPLAY,   // from the newest input change the runtime saw
+    };
+    static constexpr size_t METRIC_COUNT = 6;
+    static const char* GetMetricName(Metric metric);
+
+    // One frame's latencies in nanoseconds, by Metric; -1 where not measured
+    using FrameLatencies = std::array<int64_t, METRIC_COUNT>;
+
+    struct Distribution {
+        size_t mCount = 0;
+        int64_t mP50Ns = 0;
+        int64_t mP90Ns = 0;
+        int64_t mP99Ns = 0;
+        int64_t mMaxNs = 0;
+    };
+
+    // Now, as an XrTime; 0 if it can't be read
+    using Clock = std::function<XrTime()>;
+
+    // Samples past @p windowFrames are dropped until the window is cleared
+    explicit LatencyTracker(size_t windowFrames);
+
+    void SetClock(Clock clock) { mClock = std::move(clock); }
+    bool HasClock() const { return static_cast<bool>(mClock); }
+
+    // Forget the last frame's stamps
+    void BeginFrame(uint64_t frameIndex);
+    void Mark(Stage stage);
+    // Runtime time of the newest input change this frame, or 0 for none
+    void SetInputEventTime(XrTime time) { mInputEventTime = time; }
+    void SetPredictedDisplayTime(XrTime time) { mPredictedDisplayTime = time; }
+
+    // This frame's latencies, also added to the window
+    const FrameLatencies& EndFrame();
+
+    // Frames in the window with at least one latency
+    size_t GetFrameCount() const { return mFrameCount; }
+    Distribution GetDistribution(Metric metric) const;
+
+    // One line per measured metric, then empty the window
+    void LogSummary();
+    void Clear();
+
+private:
+    XrTime Now() const { return mClock ? mClock() : 0; }
+
+    Clock mClock;
+    size_t mWindowFrames;
+
+    std::array<XrTime, STAGE_COUNT> mStamps = {};
+    XrTime mInputEventTime = 0;
+    XrTime mPredictedDisplayTime = 0;
+    FrameLatencies mLatest = {};
+
+    std::array<std::vector<int64_t>, METRIC_COUNT> mSamples;
+    size_t mFrameCount = 0;
+    // The window's span, and the frame being stamped
+    uint64_t mFirstFrame = 0;
+    uint64_t mLastFrame = 0;
+    uint64_t mFrameIndex = 0;
+};
@@ -11,12 +11,32 @@ License     :   Licensed under GPLv3 or any later version.
 *******************************************************************************/
 #pragma once
 
-#include <android/log.h>
-
 #ifndef LOG_TAG
 #define LOG_TAG "VrTemplate"
 #endif
 
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__ANDROID__)
+#include <android/log.h>
+#else
+// Host builds (headless benchmarking, tools) have no logcat, so route the
+// same priorities to stderr.
+enum {
+    ANDROID_LOG_VERBOSE = 2,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL
+};
+
+#define __android_log_print(prio, tag, ...)                                                        \
+    (std::fprintf(stderr, "%c/%s: ", "??VDIWEF"[(prio) & 7], (tag)),                               \
+     std::fprintf(stderr, __VA_ARGS__), std::fputc('\n', stderr))
+#endif
+
 #define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 #define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
 #define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
@@ -29,8 +49,17 @@ License     :   Licensed under GPLv3 or any later version.
 #endif
 #define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
 
+// Called with FAIL()'s message just before it aborts, e.g. to get it into a
+// crash record. Set once at startup; nullptr for none.
+inline void (*gFailHook)(const char* message) = nullptr;
+
 #define FAIL(...)                                                                                  \
     do {                                                                                           \
-        __android_log_print(ANDROID_LOG_FATAL, LOG_TAG, __VA_ARGS__);                              \
+        char failMessage[512];                                                                     \
+        std::snprintf(failMessage, sizeof(failMessage), __VA_ARGS__);                              \
+        __android_log_print(ANDROID_LOG_FATAL, LOG_TAG, "%s", failMessage);                        \
+        if (gFailHook != nullptr) {                                                                \
+            gFailHook(failMessage);                                                                \
+        }                                                                                          \
         abort();                                                                                   \
     } while (0)
\ No newline at end of file
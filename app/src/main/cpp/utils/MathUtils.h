@@ -12,6 +12,8 @@ License     :   Licensed under GPLv3 or any later version.
 
 #include <openxr/openxr.h>
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
 // Math constants
@@ -90,4 +92,39 @@ inline constexpr XrPosef       kIdentityPose{kIdentityQuat, {0.f, 0.f, 0.f}};
             return kIdentityPose;
         }
     };
+
+    inline float Dot(const XrVector3f& a, const XrVector3f& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline XrVector3f Cross(const XrVector3f& a, const XrVector3f& b) {
+        return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    }
+
+    inline XrVector3f Normalized(const XrVector3f& v) {
+        const float length = std::sqrt(Dot(v, v));
+        return length > MATH_FLOAT_EPSILON ? v * (1.0f / length) : XrVector3f{0.0f, 0.0f, 0.0f};
+    }
+
+    /**
+     * Bounds3f - axis-aligned bounding box
+     */
+    struct Bounds3f {
+        XrVector3f mMin = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                           std::numeric_limits<float>::max()};
+        XrVector3f mMax = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+                           -std::numeric_limits<float>::max()};
+
+        bool IsEmpty() const { return mMin.x > mMax.x || mMin.y > mMax.y || mMin.z > mMax.z; }
+
+        void Expand(const XrVector3f& p) {
+            mMin = {std::min(mMin.x, p.x), std::min(mMin.y, p.y), std::min(mMin.z, p.z)};
+            mMax = {std::max(mMax.x, p.x), std::max(mMax.y, p.y), std::max(mMax.z, p.z)};
+        }
+
+        XrVector3f GetCorner(const int index) const {
+            return {(index & 1) ? mMax.x : mMin.x, (index & 2) ? mMax.y : mMin.y,
+                    (index & 4) ? mMax.z : mMin.z};
+        }
+    };
 } // namespace MathUtils
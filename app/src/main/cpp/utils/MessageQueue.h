@@ -7,10 +7,10 @@ Content     :   Simple, lock-free MPSC (multiple-producer, single-consumer) queu
 
                 TEMPLATE NOTE
                 ------------------------------------------------------------------
-                In the template app, this class is being used for exactly one thing
-                (signalling exit), but real-world apps may want to use MessageQueue
-                to communicate frequently between the main thread and the render
-                thread. In general, you shouldn't cause the render thread to block
+                In the template app, this class is used for signalling exit and for
+                live ParameterRegistry changes, but real-world apps may want to use
+                MessageQueue to communicate frequently between the main thread and
+                the render thread. In general, you shouldn't cause the render thread to block
                 for any reason during rendering, and so, in an effort to be as
                 correct as possible, this class is non-blocking-on-read even in the
                 completely hypothetical case of frequent writes.
@@ -39,6 +39,7 @@ class Message {
 public:
     enum class Type {
         EXIT_NEEDED = 0, // payload ignored
+        SET_PARAMETER,   // payload: ParameterRegistry id << 32 | value bits
     };
 
     constexpr Message(const Type t = Type::EXIT_NEEDED,
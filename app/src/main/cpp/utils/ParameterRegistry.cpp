@@ -0,0 +1,323 @@
+/*******************************************************************************
+
+Filename    :   ParameterRegistry.cpp
+Content     :   Named, typed, range-checked tuning parameters, loaded from a
+                config file and changed live through MessageQueue messages
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "ParameterRegistry.h"
+#include "LogUtils.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace {
+    uint32_t IntToBits(const int32_t value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    int32_t BitsToInt(const uint32_t bits) {
+        int32_t value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint32_t FloatToBits(const float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    float BitsToFloat(const uint32_t bits) {
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    std::string Trim(const std::string& text) {
+        const size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) {
+            return {};
+        }
+        return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+    }
+
+    bool ParseInt(const std::string& text, int32_t& value) {
+        errno = 0;
+        char* end = nullptr;
+        const long parsed = strtol(text.c_str(), &end, 0);
+        if (text.empty() || *end != '\0' || errno != 0 || parsed < INT32_MIN ||
+            parsed > INT32_MAX) {
+            return false;
+        }
+        value = static_cast<int32_t>(parsed);
+        return true;
+    }
+} // anonymous namespace
+
+ParameterRegistry::Id ParameterRegistry::Add(Parameter parameter) {
+    assert(mParameters.size() < MAX_PARAMETERS && Find(parameter.mName) == INVALID_ID);
+    assert(IsValid(parameter, parameter.mBits));
+    mParameters.push_back(std::move(parameter));
+    return static_cast<Id>(mParameters.size() - 1);
+}
+
+ParameterRegistry::Id ParameterRegistry::AddBool(const char* name, const bool defaultValue,
+                                                 const char* description) {
+    return Add({name, description, Type::BOOL, IntToBits(defaultValue ? 1 : 0), 0, 1, 0.0f,
+                0.0f, {}, false});
+}
+
+ParameterRegistry::Id ParameterRegistry::AddInt(const char* name, const int32_t defaultValue,
+                                                const int32_t minValue, const int32_t maxValue,
+                                                const char* description) {
+    return Add({name, description, Type::INT, IntToBits(defaultValue), minValue, maxValue, 0.0f,
+                0.0f, {}, false});
+}
+
+ParameterRegistry::Id ParameterRegistry::AddChoice(const char* name, const int32_t defaultValue,
+                                                   std::vector<Choice> choices,
+                                                   const char* description) {
+    return Add({name, description, Type::CHOICE, IntToBits(defaultValue), 0, 0, 0.0f, 0.0f,
+                std::move(choices), false});
+}
+
+ParameterRegistry::Id ParameterRegistry::AddFloat(const char* name, const float defaultValue,
+                                                  const float minValue, const float maxValue,
+                                                  const char* description) {
+    return Add({name, description, Type::FLOAT, FloatToBits(defaultValue), 0, 0, minValue,
+                maxValue, {}, false});
+}
+
+ParameterRegistry::Id ParameterRegistry::Find(const std::string& name) const {
+    for (size_t i = 0; i < mParameters.size(); i++) {
+        if (name == mParameters[i].mName) {
+            return static_cast<Id>(i);
+        }
+    }
+    return INVALID_ID;
+}
+
+bool ParameterRegistry::IsValid(const Parameter& parameter, const uint32_t bits) const {
+    switch (parameter.mType) {
+        case Type::BOOL:
+        case Type::INT: {
+            const int32_t value = BitsToInt(bits);
+            return value >= parameter.mMinInt && value <= parameter.mMaxInt;
+        }
+        case Type::CHOICE:
+            for (const Choice& choice : parameter.mChoices) {
+                if (choice.mValue == BitsToInt(bits)) {
+                    return true;
+                }
+            }
+            return false;
+        case Type::FLOAT: {
+            const float value = BitsToFloat(bits);
+            return std::isfinite(value) && value >= parameter.mMinFloat &&
+                   value <= parameter.mMaxFloat;
+        }
+    }
+    return false;
+}
+
+bool ParameterRegistry::Parse(const Parameter& parameter, const std::string& text,
+                              uint32_t& bits) const {
+    int32_t intValue = 0;
+    switch (parameter.mType) {
+        case Type::BOOL:
+            if (text == "true" || text == "on") {
+                intValue = 1;
+            } else if (text == "false" || text == "off") {
+                intValue = 0;
+            } else if (!ParseInt(text, intValue)) {
+                return false;
+            }
+            bits = IntToBits(intValue);
+            break;
+        case Type::INT:
+            if (!ParseInt(text, intValue)) {
+                return false;
+            }
+            bits = IntToBits(intValue);
+            break;
+        case Type::CHOICE: {
+            bool named = false;
+            for (const Choice& choice : parameter.mChoices) {
+                if (text == choice.mName) {
+                    intValue = choice.mValue;
+                    named = true;
+                }
+            }
+            if (!named && !ParseInt(text, intValue)) {
+                return false;
+            }
+            bits = IntToBits(intValue);
+            break;
+        }
+        case Type::FLOAT: {
+            char* end = nullptr;
+            const float value = strtof(text.c_str(), &end);
+            if (text.empty() || *end != '\0') {
+                return false;
+            }
+            bits = FloatToBits(value);
+            break;
+        }
+    }
+    return IsValid(parameter, bits);
+}
+
+bool ParameterRegistry::MakeSetMessage(const std::string& name, const std::string& value,
+                                       Message& message) const {
+    const Id id = Find(name);
+    if (id == INVALID_ID) {
+        ALOGW("ParameterRegistry: no parameter \"%s\"", name.c_str());
+        return false;
+    }
+    uint32_t bits = 0;
+    if (!Parse(mParameters[id], value, bits)) {
+        ALOGW("ParameterRegistry: \"%s\" is not a valid %s", value.c_str(), name.c_str());
+        return false;
+    }
+    message = Message(Message::Type::SET_PARAMETER, (uint64_t{id} << 32) | bits);
+    return true;
+}
+
+Message ParameterRegistry::MakeSetMessage(const Id id, const int32_t value) const {
+    assert(mParameters[id].mType != Type::FLOAT);
+    return Message(Message::Type::SET_PARAMETER, (uint64_t{id} << 32) | IntToBits(value));
+}
+
+Message ParameterRegistry::MakeSetMessage(const Id id, const float value) const {
+    assert(mParameters[id].mType == Type::FLOAT);
+    return Message(Message::Type::SET_PARAMETER, (uint64_t{id} << 32) | FloatToBits(value));
+}
+
+bool ParameterRegistry::Set(const Id id, const uint32_t bits) {
+    Parameter& parameter = mParameters[id];
+    if (!IsValid(parameter, bits)) {
+        ALOGW("ParameterRegistry: rejected out-of-range value for %s", parameter.mName);
+        return false;
+    }
+    if (parameter.mBits == bits) {
+        return false;
+    }
+    parameter.mBits = bits;
+    parameter.mChanged = true;
+    mVersion++;
+    ALOGI("ParameterRegistry: %s = %s", parameter.mName, Format(id).c_str());
+    return true;
+}
+
+bool ParameterRegistry::Apply(const Message& message) {
+    assert(message.mType == Message::Type::SET_PARAMETER);
+    const auto id = static_cast<Id>(message.mPayload >> 32);
+    if (id >= mParameters.size()) {
+        ALOGW("ParameterRegistry: message for unknown parameter %u", id);
+        return false;
+    }
+    return Set(id, static_cast<uint32_t>(message.mPayload));
+}
+
+bool ParameterRegistry::LoadFile(const std::string& path, const std::string& model) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    bool matches = true;
+    int lineNumber = 0;
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), file) != nullptr) {
+        lineNumber++;
+        std::string line = buffer;
+        line = Trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        if (line.front() == '[' && line.back() == ']') {
+            const std::string section = Trim(line.substr(1, line.size() - 2));
+            matches = section == "*" || section == model;
+            continue;
+        }
+        const size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            ALOGW("ParameterRegistry: %s:%d: expected name = value", path.c_str(), lineNumber);
+            continue;
+        }
+        Message message;
+        if (matches &&
+            MakeSetMessage(Trim(line.substr(0, equals)), Trim(line.substr(equals + 1)), message)) {
+            Apply(message);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+bool ParameterRegistry::TakeChanged(const Id id) {
+    return std::exchange(mParameters[id].mChanged, false);
+}
+
+int32_t ParameterRegistry::GetInt(const Id id) const {
+    assert(mParameters[id].mType != Type::FLOAT);
+    return BitsToInt(mParameters[id].mBits);
+}
+
+float ParameterRegistry::GetFloat(const Id id) const {
+    assert(mParameters[id].mType == Type::FLOAT);
+    return BitsToFloat(mParameters[id].mBits);
+}
+
+float ParameterRegistry::GetAsFloat(const Id id) const {
+    return mParameters[id].mType == Type::FLOAT ? GetFloat(id)
+                                                : static_cast<float>(GetInt(id));
+}
+
+std::string ParameterRegistry::Format(const Id id) const {
+    const Parameter& parameter = mParameters[id];
+    char text[32];
+    switch (parameter.mType) {
+        case Type::BOOL:
+            return GetBool(id) ? "true" : "false";
+        case Type::CHOICE:
+            for (const Choice& choice : parameter.mChoices) {
+                if (choice.mValue == GetInt(id)) {
+                    return choice.mName;
+                }
+            }
+            break;
+        case Type::FLOAT:
+            snprintf(text, sizeof(text), "%g", GetFloat(id));
+            return text;
+        case Type::INT:
+            break;
+    }
+    snprintf(text, sizeof(text), "%d", GetInt(id));
+    return text;
+}
+
+void ParameterRegistry::GetValues(Values& values) const {
+    values = {};
+    for (size_t i = 0; i < mParameters.size(); i++) {
+        values[i] = GetAsFloat(static_cast<Id>(i));
+    }
+}
+
+void ParameterRegistry::LogValues() const {
+    for (size_t i = 0; i < mParameters.size(); i++) {
+        ALOGI("  %-24s %-16s %s", mParameters[i].mName, Format(static_cast<Id>(i)).c_str(),
+              mParameters[i].mDescription);
+    }
+}
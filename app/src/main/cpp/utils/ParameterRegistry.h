@@ -0,0 +1,147 @@
+/*******************************************************************************
+
+Filename    :   ParameterRegistry.h
+Content     :   Named, typed, range-checked tuning parameters, loaded from a
+                config file and changed live through MessageQueue messages
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "MessageQueue.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * ParameterRegistry - the knobs performance tuning turns, in one place.
+ *
+ * Each parameter has a name, a type, a default and the values it may take:
+ * a range for INT and FLOAT, a list of named values for CHOICE (which are
+ * ints underneath). Values only ever change to something in range, so
+ * whoever reads one needn't check it again.
+ *
+ * Values change in two ways:
+ *  - LoadFile() at startup, from "name = value" lines. A "[model]" line
+ *    makes the lines after it apply only on that device model, so one file
+ *    carries per-device tuning; "[*]" goes back to all devices.
+ *  - A SET_PARAMETER Message, built by MakeSetMessage() on any thread and
+ *    applied by Apply() on the render thread, which polls its queue between
+ *    frames. Changes therefore land on a frame boundary.
+ *
+ * Whoever owns a parameter checks TakeChanged() after messages are applied
+ * and reconfigures itself.
+ *
+ * Registration happens before any other thread sees the registry; after
+ * that, names and types are read-only and safe to use from any thread.
+ * Values belong to the render thread.
+ */
+class ParameterRegistry {
+public:
+    static constexpr size_t MAX_PARAMETERS = 16;
+
+    using Id = uint32_t;
+    static constexpr Id INVALID_ID = UINT32_MAX;
+
+    enum class Type : uint8_t {
+        BOOL,
+        INT,
+        CHOICE,
+        FLOAT,
+    };
+
+    struct Choice {
+        const char* mName;
+        int32_t mValue;
+    };
+
+    using Values = std::array<float, MAX_PARAMETERS>;
+
+    Id AddBool(const char* name, bool defaultValue, const char* description);
+    Id AddInt(const char* name, int32_t defaultValue, int32_t minValue, int32_t maxValue,
+              const char* description);
+    Id AddChoice(const char* name, int32_t defaultValue, std::vector<Choice> choices,
+                 const char* description);
+    Id AddFloat(const char* name, float defaultValue, float minValue, float maxValue,
+                const char* description);
+
+    // Any thread, once registration is done
+    Id Find(const std::string& name) const;
+    size_t GetCount() const { return mParameters.size(); }
+    const char* GetName(Id id) const { return mParameters[id].mName; }
+    Type GetType(Id id) const { return mParameters[id].mType; }
+
+    /**
+     * Any thread: a message setting @p name to @p value, parsed and checked
+     * for its type and range. Choices take their name or their number.
+     *
+     * @return false, and logs why, if there is no such parameter or the
+     *         value doesn't fit it
+     */
+    bool MakeSetMessage(const std::string& name, const std::string& value,
+                        Message& message) const;
+    Message MakeSetMessage(Id id, int32_t value) const;
+    Message MakeSetMessage(Id id, float value) const;
+
+    /**
+     * Apply the "name = value" lines of @p path that match @p model.
+     *
+     * @return false if the file couldn't be read; bad lines are logged and
+     *         skipped
+     */
+    bool LoadFile(const std::string& path, const std::string& model);
+
+    /**
+     * Apply a SET_PARAMETER message.
+     *
+     * @return true if the value changed
+     */
+    bool Apply(const Message& message);
+
+    // True once after each change to @p id
+    bool TakeChanged(Id id);
+
+    bool GetBool(Id id) const { return GetInt(id) != 0; }
+    int32_t GetInt(Id id) const;
+    float GetFloat(Id id) const;
+    // Any type, for logging and stats
+    float GetAsFloat(Id id) const;
+    // Choices by name
+    std::string Format(Id id) const;
+
+    // Bumped by every change
+    uint32_t GetVersion() const { return mVersion; }
+    // All values as floats, by id, for FrameStats
+    void GetValues(Values& values) const;
+
+    void LogValues() const;
+
+private:
+    struct Parameter {
+        const char* mName;
+        const char* mDescription;
+        Type mType;
+        // An int32_t or a float, by mType
+        uint32_t mBits;
+        int32_t mMinInt;
+        int32_t mMaxInt;
+        float mMinFloat;
+        float mMaxFloat;
+        std::vector<Choice> mChoices;
+        bool mChanged;
+    };
+
+    Id Add(Parameter parameter);
+    bool Parse(const Parameter& parameter, const std::string& text, uint32_t& bits) const;
+    bool IsValid(const Parameter& parameter, uint32_t bits) const;
+    bool Set(Id id, uint32_t bits);
+
+    std::vector<Parameter> mParameters;
+    uint32_t mVersion = 0;
+};
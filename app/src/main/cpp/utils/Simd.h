@@ -0,0 +1,182 @@
+/*******************************************************************************
+
+Filename    :   Simd.h
+Content     :   Minimal 4-wide float SIMD wrapper (NEON / SSE2 / scalar)
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMD_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#else
+#define SIMD_SCALAR 1
+#endif
+
+/**
+ * Float4 - four floats processed together.
+ *
+ * Only covers what the CPU-side culling, binning and rasterization loops need. Comparisons
+ * return lane masks (all bits set or clear) that combine with & and | and
+ * collapse to a 4-bit integer with MoveMask(), lane 0 in bit 0.
+ *
+ * Data is kept in structure-of-arrays form by callers, so loads and stores
+ * are plain 16-byte-aligned vector moves.
+ */
+struct Float4 {
+#if defined(SIMD_NEON)
+    float32x4_t mV;
+#elif defined(SIMD_SSE2)
+    __m128 mV;
+#else
+    float mV[4];
+#endif
+
+    static Float4 Splat(float value);
+    static Float4 Load(const float* alignedPtr);
+    void Store(float* alignedPtr) const;
+};
+
+#if defined(SIMD_NEON)
+
+inline Float4 Float4::Splat(const float value) { return {vdupq_n_f32(value)}; }
+inline Float4 Float4::Load(const float* alignedPtr) { return {vld1q_f32(alignedPtr)}; }
+inline void Float4::Store(float* alignedPtr) const { vst1q_f32(alignedPtr, mV); }
+
+inline Float4 operator+(const Float4 a, const Float4 b) { return {vaddq_f32(a.mV, b.mV)}; }
+inline Float4 operator-(const Float4 a, const Float4 b) { return {vsubq_f32(a.mV, b.mV)}; }
+inline Float4 operator*(const Float4 a, const Float4 b) { return {vmulq_f32(a.mV, b.mV)}; }
+inline Float4 Min(const Float4 a, const Float4 b) { return {vminq_f32(a.mV, b.mV)}; }
+inline Float4 Max(const Float4 a, const Float4 b) { return {vmaxq_f32(a.mV, b.mV)}; }
+// a * b + c
+inline Float4 MulAdd(const Float4 a, const Float4 b, const Float4 c) {
+    return {vmlaq_f32(c.mV, a.mV, b.mV)};
+}
+
+inline Float4 CmpLe(const Float4 a, const Float4 b) {
+    return {vreinterpretq_f32_u32(vcleq_f32(a.mV, b.mV))};
+}
+inline Float4 CmpGe(const Float4 a, const Float4 b) {
+    return {vreinterpretq_f32_u32(vcgeq_f32(a.mV, b.mV))};
+}
+inline Float4 operator&(const Float4 a, const Float4 b) {
+    return {vreinterpretq_f32_u32(
+            vandq_u32(vreinterpretq_u32_f32(a.mV), vreinterpretq_u32_f32(b.mV)))};
+}
+inline Float4 operator|(const Float4 a, const Float4 b) {
+    return {vreinterpretq_f32_u32(
+            vorrq_u32(vreinterpretq_u32_f32(a.mV), vreinterpretq_u32_f32(b.mV)))};
+}
+
+// Per lane: mask ? a : b
+inline Float4 Select(const Float4 mask, const Float4 a, const Float4 b) {
+    return {vbslq_f32(vreinterpretq_u32_f32(mask.mV), a.mV, b.mV)};
+}
+
+inline uint32_t MoveMask(const Float4 mask) {
+    // Keep one bit per lane, shift it into lane position, then sum the lanes
+    static const int32_t kShifts[4] = {0, 1, 2, 3};
+    const uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(mask.mV), 31);
+    const uint32x4_t positioned = vshlq_u32(bits, vld1q_s32(kShifts));
+#if defined(__aarch64__)
+    return vaddvq_u32(positioned);
+#else
+    const uint32x2_t pairs = vadd_u32(vget_low_u32(positioned), vget_high_u32(positioned));
+    return vget_lane_u32(vpadd_u32(pairs, pairs), 0);
+#endif
+}
+
+#elif defined(SIMD_SSE2)
+
+inline Float4 Float4::Splat(const float value) { return {_mm_set1_ps(value)}; }
+inline Float4 Float4::Load(const float* alignedPtr) { return {_mm_load_ps(alignedPtr)}; }
+inline void Float4::Store(float* alignedPtr) const { _mm_store_ps(alignedPtr, mV); }
+
+inline Float4 operator+(const Float4 a, const Float4 b) { return {_mm_add_ps(a.mV, b.mV)}; }
+inline Float4 operator-(const Float4 a, const Float4 b) { return {_mm_sub_ps(a.mV, b.mV)}; }
+inline Float4 operator*(const Float4 a, const Float4 b) { return {_mm_mul_ps(a.mV, b.mV)}; }
+inline Float4 Min(const Float4 a, const Float4 b) { return {_mm_min_ps(a.mV, b.mV)}; }
+inline Float4 Max(const Float4 a, const Float4 b) { return {_mm_max_ps(a.mV, b.mV)}; }
+inline Float4 MulAdd(const Float4 a, const Float4 b, const Float4 c) {
+    return {_mm_add_ps(_mm_mul_ps(a.mV, b.mV), c.mV)};
+}
+
+inline Float4 CmpLe(const Float4 a, const Float4 b) { return {_mm_cmple_ps(a.mV, b.mV)}; }
+inline Float4 CmpGe(const Float4 a, const Float4 b) { return {_mm_cmpge_ps(a.mV, b.mV)}; }
+inline Float4 operator&(const Float4 a, const Float4 b) { return {_mm_and_ps(a.mV, b.mV)}; }
+inline Float4 operator|(const Float4 a, const Float4 b) { return {_mm_or_ps(a.mV, b.mV)}; }
+
+inline Float4 Select(const Float4 mask, const Float4 a, const Float4 b) {
+    return {_mm_or_ps(_mm_and_ps(mask.mV, a.mV), _mm_andnot_ps(mask.mV, b.mV))};
+}
+
+inline uint32_t MoveMask(const Float4 mask) {
+    return static_cast<uint32_t>(_mm_movemask_ps(mask.mV));
+}
+
+#else
+
+inline Float4 Float4::Splat(const float value) { return {{value, value, value, value}}; }
+inline Float4 Float4::Load(const float* alignedPtr) {
+    return {{alignedPtr[0], alignedPtr[1], alignedPtr[2], alignedPtr[3]}};
+}
+inline void Float4::Store(float* alignedPtr) const {
+    for (int i = 0; i < 4; i++) { alignedPtr[i] = mV[i]; }
+}
+
+#define SIMD_SCALAR_OP(name, expr)                                                                 \
+    inline Float4 name(const Float4 a, const Float4 b) {                                           \
+        Float4 r;                                                                                  \
+        for (int i = 0; i < 4; i++) { r.mV[i] = (expr); }                                          \
+        return r;                                                                                  \
+    }
+
+SIMD_SCALAR_OP(operator+, a.mV[i] + b.mV[i])
+SIMD_SCALAR_OP(operator-, a.mV[i] - b.mV[i])
+SIMD_SCALAR_OP(operator*, a.mV[i] * b.mV[i])
+SIMD_SCALAR_OP(Min, a.mV[i] < b.mV[i] ? a.mV[i] : b.mV[i])
+SIMD_SCALAR_OP(Max, a.mV[i] > b.mV[i] ? a.mV[i] : b.mV[i])
+#undef SIMD_SCALAR_OP
+
+inline Float4 MulAdd(const Float4 a, const Float4 b, const Float4 c) { return a * b + c; }
+
+// Scalar masks use 1.0 / 0.0 per lane; only & | and MoveMask() look at them
+inline Float4 CmpLe(const Float4 a, const Float4 b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) { r.mV[i] = a.mV[i] <= b.mV[i] ? 1.0f : 0.0f; }
+    return r;
+}
+inline Float4 CmpGe(const Float4 a, const Float4 b) { return CmpLe(b, a); }
+inline Float4 operator&(const Float4 a, const Float4 b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) { r.mV[i] = (a.mV[i] != 0.0f && b.mV[i] != 0.0f) ? 1.0f : 0.0f; }
+    return r;
+}
+inline Float4 operator|(const Float4 a, const Float4 b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) { r.mV[i] = (a.mV[i] != 0.0f || b.mV[i] != 0.0f) ? 1.0f : 0.0f; }
+    return r;
+}
+
+inline Float4 Select(const Float4 mask, const Float4 a, const Float4 b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) { r.mV[i] = mask.mV[i] != 0.0f ? a.mV[i] : b.mV[i]; }
+    return r;
+}
+
+inline uint32_t MoveMask(const Float4 mask) {
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; i++) { bits |= (mask.mV[i] != 0.0f ? 1u : 0u) << i; }
+    return bits;
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*******************************************************************************
+
+Filename    :   SlackScheduler.cpp
+Content     :   Runs deferrable, time-sliced tasks in the idle time between
+                submitting a frame and the runtime waking the app for the next
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "SlackScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+    // Decaying maxima lose 1/16 of their value per sample
+    int64_t DecayMax(const int64_t current, const int64_t sample) {
+        return std::max(sample, current - current / 16);
+    }
+} // anonymous namespace
+
+int64_t SlackScheduler::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SlackScheduler::TaskId SlackScheduler::Add(const char* name, const Priority priority,
+                                           TaskFn fn) {
+    const TaskId id = mNextId++;
+    mTasks.push_back({id, priority, name, std::move(fn)});
+    return id;
+}
+
+void SlackScheduler::Remove(const TaskId id) {
+    // Only marked here, so removing from inside a task is safe
+    for (Task& task : mTasks) {
+        if (task.mId == id) {
+            task.mRemoved = true;
+        }
+    }
+}
+
+void SlackScheduler::BeginWait() {
+    mWaitStartNs = Now();
+    if (mRunEndNs != 0) {
+        mPreWaitNs = DecayMax(mPreWaitNs, mWaitStartNs - mRunEndNs);
+    }
+}
+
+void SlackScheduler::EndWait(const int64_t displayPeriodNs) {
+    const int64_t now = Now();
+    const int64_t waitNs = now - mWaitStartNs;
+    mLastWakeNs = now;
+    mDisplayPeriodNs = displayPeriodNs;
+
+    // Barely waiting after slack work means the work ate into the frame
+    if (mRanWork && waitNs < SHORT_WAIT_NS) {
+        mStats.mShortWaits++;
+        mStats.mMarginNs = std::min(mStats.mMarginNs * 3 / 2, MAX_MARGIN_NS);
+    } else {
+        mStats.mMarginNs = std::max(mStats.mMarginNs - mStats.mMarginNs / 64, MIN_MARGIN_NS);
+    }
+    mRanWork = false;
+}
+
+int64_t SlackScheduler::EstimateSlack(const int64_t nowNs) const {
+    if (mDisplayPeriodNs <= 0) {
+        return 0;
+    }
+    // xrWaitFrame() paces wakes one period apart
+    const int64_t nextWakeNs = mLastWakeNs + mDisplayPeriodNs;
+    return std::max<int64_t>(nextWakeNs - nowNs - mStats.mMarginNs - mPreWaitNs, 0);
+}
+
+void SlackScheduler::Run() {
+    const int64_t start = Now();
+    const int64_t slack = EstimateSlack(start);
+    const int64_t deadline = start + slack;
+    mStats.mSlackNs = slack;
+    mStats.mTasksRun = 0;
+    mStats.mTasksSkipped = 0;
+    if (slack < MIN_SLICE_NS) {
+        mStats.mFramesWithoutSlack++;
+    }
+
+    // Tasks added from inside a task wait for the next Run()
+    const size_t taskCount = mTasks.size();
+    for (size_t p = 0; p < PRIORITY_COUNT; p++) {
+        const auto priority = static_cast<Priority>(p);
+        size_t last = 0;
+        bool ran = false;
+        for (size_t n = 0; n < taskCount; n++) {
+            const size_t index = (mNextTask[p] + n) % taskCount;
+            if (mTasks[index].mPriority != priority || mTasks[index].mRemoved) {
+                continue;
+            }
+            const int64_t now = Now();
+            // Leave room for this task's usual overrun
+            const int64_t taskDeadline = deadline - mTasks[index].mOverrunNs;
+            if (taskDeadline - now < MIN_SLICE_NS) {
+                mStats.mTasksSkipped++;
+                continue;
+            }
+            // Copied out: the task may Add() and reallocate mTasks
+            const TaskFn fn = mTasks[index].mFn;
+            const Result result = fn(taskDeadline);
+            const int64_t end = Now();
+            Task& task = mTasks[index];
+            task.mOverrunNs = DecayMax(task.mOverrunNs, std::max<int64_t>(end - taskDeadline, 0));
+            if (result == Result::DONE) {
+                task.mRemoved = true;
+            }
+            mStats.mTasksRun++;
+            mRanWork = true;
+            ran = true;
+            last = index;
+        }
+        // Whoever ran last goes to the back of the line
+        if (ran) {
+            mNextTask[p] = (last + 1) % taskCount;
+        }
+    }
+
+    mTasks.erase(std::remove_if(mTasks.begin(), mTasks.end(),
+                                [](const Task& task) { return task.mRemoved; }),
+                 mTasks.end());
+    for (size_t& next : mNextTask) {
+        next = mTasks.empty() ? 0 : next % mTasks.size();
+    }
+    mRunEndNs = Now();
+    mStats.mUsedNs = mRunEndNs - start;
+}
@@ -0,0 +1,130 @@
+/*******************************************************************************
+
+Filename    :   SlackScheduler.h
+Content     :   Runs deferrable, time-sliced tasks in the idle time between
+                submitting a frame and the runtime waking the app for the next
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * SlackScheduler - turns the render thread's idle time into useful work.
+ *
+ * After xrEndFrame() the render thread has nothing to do until xrWaitFrame()
+ * returns for the next frame, roughly one display period after it last
+ * returned. Run() estimates how much of that is left, keeps a safety margin
+ * plus the time the thread needs between Run() and xrWaitFrame() (event
+ * polling, input sync), and spends the rest on registered tasks.
+ *
+ * The margin adapts from past waits: a frame whose xrWaitFrame() barely
+ * blocked after slack work ran means the estimate was too generous, so the
+ * margin grows at once; it shrinks back slowly while waits stay long.
+ *
+ * Tasks are called highest priority first, round-robin within a priority,
+ * at most once per Run(), with a deadline they should check between small
+ * slices of work. A task is skipped when the remaining time is less than the
+ * longest it has recently overrun its deadline by, so one slow task can't
+ * push the frame late. Tasks may be starved indefinitely when there is no
+ * slack; nothing that must happen every frame belongs here.
+ *
+ * Times are steady_clock nanoseconds. Render thread only.
+ */
+class SlackScheduler {
+public:
+    enum class Priority : uint8_t {
+        HIGH,
+        NORMAL,
+        LOW,
+    };
+    static constexpr size_t PRIORITY_COUNT = 3;
+
+    enum class Result {
+        DONE,  // remove the task
+        MORE,  // call again in a later frame
+    };
+
+    // Do some work, returning by @p deadlineNs where possible
+    using TaskFn = std::function<Result(int64_t deadlineNs)>;
+    using TaskId = uint32_t;
+    static constexpr TaskId INVALID_TASK = UINT32_MAX;
+
+    static constexpr int64_t MIN_MARGIN_NS = 1000000;
+    static constexpr int64_t MAX_MARGIN_NS = 4000000;
+    // An xrWaitFrame() shorter than this after slack work counts as too close
+    static constexpr int64_t SHORT_WAIT_NS = 500000;
+    // Not worth calling a task with less than this left
+    static constexpr int64_t MIN_SLICE_NS = 50000;
+
+    struct Stats {
+        // From the last Run()
+        int64_t mSlackNs = 0;
+        int64_t mUsedNs = 0;
+        uint32_t mTasksRun = 0;
+        uint32_t mTasksSkipped = 0;
+        // Running totals
+        uint64_t mShortWaits = 0;
+        uint64_t mFramesWithoutSlack = 0;
+        int64_t mMarginNs = MIN_MARGIN_NS;
+    };
+
+    static int64_t Now();
+
+    /**
+     * Register a task; it is called in later Run()s until it returns DONE
+     * or is removed. May be called from inside a task.
+     */
+    TaskId Add(const char* name, Priority priority, TaskFn fn);
+    void Remove(TaskId id);
+
+    // Bracket xrWaitFrame() with these
+    void BeginWait();
+    void EndWait(int64_t displayPeriodNs);
+
+    /**
+     * Run tasks in the time left before the next frame's xrWaitFrame() is
+     * expected to return. Call right after xrEndFrame().
+     */
+    void Run();
+
+    // Slack Run() would have at @p nowNs, after the margins
+    int64_t EstimateSlack(int64_t nowNs) const;
+
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    struct Task {
+        TaskId mId;
+        Priority mPriority;
+        std::string mName;
+        TaskFn mFn;
+        // Decaying maximum of how far calls ran past their deadline
+        int64_t mOverrunNs = 0;
+        bool mRemoved = false;
+    };
+
+    std::vector<Task> mTasks;
+    TaskId mNextId = 0;
+    // Per priority: where the next Run() starts its round-robin
+    std::array<size_t, PRIORITY_COUNT> mNextTask = {};
+
+    int64_t mWaitStartNs = 0;
+    int64_t mLastWakeNs = 0;
+    int64_t mDisplayPeriodNs = 0;
+    // When the last Run() returned, and the decaying maximum of the time
+    // from there to the next BeginWait()
+    int64_t mRunEndNs = 0;
+    int64_t mPreWaitNs = 0;
+    bool mRanWork = false;
+
+    Stats mStats;
+};
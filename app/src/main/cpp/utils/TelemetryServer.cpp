@@ -0,0 +1,332 @@
+/*******************************************************************************
+
+Filename    :   TelemetryServer.cpp
+Content     :   Opt-in live telemetry stream over a local Unix domain socket
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "TelemetryServer.h"
+#include "LogUtils.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+    constexpr int64_t kSecToNs = 1000000000;
+
+    int64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double ToMs(const int64_t ns) {
+        return static_cast<double>(ns) * 1e-6;
+    }
+
+    __attribute__((format(printf, 2, 3)))
+    void AppendF(std::string& out, const char* format, ...) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        const int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length > 0) {
+            out.append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+        }
+    }
+
+    // Resident set size from /proc, in KiB; 0 if unavailable
+    uint64_t ReadRssKb() {
+        FILE* file = fopen("/proc/self/statm", "r");
+        if (file == nullptr) {
+            return 0;
+        }
+        unsigned long long sizePages = 0;
+        unsigned long long residentPages = 0;
+        const int read = fscanf(file, "%llu %llu", &sizePages, &residentPages);
+        fclose(file);
+        if (read != 2) {
+            return 0;
+        }
+        return residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+    }
+
+    constexpr size_t kMaxCommandLength = 256;
+
+    // One line, less the per-client "dropped" count and closing brace
+    void FormatSample(const TelemetrySample& sample,
+                      const std::vector<std::string>& parameterNames, std::string& out) {
+        const FrameStats& frame = sample.mFrame;
+        out.clear();
+        AppendF(out, "{\"type\":\"sample\",\"time_ns\":%lld,\"frame\":%llu",
+                static_cast<long long>(sample.mTimeNs),
+                static_cast<unsigned long long>(frame.mFrameIndex));
+        AppendF(out, ",\"session\":\"%s\",\"focused\":%s", sample.mSessionState,
+                sample.mFocused ? "true" : "false");
+        AppendF(out, ",\"display_period_ms\":%.3f,\"cpu_submit_ms\":%.3f,\"resolve_ms\":%.3f",
+                ToMs(sample.mDisplayPeriodNs), ToMs(frame.mCpuSubmitNs), ToMs(frame.mResolveNs));
+        AppendF(out, ",\"light_bin_ms\":%.3f,\"occlusion_ms\":%.3f,\"readback_ms\":%.3f",
+                ToMs(frame.mLightBinNs), ToMs(frame.mOcclusionNs), ToMs(frame.mReadbackNs));
+        AppendF(out, ",\"slack_ms\":%.3f,\"slack_used_ms\":%.3f", ToMs(frame.mSlackNs),
+                ToMs(frame.mSlackUsedNs));
+        const std::pair<const char*, int64_t> latencies[] = {
+                {"input_to_wait_end", frame.mInputToWaitEndNs},
+                {"input_to_submit", frame.mInputToSubmitNs},
+                {"input_to_display", frame.mInputToDisplayNs},
+                {"pose_to_submit", frame.mPoseToSubmitNs},
+                {"pose_to_display", frame.mPoseToDisplayNs},
+                {"event_to_display", frame.mEventToDisplayNs},
+        };
+        for (const auto& [name, latencyNs] : latencies) {
+            if (latencyNs >= 0) {
+                AppendF(out, ",\"%s_ms\":%.3f", name, ToMs(latencyNs));
+            }
+        }
+        AppendF(out, ",\"gl_calls\":%u,\"draws\":%u,\"triangles\":%u,\"objects_occluded\":%u",
+                frame.mGlCalls, frame.mDrawCalls, frame.mTriangles, frame.mObjectsOccluded);
+        AppendF(out, ",\"shadow_tile_updates\":%u,\"foveation\":%u", frame.mShadowTileUpdates,
+                frame.mFoveationLevel);
+        AppendF(out, ",\"pool_live_kb\":%llu,\"pool_hit_rate\":%.3f",
+                static_cast<unsigned long long>(frame.mPoolLiveBytes / 1024),
+                frame.mPoolHitRate);
+        AppendF(out, ",\"gpu_mem_kb\":%llu,\"gpu_mem_peak_kb\":%llu,\"gpu_mem_budget_kb\":%llu",
+                static_cast<unsigned long long>(frame.mGpuMemory.GetTotal() / 1024),
+                static_cast<unsigned long long>(frame.mGpuMemoryPeakBytes / 1024),
+                static_cast<unsigned long long>(sample.mGpuMemoryBudget / 1024));
+        for (size_t i = 0; i < GpuMemoryUsage::CATEGORY_COUNT; i++) {
+            AppendF(out, ",\"gpu_mem_%s_kb\":%llu",
+                    GpuMemoryUsage::GetCategoryName(static_cast<GpuMemoryCategory>(i)),
+                    static_cast<unsigned long long>(frame.mGpuMemory.mBytes[i] / 1024));
+        }
+        AppendF(out, ",\"rss_kb\":%llu", static_cast<unsigned long long>(ReadRssKb()));
+        AppendF(out, ",\"cpu_level\":\"%s\",\"gpu_level\":\"%s\"", sample.mCpuPerfLevel,
+                sample.mGpuPerfLevel);
+        AppendF(out, ",\"cpu_notification\":\"%s\",\"gpu_notification\":\"%s\"",
+                sample.mCpuPerfNotification, sample.mGpuPerfNotification);
+        AppendF(out, ",\"resolution_scale\":%.3f,\"msaa\":%d,\"watchdog_stalls\":%u",
+                sample.mResolutionScale, sample.mMultisamples, sample.mWatchdogStalls);
+        AppendF(out, ",\"param_version\":%u", frame.mParameterVersion);
+        for (size_t i = 0; i < parameterNames.size() && i < frame.mParameters.size(); i++) {
+            AppendF(out, ",\"param_%s\":%g", parameterNames[i].c_str(),
+                    static_cast<double>(frame.mParameters[i]));
+        }
+    }
+} // anonymous namespace
+
+TelemetryServer::~TelemetryServer() {
+    Stop();
+}
+
+bool TelemetryServer::Start(const std::string& socketName, const uint32_t rateHz,
+                            Options options) {
+    Stop();
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    // Abstract names start with a NUL and are not terminated
+    const bool abstract = socketName.empty() || socketName[0] != '/';
+    const size_t pathOffset = abstract ? 1 : 0;
+    if (socketName.empty() || rateHz == 0 ||
+        pathOffset + socketName.size() >= sizeof(address.sun_path)) {
+        ALOGE("TelemetryServer: bad socket name \"%s\" or rate %u", socketName.c_str(), rateHz);
+        return false;
+    }
+    memcpy(address.sun_path + pathOffset, socketName.data(), socketName.size());
+    const auto addressLength = static_cast<socklen_t>(
+            offsetof(sockaddr_un, sun_path) + pathOffset + socketName.size() + (abstract ? 0 : 1));
+    if (!abstract) {
+        // A stale socket file from a previous run would fail the bind
+        unlink(socketName.c_str());
+    }
+
+    mListenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (mListenFd < 0 ||
+        bind(mListenFd, reinterpret_cast<const sockaddr*>(&address), addressLength) != 0 ||
+        listen(mListenFd, MAX_CLIENTS) != 0 ||
+        pipe2(mWakeFds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        ALOGE("TelemetryServer: could not listen on %s%s: %s", abstract ? "@" : "",
+              socketName.c_str(), strerror(errno));
+        if (mListenFd >= 0) {
+            close(mListenFd);
+            mListenFd = -1;
+        }
+        return false;
+    }
+
+    mSocketName = socketName;
+    mIntervalNs = kSecToNs / rateHz;
+    mOptions = std::move(options);
+    mThread = std::thread(&TelemetryServer::ServeLoop, this);
+    ALOGI("TelemetryServer: streaming at %u Hz on %s%s", rateHz, abstract ? "@" : "",
+          socketName.c_str());
+    return true;
+}
+
+void TelemetryServer::Stop() {
+    if (!mThread.joinable()) {
+        return;
+    }
+    const char wake = 0;
+    if (write(mWakeFds[1], &wake, 1) != 1) {
+        ALOGW("TelemetryServer: wake write failed: %s", strerror(errno));
+    }
+    mThread.join();
+
+    close(mListenFd);
+    close(mWakeFds[0]);
+    close(mWakeFds[1]);
+    mListenFd = -1;
+    mWakeFds[0] = mWakeFds[1] = -1;
+    if (mSocketName[0] == '/') {
+        unlink(mSocketName.c_str());
+    }
+}
+
+void TelemetryServer::ServeLoop() {
+    prctl(PR_SET_NAME, (long) "VR::Telemetry", 0, 0, 0);
+
+    struct Client {
+        int mFd = -1;
+        // Unsent tail of a partially written line, so lines stay whole
+        std::string mPending;
+        // Received text not yet ending in a newline
+        std::string mReceived;
+        uint64_t mDropped = 0;
+    };
+    std::vector<Client> clients;
+    std::vector<pollfd> fds;
+    TelemetrySample sample;
+    std::string line;
+    std::string clientLine;
+
+    // Send what fits without blocking; the rest waits for the next tick
+    const auto flush = [](Client& client) {
+        while (!client.mPending.empty()) {
+            const ssize_t sent = send(client.mFd, client.mPending.data(), client.mPending.size(),
+                                      MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            client.mPending.erase(0, static_cast<size_t>(sent));
+        }
+        return true;
+    };
+    const auto disconnect = [&clients](const size_t index) {
+        close(clients[index].mFd);
+        ALOGI("TelemetryServer: client %d disconnected, %llu lines dropped", clients[index].mFd,
+              static_cast<unsigned long long>(clients[index].mDropped));
+        clients.erase(clients.begin() + static_cast<std::ptrdiff_t>(index));
+    };
+
+    int64_t nextSendNs = NowNs();
+    for (;;) {
+        fds.clear();
+        fds.push_back({mWakeFds[0], POLLIN, 0});
+        fds.push_back({mListenFd, POLLIN, 0});
+        for (const Client& client : clients) {
+            fds.push_back({client.mFd, POLLIN, 0});
+        }
+        const int64_t waitNs = std::max<int64_t>(nextSendNs - NowNs(), 0);
+        if (poll(fds.data(), fds.size(), static_cast<int>((waitNs + 999999) / 1000000)) < 0 &&
+            errno != EINTR) {
+            ALOGE("TelemetryServer: poll failed: %s", strerror(errno));
+            break;
+        }
+        if (fds[0].revents != 0) {
+            break;
+        }
+
+        for (size_t i = clients.size(); i-- > 0;) {
+            if (fds[i + 2].revents == 0) {
+                continue;
+            }
+            Client& client = clients[i];
+            char buffer[256];
+            const ssize_t received = recv(client.mFd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                disconnect(i);
+                continue;
+            }
+            client.mReceived.append(buffer, static_cast<size_t>(std::max<ssize_t>(received, 0)));
+            size_t newline;
+            while ((newline = client.mReceived.find('\n')) != std::string::npos) {
+                if (mOptions.mCommandHandler) {
+                    mOptions.mCommandHandler(client.mReceived.substr(0, newline));
+                }
+                client.mReceived.erase(0, newline + 1);
+            }
+            if (client.mReceived.size() > kMaxCommandLength) {
+                ALOGW("TelemetryServer: dropping overlong command from client %d", client.mFd);
+                client.mReceived.clear();
+            }
+        }
+
+        if ((fds[1].revents & POLLIN) != 0) {
+            const int fd = accept4(mListenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0 && clients.size() >= MAX_CLIENTS) {
+                ALOGW("TelemetryServer: refusing client, %u already connected", MAX_CLIENTS);
+                close(fd);
+            } else if (fd >= 0) {
+                Client client;
+                client.mFd = fd;
+                AppendF(client.mPending, "{\"type\":\"hello\",\"version\":%u,\"rate_hz\":%.1f}\n",
+                        PROTOCOL_VERSION, static_cast<double>(kSecToNs) / mIntervalNs);
+                ALOGI("TelemetryServer: client %d connected", fd);
+                clients.push_back(std::move(client));
+                if (!flush(clients.back())) {
+                    disconnect(clients.size() - 1);
+                }
+            }
+        }
+
+        const int64_t now = NowNs();
+        if (now < nextSendNs) {
+            continue;
+        }
+        // Don't try to catch up after a stall; just keep the rate from here
+        nextSendNs = std::max(nextSendNs + mIntervalNs, now);
+        if (clients.empty() || !mLatest.Take(sample)) {
+            continue;
+        }
+        FormatSample(sample, mOptions.mParameterNames, line);
+        for (size_t i = clients.size(); i-- > 0;) {
+            Client& client = clients[i];
+            if (!flush(client)) {
+                disconnect(i);
+                continue;
+            }
+            if (!client.mPending.empty()) {
+                client.mDropped++;
+                continue;
+            }
+            clientLine = line;
+            AppendF(clientLine, ",\"dropped\":%llu}\n",
+                    static_cast<unsigned long long>(client.mDropped));
+            client.mPending = clientLine;
+            if (!flush(client)) {
+                disconnect(i);
+            }
+        }
+    }
+
+    for (const Client& client : clients) {
+        close(client.mFd);
+    }
+}
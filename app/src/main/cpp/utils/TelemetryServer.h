@@ -0,0 +1,119 @@
+/*******************************************************************************
+
+Filename    :   TelemetryServer.h
+Content     :   Opt-in live telemetry stream over a local Unix domain socket
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "FrameStats.h"
+#include "TripleBuffer.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * What the render thread publishes each frame. Plain data: it is copied
+ * through a TripleBuffer, and the name pointers must be string literals.
+ */
+struct TelemetrySample {
+    // steady_clock, so samples line up with log timestamps
+    int64_t mTimeNs = 0;
+    FrameStats mFrame;
+    int64_t mDisplayPeriodNs = 0;
+
+    const char* mSessionState = "";
+    bool mFocused = false;
+
+    // Levels the app asked for, and the runtime's latest thermal/load
+    // notification for each domain
+    const char* mCpuPerfLevel = "";
+    const char* mGpuPerfLevel = "";
+    const char* mCpuPerfNotification = "";
+    const char* mGpuPerfNotification = "";
+
+    float mResolutionScale = 0.0f;
+    int32_t mMultisamples = 0;
+    uint64_t mGpuMemoryBudget = 0;
+    uint32_t mWatchdogStalls = 0;
+};
+
+/**
+ * TelemetryServer - streams TelemetrySamples to local clients while the
+ * app runs, for watching a session live instead of reading logs after.
+ *
+ * A background thread listens on a Unix domain socket and, at a fixed
+ * rate, sends every connected client the latest published sample as one
+ * JSON object per line. A name starting with '/' is a filesystem socket;
+ * anything else is in the abstract namespace, which an app can bind
+ * without storage permissions and which adb can forward to:
+ *
+ *     adb forward tcp:7000 localabstract:vrtemplate.telemetry
+ *
+ * Publish() is the render thread's only cost: a copy into a TripleBuffer,
+ * never a lock or a syscall. Samples published between two sends are
+ * skipped. A client that reads too slowly has lines dropped rather than
+ * holding up the others; dropped counts are reported in the next line
+ * it does get.
+ *
+ * Lines are "sample" objects with flat keys, preceded by one "hello"
+ * object on connect. tools/TelemetryClient.cpp records and plots them.
+ *
+ * Clients may send text lines back; each is passed to the CommandHandler,
+ * on the server thread, which is how tuning parameters change live.
+ */
+class TelemetryServer {
+public:
+    static constexpr uint32_t MAX_CLIENTS = 4;
+    static constexpr uint32_t PROTOCOL_VERSION = 1;
+
+    // One line from a client, without the newline
+    using CommandHandler = std::function<void(const std::string& command)>;
+
+    struct Options {
+        // Names of FrameStats::mParameters, sent as "param_<name>" keys
+        std::vector<std::string> mParameterNames;
+        // Called on the server thread; lines are ignored without one
+        CommandHandler mCommandHandler;
+    };
+
+    TelemetryServer() = default;
+    ~TelemetryServer();
+
+    TelemetryServer(const TelemetryServer&) = delete;
+    TelemetryServer& operator=(const TelemetryServer&) = delete;
+
+    /**
+     * Bind @p socketName and start the server thread.
+     *
+     * @param rateHz Samples sent per second, per client
+     * @return false if the socket could not be set up; nothing is started
+     */
+    bool Start(const std::string& socketName, uint32_t rateHz, Options options = {});
+    void Stop();
+
+    bool IsRunning() const { return mThread.joinable(); }
+
+    // Render thread
+    void Publish(const TelemetrySample& sample) noexcept { mLatest.Publish(sample); }
+
+private:
+    void ServeLoop();
+
+    std::string mSocketName;
+    int64_t mIntervalNs = 0;
+    Options mOptions;
+    int mListenFd = -1;
+    // Written to wake the server thread for Stop()
+    int mWakeFds[2] = {-1, -1};
+    std::thread mThread;
+
+    TripleBuffer<TelemetrySample> mLatest;
+};
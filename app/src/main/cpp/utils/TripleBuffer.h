@@ -0,0 +1,61 @@
+/*******************************************************************************
+
+Filename    :   TripleBuffer.h
+Content     :   Lock-free single-producer, single-consumer "latest value" slot
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * TripleBuffer - hands the most recent value from one thread to another
+ * without either ever waiting.
+ *
+ * The writer owns one slot, the reader owns another, and the third sits in
+ * the middle. Publish() fills the writer's slot and swaps it with the middle
+ * one; Take() swaps the reader's slot with the middle one if something new
+ * was published since. Values the reader never took are overwritten, which
+ * is the point: the render thread publishes every frame, and a slower
+ * reader only ever sees the latest.
+ *
+ * One writer thread and one reader thread.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer side: copy @p value in and make it the latest
+    void Publish(const T& value) noexcept {
+        mSlots[mWriteSlot] = value;
+        mWriteSlot = mMiddle.exchange(mWriteSlot | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /**
+     * Reader side: the latest value, if one was published since the last
+     * call. @return false if nothing new
+     */
+    bool Take(T& value) noexcept {
+        if ((mMiddle.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        mReadSlot = mMiddle.exchange(mReadSlot, std::memory_order_acq_rel) & INDEX;
+        value = mSlots[mReadSlot];
+        return true;
+    }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    std::array<T, 3> mSlots = {};
+    uint8_t mWriteSlot = 0;
+    uint8_t mReadSlot = 1;
+    // Index of the middle slot, plus FRESH if the reader hasn't taken it
+    std::atomic<uint8_t> mMiddle{2};
+};
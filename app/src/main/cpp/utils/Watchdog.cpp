@@ -0,0 +1,225 @@
+/*******************************************************************************
+
+Filename    :   Watchdog.cpp
+Content     :   Render-thread stall detection from per-phase heartbeats, with
+                a diagnostic report written when a phase overruns
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#include "Watchdog.h"
+#include "LogUtils.h"
+
+#include <sys/prctl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <utility>
+
+namespace {
+    constexpr int64_t kMsToNs = 1000000;
+
+    int64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double ToMs(const int64_t ns) {
+        return static_cast<double>(ns) * 1e-6;
+    }
+} // anonymous namespace
+
+Watchdog::Config Watchdog::Config::Default() {
+    Config config;
+    config.mDeadlineNs[static_cast<size_t>(Phase::IDLE)] = 0;
+    // The runtime throttles unfocused apps, so allow a few slow frames
+    config.mDeadlineNs[static_cast<size_t>(Phase::WAIT_FRAME)] = 1000 * kMsToNs;
+    config.mDeadlineNs[static_cast<size_t>(Phase::BEGIN_FRAME)] = 250 * kMsToNs;
+    // Framebuffer::Acquire() waits up to a second per try, four tries
+    config.mDeadlineNs[static_cast<size_t>(Phase::ACQUIRE)] = 1000 * kMsToNs;
+    config.mDeadlineNs[static_cast<size_t>(Phase::RENDER)] = 250 * kMsToNs;
+    config.mDeadlineNs[static_cast<size_t>(Phase::END_FRAME)] = 250 * kMsToNs;
+    config.mDeadlineNs[static_cast<size_t>(Phase::SLACK)] = 100 * kMsToNs;
+    config.mPollIntervalNs = 50 * kMsToNs;
+    return config;
+}
+
+const char* Watchdog::GetPhaseName(const Phase phase) {
+    switch (phase) {
+        case Phase::IDLE:
+            return "Idle";
+        case Phase::WAIT_FRAME:
+            return "WaitFrame";
+        case Phase::BEGIN_FRAME:
+            return "BeginFrame";
+        case Phase::ACQUIRE:
+            return "AcquireImage";
+        case Phase::RENDER:
+            return "Render";
+        case Phase::END_FRAME:
+            return "EndFrame";
+        case Phase::SLACK:
+            return "Slack";
+    }
+    return "Unknown";
+}
+
+Watchdog::~Watchdog() {
+    Stop();
+}
+
+void Watchdog::Start(std::string reportDir, const Config& config) {
+    Stop();
+    mReportDir = std::move(reportDir);
+    mConfig = config;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = false;
+        mHistory = {};
+        mStallCount = 0;
+    }
+    mThread = std::thread(&Watchdog::WatchLoop, this);
+}
+
+void Watchdog::Stop() {
+    if (!mThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWake.notify_one();
+    mThread.join();
+}
+
+void Watchdog::Beat(const Phase phase, const uint64_t frameIndex) {
+    const int64_t now = NowNs();
+    std::lock_guard<std::mutex> lock(mMutex);
+    TraceEvent& event = mHistory.mTrace[mHistory.mTraceCount % TRACE_SIZE];
+    event.mTimeNs = now;
+    event.mFrameIndex = frameIndex;
+    event.mPhase = phase;
+    mHistory.mTraceCount++;
+}
+
+void Watchdog::AddFrameStats(const FrameStats& stats) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHistory.mStats[mHistory.mStatsCount % STATS_HISTORY] = stats;
+    mHistory.mStatsCount++;
+}
+
+void Watchdog::SetDeadline(const Phase phase, const int64_t deadlineNs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mConfig.mDeadlineNs[static_cast<size_t>(phase)] = deadlineNs;
+}
+
+uint32_t Watchdog::GetStallCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStallCount;
+}
+
+void Watchdog::WatchLoop() {
+    prctl(PR_SET_NAME, (long) "VR::Watchdog", 0, 0, 0);
+
+    // Trace position of the phase entry last reported as stalled, so each
+    // entry is reported once and its recovery can be timed
+    uint64_t stalledEntry = 0;
+    int64_t stalledSinceNs = 0;
+    bool stalled = false;
+    uint32_t reportsWritten = 0;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mWake.wait_for(lock, std::chrono::nanoseconds(mConfig.mPollIntervalNs),
+                           [this] { return mStopping; })) {
+        if (mHistory.mTraceCount == 0) {
+            continue;
+        }
+        const uint64_t entry = mHistory.mTraceCount - 1;
+        const TraceEvent current = mHistory.mTrace[entry % TRACE_SIZE];
+
+        if (stalled && entry != stalledEntry) {
+            // The next transition after the stalled one ends the stall
+            const TraceEvent& next = mHistory.mTrace[(stalledEntry + 1) % TRACE_SIZE];
+            const bool overwritten = entry - stalledEntry >= TRACE_SIZE;
+            ALOGW("Watchdog: render thread recovered after %.0f ms",
+                  ToMs((overwritten ? current.mTimeNs : next.mTimeNs) - stalledSinceNs));
+            stalled = false;
+        }
+
+        const int64_t deadline = mConfig.mDeadlineNs[static_cast<size_t>(current.mPhase)];
+        const int64_t now = NowNs();
+        if (stalled || deadline <= 0 || now - current.mTimeNs <= deadline) {
+            continue;
+        }
+        stalled = true;
+        stalledEntry = entry;
+        stalledSinceNs = current.mTimeNs;
+        mStallCount++;
+        const Snapshot snapshot = mHistory;
+
+        lock.unlock();
+        ALOGE("Watchdog: frame %llu stuck in %s for %.0f ms (deadline %.0f ms)",
+              static_cast<unsigned long long>(current.mFrameIndex),
+              GetPhaseName(current.mPhase), ToMs(now - current.mTimeNs), ToMs(deadline));
+        if (!mReportDir.empty() && reportsWritten < MAX_REPORTS) {
+            WriteReport(snapshot, now, deadline);
+            reportsWritten++;
+        }
+        lock.lock();
+    }
+}
+
+void Watchdog::WriteReport(const Snapshot& snapshot, const int64_t nowNs,
+                           const int64_t deadlineNs) const {
+    const TraceEvent& stalled = snapshot.mTrace[(snapshot.mTraceCount - 1) % TRACE_SIZE];
+    // Wall-clock names so reports from earlier runs survive
+    const time_t wallTime = time(nullptr);
+    const std::string path = mReportDir + "/watchdog_" + std::to_string(wallTime) + "_" +
+                             std::to_string(stalled.mFrameIndex) + ".txt";
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        ALOGE("Watchdog: could not write %s", path.c_str());
+        return;
+    }
+
+    char when[32] = {};
+    tm local = {};
+    localtime_r(&wallTime, &local);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local);
+    fprintf(file, "Render thread stall at %s\n", when);
+    fprintf(file, "phase %s, frame %llu, %.1f ms (deadline %.1f ms)\n",
+            GetPhaseName(stalled.mPhase), static_cast<unsigned long long>(stalled.mFrameIndex),
+            ToMs(nowNs - stalled.mTimeNs), ToMs(deadlineNs));
+
+    // Times relative to the stalled phase's entry
+    fprintf(file, "\nphases, oldest first\n");
+    const uint64_t traceCount = std::min<uint64_t>(snapshot.mTraceCount, TRACE_SIZE);
+    for (uint64_t i = snapshot.mTraceCount - traceCount; i < snapshot.mTraceCount; i++) {
+        const TraceEvent& event = snapshot.mTrace[i % TRACE_SIZE];
+        fprintf(file, "%10.2f ms  frame %-8llu %s\n", ToMs(event.mTimeNs - stalled.mTimeNs),
+                static_cast<unsigned long long>(event.mFrameIndex), GetPhaseName(event.mPhase));
+    }
+
+    fprintf(file, "\nframes, oldest first\n");
+    fprintf(file, "frame     submit_ms resolve_ms bin_ms occl_ms gl_calls draws triangles "
+                  "fov pool_kb slack_ms\n");
+    const uint64_t statsCount = std::min<uint64_t>(snapshot.mStatsCount, STATS_HISTORY);
+    for (uint64_t i = snapshot.mStatsCount - statsCount; i < snapshot.mStatsCount; i++) {
+        const FrameStats& stats = snapshot.mStats[i % STATS_HISTORY];
+        fprintf(file, "%-9llu %9.2f %10.2f %6.2f %7.2f %8u %5u %9u %3u %7llu %8.2f\n",
+                static_cast<unsigned long long>(stats.mFrameIndex), ToMs(stats.mCpuSubmitNs),
+                ToMs(stats.mResolveNs), ToMs(stats.mLightBinNs), ToMs(stats.mOcclusionNs),
+                stats.mGlCalls, stats.mDrawCalls, stats.mTriangles, stats.mFoveationLevel,
+                static_cast<unsigned long long>(stats.mPoolLiveBytes / 1024),
+                ToMs(stats.mSlackNs));
+    }
+
+    if (fclose(file) == 0) {
+        ALOGI("Watchdog: wrote %s", path.c_str());
+    }
+}
@@ -0,0 +1,123 @@
+/*******************************************************************************
+
+Filename    :   Watchdog.h
+Content     :   Render-thread stall detection from per-phase heartbeats, with
+                a diagnostic report written when a phase overruns
+Authors     :   Amanda Watson
+License     :   Licensed under GPLv3 or any later version.
+                Refer to the license.txt file included.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "FrameStats.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Watchdog - notices when the render thread stops making progress.
+ *
+ * The render thread calls Beat() as it enters each phase of a frame. A
+ * background thread polls the current phase and, once it has run past its
+ * deadline, logs which phase is stuck and writes a report holding the
+ * recent phase transitions and the last frames' FrameStats. A hang inside
+ * xrWaitFrame(), a swapchain wait or a GL call then leaves behind something
+ * a field report can be triaged from, even if the app is killed after.
+ *
+ * Only the first overrun of each phase entry is reported, and a recovery
+ * is logged with the total stall time. At most MAX_REPORTS files are
+ * written per run. Phases with a zero deadline (IDLE by default) are never
+ * reported.
+ *
+ * Beat() and AddFrameStats() take a mutex the watchdog only holds for a
+ * copy, so they never wait on it in practice.
+ */
+class Watchdog {
+public:
+    enum class Phase : uint8_t {
+        IDLE,        // between frames, or no session
+        WAIT_FRAME,  // xrWaitFrame()
+        BEGIN_FRAME, // xrBeginFrame() through pose and scene updates
+        ACQUIRE,     // xrAcquireSwapchainImage() / xrWaitSwapchainImage()
+        RENDER,      // building and executing the render graph
+        END_FRAME,   // xrEndFrame()
+        SLACK,       // SlackScheduler tasks
+    };
+    static constexpr size_t PHASE_COUNT = 7;
+
+    // Phase transitions and frames kept for the report
+    static constexpr size_t TRACE_SIZE = 64;
+    static constexpr size_t STATS_HISTORY = 16;
+    static constexpr uint32_t MAX_REPORTS = 8;
+
+    struct Config {
+        // Per phase; 0 never reports
+        std::array<int64_t, PHASE_COUNT> mDeadlineNs = {};
+        int64_t mPollIntervalNs = 0;
+
+        static Config Default();
+    };
+
+    static const char* GetPhaseName(Phase phase);
+
+    Watchdog() = default;
+    ~Watchdog();
+
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+
+    /**
+     * Start the watchdog thread.
+     *
+     * @param reportDir Where reports are written; logging only if empty
+     */
+    void Start(std::string reportDir, const Config& config = Config::Default());
+    void Stop();
+
+    // Render thread: entering @p phase of frame @p frameIndex
+    void Beat(Phase phase, uint64_t frameIndex);
+    // Render thread: a finished frame's stats, kept for the report
+    void AddFrameStats(const FrameStats& stats);
+
+    // Change one phase's deadline while running; 0 never reports
+    void SetDeadline(Phase phase, int64_t deadlineNs);
+
+    uint32_t GetStallCount() const;
+
+private:
+    struct TraceEvent {
+        int64_t mTimeNs = 0;
+        uint64_t mFrameIndex = 0;
+        Phase mPhase = Phase::IDLE;
+    };
+
+    // Recent phase transitions and frame stats, both rings; copied whole
+    // for a report
+    struct Snapshot {
+        std::array<TraceEvent, TRACE_SIZE> mTrace = {};
+        uint64_t mTraceCount = 0;
+        std::array<FrameStats, STATS_HISTORY> mStats = {};
+        uint64_t mStatsCount = 0;
+    };
+
+    void WatchLoop();
+    void WriteReport(const Snapshot& snapshot, int64_t nowNs, int64_t deadlineNs) const;
+
+    // Deadlines change under mMutex while running
+    Config mConfig;
+    std::string mReportDir;
+    std::thread mThread;
+
+    // Guarded by mMutex
+    mutable std::mutex mMutex;
+    std::condition_variable mWake;
+    bool mStopping = false;
+    Snapshot mHistory;
+    uint32_t mStallCount = 0;
+};